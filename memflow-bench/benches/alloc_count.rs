@@ -0,0 +1,201 @@
+extern crate memflow_bench;
+use memflow_bench::alloc::{measure, AllocReport, AllocStats, CountingAllocator};
+
+use memflow::iter::FnExtend;
+use memflow::mem::dummy::DummyMemory as Memory;
+use memflow::prelude::v1::*;
+use memflow_win32::prelude::v1::*;
+
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
+
+const ITERATIONS: usize = 1000;
+const CHUNKS: usize = 64;
+
+/// Allocation budgets per operation.
+///
+/// These are upper bounds of the current implementation, lower them whenever a path stops
+/// allocating, so that the improvement does not silently regress again.
+fn budget(allocs: f64, bytes: f64) -> AllocStats {
+    AllocStats { allocs, bytes }
+}
+
+fn dummy_allocs(report: &mut AllocReport) {
+    let mut mem = Memory::new(size::mb(64));
+    let proc = mem.alloc_process(size::mb(60), &[]);
+    let module = proc.get_module(size::mb(4));
+    let translator = proc.translator();
+
+    let addrs = (0..CHUNKS)
+        .map(|i| module.base() + i * 0x1234)
+        .collect::<Vec<_>>();
+    let mut bufs = vec![[0_u8; 8]; CHUNKS];
+
+    // physical reads
+    {
+        let mut mem = mem.clone();
+        report.check(
+            "phys_read_raw_list (64x8)",
+            measure(ITERATIONS, || {
+                let mut list = bufs
+                    .iter_mut()
+                    .enumerate()
+                    .map(|(i, buf)| {
+                        PhysicalReadData(Address::from(i * 0x1234).into(), &mut buf[..])
+                    })
+                    .collect::<Vec<_>>();
+                mem.phys_read_raw_list(&mut list).unwrap();
+            })
+            .per_item(CHUNKS),
+            // the list itself is collected into a vec
+            budget(1.0 / CHUNKS as f64, 32.0),
+        );
+    }
+
+    // translations
+    {
+        let mut mem = mem.clone();
+        let mut vat = DirectTranslate::new();
+        report.check(
+            "virt_to_phys",
+            measure(ITERATIONS, || {
+                vat.virt_to_phys(&mut mem, &translator, module.base())
+                    .unwrap();
+            }),
+            budget(2.0, 128.0),
+        );
+
+        let mut out = Vec::with_capacity(CHUNKS);
+        report.check(
+            "virt_to_phys_iter (64)",
+            measure(ITERATIONS, || {
+                out.clear();
+                vat.virt_to_phys_iter(
+                    &mut mem,
+                    &translator,
+                    addrs.iter().map(|&addr| (addr, 1)),
+                    &mut out,
+                    &mut FnExtend::void(),
+                );
+            })
+            .per_item(CHUNKS),
+            budget(0.0, 0.0),
+        );
+
+        let mut vat = CachedVirtualTranslate::builder(DirectTranslate::new())
+            .arch(proc.sys_arch())
+            .build()
+            .unwrap();
+        report.check(
+            "virt_to_phys_iter cached (64)",
+            measure(ITERATIONS, || {
+                out.clear();
+                vat.virt_to_phys_iter(
+                    &mut mem,
+                    &translator,
+                    addrs.iter().map(|&addr| (addr, 1)),
+                    &mut out,
+                    &mut FnExtend::void(),
+                );
+            })
+            .per_item(CHUNKS),
+            budget(0.0, 0.0),
+        );
+    }
+
+    // virtual reads
+    {
+        let mut virt_mem = VirtualDMA::new(mem.clone(), proc.proc_arch(), translator);
+
+        report.check(
+            "virt_read_raw_list (64x8)",
+            measure(ITERATIONS, || {
+                let mut list = bufs
+                    .iter_mut()
+                    .zip(addrs.iter())
+                    .map(|(buf, &addr)| VirtualReadData(addr, &mut buf[..]))
+                    .collect::<Vec<_>>();
+                virt_mem.virt_read_raw_list(&mut list).unwrap();
+            })
+            .per_item(CHUNKS),
+            budget(1.0 / CHUNKS as f64, 32.0),
+        );
+
+        report.check(
+            "virt_read_raw (0x100)",
+            measure(ITERATIONS, || {
+                virt_mem.virt_read_raw(module.base(), 0x100).unwrap();
+            }),
+            budget(1.0, 0x100 as f64),
+        );
+
+        report.check(
+            "virt_read_cstr (0x100)",
+            measure(ITERATIONS, || {
+                virt_mem.virt_read_cstr(module.base(), 0x100).unwrap();
+            }),
+            // invalid utf-8 gets copied once more by from_utf8_lossy
+            budget(3.0, 0x800 as f64),
+        );
+    }
+}
+
+/// Measures the win32 enumeration paths if a target is configured.
+///
+/// The connector is taken from `MEMFLOW_BENCH_CONNECTOR` and its arguments from
+/// `MEMFLOW_BENCH_ARGS`. Results are reported per enumerated process or module.
+fn win32_allocs(report: &mut AllocReport) {
+    let connector_name = match std::env::var("MEMFLOW_BENCH_CONNECTOR") {
+        Ok(name) => name,
+        Err(_) => {
+            println!("MEMFLOW_BENCH_CONNECTOR not set, skipping win32 allocations");
+            return;
+        }
+    };
+    let args = std::env::var("MEMFLOW_BENCH_ARGS").unwrap_or_default();
+
+    let connector = unsafe {
+        ConnectorInventory::scan()
+            .create_connector(&connector_name, &ConnectorArgs::parse(&args).unwrap())
+    }
+    .unwrap();
+
+    let mut kernel = Kernel::builder(connector)
+        .build_default_caches()
+        .build()
+        .unwrap();
+
+    let proc_count = kernel.process_info_list().unwrap().len();
+    report.check(
+        "win32 process_info_list (per process)",
+        measure(10, || {
+            kernel.process_info_list().unwrap();
+        })
+        .per_item(proc_count),
+        budget(8.0, 1024.0),
+    );
+
+    let proc_info = kernel.kernel_process_info().unwrap();
+    let mut process = Win32Process::with_kernel_ref(&mut kernel, proc_info);
+    let module_count = process.module_list().unwrap().len();
+    report.check(
+        "win32 module_list (per module)",
+        measure(10, || {
+            process.module_list().unwrap();
+        })
+        .per_item(module_count),
+        budget(8.0, 1024.0),
+    );
+}
+
+fn main() {
+    let mut report = AllocReport::new();
+
+    dummy_allocs(&mut report);
+    win32_allocs(&mut report);
+
+    if !report.failed().is_empty() {
+        eprintln!("allocation regressions in: {}", report.failed().join(", "));
+        std::process::exit(1);
+    }
+}
@@ -0,0 +1,39 @@
+extern crate memflow_bench;
+use memflow_bench::cache;
+
+use criterion::*;
+
+use memflow::mem::dummy::{DummyMemory as Memory, DummyModule, DummyProcess};
+use memflow::prelude::v1::*;
+
+fn initialize_virt_ctx() -> Result<(
+    Memory,
+    DirectTranslate,
+    DummyProcess,
+    impl ScopedVirtualTranslate,
+    DummyModule,
+)> {
+    let mut mem = Memory::new(size::mb(64));
+
+    let vat = DirectTranslate::new();
+
+    let proc = mem.alloc_process(size::mb(60), &[]);
+    let module = proc.get_module(size::mb(16));
+    let translator = proc.translator();
+    Ok((mem, vat, proc, translator, module))
+}
+
+fn cache_patterns_group(c: &mut Criterion) {
+    cache::page_cache_patterns(c, "dummy", &|| Ok(Memory::new(size::mb(64))));
+    cache::tlb_patterns(c, "dummy", &initialize_virt_ctx);
+}
+
+criterion_group! {
+    name = cache_patterns;
+    config = Criterion::default()
+        .warm_up_time(std::time::Duration::from_millis(300))
+        .measurement_time(std::time::Duration::from_millis(2700));
+    targets = cache_patterns_group
+}
+
+criterion_main!(cache_patterns);
@@ -1,5 +1,5 @@
 extern crate memflow_bench;
-use memflow_bench::{phys, vat, virt};
+use memflow_bench::{phys, scaling, vat, virt};
 
 use criterion::*;
 
@@ -75,12 +75,33 @@ fn win32_read_group(c: &mut Criterion) {
     vat::chunk_vat(c, "win32", &initialize_virt_ctx);
 }
 
+fn win32_scaling_group(c: &mut Criterion) {
+    scaling::phys_read(c, "win32", &|| create_connector(&ConnectorArgs::new()));
+    scaling::virt_read(c, "win32", &initialize_virt_ctx);
+
+    let kernel = Kernel::builder(create_connector(&ConnectorArgs::new()).unwrap())
+        .build_default_caches()
+        .build()
+        .unwrap();
+
+    scaling::enumeration(
+        c,
+        "win32",
+        "process_list",
+        kernel,
+        |kernel| kernel,
+        |kernel| {
+            black_box(kernel.process_info_list().unwrap());
+        },
+    );
+}
+
 criterion_group! {
     name = win32_read;
     config = Criterion::default()
         .warm_up_time(std::time::Duration::from_millis(300))
         .measurement_time(std::time::Duration::from_millis(2700));
-    targets = win32_read_group
+    targets = win32_read_group, win32_scaling_group
 }
 
 criterion_main!(win32_read);
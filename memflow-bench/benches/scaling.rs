@@ -0,0 +1,63 @@
+extern crate memflow_bench;
+use memflow_bench::scaling;
+
+use criterion::*;
+
+use memflow::connector::MMAPInfo;
+use memflow::mem::dummy::{DummyMemory as Memory, DummyModule, DummyProcess};
+use memflow::prelude::v1::*;
+
+use std::fs::File;
+
+fn initialize_virt_ctx() -> Result<(
+    Memory,
+    DirectTranslate,
+    DummyProcess,
+    impl ScopedVirtualTranslate,
+    DummyModule,
+)> {
+    let mut mem = Memory::new(size::mb(64));
+
+    let vat = DirectTranslate::new();
+
+    let proc = mem.alloc_process(size::mb(60), &[]);
+    let module = proc.get_module(size::mb(4));
+    let translator = proc.translator();
+    Ok((mem, vat, proc, translator, module))
+}
+
+/// Maps the memory dump at `MEMFLOW_BENCH_DUMP` as flat physical memory
+fn initialize_dump() -> Option<ReadMappedFilePhysicalMemory<'static>> {
+    let path = std::env::var("MEMFLOW_BENCH_DUMP").ok()?;
+    let file = File::open(path).unwrap();
+    let len = file.metadata().unwrap().len() as usize;
+
+    let mut map = MemoryMap::new();
+    map.push_remap(Address::null(), len, Address::null());
+
+    Some(
+        MMAPInfo::try_with_filemap(file, map)
+            .unwrap()
+            .into_connector(),
+    )
+}
+
+fn scaling_group(c: &mut Criterion) {
+    scaling::phys_read(c, "dummy", &|| Ok(Memory::new(size::mb(64))));
+    scaling::virt_read(c, "dummy", &initialize_virt_ctx);
+
+    if let Some(dump) = initialize_dump() {
+        scaling::phys_read(c, "dump", &|| Ok(dump.clone()));
+    }
+}
+
+criterion_group! {
+    name = scaling_bench;
+    config = Criterion::default()
+        .sample_size(20)
+        .warm_up_time(std::time::Duration::from_millis(300))
+        .measurement_time(std::time::Duration::from_millis(2700));
+    targets = scaling_group
+}
+
+criterion_main!(scaling_bench);
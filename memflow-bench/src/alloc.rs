@@ -0,0 +1,126 @@
+/*!
+Allocation counting helpers.
+
+The `CountingAllocator` has to be installed as the `#[global_allocator]` of the bench binary,
+after that `measure` reports how many allocations an operation performs on average.
+*/
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::fmt;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+const WARMUP_ITERATIONS: usize = 10;
+
+static ALLOCS: AtomicUsize = AtomicUsize::new(0);
+static BYTES: AtomicUsize = AtomicUsize::new(0);
+
+/// A global allocator that counts all allocations and reallocations made through it.
+pub struct CountingAllocator;
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCS.fetch_add(1, Ordering::Relaxed);
+        BYTES.fetch_add(layout.size(), Ordering::Relaxed);
+        System.alloc(layout)
+    }
+
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        ALLOCS.fetch_add(1, Ordering::Relaxed);
+        BYTES.fetch_add(layout.size(), Ordering::Relaxed);
+        System.alloc_zeroed(layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        ALLOCS.fetch_add(1, Ordering::Relaxed);
+        BYTES.fetch_add(new_size.saturating_sub(layout.size()), Ordering::Relaxed);
+        System.realloc(ptr, layout, new_size)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+}
+
+/// Allocations performed by a single operation.
+#[derive(Copy, Clone, Debug, Default, PartialEq)]
+pub struct AllocStats {
+    /// Number of allocations and reallocations.
+    pub allocs: f64,
+    /// Number of bytes allocated, reallocations only count the growth.
+    pub bytes: f64,
+}
+
+impl AllocStats {
+    /// Scales the stats down to a single item of an operation that processed `count` items.
+    pub fn per_item(self, count: usize) -> Self {
+        let count = count.max(1) as f64;
+        Self {
+            allocs: self.allocs / count,
+            bytes: self.bytes / count,
+        }
+    }
+}
+
+impl fmt::Display for AllocStats {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "{:8.2} allocs {:10.2} bytes", self.allocs, self.bytes)
+    }
+}
+
+/// Runs `op` `iterations` times and returns the average allocations of a single run.
+///
+/// The operation is run a few times before measuring, so that one-time allocations, like growing
+/// arenas and caches to their working size, do not show up in the results.
+/// Allocations of all threads are counted, so nothing else should run in the meantime.
+pub fn measure<F: FnMut()>(iterations: usize, mut op: F) -> AllocStats {
+    for _ in 0..WARMUP_ITERATIONS {
+        op();
+    }
+
+    let allocs = ALLOCS.load(Ordering::Relaxed);
+    let bytes = BYTES.load(Ordering::Relaxed);
+
+    for _ in 0..iterations {
+        op();
+    }
+
+    let iterations = iterations.max(1) as f64;
+    AllocStats {
+        allocs: (ALLOCS.load(Ordering::Relaxed) - allocs) as f64 / iterations,
+        bytes: (BYTES.load(Ordering::Relaxed) - bytes) as f64 / iterations,
+    }
+}
+
+/// Collects allocation stats of multiple operations and checks them against their budgets.
+#[derive(Default)]
+pub struct AllocReport {
+    failed: Vec<String>,
+}
+
+impl AllocReport {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Prints the stats of an operation and records a failure if they exceed the budget.
+    pub fn check(&mut self, name: &str, stats: AllocStats, budget: AllocStats) {
+        let ok = stats.allocs <= budget.allocs && stats.bytes <= budget.bytes;
+
+        println!(
+            "{:<40} {} (budget {}){}",
+            name,
+            stats,
+            budget,
+            if ok { "" } else { " REGRESSION" }
+        );
+
+        if !ok {
+            self.failed.push(name.to_string());
+        }
+    }
+
+    /// Returns the names of all operations that exceeded their budget.
+    pub fn failed(&self) -> &[String] {
+        &self.failed
+    }
+}
@@ -0,0 +1,381 @@
+/*!
+Cache behaviour benchmarks with synthetic access distributions.
+
+The page cache and the TLB are driven with different access patterns, and for every pattern
+the throughput is measured with criterion. In addition a summary with the hit rate of every
+cache size, and the average cost of an access with and without the cache is printed.
+
+Hits are counted from the outside, by counting the reads that reach the underlying physical
+memory, so no instrumentation of the caches themselves is required.
+*/
+
+use criterion::*;
+
+use memflow::mem::{
+    CachedMemoryAccess, CachedVirtualTranslate, PhysicalMemory, PhysicalMemoryMetadata,
+    PhysicalReadData, PhysicalWriteData, VirtualTranslate,
+};
+
+use memflow::architecture::{x86, ScopedVirtualTranslate};
+use memflow::error::Result;
+use memflow::process::*;
+use memflow::types::*;
+
+use rand::prelude::*;
+use rand::{Rng, SeedableRng};
+use rand_xorshift::XorShiftRng as CurRng;
+
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::time::Instant;
+
+const PAGE_SIZE: usize = 0x1000;
+const SUMMARY_ACCESSES: usize = 0x40000;
+
+/// Page cache sizes the hit rate summary is computed for.
+pub const PAGE_CACHE_SIZES: [usize; 4] = [0x8_0000, 0x20_0000, 0x80_0000, 0x200_0000];
+
+/// TLB sizes (in entries) the hit rate summary is computed for.
+pub const TLB_SIZES: [usize; 4] = [256, 1024, 2048, 8192];
+
+/// A synthetic memory access distribution.
+#[derive(Copy, Clone, Debug)]
+pub enum AccessPattern {
+    /// Sequential 64 byte steps.
+    Sequential,
+    /// Fixed steps of the given size.
+    Strided(usize),
+    /// Pages picked with a zipfian distribution with the given exponent, hot pages are scattered
+    /// across the whole range.
+    Zipfian(f64),
+    /// Walking a linked list whose nodes are scattered randomly across the range.
+    PointerChase,
+    /// Uniform accesses inside a working set of the given number of pages, which moves to a
+    /// different part of the range every given number of accesses.
+    WorkingSetShift(usize, usize),
+}
+
+/// Patterns every cache is benchmarked with.
+pub const PATTERNS: [AccessPattern; 6] = [
+    AccessPattern::Sequential,
+    AccessPattern::Strided(PAGE_SIZE + 0x40),
+    AccessPattern::Zipfian(1.0),
+    AccessPattern::Zipfian(1.4),
+    AccessPattern::PointerChase,
+    AccessPattern::WorkingSetShift(256, 0x4000),
+];
+
+impl AccessPattern {
+    fn name(&self) -> String {
+        match self {
+            AccessPattern::Sequential => "sequential".into(),
+            AccessPattern::Strided(stride) => format!("strided_{:x}", stride),
+            AccessPattern::Zipfian(s) => format!("zipf_{}", s),
+            AccessPattern::PointerChase => "pointer_chase".into(),
+            AccessPattern::WorkingSetShift(pages, period) => {
+                format!("working_set_{}_{:x}", pages, period)
+            }
+        }
+    }
+}
+
+/// Generates offsets inside of a range following an `AccessPattern`.
+pub struct AccessGenerator {
+    pattern: AccessPattern,
+    rng: CurRng,
+    pages: usize,
+    pos: usize,
+    counter: usize,
+    // zipfian cumulative distribution, or linked list node order
+    cdf: Vec<f64>,
+    perm: Vec<usize>,
+}
+
+impl AccessGenerator {
+    /// Creates a generator of offsets in `0..range`.
+    pub fn new(pattern: AccessPattern, range: usize, seed: u64) -> Self {
+        let pages = (range / PAGE_SIZE).max(1);
+        let mut rng = CurRng::seed_from_u64(seed);
+
+        let mut perm = (0..pages).collect::<Vec<_>>();
+        perm.shuffle(&mut rng);
+
+        let cdf = if let AccessPattern::Zipfian(s) = pattern {
+            let mut sum = 0.0;
+            let mut cdf = (1..=pages)
+                .map(|rank| {
+                    sum += 1.0 / (rank as f64).powf(s);
+                    sum
+                })
+                .collect::<Vec<_>>();
+            cdf.iter_mut().for_each(|v| *v /= sum);
+            cdf
+        } else {
+            vec![]
+        };
+
+        Self {
+            pattern,
+            rng,
+            pages,
+            pos: 0,
+            counter: 0,
+            cdf,
+            perm,
+        }
+    }
+
+    /// Returns the next 8 byte aligned offset.
+    pub fn next_offset(&mut self) -> usize {
+        let range = self.pages * PAGE_SIZE;
+        self.counter += 1;
+
+        match self.pattern {
+            AccessPattern::Sequential => {
+                self.pos = (self.pos + 0x40) % range;
+                self.pos
+            }
+            AccessPattern::Strided(stride) => {
+                self.pos = (self.pos + stride) % range;
+                self.pos & !7
+            }
+            AccessPattern::Zipfian(_) => {
+                let val = self.rng.gen::<f64>();
+                let rank = match self.cdf.binary_search_by(|v| v.partial_cmp(&val).unwrap()) {
+                    Ok(idx) | Err(idx) => idx.min(self.pages - 1),
+                };
+                self.perm[rank] * PAGE_SIZE + (self.rng.gen_range(0, PAGE_SIZE) & !7)
+            }
+            AccessPattern::PointerChase => {
+                // perm is a random order of nodes, every node is at a fixed offset of its page
+                self.pos = (self.pos + 1) % self.pages;
+                self.perm[self.pos] * PAGE_SIZE + (self.perm[self.pos] % 64) * 0x40
+            }
+            AccessPattern::WorkingSetShift(set_pages, period) => {
+                let set_pages = set_pages.min(self.pages);
+                if self.counter % period == 0 {
+                    self.pos = (self.pos + set_pages) % self.pages;
+                }
+                let page = (self.pos + self.rng.gen_range(0, set_pages)) % self.pages;
+                page * PAGE_SIZE + (self.rng.gen_range(0, PAGE_SIZE) & !7)
+            }
+        }
+    }
+}
+
+/// Physical memory wrapper counting the reads that reach the underlying memory.
+#[derive(Clone)]
+pub struct CountingMemory<T> {
+    mem: T,
+    reads: Arc<AtomicUsize>,
+}
+
+impl<T> CountingMemory<T> {
+    pub fn new(mem: T) -> Self {
+        Self {
+            mem,
+            reads: Arc::new(AtomicUsize::new(0)),
+        }
+    }
+
+    /// Returns a handle to the read counter, that stays valid after the memory was moved into a
+    /// cache.
+    pub fn counter(&self) -> Arc<AtomicUsize> {
+        self.reads.clone()
+    }
+}
+
+impl<T: PhysicalMemory> PhysicalMemory for CountingMemory<T> {
+    fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+        self.reads.fetch_add(data.len(), Ordering::Relaxed);
+        self.mem.phys_read_raw_list(data)
+    }
+
+    fn phys_write_raw_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
+        self.mem.phys_write_raw_list(data)
+    }
+
+    fn metadata(&self) -> PhysicalMemoryMetadata {
+        self.mem.metadata()
+    }
+}
+
+fn page_cache<T: PhysicalMemory>(mem: T, cache_size: usize) -> impl PhysicalMemory {
+    CachedMemoryAccess::builder(mem)
+        .arch(x86::x64::ARCH)
+        .cache_size(cache_size)
+        .page_type_mask(PageType::PAGE_TABLE | PageType::READ_ONLY | PageType::WRITEABLE)
+        .build()
+        .unwrap()
+}
+
+fn phys_access<T: PhysicalMemory>(mem: &mut T, gen: &mut AccessGenerator) {
+    let addr = PhysicalAddress::with_page(gen.next_offset().into(), PageType::READ_ONLY, PAGE_SIZE);
+    let mut buf = [0_u8; 8];
+    let _ = black_box(mem.phys_read_raw_into(addr, &mut buf));
+}
+
+/// Returns the hit rate and average time per access in nanoseconds.
+fn phys_summary<T: PhysicalMemory>(
+    mem: &mut T,
+    counter: &AtomicUsize,
+    pattern: AccessPattern,
+    range: usize,
+) -> (f64, f64) {
+    let mut gen = AccessGenerator::new(pattern, range, 0);
+
+    // fill the cache first
+    for _ in 0..SUMMARY_ACCESSES {
+        phys_access(mem, &mut gen);
+    }
+
+    let reads = counter.load(Ordering::Relaxed);
+    let start = Instant::now();
+    for _ in 0..SUMMARY_ACCESSES {
+        phys_access(mem, &mut gen);
+    }
+    let elapsed = start.elapsed().as_nanos() as f64;
+    let misses = counter.load(Ordering::Relaxed) - reads;
+
+    (
+        1.0 - misses as f64 / SUMMARY_ACCESSES as f64,
+        elapsed / SUMMARY_ACCESSES as f64,
+    )
+}
+
+/// Page cache throughput and hit rates for all access patterns.
+pub fn page_cache_patterns<T: PhysicalMemory + Clone>(
+    c: &mut Criterion,
+    backend_name: &str,
+    initialize_ctx: &dyn Fn() -> Result<T>,
+) {
+    let mem = initialize_ctx().unwrap();
+    let range = mem.metadata().size / 2;
+
+    let mut group = c.benchmark_group(format!("{}_page_cache_patterns", backend_name));
+    group.throughput(Throughput::Elements(1));
+
+    for pattern in PATTERNS.iter() {
+        group.bench_function(BenchmarkId::new("cached", pattern.name()), |b| {
+            let mut mem = page_cache(mem.clone(), size::mb(2));
+            let mut gen = AccessGenerator::new(*pattern, range, 0);
+            b.iter(|| phys_access(&mut mem, &mut gen))
+        });
+    }
+    group.finish();
+
+    println!("{} page cache summary:", backend_name);
+    for pattern in PATTERNS.iter() {
+        let counting = CountingMemory::new(mem.clone());
+        let counter = counting.counter();
+        let mut uncached = counting.clone();
+        let (_, miss_ns) = phys_summary(&mut uncached, &counter, *pattern, range);
+
+        print!("{:<24} uncached {:8.1} ns", pattern.name(), miss_ns);
+        for &cache_size in PAGE_CACHE_SIZES.iter() {
+            let mut cached = page_cache(counting.clone(), cache_size);
+            let (hit_rate, ns) = phys_summary(&mut cached, &counter, *pattern, range);
+            print!(
+                ", {:5}kb: {:6.2}% {:8.1} ns",
+                cache_size / 1024,
+                hit_rate * 100.0,
+                ns
+            );
+        }
+        println!();
+    }
+}
+
+fn vat_access<T: PhysicalMemory, V: VirtualTranslate, S: ScopedVirtualTranslate>(
+    mem: &mut T,
+    vat: &mut V,
+    translator: &S,
+    base: Address,
+    gen: &mut AccessGenerator,
+) {
+    let _ = black_box(vat.virt_to_phys(mem, translator, base + gen.next_offset()));
+}
+
+/// TLB throughput and hit rates for all access patterns.
+///
+/// Translations run on top of an uncached physical memory, so that every TLB miss shows up as
+/// page table reads.
+pub fn tlb_patterns<T, V, P, S, M>(
+    c: &mut Criterion,
+    backend_name: &str,
+    initialize_ctx: &dyn Fn() -> Result<(T, V, P, S, M)>,
+) where
+    T: PhysicalMemory,
+    V: VirtualTranslate + Clone,
+    P: OsProcessInfo,
+    S: ScopedVirtualTranslate,
+    M: OsProcessModuleInfo,
+{
+    let (mem, vat, proc, translator, module) = initialize_ctx().unwrap();
+    let base = module.base();
+    let range = module.size();
+
+    let mut mem = CountingMemory::new(mem);
+    let counter = mem.counter();
+
+    let tlb = |vat: V, entries: usize| {
+        CachedVirtualTranslate::builder(vat)
+            .arch(proc.sys_arch())
+            .entries(entries)
+            .build()
+            .unwrap()
+    };
+
+    let mut group = c.benchmark_group(format!("{}_tlb_patterns", backend_name));
+    group.throughput(Throughput::Elements(1));
+
+    for pattern in PATTERNS.iter() {
+        group.bench_function(BenchmarkId::new("cached", pattern.name()), |b| {
+            let mut vat = tlb(vat.clone(), 2048);
+            let mut gen = AccessGenerator::new(*pattern, range, 0);
+            b.iter(|| vat_access(&mut mem, &mut vat, &translator, base, &mut gen))
+        });
+    }
+    group.finish();
+
+    println!("{} tlb summary:", backend_name);
+    for pattern in PATTERNS.iter() {
+        let mut summary = |vat: &mut dyn FnMut(&mut CountingMemory<T>, Address)| {
+            let mut gen = AccessGenerator::new(*pattern, range, 0);
+            for _ in 0..SUMMARY_ACCESSES {
+                vat(&mut mem, base + gen.next_offset());
+            }
+
+            let mut misses = 0;
+            let start = Instant::now();
+            for _ in 0..SUMMARY_ACCESSES {
+                let reads = counter.load(Ordering::Relaxed);
+                vat(&mut mem, base + gen.next_offset());
+                if counter.load(Ordering::Relaxed) != reads {
+                    misses += 1;
+                }
+            }
+            let elapsed = start.elapsed().as_nanos() as f64;
+
+            (
+                1.0 - misses as f64 / SUMMARY_ACCESSES as f64,
+                elapsed / SUMMARY_ACCESSES as f64,
+            )
+        };
+
+        let mut uncached = vat.clone();
+        let (_, miss_ns) = summary(&mut |mem, addr| {
+            let _ = black_box(uncached.virt_to_phys(mem, &translator, addr));
+        });
+
+        print!("{:<24} uncached {:8.1} ns", pattern.name(), miss_ns);
+        for &entries in TLB_SIZES.iter() {
+            let mut cached = tlb(vat.clone(), entries);
+            let (hit_rate, ns) = summary(&mut |mem, addr| {
+                let _ = black_box(cached.virt_to_phys(mem, &translator, addr));
+            });
+            print!(", {:5}: {:6.2}% {:8.1} ns", entries, hit_rate * 100.0, ns);
+        }
+        println!();
+    }
+}
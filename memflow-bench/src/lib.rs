@@ -1,3 +1,6 @@
+pub mod alloc;
+pub mod cache;
 pub mod phys;
+pub mod scaling;
 pub mod vat;
 pub mod virt;
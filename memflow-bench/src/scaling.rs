@@ -0,0 +1,377 @@
+/*!
+Multi-threaded scaling benchmarks.
+
+Every thread works on its own clone of the connector (and translation / caching layers), the
+same way multiple workers are usually set up (see `memflow-win32/examples/multithreading.rs`).
+Throughput is reported per thread count, and a scaling efficiency table is printed at the end
+of every group, relative to the single threaded throughput.
+*/
+
+use criterion::*;
+
+use memflow::mem::{
+    CachedMemoryAccess, CachedVirtualTranslate, PhysicalMemory, PhysicalReadData, VirtualDMA,
+    VirtualMemory, VirtualReadData, VirtualTranslate,
+};
+
+use memflow::architecture::{x86, ScopedVirtualTranslate};
+use memflow::error::Result;
+use memflow::iter::FnExtend;
+use memflow::process::*;
+use memflow::types::*;
+
+use rand::prelude::*;
+use rand::{Rng, SeedableRng};
+use rand_xorshift::XorShiftRng as CurRng;
+
+use std::cell::RefCell;
+use std::collections::BTreeMap;
+use std::sync::{Arc, Barrier};
+use std::thread;
+use std::time::{Duration, Instant};
+
+/// Thread counts every workload is measured with.
+pub const THREAD_COUNTS: [usize; 6] = [1, 2, 4, 8, 16, 32];
+
+const CHUNK_COUNT: usize = 64;
+const CHUNK_SIZE: usize = 0x100;
+
+/// Best observed time per operation of every thread count.
+#[derive(Default)]
+struct ScalingResults(RefCell<BTreeMap<usize, f64>>);
+
+impl ScalingResults {
+    fn record(&self, threads: usize, ns_per_op: f64) {
+        let mut results = self.0.borrow_mut();
+        let entry = results.entry(threads).or_insert(std::f64::MAX);
+        *entry = entry.min(ns_per_op);
+    }
+
+    fn print(&self, name: &str) {
+        let results = self.0.borrow();
+        let base = match results.get(&1) {
+            Some(&base) => base,
+            None => return,
+        };
+
+        println!("{} scaling:", name);
+        for (&threads, &ns_per_op) in results.iter() {
+            let ops = threads as f64 * 1e9 / ns_per_op;
+            println!(
+                "{:>4} threads: {:12.2} ops/s, efficiency {:6.2}%",
+                threads,
+                ops,
+                100.0 * base / ns_per_op
+            );
+        }
+    }
+}
+
+/// Runs `work` on `threads` threads at once, `iters` times each.
+///
+/// Every thread sets up its own state from a clone of `ctx` before the clock starts, so the
+/// measured time only contains the work itself. Returns the wall clock time of the slowest
+/// thread.
+fn run_threads<C, W>(
+    threads: usize,
+    iters: u64,
+    ctx: &C,
+    setup: fn(C) -> W,
+    work: fn(&mut W),
+) -> Duration
+where
+    C: Clone + Send + 'static,
+    W: 'static,
+{
+    let barrier = Arc::new(Barrier::new(threads + 1));
+
+    let handles = (0..threads)
+        .map(|_| {
+            let ctx = ctx.clone();
+            let barrier = barrier.clone();
+            thread::spawn(move || {
+                let mut worker = setup(ctx);
+                barrier.wait();
+                for _ in 0..iters {
+                    work(&mut worker);
+                }
+            })
+        })
+        .collect::<Vec<_>>();
+
+    barrier.wait();
+    let start = Instant::now();
+    handles.into_iter().for_each(|h| h.join().unwrap());
+    start.elapsed()
+}
+
+fn scaling_group<C, W>(
+    c: &mut Criterion,
+    backend_name: &str,
+    group_name: &str,
+    ctx: C,
+    setup: fn(C) -> W,
+    work: fn(&mut W),
+) where
+    C: Clone + Send + 'static,
+    W: 'static,
+{
+    let name = format!("{}_{}", backend_name, group_name);
+    let results = ScalingResults::default();
+
+    let mut group = c.benchmark_group(&name);
+    for &threads in THREAD_COUNTS.iter() {
+        group.throughput(Throughput::Elements(threads as u64));
+        group.bench_with_input(
+            BenchmarkId::new("threads", threads),
+            &threads,
+            |b, &threads| {
+                b.iter_custom(|iters| {
+                    let elapsed = run_threads(threads, iters, &ctx, setup, work);
+                    results.record(threads, elapsed.as_nanos() as f64 / iters.max(1) as f64);
+                    elapsed
+                })
+            },
+        );
+    }
+    group.finish();
+
+    results.print(&name);
+}
+
+struct PhysWorker<T> {
+    mem: T,
+    rng: CurRng,
+    bufs: Vec<[u8; CHUNK_SIZE]>,
+    range: usize,
+}
+
+impl<T: PhysicalMemory> PhysWorker<T> {
+    fn new(mem: T) -> Self {
+        let range = mem.metadata().size.saturating_sub(0x1000).max(1);
+        Self {
+            mem,
+            rng: CurRng::from_rng(thread_rng()).unwrap(),
+            bufs: vec![[0; CHUNK_SIZE]; CHUNK_COUNT],
+            range,
+        }
+    }
+
+    fn read(&mut self) {
+        let rng = &mut self.rng;
+        let range = self.range;
+        let mut list = self
+            .bufs
+            .iter_mut()
+            .map(|buf| {
+                PhysicalReadData(Address::from(rng.gen_range(0, range)).into(), &mut buf[..])
+            })
+            .collect::<Vec<_>>();
+        let _ = black_box(self.mem.phys_read_raw_list(&mut list));
+    }
+}
+
+fn cached_phys<T: PhysicalMemory>(mem: T) -> impl PhysicalMemory {
+    CachedMemoryAccess::builder(mem)
+        .arch(x86::x64::ARCH)
+        .cache_size(size::mb(2))
+        .page_type_mask(PageType::PAGE_TABLE | PageType::READ_ONLY | PageType::WRITEABLE)
+        .build()
+        .unwrap()
+}
+
+/// Physical read throughput, with and without a page cache per thread.
+pub fn phys_read<T: PhysicalMemory + Clone + Send + 'static>(
+    c: &mut Criterion,
+    backend_name: &str,
+    initialize_ctx: &dyn Fn() -> Result<T>,
+) {
+    let mem = initialize_ctx().unwrap();
+
+    scaling_group(
+        c,
+        backend_name,
+        "phys_read",
+        mem.clone(),
+        PhysWorker::new,
+        |w| w.read(),
+    );
+    scaling_group(
+        c,
+        backend_name,
+        "phys_read_cached",
+        mem,
+        |mem| PhysWorker::new(cached_phys(mem)),
+        |w| w.read(),
+    );
+}
+
+struct VirtWorker<V> {
+    virt_mem: V,
+    rng: CurRng,
+    bufs: Vec<[u8; CHUNK_SIZE]>,
+    base: u64,
+    size: u64,
+}
+
+impl<V: VirtualMemory> VirtWorker<V> {
+    fn new<M: OsProcessModuleInfo>(virt_mem: V, module: &M) -> Self {
+        Self {
+            virt_mem,
+            rng: CurRng::from_rng(thread_rng()).unwrap(),
+            bufs: vec![[0; CHUNK_SIZE]; CHUNK_COUNT],
+            base: module.base().as_u64(),
+            size: (module.size() as u64).saturating_sub(0x2000).max(1),
+        }
+    }
+
+    fn read(&mut self) {
+        let rng = &mut self.rng;
+        let base_addr = self.base + rng.gen_range(0, self.size);
+        let mut list = self
+            .bufs
+            .iter_mut()
+            .map(|buf| {
+                VirtualReadData(
+                    Address::from(base_addr + rng.gen_range(0, 0x2000)),
+                    &mut buf[..],
+                )
+            })
+            .collect::<Vec<_>>();
+        let _ = black_box(self.virt_mem.virt_read_raw_list(&mut list));
+    }
+}
+
+struct VatWorker<T, V, S> {
+    mem: T,
+    vat: V,
+    translator: S,
+    rng: CurRng,
+    addrs: Vec<Address>,
+    out: Vec<(PhysicalAddress, usize)>,
+    base: u64,
+    size: u64,
+}
+
+impl<T: PhysicalMemory, V: VirtualTranslate, S: ScopedVirtualTranslate> VatWorker<T, V, S> {
+    fn new<M: OsProcessModuleInfo>(mem: T, vat: V, translator: S, module: &M) -> Self {
+        Self {
+            mem,
+            vat,
+            translator,
+            rng: CurRng::from_rng(thread_rng()).unwrap(),
+            addrs: vec![Address::null(); CHUNK_COUNT],
+            out: Vec::with_capacity(CHUNK_COUNT),
+            base: module.base().as_u64(),
+            size: (module.size() as u64).saturating_sub(0x2000).max(1),
+        }
+    }
+
+    fn translate(&mut self) {
+        let rng = &mut self.rng;
+        let base_addr = self.base + rng.gen_range(0, self.size);
+        for addr in self.addrs.iter_mut() {
+            *addr = (base_addr + rng.gen_range(0, 0x2000)).into();
+        }
+
+        self.out.clear();
+        self.vat.virt_to_phys_iter(
+            &mut self.mem,
+            &self.translator,
+            self.addrs.iter().map(|&addr| (addr, 1)),
+            &mut self.out,
+            &mut FnExtend::void(),
+        );
+        black_box(&self.out);
+    }
+}
+
+fn cached_vat<V: VirtualTranslate, P: OsProcessInfo>(vat: V, proc: &P) -> impl VirtualTranslate {
+    CachedVirtualTranslate::builder(vat)
+        .arch(proc.sys_arch())
+        .build()
+        .unwrap()
+}
+
+/// Virtual read and translation throughput, with and without page cache and TLB per thread.
+pub fn virt_read<T, V, P, S, M>(
+    c: &mut Criterion,
+    backend_name: &str,
+    initialize_ctx: &dyn Fn() -> Result<(T, V, P, S, M)>,
+) where
+    T: PhysicalMemory + Clone + Send + 'static,
+    V: VirtualTranslate + Clone + Send + 'static,
+    P: OsProcessInfo + Clone + Send + 'static,
+    S: ScopedVirtualTranslate + 'static,
+    M: OsProcessModuleInfo + Clone + Send + 'static,
+{
+    let ctx = initialize_ctx().unwrap();
+
+    scaling_group(
+        c,
+        backend_name,
+        "virt_read",
+        ctx.clone(),
+        |(mem, vat, proc, translator, module)| {
+            VirtWorker::new(
+                VirtualDMA::with_vat(mem, proc.proc_arch(), translator, vat),
+                &module,
+            )
+        },
+        |w| w.read(),
+    );
+
+    scaling_group(
+        c,
+        backend_name,
+        "virt_read_cached",
+        ctx.clone(),
+        |(mem, vat, proc, translator, module)| {
+            let vat = cached_vat(vat, &proc);
+            VirtWorker::new(
+                VirtualDMA::with_vat(cached_phys(mem), proc.proc_arch(), translator, vat),
+                &module,
+            )
+        },
+        |w| w.read(),
+    );
+
+    scaling_group(
+        c,
+        backend_name,
+        "vat",
+        ctx.clone(),
+        |(mem, vat, _, translator, module)| VatWorker::new(mem, vat, translator, &module),
+        |w| w.translate(),
+    );
+
+    scaling_group(
+        c,
+        backend_name,
+        "vat_cached",
+        ctx,
+        |(mem, vat, proc, translator, module)| {
+            let vat = cached_vat(vat, &proc);
+            VatWorker::new(cached_phys(mem), vat, translator, &module)
+        },
+        |w| w.translate(),
+    );
+}
+
+/// Throughput of an arbitrary enumeration, like a process or module list.
+///
+/// `setup` creates the per thread state (for instance a cloned kernel) from `ctx`, `work`
+/// performs a single enumeration.
+pub fn enumeration<C, W>(
+    c: &mut Criterion,
+    backend_name: &str,
+    group_name: &str,
+    ctx: C,
+    setup: fn(C) -> W,
+    work: fn(&mut W),
+) where
+    C: Clone + Send + 'static,
+    W: 'static,
+{
+    scaling_group(c, backend_name, group_name, ctx, setup, work);
+}
@@ -94,3 +94,74 @@ pub fn byteswap_derive(input: TokenStream) -> TokenStream {
 
     gen.into()
 }
+
+/// Derives `ByteSwap` together with `UniformSwap`.
+///
+/// All fields have to implement `UniformSwap`. Slices of the struct are swapped in bulk
+/// if all fields share the same width and the struct has no padding.
+#[proc_macro_derive(UniformSwap)]
+pub fn uniformswap_derive(input: TokenStream) -> TokenStream {
+    let input = parse_macro_input!(input as DeriveInput);
+    let name = &input.ident;
+
+    let mut gen_inner = quote!();
+    let mut gen_widths = quote!();
+    let mut generics = input.generics.clone();
+    let where_clause = generics.make_where_clause();
+    match input.data {
+        Data::Struct(data) => match data.fields {
+            Fields::Named(named) => {
+                for field in named.named.iter() {
+                    let name = field.ident.as_ref().unwrap();
+                    gen_inner.extend(quote!(
+                        self.#name.byte_swap();
+                    ));
+
+                    // arrays are swapped through their slice
+                    let ty = &field.ty;
+                    let swap_ty = match ty {
+                        syn::Type::Array(array) => {
+                            let elem = &array.elem;
+                            quote!([#elem])
+                        }
+                        _ => quote!(#ty),
+                    };
+                    where_clause.predicates.push(syn::parse_quote!(
+                        #swap_ty: ::memflow::types::byte_swap::UniformSwap
+                    ));
+                    gen_widths.extend(quote!(
+                        (
+                            <#swap_ty as ::memflow::types::byte_swap::UniformSwap>::SWAP_WIDTH,
+                            ::core::mem::size_of::<#ty>(),
+                        ),
+                    ));
+                }
+            }
+            _ => unimplemented!(),
+        },
+        _ => unimplemented!(),
+    };
+    let (impl_generics, ty_generics, where_clause) = generics.split_for_impl();
+
+    let gen = quote!(
+        impl #impl_generics ::memflow::types::byte_swap::ByteSwap for #name #ty_generics #where_clause {
+            fn byte_swap(&mut self) {
+                #gen_inner
+            }
+
+            fn byte_swap_slice(slice: &mut [Self]) {
+                ::memflow::types::byte_swap::byte_swap_uniform(slice);
+            }
+        }
+
+        // the width is only derived from fields that are `UniformSwap` themselves
+        unsafe impl #impl_generics ::memflow::types::byte_swap::UniformSwap for #name #ty_generics #where_clause {
+            const SWAP_WIDTH: usize = ::memflow::types::byte_swap::uniform_swap_width(
+                ::core::mem::size_of::<Self>(),
+                &[#gen_widths],
+            );
+        }
+    );
+
+    gen.into()
+}
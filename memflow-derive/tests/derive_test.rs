@@ -1,4 +1,4 @@
-use memflow::types::byte_swap::ByteSwap;
+use memflow::types::byte_swap::{ByteSwap, UniformSwap};
 use memflow_derive::*;
 
 #[derive(ByteSwap)]
@@ -36,3 +36,83 @@ struct ByteSwapDeriveStructGenericSlice<T: ByteSwap> {
 
 #[test]
 pub fn compiles() {}
+
+#[derive(UniformSwap)]
+struct UniformSwapDerive {
+    pub val: u32,
+}
+
+#[derive(UniformSwap)]
+struct UniformSwapDeriveGeneric<T: ByteSwap> {
+    pub val: T,
+}
+
+#[derive(UniformSwap)]
+struct UniformSwapDeriveSlice {
+    pub slice: [u8; 32],
+}
+
+#[derive(UniformSwap)]
+struct UniformSwapDeriveStructSlice {
+    pub slice: [UniformSwapDeriveSlice; 128],
+}
+
+#[derive(UniformSwap, Clone, Copy, PartialEq, Debug)]
+#[repr(C)]
+struct UniformSwapDeriveArray {
+    pub a: u32,
+    pub b: [u32; 3],
+}
+
+#[derive(UniformSwap)]
+#[repr(C)]
+struct UniformSwapDerivePadded {
+    pub a: u32,
+    pub b: u64,
+}
+
+#[test]
+pub fn swap_width() {
+    assert_eq!(UniformSwapDerive::SWAP_WIDTH, 4);
+    assert_eq!(UniformSwapDeriveSlice::SWAP_WIDTH, 1);
+    assert_eq!(UniformSwapDeriveStructSlice::SWAP_WIDTH, 1);
+    assert_eq!(UniformSwapDeriveGeneric::<u64>::SWAP_WIDTH, 8);
+    assert_eq!(UniformSwapDeriveArray::SWAP_WIDTH, 4);
+    assert_eq!(UniformSwapDerivePadded::SWAP_WIDTH, 0);
+}
+
+#[test]
+pub fn swap_uniform_slice() {
+    let mut vals = (0..9)
+        .map(|i| UniformSwapDeriveArray {
+            a: i * 0x0102_0304,
+            b: [i, i << 8, i << 16],
+        })
+        .collect::<Vec<_>>();
+    let expected = vals
+        .iter()
+        .map(|v| UniformSwapDeriveArray {
+            a: v.a.swap_bytes(),
+            b: [
+                v.b[0].swap_bytes(),
+                v.b[1].swap_bytes(),
+                v.b[2].swap_bytes(),
+            ],
+        })
+        .collect::<Vec<_>>();
+
+    vals.byte_swap();
+    assert_eq!(vals, expected);
+}
+
+#[test]
+pub fn swap_padded_slice() {
+    let mut vals = [UniformSwapDerivePadded {
+        a: 0x0102_0304,
+        b: 0x0102_0304_0506_0708,
+    }];
+
+    vals.byte_swap();
+    assert_eq!(vals[0].a, 0x0403_0201);
+    assert_eq!(vals[0].b, 0x0807_0605_0403_0201);
+}
@@ -51,6 +51,27 @@ typedef struct PhysicalReadData PhysicalReadData;
 
 typedef struct PhysicalWriteData PhysicalWriteData;
 
+/**
+ * Publishes snapshots of registered regions into a shared segment.
+ *
+ * The segment is removed when the publisher is dropped. Readers that already opened it keep
+ * their mapping.
+ */
+typedef struct SnapshotPublisher SnapshotPublisher;
+
+/**
+ * Reads snapshots from a shared segment created by a `SnapshotPublisher`.
+ */
+typedef struct SnapshotReader SnapshotReader;
+
+/**
+ * Performs virtual memory reads on a worker thread
+ *
+ * Everything that is submitted while the worker is busy gets merged into a single list read,
+ * so many outstanding reads of different callers cost one round trip to the connector.
+ */
+typedef struct VirtualAsyncReader VirtualAsyncReader;
+
 typedef struct VirtualMemoryObj VirtualMemoryObj;
 
 typedef struct VirtualReadData VirtualReadData;
@@ -108,15 +129,13 @@ typedef uint8_t PageType;
 #define PageType_NOEXEC (uint8_t)16
 
 /**
- * This type represents a wrapper over a [address](address/index.html)
- * with additional information about the containing page in the physical memory domain.
+ * A physical address with information about its containing page, as passed through the C API
  *
- * This type will mostly be used by the [virtual to physical address translation](todo.html).
- * When a physical address is translated from a virtual address the additional information
- * about the allocated page the virtual address points to can be obtained from this structure.
+ * memflow packs the page information of a `PhysicalAddress` into the low bits of the address.
+ * That representation is kept out of the C API, physical addresses are converted from and to
+ * this structure at the boundary. Use `addr_to_paddr` to create one from an `Address`.
  *
- * Most architectures have support multiple page sizes (see [huge pages](todo.html))
- * which will be represented by the containing `page` of the `PhysicalAddress` struct.
+ * A `page_size_log2` of 0 means that no page information is attached.
  */
 typedef struct PhysicalAddress {
     Address address;
@@ -129,6 +148,61 @@ typedef struct PhysicalMemoryMetadata {
     bool readonly;
 } PhysicalMemoryMetadata;
 
+/**
+ * A single component of a memory usage report
+ *
+ * `name` points to a static string of `name_len` bytes, it is not null-terminated.
+ */
+typedef struct MemoryUsageEntry {
+    const uint8_t *name;
+    uintptr_t name_len;
+    uintptr_t bytes;
+    uintptr_t high_water_mark;
+} MemoryUsageEntry;
+
+/**
+ * A single read of a list, in plain C layout
+ *
+ * Unlike `VirtualReadData` this can be filled in from C and C++ directly.
+ */
+typedef struct VirtualReadEntry {
+    Address addr;
+    uint8_t *out;
+    uintptr_t len;
+} VirtualReadEntry;
+
+/**
+ * A region registered with `snapshot_publisher_create`
+ */
+typedef struct SnapshotRegionDesc {
+    const char *name;
+    Address address;
+    uintptr_t size;
+} SnapshotRegionDesc;
+
+/**
+ * A read submitted to a `VirtualAsyncReader`
+ *
+ * `user_data` is handed back unchanged in the matching `VirtualAsyncCompletion`.
+ */
+typedef struct VirtualAsyncEntry {
+    Address addr;
+    uint8_t *out;
+    uintptr_t len;
+    void *user_data;
+} VirtualAsyncEntry;
+
+/**
+ * A finished read of a `VirtualAsyncReader`
+ *
+ * `status` is the result of the list read the entry was part of. Parts that could not be read
+ * are zeroed.
+ */
+typedef struct VirtualAsyncCompletion {
+    void *user_data;
+    int32_t status;
+} VirtualAsyncCompletion;
+
 /**
  * Type alias for a PID.
  */
@@ -153,6 +227,13 @@ void log_init(int32_t level_num);
  */
 PhysicalAddress addr_to_paddr(Address address);
 
+/**
+ * Helper to convert `PhysicalAddress` back to an `Address`
+ *
+ * This strips the page information of the `PhysicalAddress`.
+ */
+Address paddr_to_addr(PhysicalAddress address);
+
 /**
  * Create a new connector inventory
  *
@@ -210,6 +291,24 @@ CloneablePhysicalMemoryObj *inventory_create_connector(ConnectorInventory *inv,
                                                        const char *name,
                                                        const char *args);
 
+/**
+ * Connect to a memflow daemon
+ *
+ * This creates an instance of a `CloneablePhysicalMemory` which forwards all physical memory
+ * operations to the daemon listening on the unix socket at `path`. It is used exactly like a
+ * connector created by `inventory_create_connector`, and needs to be freed using
+ * `connector_free`.
+ *
+ * Every clone opens its own connection to the daemon.
+ *
+ * The daemon is only available on unix systems, elsewhere this always returns null.
+ *
+ * # Safety
+ *
+ * `path` must be a valid null terminated string.
+ */
+CloneablePhysicalMemoryObj *daemon_connect(const char *path);
+
 /**
  * Clone a connector
  *
@@ -300,6 +399,25 @@ int32_t phys_write_raw_list(PhysicalMemoryObj *mem, const PhysicalWriteData *dat
  */
 PhysicalMemoryMetadata phys_metadata(const PhysicalMemoryObj *mem);
 
+/**
+ * Retrieve the memory held by the physical memory object and the layers it wraps
+ *
+ * Up to `max_len` components are written into `out`. The total number of components is
+ * returned, if it is larger than `max_len` the call can be repeated with a larger buffer.
+ *
+ * # Safety
+ *
+ * `out` must be a valid array of `MemoryUsageEntry` with the length of at least `max_len`
+ */
+uintptr_t phys_memory_usage(const PhysicalMemoryObj *mem,
+                            MemoryUsageEntry *out,
+                            uintptr_t max_len);
+
+/**
+ * Release memory of the physical memory object that is not needed right now
+ */
+void phys_shrink_memory(PhysicalMemoryObj *mem);
+
 /**
  * Read a single value into `out` from a provided `PhysicalAddress`
  *
@@ -368,6 +486,18 @@ void virt_free(VirtualMemoryObj *mem);
  */
 int32_t virt_read_raw_list(VirtualMemoryObj *mem, VirtualReadData *data, uintptr_t len);
 
+/**
+ * Read a list of values described by `VirtualReadEntry` elements
+ *
+ * This behaves like `virt_read_raw_list`. Parts that could not be read are left zeroed.
+ *
+ * # Safety
+ *
+ * `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`, and
+ * every entry must point to a valid buffer of at least its `len` size.
+ */
+int32_t virt_read_entries(VirtualMemoryObj *mem, const VirtualReadEntry *data, uintptr_t len);
+
 /**
  * Write a list of values
  *
@@ -390,6 +520,23 @@ int32_t virt_write_raw_list(VirtualMemoryObj *mem, const VirtualWriteData *data,
  */
 int32_t virt_read_raw_into(VirtualMemoryObj *mem, Address addr, uint8_t *out, uintptr_t len);
 
+/**
+ * Retrieve the memory held by the virtual memory object and the layers it wraps
+ *
+ * Up to `max_len` components are written into `out`. The total number of components is
+ * returned, if it is larger than `max_len` the call can be repeated with a larger buffer.
+ *
+ * # Safety
+ *
+ * `out` must be a valid array of `MemoryUsageEntry` with the length of at least `max_len`
+ */
+uintptr_t virt_memory_usage(const VirtualMemoryObj *mem, MemoryUsageEntry *out, uintptr_t max_len);
+
+/**
+ * Release memory of the virtual memory object that is not needed right now
+ */
+void virt_shrink_memory(VirtualMemoryObj *mem);
+
 /**
  * Read a single 32-bit value from a provided `Address`
  */
@@ -419,6 +566,152 @@ int32_t virt_write_u32(VirtualMemoryObj *mem, Address addr, uint32_t val);
  */
 int32_t virt_write_u64(VirtualMemoryObj *mem, Address addr, uint64_t val);
 
+/**
+ * Create an asynchronous reader from a virtual memory object
+ *
+ * This takes ownership of `mem`, it must not be used or freed afterwards. It is freed together
+ * with the reader.
+ *
+ * A virtual memory object only refers to the memory of the object it was taken from (for
+ * instance a process). The worker thread reads through it without any synchronization, so
+ * that object must neither be used nor freed until the reader has been freed. Prefer the
+ * constructors that give the reader its own copy, like `process_virt_async`.
+ *
+ * # Safety
+ *
+ * `mem` must be a valid virtual memory object that was created using one of the provided
+ * functions. The object it was taken from must not be used until the reader is freed.
+ */
+VirtualAsyncReader *virt_async_new(VirtualMemoryObj *mem);
+
+/**
+ * Free an asynchronous reader
+ *
+ * Reads that did not complete yet are dropped, their buffers are not written to afterwards.
+ *
+ * # Safety
+ *
+ * `reader` must be a valid reader created with `virt_async_new`.
+ */
+void virt_async_free(VirtualAsyncReader *reader);
+
+/**
+ * Submit a list of reads without waiting for them
+ *
+ * All reads submitted until the worker picks them up are performed as a single list read.
+ *
+ * # Safety
+ *
+ * `data` must be a valid array of `VirtualAsyncEntry` with the length of at least `len`, and
+ * every entry must point to a buffer of at least its `len` size, which stays valid until the
+ * completion of the entry has been retrieved.
+ */
+int32_t virt_async_submit(VirtualAsyncReader *reader, const VirtualAsyncEntry *data, uintptr_t len);
+
+/**
+ * Retrieve up to `max_len` completed reads without blocking
+ *
+ * Returns the number of completions written into `out`.
+ *
+ * # Safety
+ *
+ * `out` must be a valid array of `VirtualAsyncCompletion` with the length of at least `max_len`
+ */
+uintptr_t virt_async_poll(VirtualAsyncReader *reader,
+                          VirtualAsyncCompletion *out,
+                          uintptr_t max_len);
+
+/**
+ * Retrieve up to `max_len` completed reads, waiting up to `timeout_ms` for the first one
+ *
+ * Returns the number of completions written into `out`, 0 if the timeout expired.
+ *
+ * # Safety
+ *
+ * `out` must be a valid array of `VirtualAsyncCompletion` with the length of at least `max_len`
+ */
+uintptr_t virt_async_wait(VirtualAsyncReader *reader,
+                          VirtualAsyncCompletion *out,
+                          uintptr_t max_len,
+                          uint64_t timeout_ms);
+
+/**
+ * Create a snapshot publisher with the shared segment `name`
+ *
+ * The regions are published in the order of `regions`, readers can look them up by name.
+ *
+ * # Safety
+ *
+ * `name` must be a valid null terminated string, `regions` must be a valid array of
+ * `SnapshotRegionDesc` with the length of at least `len`, each with a valid null terminated
+ * name.
+ */
+SnapshotPublisher *snapshot_publisher_create(const char *name,
+                                             const SnapshotRegionDesc *regions,
+                                             uintptr_t len);
+
+/**
+ * Read all regions from `mem` and publish them
+ *
+ * Partially read regions are published as well, with the unread parts zeroed.
+ */
+int32_t snapshot_publish(SnapshotPublisher *publisher, VirtualMemoryObj *mem);
+
+/**
+ * Free a snapshot publisher and remove its shared segment
+ *
+ * # Safety
+ *
+ * `publisher` must be a valid publisher created with `snapshot_publisher_create`.
+ */
+void snapshot_publisher_free(SnapshotPublisher *publisher);
+
+/**
+ * Open the shared segment `name` of a snapshot publisher
+ *
+ * # Safety
+ *
+ * `name` must be a valid null terminated string
+ */
+SnapshotReader *snapshot_reader_open(const char *name);
+
+/**
+ * Find the index of the region called `name`, -1 if there is none
+ *
+ * # Safety
+ *
+ * `name` must be a valid null terminated string
+ */
+int32_t snapshot_reader_find_region(const SnapshotReader *reader, const char *name);
+
+/**
+ * Returns the generation of the latest publication, 0 if nothing was published yet
+ */
+uint64_t snapshot_reader_generation(const SnapshotReader *reader);
+
+/**
+ * Copy the latest consistent version of the region at `idx` into `out`
+ *
+ * Returns the generation of the copied data, or 0 if no consistent copy could be made.
+ *
+ * # Safety
+ *
+ * `out` must be a valid buffer of at least `len` bytes
+ */
+uint64_t snapshot_read_region(const SnapshotReader *reader,
+                              uintptr_t idx,
+                              uint8_t *out,
+                              uintptr_t len);
+
+/**
+ * Free a snapshot reader
+ *
+ * # Safety
+ *
+ * `reader` must be a valid reader created with `snapshot_reader_open`.
+ */
+void snapshot_reader_free(SnapshotReader *reader);
+
 uint8_t arch_bits(const ArchitectureObj *arch);
 
 Endianess arch_endianess(const ArchitectureObj *arch);
@@ -4,11 +4,28 @@
 #include "memflow.h"
 #include "binddestr.h"
 
+#include <cstddef>
+#include <type_traits>
+
 #ifndef NO_STL_CONTAINERS
+#include <algorithm>
+#include <iterator>
 #include <string>
+#include <vector>
 #ifndef AUTO_STRING_SIZE
 #define AUTO_STRING_SIZE 128
 #endif
+#ifndef REMOTE_ARRAY_CHUNK_SIZE
+#define REMOTE_ARRAY_CHUNK_SIZE 1024
+#endif
+#endif
+
+#if !defined(NO_STL_CONTAINERS) && defined(__cpp_impl_coroutine)
+#define MEMFLOW_COROUTINES
+#include <coroutine>
+#ifndef ASYNC_COMPLETION_BATCH
+#define ASYNC_COMPLETION_BATCH 64
+#endif
 #endif
 
 struct CConnectorInventory
@@ -73,6 +90,7 @@ struct CVirtualMemory
         : BindDestr(virt_mem) {}
 
     WRAP_FN_RAW(virt_read_raw_list);
+    WRAP_FN_RAW(virt_read_entries);
     WRAP_FN_RAW(virt_write_raw_list);
     WRAP_FN_RAW(virt_read_raw_into);
     WRAP_FN_RAW(virt_read_u32);
@@ -94,6 +112,425 @@ struct CVirtualMemory
     }
 };
 
+#ifndef NO_STL_CONTAINERS
+template<typename T>
+class RemoteArray;
+#endif
+
+// A typed pointer into virtual memory
+//
+// The value is read on first access and cached afterwards, `refresh` drops the cached value.
+// The pointer does not own the memory object, which has to outlive it. A default constructed
+// pointer has no memory object, reading through it fails with -1 and yields a zeroed value.
+template<typename T>
+class RemotePtr
+{
+    static_assert(std::is_trivially_copyable<T>::value, "remote types must be trivially copyable");
+
+public:
+    RemotePtr()
+        : mem(nullptr), addr(0), fetched(false), last_status(0), value() {}
+
+    RemotePtr(CVirtualMemory &mem, Address addr)
+        : mem(&mem), addr(addr), fetched(false), last_status(0), value() {}
+
+    inline Address address() const {
+        return this->addr;
+    }
+
+    inline bool is_null() const {
+        return this->addr == 0;
+    }
+
+    // Result of the last read, parts that could not be read are zeroed
+    inline int32_t status() const {
+        return this->last_status;
+    }
+
+    const T &get() const {
+        if (!this->fetched) {
+            if (this->mem) {
+                VirtualReadEntry entry = { this->addr, (uint8_t *)&this->value, sizeof(T) };
+                this->last_status = this->mem->virt_read_entries(&entry, 1);
+            } else {
+                this->value = T();
+                this->last_status = -1;
+            }
+            this->fetched = true;
+        }
+        return this->value;
+    }
+
+    inline const T &operator*() const {
+        return this->get();
+    }
+
+    inline const T *operator->() const {
+        return &this->get();
+    }
+
+    inline void refresh() {
+        this->fetched = false;
+    }
+
+    inline RemotePtr operator+(ptrdiff_t n) const {
+        return RemotePtr(this->mem, this->addr + n * sizeof(T));
+    }
+
+#ifndef NO_STL_CONTAINERS
+    RemoteArray<T> array(size_t len, size_t chunk_len = REMOTE_ARRAY_CHUNK_SIZE) const;
+
+    // Reads all pointers of `first..last` that were not read yet with a single list read
+    template<typename It>
+    static int32_t fetch_all(CVirtualMemory &mem, It first, It last) {
+        std::vector<VirtualReadEntry> entries;
+        std::vector<const RemotePtr *> ptrs;
+
+        for (It it = first; it != last; ++it) {
+            const RemotePtr &ptr = *it;
+            if (!ptr.fetched) {
+                entries.push_back({ ptr.addr, (uint8_t *)&ptr.value, sizeof(T) });
+                ptrs.push_back(&ptr);
+            }
+        }
+
+        if (entries.empty()) {
+            return 0;
+        }
+
+        int32_t ret = mem.virt_read_entries(entries.data(), entries.size());
+        for (const RemotePtr *ptr : ptrs) {
+            ptr->fetched = true;
+            ptr->last_status = ret;
+        }
+        return ret;
+    }
+#endif
+
+private:
+#ifndef NO_STL_CONTAINERS
+    friend class RemoteArray<T>;
+#endif
+
+    RemotePtr(CVirtualMemory *mem, Address addr)
+        : mem(mem), addr(addr), fetched(false), last_status(0), value() {}
+
+    CVirtualMemory *mem;
+    Address addr;
+    mutable bool fetched;
+    mutable int32_t last_status;
+    mutable T value;
+};
+
+#ifndef NO_STL_CONTAINERS
+// A typed array in virtual memory
+//
+// Elements are read lazily in windows of `chunk_len` elements, and the last window is cached.
+// Sequential access, like iterating the whole array, thus only performs one read per window.
+// References to elements stay valid until a different window is read.
+template<typename T>
+class RemoteArray
+{
+    static_assert(std::is_trivially_copyable<T>::value, "remote types must be trivially copyable");
+
+public:
+    class const_iterator
+    {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const T *pointer;
+        typedef const T &reference;
+
+        const_iterator(const RemoteArray *array, size_t idx)
+            : array(array), idx(idx) {}
+
+        inline reference operator*() const {
+            return (*this->array)[this->idx];
+        }
+
+        inline pointer operator->() const {
+            return &(*this->array)[this->idx];
+        }
+
+        inline const_iterator &operator++() {
+            this->idx++;
+            return *this;
+        }
+
+        inline const_iterator operator++(int) {
+            const_iterator ret = *this;
+            this->idx++;
+            return ret;
+        }
+
+        inline bool operator==(const const_iterator &other) const {
+            return this->array == other.array && this->idx == other.idx;
+        }
+
+        inline bool operator!=(const const_iterator &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        const RemoteArray *array;
+        size_t idx;
+    };
+
+    RemoteArray(CVirtualMemory &mem, Address base, size_t len,
+                size_t chunk_len = REMOTE_ARRAY_CHUNK_SIZE)
+        : mem(&mem), base(base), len(len), chunk_len(chunk_len ? chunk_len : 1),
+          window_start(0), last_status(0) {}
+
+    inline Address address() const {
+        return this->base;
+    }
+
+    inline size_t size() const {
+        return this->len;
+    }
+
+    inline bool empty() const {
+        return this->len == 0;
+    }
+
+    // Result of the last read, parts that could not be read are zeroed
+    inline int32_t status() const {
+        return this->last_status;
+    }
+
+    // Element access does not check bounds
+    const T &operator[](size_t idx) const {
+        if (idx < this->window_start || idx >= this->window_start + this->window.size()) {
+            this->fetch_window(idx);
+        }
+        return this->window[idx - this->window_start];
+    }
+
+    inline RemotePtr<T> ptr(size_t idx) const {
+        return RemotePtr<T>(this->mem, this->base + idx * sizeof(T));
+    }
+
+    // Drops the cached window
+    inline void refresh() {
+        this->window.clear();
+    }
+
+    inline const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+
+    inline const_iterator end() const {
+        return const_iterator(this, this->len);
+    }
+
+    // Reads `count` elements starting at `first` into `out`, bypassing the window
+    //
+    // All chunks are read with a single list read.
+    int32_t read_range(size_t first, size_t count, T *out) const {
+        std::vector<VirtualReadEntry> entries;
+        entries.reserve((count + this->chunk_len - 1) / this->chunk_len);
+
+        for (size_t i = 0; i < count; i += this->chunk_len) {
+            size_t n = std::min(this->chunk_len, count - i);
+            entries.push_back({
+                this->base + (first + i) * sizeof(T),
+                (uint8_t *)(out + i),
+                n * sizeof(T)
+            });
+        }
+
+        if (entries.empty()) {
+            this->last_status = 0;
+        } else if (!this->mem) {
+            std::fill(out, out + count, T());
+            this->last_status = -1;
+        } else {
+            this->last_status = this->mem->virt_read_entries(entries.data(), entries.size());
+        }
+        return this->last_status;
+    }
+
+    std::vector<T> to_vector() const {
+        std::vector<T> ret(this->len);
+        this->read_range(0, this->len, ret.data());
+        return ret;
+    }
+
+private:
+    friend class RemotePtr<T>;
+
+    RemoteArray(CVirtualMemory *mem, Address base, size_t len, size_t chunk_len)
+        : mem(mem), base(base), len(len), chunk_len(chunk_len ? chunk_len : 1),
+          window_start(0), last_status(0) {}
+
+    void fetch_window(size_t idx) const {
+        size_t start = idx - idx % this->chunk_len;
+        size_t count = std::min(this->chunk_len, this->len - start);
+
+        this->window.resize(count);
+        this->window_start = start;
+        this->read_range(start, count, this->window.data());
+    }
+
+    CVirtualMemory *mem;
+    Address base;
+    size_t len;
+    size_t chunk_len;
+    mutable std::vector<T> window;
+    mutable size_t window_start;
+    mutable int32_t last_status;
+};
+
+template<typename T>
+RemoteArray<T> RemotePtr<T>::array(size_t len, size_t chunk_len) const {
+    return RemoteArray<T>(this->mem, this->addr, len, chunk_len);
+}
+#endif
+
+#ifdef MEMFLOW_COROUTINES
+// Awaitable reads on top of a `VirtualAsyncReader`
+//
+// Reads awaited by any number of coroutines are queued and submitted together on the next
+// `poll` or `wait` call, which also resumes the coroutines of all completed reads. The reader
+// has to be driven by the executor, for instance whenever it runs out of ready tasks:
+//
+//     uint32_t value = co_await async_mem.read<uint32_t>(addr);
+//
+// Coroutines still waiting for a read when the reader is destroyed are never resumed.
+struct CAsyncVirtualMemory
+    : BindDestr<VirtualAsyncReader, virt_async_free>
+{
+    CAsyncVirtualMemory(VirtualAsyncReader *reader)
+        : BindDestr(reader), pending(0) {}
+
+    // Takes ownership of the virtual memory object. The object it was taken from (for instance
+    // a process) must not be used until this reader is destroyed, as the worker thread reads
+    // through it unsynchronized. Prefer `CWin32Process::virt_async`, which reads from a copy.
+    CAsyncVirtualMemory(CVirtualMemory &&mem)
+        : CAsyncVirtualMemory(::virt_async_new(mem.invalidate())) {}
+
+    struct ReadOp
+    {
+        VirtualAsyncEntry entry;
+        std::coroutine_handle<> handle;
+        int32_t status;
+    };
+
+    template<typename T>
+    struct ReadAwaitable
+    {
+        CAsyncVirtualMemory *mem;
+        Address addr;
+        T value;
+        ReadOp op;
+
+        inline bool await_ready() const noexcept {
+            return false;
+        }
+
+        inline void await_suspend(std::coroutine_handle<> handle) {
+            this->mem->queue(this->op, handle, this->addr, (uint8_t *)&this->value, sizeof(T));
+        }
+
+        inline T await_resume() const noexcept {
+            return this->value;
+        }
+    };
+
+    struct ReadIntoAwaitable
+    {
+        CAsyncVirtualMemory *mem;
+        Address addr;
+        uint8_t *out;
+        uintptr_t len;
+        ReadOp op;
+
+        inline bool await_ready() const noexcept {
+            return this->len == 0;
+        }
+
+        inline void await_suspend(std::coroutine_handle<> handle) {
+            this->mem->queue(this->op, handle, this->addr, this->out, this->len);
+        }
+
+        inline int32_t await_resume() const noexcept {
+            return this->len ? this->op.status : 0;
+        }
+    };
+
+    // Reads a single value, parts that could not be read are zeroed
+    template<typename T>
+    ReadAwaitable<T> read(Address addr) {
+        static_assert(std::is_trivially_copyable<T>::value, "remote types must be trivially copyable");
+        return ReadAwaitable<T>{ this, addr, T(), ReadOp() };
+    }
+
+    // Reads `len` bytes into `out` and returns the status of the read
+    ReadIntoAwaitable read_into(Address addr, uint8_t *out, uintptr_t len) {
+        return ReadIntoAwaitable{ this, addr, out, len, ReadOp() };
+    }
+
+    // Number of reads that were awaited but did not complete yet
+    inline size_t in_flight() const {
+        return this->pending + this->queued.size();
+    }
+
+    // Submits queued reads and resumes the coroutines of completed ones without blocking
+    //
+    // Returns the number of resumed coroutines.
+    size_t poll() {
+        this->submit();
+        VirtualAsyncCompletion completions[ASYNC_COMPLETION_BATCH];
+        size_t count = ::virt_async_poll(this->inner, completions, ASYNC_COMPLETION_BATCH);
+        return this->resume(completions, count);
+    }
+
+    // Like `poll`, but waits up to `timeout_ms` for the first completion
+    size_t wait(uint64_t timeout_ms) {
+        this->submit();
+        if (!this->pending) {
+            return 0;
+        }
+        VirtualAsyncCompletion completions[ASYNC_COMPLETION_BATCH];
+        size_t count = ::virt_async_wait(this->inner, completions, ASYNC_COMPLETION_BATCH, timeout_ms);
+        return this->resume(completions, count);
+    }
+
+private:
+    void queue(ReadOp &op, std::coroutine_handle<> handle, Address addr, uint8_t *out, uintptr_t len) {
+        op.entry = VirtualAsyncEntry{ addr, out, len, &op };
+        op.handle = handle;
+        op.status = 0;
+        this->queued.push_back(op.entry);
+    }
+
+    void submit() {
+        if (!this->queued.empty()) {
+            ::virt_async_submit(this->inner, this->queued.data(), this->queued.size());
+            this->pending += this->queued.size();
+            this->queued.clear();
+        }
+    }
+
+    size_t resume(VirtualAsyncCompletion *completions, size_t count) {
+        // resumed coroutines may queue new reads, which is fine since they are only
+        // submitted on the next call
+        this->pending -= count;
+        for (size_t i = 0; i < count; i++) {
+            ReadOp *op = (ReadOp *)completions[i].user_data;
+            op->status = completions[i].status;
+            op->handle.resume();
+        }
+        return count;
+    }
+
+    std::vector<VirtualAsyncEntry> queued;
+    size_t pending;
+};
+#endif
+
 struct CArchitecture
     : BindDestr<ArchitectureObj, arch_free>
 {
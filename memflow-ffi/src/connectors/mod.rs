@@ -2,6 +2,8 @@ use std::ffi::CStr;
 use std::os::raw::c_char;
 use std::path::PathBuf;
 
+#[cfg(unix)]
+use memflow::connector::DaemonConnector;
 use memflow::connector::{ConnectorArgs, ConnectorInventory};
 
 use crate::util::*;
@@ -104,6 +106,51 @@ pub unsafe extern "C" fn inventory_create_connector(
     }
 }
 
+/// Connect to a memflow daemon
+///
+/// This creates an instance of a `CloneablePhysicalMemory` which forwards all physical memory
+/// operations to the daemon listening on the unix socket at `path`. It is used exactly like a
+/// connector created by `inventory_create_connector`, and needs to be freed using
+/// `connector_free`.
+///
+/// Every clone opens its own connection to the daemon.
+///
+/// The daemon is only available on unix systems, elsewhere this always returns null.
+///
+/// # Safety
+///
+/// `path` must be a valid null terminated string.
+#[cfg(unix)]
+#[no_mangle]
+pub unsafe extern "C" fn daemon_connect(
+    path: *const c_char,
+) -> Option<&'static mut CloneablePhysicalMemoryObj> {
+    let rpath = CStr::from_ptr(path).to_string_lossy();
+
+    DaemonConnector::connect(&*rpath)
+        .map_err(inspect_err)
+        .ok()
+        .map(to_heap)
+        .map(|c| c as CloneablePhysicalMemoryObj)
+        .map(to_heap)
+}
+
+/// Connect to a memflow daemon
+///
+/// The daemon is only available on unix systems, this always returns null.
+///
+/// # Safety
+///
+/// `path` must be a valid null terminated string.
+#[cfg(not(unix))]
+#[no_mangle]
+pub unsafe extern "C" fn daemon_connect(
+    _path: *const c_char,
+) -> Option<&'static mut CloneablePhysicalMemoryObj> {
+    log::error!("memflow daemon connections are only supported on unix");
+    None
+}
+
 /// Clone a connector
 ///
 /// This method is useful when needing to perform multithreaded operations, as a connector is not
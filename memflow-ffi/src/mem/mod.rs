@@ -1,2 +1,39 @@
 pub mod phys_mem;
+pub mod snapshot;
+pub mod virt_async;
 pub mod virt_mem;
+
+use memflow::mem::MemoryUsage;
+
+/// A single component of a memory usage report
+///
+/// `name` points to a static string of `name_len` bytes, it is not null-terminated.
+#[repr(C)]
+pub struct MemoryUsageEntry {
+    pub name: *const u8,
+    pub name_len: usize,
+    pub bytes: usize,
+    pub high_water_mark: usize,
+}
+
+/// Copies up to `max_len` components of `usage` into `out` and returns the number of components.
+///
+/// # Safety
+///
+/// `out` must be a valid array of `MemoryUsageEntry` with the length of at least `max_len`,
+/// or null if `max_len` is 0.
+pub unsafe fn write_memory_usage(
+    usage: &MemoryUsage,
+    out: *mut MemoryUsageEntry,
+    max_len: usize,
+) -> usize {
+    for (i, component) in usage.iter().take(max_len).enumerate() {
+        out.add(i).write(MemoryUsageEntry {
+            name: component.name.as_ptr(),
+            name_len: component.name.len(),
+            bytes: component.bytes,
+            high_water_mark: component.high_water_mark,
+        });
+    }
+    usage.len()
+}
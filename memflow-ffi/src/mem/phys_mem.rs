@@ -1,9 +1,10 @@
 use memflow::mem::phys_mem::*;
-use memflow::types::PhysicalAddress;
+use memflow::mem::MemoryUsage;
 
-use crate::util::*;
+use super::{write_memory_usage, MemoryUsageEntry};
 
-use std::slice::{from_raw_parts, from_raw_parts_mut};
+use crate::types::CPhysicalAddress;
+use crate::util::*;
 
 use log::trace;
 
@@ -53,7 +54,7 @@ pub unsafe extern "C" fn phys_read_raw_list(
     data: *mut PhysicalReadData,
     len: usize,
 ) -> i32 {
-    let data = from_raw_parts_mut(data, len);
+    let data = from_c_array_mut(data, len);
     mem.phys_read_raw_list(data).int_result()
 }
 
@@ -71,7 +72,7 @@ pub unsafe extern "C" fn phys_write_raw_list(
     data: *const PhysicalWriteData,
     len: usize,
 ) -> i32 {
-    let data = from_raw_parts(data, len);
+    let data = from_c_array(data, len);
     mem.phys_write_raw_list(data).int_result()
 }
 
@@ -81,6 +82,31 @@ pub extern "C" fn phys_metadata(mem: &PhysicalMemoryObj) -> PhysicalMemoryMetada
     mem.metadata()
 }
 
+/// Retrieve the memory held by the physical memory object and the layers it wraps
+///
+/// Up to `max_len` components are written into `out`. The total number of components is
+/// returned, if it is larger than `max_len` the call can be repeated with a larger buffer.
+///
+/// # Safety
+///
+/// `out` must be a valid array of `MemoryUsageEntry` with the length of at least `max_len`
+#[no_mangle]
+pub unsafe extern "C" fn phys_memory_usage(
+    mem: &PhysicalMemoryObj,
+    out: *mut MemoryUsageEntry,
+    max_len: usize,
+) -> usize {
+    let mut usage = MemoryUsage::new();
+    mem.memory_usage(&mut usage);
+    write_memory_usage(&usage, out, max_len)
+}
+
+/// Release memory of the physical memory object that is not needed right now
+#[no_mangle]
+pub extern "C" fn phys_shrink_memory(mem: &mut PhysicalMemoryObj) {
+    mem.shrink_memory()
+}
+
 /// Read a single value into `out` from a provided `PhysicalAddress`
 ///
 /// # Safety
@@ -89,24 +115,24 @@ pub extern "C" fn phys_metadata(mem: &PhysicalMemoryObj) -> PhysicalMemoryMetada
 #[no_mangle]
 pub unsafe extern "C" fn phys_read_raw_into(
     mem: &mut PhysicalMemoryObj,
-    addr: PhysicalAddress,
+    addr: CPhysicalAddress,
     out: *mut u8,
     len: usize,
 ) -> i32 {
-    mem.phys_read_raw_into(addr, from_raw_parts_mut(out, len))
+    mem.phys_read_raw_into(addr.into(), from_c_array_mut(out, len))
         .int_result()
 }
 
 /// Read a single 32-bit value from a provided `PhysicalAddress`
 #[no_mangle]
-pub extern "C" fn phys_read_u32(mem: &mut PhysicalMemoryObj, addr: PhysicalAddress) -> u32 {
-    mem.phys_read::<u32>(addr).unwrap_or_default()
+pub extern "C" fn phys_read_u32(mem: &mut PhysicalMemoryObj, addr: CPhysicalAddress) -> u32 {
+    mem.phys_read::<u32>(addr.into()).unwrap_or_default()
 }
 
 /// Read a single 64-bit value from a provided `PhysicalAddress`
 #[no_mangle]
-pub extern "C" fn phys_read_u64(mem: &mut PhysicalMemoryObj, addr: PhysicalAddress) -> u64 {
-    mem.phys_read::<u64>(addr).unwrap_or_default()
+pub extern "C" fn phys_read_u64(mem: &mut PhysicalMemoryObj, addr: CPhysicalAddress) -> u64 {
+    mem.phys_read::<u64>(addr.into()).unwrap_or_default()
 }
 
 /// Write a single value from `input` into a provided `PhysicalAddress`
@@ -117,11 +143,11 @@ pub extern "C" fn phys_read_u64(mem: &mut PhysicalMemoryObj, addr: PhysicalAddre
 #[no_mangle]
 pub unsafe extern "C" fn phys_write_raw(
     mem: &mut PhysicalMemoryObj,
-    addr: PhysicalAddress,
+    addr: CPhysicalAddress,
     input: *const u8,
     len: usize,
 ) -> i32 {
-    mem.phys_write_raw(addr, from_raw_parts(input, len))
+    mem.phys_write_raw(addr.into(), from_c_array(input, len))
         .int_result()
 }
 
@@ -129,18 +155,18 @@ pub unsafe extern "C" fn phys_write_raw(
 #[no_mangle]
 pub extern "C" fn phys_write_u32(
     mem: &mut PhysicalMemoryObj,
-    addr: PhysicalAddress,
+    addr: CPhysicalAddress,
     val: u32,
 ) -> i32 {
-    mem.phys_write(addr, &val).int_result()
+    mem.phys_write(addr.into(), &val).int_result()
 }
 
 /// Write a single 64-bit value into a provided `PhysicalAddress`
 #[no_mangle]
 pub extern "C" fn phys_write_u64(
     mem: &mut PhysicalMemoryObj,
-    addr: PhysicalAddress,
+    addr: CPhysicalAddress,
     val: u64,
 ) -> i32 {
-    mem.phys_write(addr, &val).int_result()
+    mem.phys_write(addr.into(), &val).int_result()
 }
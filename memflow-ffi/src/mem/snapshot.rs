@@ -0,0 +1,139 @@
+use memflow::error::PartialResultExt;
+use memflow::mem::snapshot::{SnapshotPublisher, SnapshotReader};
+use memflow::types::Address;
+
+use super::virt_mem::VirtualMemoryObj;
+use crate::util::*;
+
+use std::ffi::CStr;
+use std::os::raw::c_char;
+
+/// A region registered with `snapshot_publisher_create`
+#[repr(C)]
+pub struct SnapshotRegionDesc {
+    pub name: *const c_char,
+    pub address: Address,
+    pub size: usize,
+}
+
+/// Create a snapshot publisher with the shared segment `name`
+///
+/// The regions are published in the order of `regions`, readers can look them up by name.
+///
+/// # Safety
+///
+/// `name` must be a valid null terminated string, `regions` must be a valid array of
+/// `SnapshotRegionDesc` with the length of at least `len`, each with a valid null terminated
+/// name.
+#[no_mangle]
+pub unsafe extern "C" fn snapshot_publisher_create(
+    name: *const c_char,
+    regions: *const SnapshotRegionDesc,
+    len: usize,
+) -> Option<&'static mut SnapshotPublisher> {
+    let name = CStr::from_ptr(name).to_string_lossy();
+    let regions: &[SnapshotRegionDesc] = from_c_array(regions, len);
+
+    regions
+        .iter()
+        .fold(SnapshotPublisher::builder(), |builder, r| {
+            builder.region(&CStr::from_ptr(r.name).to_string_lossy(), r.address, r.size)
+        })
+        .create(&name)
+        .map_err(inspect_err)
+        .ok()
+        .map(to_heap)
+}
+
+/// Read all regions from `mem` and publish them
+///
+/// Partially read regions are published as well, with the unread parts zeroed.
+#[no_mangle]
+pub extern "C" fn snapshot_publish(
+    publisher: &mut SnapshotPublisher,
+    mem: &mut VirtualMemoryObj,
+) -> i32 {
+    publisher.publish(mem).data_part().int_result()
+}
+
+/// Free a snapshot publisher and remove its shared segment
+///
+/// # Safety
+///
+/// `publisher` must be a valid publisher created with `snapshot_publisher_create`.
+#[no_mangle]
+pub unsafe extern "C" fn snapshot_publisher_free(publisher: &'static mut SnapshotPublisher) {
+    let _ = Box::from_raw(publisher);
+}
+
+/// Open the shared segment `name` of a snapshot publisher
+///
+/// # Safety
+///
+/// `name` must be a valid null terminated string
+#[no_mangle]
+pub unsafe extern "C" fn snapshot_reader_open(
+    name: *const c_char,
+) -> Option<&'static mut SnapshotReader> {
+    let name = CStr::from_ptr(name).to_string_lossy();
+    SnapshotReader::open(&name)
+        .map_err(inspect_err)
+        .ok()
+        .map(to_heap)
+}
+
+/// Find the index of the region called `name`, -1 if there is none
+///
+/// # Safety
+///
+/// `name` must be a valid null terminated string
+#[no_mangle]
+pub unsafe extern "C" fn snapshot_reader_find_region(
+    reader: &SnapshotReader,
+    name: *const c_char,
+) -> i32 {
+    let name = CStr::from_ptr(name).to_string_lossy();
+    reader
+        .find_region(&name)
+        .map(|idx| idx as i32)
+        .unwrap_or(-1)
+}
+
+/// Returns the generation of the latest publication, 0 if nothing was published yet
+#[no_mangle]
+pub extern "C" fn snapshot_reader_generation(reader: &SnapshotReader) -> u64 {
+    reader.generation()
+}
+
+/// Copy the latest consistent version of the region at `idx` into `out`
+///
+/// Returns the generation of the copied data, or 0 if no consistent copy could be made.
+///
+/// # Safety
+///
+/// `out` must be a valid buffer of at least `len` bytes
+#[no_mangle]
+pub unsafe extern "C" fn snapshot_read_region(
+    reader: &SnapshotReader,
+    idx: usize,
+    out: *mut u8,
+    len: usize,
+) -> u64 {
+    if len == 0 {
+        return reader.generation();
+    }
+
+    reader
+        .read_region(idx, from_c_array_mut(out, len))
+        .unwrap_or(0)
+}
+
+/// Free a snapshot reader
+///
+/// # Safety
+///
+/// `reader` must be a valid reader created with `snapshot_reader_open`.
+#[no_mangle]
+pub unsafe extern "C" fn snapshot_reader_free(reader: &'static mut SnapshotReader) {
+    let _ = Box::from_raw(reader);
+}
@@ -0,0 +1,244 @@
+use memflow::error::PartialResultExt;
+use memflow::mem::virt_mem::*;
+use memflow::types::Address;
+
+use super::virt_mem::VirtualMemoryObj;
+use crate::util::*;
+
+use std::ffi::c_void;
+use std::sync::{Arc, Condvar, Mutex};
+use std::thread::{self, JoinHandle};
+use std::time::Duration;
+
+use log::trace;
+
+/// A read submitted to a `VirtualAsyncReader`
+///
+/// `user_data` is handed back unchanged in the matching `VirtualAsyncCompletion`.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct VirtualAsyncEntry {
+    pub addr: Address,
+    pub out: *mut u8,
+    pub len: usize,
+    pub user_data: *mut c_void,
+}
+
+/// A finished read of a `VirtualAsyncReader`
+///
+/// `status` is the result of the list read the entry was part of. Parts that could not be read
+/// are zeroed.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct VirtualAsyncCompletion {
+    pub user_data: *mut c_void,
+    pub status: i32,
+}
+
+// The buffers are only touched by the worker thread until the read completes.
+unsafe impl Send for VirtualAsyncEntry {}
+unsafe impl Send for VirtualAsyncCompletion {}
+
+#[derive(Default)]
+struct State {
+    pending: Vec<VirtualAsyncEntry>,
+    completions: Vec<VirtualAsyncCompletion>,
+    shutdown: bool,
+}
+
+#[derive(Default)]
+struct Shared {
+    state: Mutex<State>,
+    submitted: Condvar,
+    completed: Condvar,
+}
+
+/// Performs virtual memory reads on a worker thread
+///
+/// Everything that is submitted while the worker is busy gets merged into a single list read,
+/// so many outstanding reads of different callers cost one round trip to the connector.
+///
+/// The worker owns the memory object it reads from, it is dropped when the reader is freed.
+pub struct VirtualAsyncReader {
+    shared: Arc<Shared>,
+    worker: Option<JoinHandle<()>>,
+}
+
+impl VirtualAsyncReader {
+    /// Moves `mem` onto a new worker thread.
+    pub fn new<M: VirtualMemory + 'static>(mem: M) -> Self {
+        let shared = Arc::new(Shared::default());
+        let worker_shared = shared.clone();
+        let worker = thread::spawn(move || Self::work(&worker_shared, mem));
+
+        Self {
+            shared,
+            worker: Some(worker),
+        }
+    }
+
+    fn work<M: VirtualMemory>(shared: &Shared, mut mem: M) {
+        let mut batch = Vec::new();
+
+        loop {
+            {
+                let mut state = shared.state.lock().unwrap();
+                while state.pending.is_empty() && !state.shutdown {
+                    state = shared.submitted.wait(state).unwrap();
+                }
+                if state.shutdown {
+                    return;
+                }
+                std::mem::swap(&mut batch, &mut state.pending);
+            }
+
+            trace!("virt_async: reading {} entries", batch.len());
+
+            let status = {
+                let mut list = batch
+                    .iter()
+                    .map(|e| VirtualReadData(e.addr, unsafe { from_c_array_mut(e.out, e.len) }))
+                    .collect::<Vec<_>>();
+                mem.virt_read_raw_list(&mut list).data_part().int_result()
+            };
+
+            let mut state = shared.state.lock().unwrap();
+            state
+                .completions
+                .extend(batch.drain(..).map(|e| VirtualAsyncCompletion {
+                    user_data: e.user_data,
+                    status,
+                }));
+            shared.completed.notify_all();
+        }
+    }
+
+    fn take_completions(state: &mut State, out: &mut [VirtualAsyncCompletion]) -> usize {
+        let count = std::cmp::min(out.len(), state.completions.len());
+        for (o, c) in out.iter_mut().zip(state.completions.drain(..count)) {
+            *o = c;
+        }
+        count
+    }
+}
+
+impl Drop for VirtualAsyncReader {
+    fn drop(&mut self) {
+        self.shared.state.lock().unwrap().shutdown = true;
+        self.shared.submitted.notify_all();
+        if let Some(worker) = self.worker.take() {
+            let _ = worker.join();
+        }
+    }
+}
+
+/// Create an asynchronous reader from a virtual memory object
+///
+/// This takes ownership of `mem`, it must not be used or freed afterwards. It is freed together
+/// with the reader.
+///
+/// A virtual memory object only refers to the memory of the object it was taken from (for
+/// instance a process). The worker thread reads through it without any synchronization, so
+/// that object must neither be used nor freed until the reader has been freed. Prefer the
+/// constructors that give the reader its own copy, like `process_virt_async`.
+///
+/// # Safety
+///
+/// `mem` must be a valid virtual memory object that was created using one of the provided
+/// functions. The object it was taken from must not be used until the reader is freed.
+#[no_mangle]
+pub unsafe extern "C" fn virt_async_new(
+    mem: &'static mut VirtualMemoryObj,
+) -> &'static mut VirtualAsyncReader {
+    to_heap(VirtualAsyncReader::new(Box::from_raw(mem)))
+}
+
+/// Free an asynchronous reader
+///
+/// Reads that did not complete yet are dropped, their buffers are not written to afterwards.
+///
+/// # Safety
+///
+/// `reader` must be a valid reader created with `virt_async_new`.
+#[no_mangle]
+pub unsafe extern "C" fn virt_async_free(reader: &'static mut VirtualAsyncReader) {
+    let _ = Box::from_raw(reader);
+}
+
+/// Submit a list of reads without waiting for them
+///
+/// All reads submitted until the worker picks them up are performed as a single list read.
+///
+/// # Safety
+///
+/// `data` must be a valid array of `VirtualAsyncEntry` with the length of at least `len`, and
+/// every entry must point to a buffer of at least its `len` size, which stays valid until the
+/// completion of the entry has been retrieved.
+#[no_mangle]
+pub unsafe extern "C" fn virt_async_submit(
+    reader: &mut VirtualAsyncReader,
+    data: *const VirtualAsyncEntry,
+    len: usize,
+) -> i32 {
+    if len == 0 {
+        return 0;
+    }
+
+    let data = from_c_array(data, len);
+    let mut state = reader.shared.state.lock().unwrap();
+    state.pending.extend_from_slice(data);
+    reader.shared.submitted.notify_one();
+    0
+}
+
+/// Retrieve up to `max_len` completed reads without blocking
+///
+/// Returns the number of completions written into `out`.
+///
+/// # Safety
+///
+/// `out` must be a valid array of `VirtualAsyncCompletion` with the length of at least `max_len`
+#[no_mangle]
+pub unsafe extern "C" fn virt_async_poll(
+    reader: &mut VirtualAsyncReader,
+    out: *mut VirtualAsyncCompletion,
+    max_len: usize,
+) -> usize {
+    if max_len == 0 {
+        return 0;
+    }
+
+    let out = from_c_array_mut(out, max_len);
+    let mut state = reader.shared.state.lock().unwrap();
+    VirtualAsyncReader::take_completions(&mut state, out)
+}
+
+/// Retrieve up to `max_len` completed reads, waiting up to `timeout_ms` for the first one
+///
+/// Returns the number of completions written into `out`, 0 if the timeout expired.
+///
+/// # Safety
+///
+/// `out` must be a valid array of `VirtualAsyncCompletion` with the length of at least `max_len`
+#[no_mangle]
+pub unsafe extern "C" fn virt_async_wait(
+    reader: &mut VirtualAsyncReader,
+    out: *mut VirtualAsyncCompletion,
+    max_len: usize,
+    timeout_ms: u64,
+) -> usize {
+    if max_len == 0 {
+        return 0;
+    }
+
+    let out = from_c_array_mut(out, max_len);
+    let state = reader.shared.state.lock().unwrap();
+    let (mut state, _) = reader
+        .shared
+        .completed
+        .wait_timeout_while(state, Duration::from_millis(timeout_ms), |state| {
+            state.completions.is_empty()
+        })
+        .unwrap();
+    VirtualAsyncReader::take_completions(&mut state, out)
+}
@@ -1,10 +1,13 @@
 use memflow::error::PartialResultExt;
 use memflow::mem::virt_mem::*;
+use memflow::mem::MemoryUsage;
 use memflow::types::Address;
 
+use super::{write_memory_usage, MemoryUsageEntry};
+
 use crate::util::*;
 
-use std::slice::{from_raw_parts, from_raw_parts_mut};
+use smallvec::SmallVec;
 
 pub type VirtualMemoryObj = &'static mut dyn VirtualMemory;
 
@@ -35,10 +38,59 @@ pub unsafe extern "C" fn virt_read_raw_list(
     data: *mut VirtualReadData,
     len: usize,
 ) -> i32 {
-    let data = from_raw_parts_mut(data, len);
+    let data = from_c_array_mut(data, len);
     mem.virt_read_raw_list(data).data_part().int_result()
 }
 
+/// A single read of a list, in plain C layout
+///
+/// Unlike `VirtualReadData` this can be filled in from C and C++ directly.
+#[repr(C)]
+pub struct VirtualReadEntry {
+    pub addr: Address,
+    pub out: *mut u8,
+    pub len: usize,
+}
+
+/// Read a list of values described by `VirtualReadEntry` elements
+///
+/// This behaves like `virt_read_raw_list`. Parts that could not be read are left zeroed.
+///
+/// # Safety
+///
+/// `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`, and
+/// every entry must point to a valid buffer of at least its `len` size.
+#[no_mangle]
+pub unsafe extern "C" fn virt_read_entries(
+    mem: &mut VirtualMemoryObj,
+    data: *const VirtualReadEntry,
+    len: usize,
+) -> i32 {
+    with_read_entries(data, len, |list| {
+        mem.virt_read_raw_list(list).data_part().int_result()
+    })
+}
+
+/// Converts the `VirtualReadEntry` array `data` into a `VirtualReadData` list for `func`.
+///
+/// Short lists are kept on the stack, so small reads do not allocate.
+///
+/// # Safety
+///
+/// `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`, and
+/// every entry must point to a valid buffer of at least its `len` size.
+pub unsafe fn with_read_entries<R, F: FnOnce(&mut [VirtualReadData]) -> R>(
+    data: *const VirtualReadEntry,
+    len: usize,
+    func: F,
+) -> R {
+    let mut list = from_c_array(data, len)
+        .iter()
+        .map(|entry| VirtualReadData(entry.addr, from_c_array_mut(entry.out, entry.len)))
+        .collect::<SmallVec<[_; 32]>>();
+    func(&mut list)
+}
+
 /// Write a list of values
 ///
 /// This will perform `len` virtual memory writes on the provided `data`. Using lists is preferable
@@ -54,7 +106,7 @@ pub unsafe extern "C" fn virt_write_raw_list(
     data: *const VirtualWriteData,
     len: usize,
 ) -> i32 {
-    let data = from_raw_parts(data, len);
+    let data = from_c_array(data, len);
     mem.virt_write_raw_list(data).data_part().int_result()
 }
 
@@ -70,11 +122,36 @@ pub unsafe extern "C" fn virt_read_raw_into(
     out: *mut u8,
     len: usize,
 ) -> i32 {
-    mem.virt_read_raw_into(addr, from_raw_parts_mut(out, len))
+    mem.virt_read_raw_into(addr, from_c_array_mut(out, len))
         .data_part()
         .int_result()
 }
 
+/// Retrieve the memory held by the virtual memory object and the layers it wraps
+///
+/// Up to `max_len` components are written into `out`. The total number of components is
+/// returned, if it is larger than `max_len` the call can be repeated with a larger buffer.
+///
+/// # Safety
+///
+/// `out` must be a valid array of `MemoryUsageEntry` with the length of at least `max_len`
+#[no_mangle]
+pub unsafe extern "C" fn virt_memory_usage(
+    mem: &VirtualMemoryObj,
+    out: *mut MemoryUsageEntry,
+    max_len: usize,
+) -> usize {
+    let mut usage = MemoryUsage::new();
+    mem.memory_usage(&mut usage);
+    write_memory_usage(&usage, out, max_len)
+}
+
+/// Release memory of the virtual memory object that is not needed right now
+#[no_mangle]
+pub extern "C" fn virt_shrink_memory(mem: &mut VirtualMemoryObj) {
+    mem.shrink_memory()
+}
+
 /// Read a single 32-bit value from a provided `Address`
 #[no_mangle]
 pub extern "C" fn virt_read_u32(mem: &mut VirtualMemoryObj, addr: Address) -> u32 {
@@ -99,7 +176,7 @@ pub unsafe extern "C" fn virt_write_raw(
     input: *const u8,
     len: usize,
 ) -> i32 {
-    mem.virt_write_raw(addr, from_raw_parts(input, len))
+    mem.virt_write_raw(addr, from_c_array(input, len))
         .data_part()
         .int_result()
 }
@@ -1,7 +1,6 @@
 use crate::util::*;
 use memflow::process::*;
 use std::os::raw::c_char;
-use std::slice::from_raw_parts_mut;
 
 use memflow::architecture::ArchitectureObj;
 use memflow::types::Address;
@@ -32,13 +31,7 @@ pub unsafe extern "C" fn os_process_info_name(
     out: *mut c_char,
     max_len: usize,
 ) -> usize {
-    let name = obj.name();
-    let name_bytes = name.as_bytes();
-    let out_bytes = from_raw_parts_mut(out as *mut u8, std::cmp::min(max_len, name.len() + 1));
-    let len = out_bytes.len();
-    out_bytes[..(len - 1)].copy_from_slice(&name_bytes[..(len - 1)]);
-    *out_bytes.iter_mut().last().unwrap() = 0;
-    len
+    write_cstr(obj.name(), out, max_len)
 }
 
 #[no_mangle]
@@ -98,13 +91,7 @@ pub unsafe extern "C" fn os_process_module_name(
     out: *mut c_char,
     max_len: usize,
 ) -> usize {
-    let name = obj.name();
-    let name_bytes = name.as_bytes();
-    let out_bytes = from_raw_parts_mut(out as *mut u8, std::cmp::min(max_len, name.len() + 1));
-    let len = out_bytes.len();
-    out_bytes[..(len - 1)].copy_from_slice(&name_bytes[..(len - 1)]);
-    *out_bytes.iter_mut().last().unwrap() = 0;
-    len
+    write_cstr(obj.name(), out, max_len)
 }
 
 /// Free a OsProcessModuleInfoObj reference
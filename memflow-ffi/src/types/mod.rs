@@ -1,9 +1,62 @@
-use memflow::types::{Address, PhysicalAddress};
+use memflow::types::{Address, PageType, PhysicalAddress};
+
+/// A physical address with information about its containing page, as passed through the C API
+///
+/// memflow packs the page information of a `PhysicalAddress` into the low bits of the address.
+/// That representation is kept out of the C API, physical addresses are converted from and to
+/// this structure at the boundary. Use `addr_to_paddr` to create one from an `Address`.
+///
+/// A `page_size_log2` of 0 means that no page information is attached.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct CPhysicalAddress {
+    pub address: Address,
+    pub page_type: PageType,
+    pub page_size_log2: u8,
+}
+
+impl From<PhysicalAddress> for CPhysicalAddress {
+    fn from(address: PhysicalAddress) -> Self {
+        Self {
+            address: address.address(),
+            page_type: address.page_type(),
+            page_size_log2: if address.has_page() {
+                (address.page_size().trailing_zeros() - 1) as u8
+            } else {
+                0
+            },
+        }
+    }
+}
+
+impl From<CPhysicalAddress> for PhysicalAddress {
+    fn from(address: CPhysicalAddress) -> Self {
+        if address.page_size_log2 == 0 {
+            PhysicalAddress::from(address.address)
+        } else {
+            // the page size has to fit into a usize
+            let max_log2 = (std::mem::size_of::<usize>() * 8 - 2) as u8;
+            PhysicalAddress::with_page(
+                address.address,
+                address.page_type,
+                2 << address.page_size_log2.min(max_log2),
+            )
+        }
+    }
+}
 
 /// Helper to convert `Address` to a `PhysicalAddress`
 ///
 /// This will create a `PhysicalAddress` with `UNKNOWN` PageType.
 #[no_mangle]
-pub extern "C" fn addr_to_paddr(address: Address) -> PhysicalAddress {
-    address.into()
+pub extern "C" fn addr_to_paddr(address: Address) -> CPhysicalAddress {
+    PhysicalAddress::from(address).into()
+}
+
+/// Helper to convert `PhysicalAddress` back to an `Address`
+///
+/// This strips the page information of the `PhysicalAddress`.
+#[no_mangle]
+pub extern "C" fn paddr_to_addr(address: CPhysicalAddress) -> Address {
+    address.address
 }
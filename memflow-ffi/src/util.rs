@@ -1,4 +1,5 @@
 use log::error;
+use std::os::raw::c_char;
 
 pub fn inspect_err<E: std::fmt::Display>(e: E) -> E {
     error!("{}", e);
@@ -9,6 +10,57 @@ pub fn to_heap<T>(a: T) -> &'static mut T {
     Box::leak(Box::new(a))
 }
 
+/// Creates a slice from the C array `data`
+///
+/// Unlike `std::slice::from_raw_parts` this accepts a null or dangling `data` pointer
+/// if `len` is 0, as C callers commonly pass for empty arrays.
+///
+/// # Safety
+///
+/// `data` must be a valid array with the length of at least `len`, unless `len` is 0
+pub unsafe fn from_c_array<'a, T>(data: *const T, len: usize) -> &'a [T] {
+    if len == 0 {
+        &[]
+    } else {
+        std::slice::from_raw_parts(data, len)
+    }
+}
+
+/// Creates a mutable slice from the C array `data`
+///
+/// See `from_c_array`.
+///
+/// # Safety
+///
+/// `data` must be a valid array with the length of at least `len`, unless `len` is 0
+pub unsafe fn from_c_array_mut<'a, T>(data: *mut T, len: usize) -> &'a mut [T] {
+    if len == 0 {
+        &mut []
+    } else {
+        std::slice::from_raw_parts_mut(data, len)
+    }
+}
+
+/// Copies `s` into the C string buffer `out`
+///
+/// This will copy at most `max_len` characters (including the null terminator) and returns the
+/// number of characters written.
+///
+/// # Safety
+///
+/// `out` must be a buffer with at least `max_len` size
+pub unsafe fn write_cstr(s: &str, out: *mut c_char, max_len: usize) -> usize {
+    if max_len == 0 {
+        return 0;
+    }
+
+    let len = std::cmp::min(max_len, s.len() + 1);
+    let out_bytes = std::slice::from_raw_parts_mut(out as *mut u8, len);
+    out_bytes[..(len - 1)].copy_from_slice(&s.as_bytes()[..(len - 1)]);
+    out_bytes[len - 1] = 0;
+    len
+}
+
 pub trait ToIntResult {
     fn int_result(self) -> i32;
 
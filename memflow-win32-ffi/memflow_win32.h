@@ -9,12 +9,22 @@
 
 typedef struct Kernel_FFIMemory__FFIVirtualTranslate Kernel_FFIMemory__FFIVirtualTranslate;
 
+typedef struct Kernel_FileMemory__FFIVirtualTranslate Kernel_FileMemory__FFIVirtualTranslate;
+
+typedef struct Kernel_MmapMemory__FFIVirtualTranslate Kernel_MmapMemory__FFIVirtualTranslate;
+
 typedef struct Win32ModuleInfo Win32ModuleInfo;
 
+typedef struct Win32ProcessEntry Win32ProcessEntry;
+
 typedef struct Win32ProcessInfo Win32ProcessInfo;
 
 typedef struct Win32Process_FFIVirtualMemory Win32Process_FFIVirtualMemory;
 
+typedef struct Win32Process_FileVirtualMemory Win32Process_FileVirtualMemory;
+
+typedef struct Win32Process_MmapVirtualMemory Win32Process_MmapVirtualMemory;
+
 typedef Kernel_FFIMemory__FFIVirtualTranslate Kernel;
 
 typedef struct StartBlock {
@@ -33,8 +43,53 @@ typedef struct Win32Version {
  */
 typedef uint32_t PID;
 
+/**
+ * Selects the fields of a `Win32ProcessEntry` that are read from its `_EPROCESS`.
+ */
+typedef uint32_t Win32ProcessFields;
+/**
+ * _EPROCESS::UniqueProcessId
+ */
+#define Win32ProcessFields_PID (uint32_t)1
+/**
+ * _EPROCESS::ImageFileName
+ */
+#define Win32ProcessFields_NAME (uint32_t)2
+/**
+ * _KPROCESS::DirectoryTableBase
+ */
+#define Win32ProcessFields_DTB (uint32_t)4
+/**
+ * _EPROCESS::WoW64Process
+ */
+#define Win32ProcessFields_WOW64 (uint32_t)8
+/**
+ * _EPROCESS::Peb
+ */
+#define Win32ProcessFields_PEB (uint32_t)16
+/**
+ * _EPROCESS::SectionBaseAddress
+ */
+#define Win32ProcessFields_SECTION_BASE (uint32_t)32
+/**
+ * _EPROCESS::ExitStatus
+ */
+#define Win32ProcessFields_EXIT_STATUS (uint32_t)64
+/**
+ * The first _ETHREAD of _EPROCESS::ThreadListHead
+ */
+#define Win32ProcessFields_ETHREAD (uint32_t)128
+
 typedef Win32Process_FFIVirtualMemory Win32Process;
 
+typedef Kernel_MmapMemory__FFIVirtualTranslate MmapKernel;
+
+typedef Win32Process_MmapVirtualMemory MmapProcess;
+
+typedef Kernel_FileMemory__FFIVirtualTranslate FileKernel;
+
+typedef Win32Process_FileVirtualMemory FileProcess;
+
 typedef struct Win32ArchOffsets {
     uintptr_t peb_ldr;
     uintptr_t ldr_list;
@@ -115,6 +170,23 @@ Win32Version kernel_winver(const Kernel *kernel);
 
 Win32Version kernel_winver_unmasked(const Kernel *kernel);
 
+/**
+ * Retrieve the memory held by the kernel object, its caches and its memory object
+ *
+ * Up to `max_len` components are written into `out`. The total number of components is
+ * returned, if it is larger than `max_len` the call can be repeated with a larger buffer.
+ *
+ * # Safety
+ *
+ * `out` must be a valid array of `MemoryUsageEntry` with the length of at least `max_len`
+ */
+uintptr_t kernel_memory_usage(const Kernel *kernel, MemoryUsageEntry *out, uintptr_t max_len);
+
+/**
+ * Release memory of the kernel object and its caches that is not needed right now
+ */
+void kernel_shrink_memory(Kernel *kernel);
+
 /**
  * Retrieve a list of peorcess addresses
  *
@@ -136,6 +208,35 @@ uintptr_t kernel_eprocess_list(Kernel *kernel, Address *buffer, uintptr_t max_si
  */
 uintptr_t kernel_process_info_list(Kernel *kernel, Win32ProcessInfo **buffer, uintptr_t max_size);
 
+/**
+ * Retrieve a list of processes with only the selected fields read
+ *
+ * This will fill `buffer` with a list of win32 process entries. These entries will need to be
+ * individually freed with `process_entry_free`
+ *
+ * # Safety
+ *
+ * `buffer` must be a valid that can contain at least `max_size` references to `Win32ProcessEntry`.
+ */
+uintptr_t kernel_process_entry_list(Kernel *kernel,
+                                    Win32ProcessFields fields,
+                                    Win32ProcessEntry **buffer,
+                                    uintptr_t max_size);
+
+/**
+ * Read the selected fields of multiple process entries at once
+ *
+ * Only the fields that are missing in any of the entries are read, in a single batch.
+ *
+ * # Safety
+ *
+ * `entries` must be a valid buffer of `len` references to `Win32ProcessEntry`.
+ */
+int32_t kernel_process_entries_load(Kernel *kernel,
+                                    Win32ProcessEntry **entries,
+                                    uintptr_t len,
+                                    Win32ProcessFields fields);
+
 Win32ProcessInfo *kernel_kernel_process_info(Kernel *kernel);
 
 Win32ProcessInfo *kernel_process_info_from_eprocess(Kernel *kernel, Address eprocess);
@@ -204,6 +305,185 @@ OsProcessModuleInfoObj *module_info_trait(Win32ModuleInfo *info);
  */
 void module_info_free(Win32ModuleInfo *info);
 
+/**
+ * Build a kernel object on top of a raw memory dump that is mapped into memory
+ *
+ * The file at `path` is mapped read-only and treated as physical memory starting at address 0.
+ * The kernel uses the default caching parameters and has to be freed with `mmap_kernel_free`
+ * or converted into a process.
+ *
+ * # Safety
+ *
+ * `path` must be a valid null terminated string. The file must not be truncated while the
+ * kernel or any process created from it is alive.
+ */
+MmapKernel *kernel_build_mmap(const char *path);
+
+/**
+ * Free a kernel object created by `kernel_build_mmap`
+ *
+ * # Safety
+ *
+ * `kernel` must be a valid reference heap allocated by `kernel_build_mmap`.
+ */
+void mmap_kernel_free(MmapKernel *kernel);
+
+/**
+ * Create a process by looking up its name
+ *
+ * This will consume `kernel` and free it later on.
+ *
+ * # Safety
+ *
+ * `name` must be a valid null terminated string
+ *
+ * `kernel` must be a valid reference to `MmapKernel`. After the function the reference to it
+ * becomes invalid.
+ */
+MmapProcess *mmap_kernel_into_process(MmapKernel *kernel, const char *name);
+
+/**
+ * Create a process by looking up its PID
+ *
+ * This will consume `kernel` and free it later on.
+ *
+ * # Safety
+ *
+ * `kernel` must be a valid reference to `MmapKernel`. After the function the reference to it
+ * becomes invalid.
+ */
+MmapProcess *mmap_kernel_into_process_pid(MmapKernel *kernel, PID pid);
+
+/**
+ * Read a list of values from the process memory
+ *
+ * The same as `process_read_list`, for processes created from an `MmapKernel`.
+ *
+ * # Safety
+ *
+ * `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`, and
+ * every entry must point to a valid buffer of at least its `len` size.
+ */
+int32_t mmap_process_read_list(MmapProcess *process, const VirtualReadEntry *data, uintptr_t len);
+
+/**
+ * Read a single value from the process memory into `out`
+ *
+ * # Safety
+ *
+ * `out` must be a valid pointer to a data buffer of at least `len` size.
+ */
+int32_t mmap_process_read_raw_into(MmapProcess *process, Address addr, uint8_t *out, uintptr_t len);
+
+/**
+ * Read a single 32-bit value from the process memory
+ */
+uint32_t mmap_process_read_u32(MmapProcess *process, Address addr);
+
+/**
+ * Read a single 64-bit value from the process memory
+ */
+uint64_t mmap_process_read_u64(MmapProcess *process, Address addr);
+
+/**
+ * Frees the `process`
+ *
+ * # Safety
+ *
+ * `process` must be a valid heap allocated reference to a `MmapProcess` object. After the
+ * function returns, the reference becomes invalid.
+ */
+void mmap_process_free(MmapProcess *process);
+
+/**
+ * Build a kernel object on top of a raw memory dump that is read with file io
+ *
+ * The file at `path` is opened read-only and treated as physical memory starting at address 0.
+ * Prefer `kernel_build_mmap` unless the file can not be mapped. The kernel uses the default
+ * caching parameters and has to be freed with `file_kernel_free` or converted into a process.
+ *
+ * # Safety
+ *
+ * `path` must be a valid null terminated string.
+ */
+FileKernel *kernel_build_file(const char *path);
+
+/**
+ * Free a kernel object created by `kernel_build_file`
+ *
+ * # Safety
+ *
+ * `kernel` must be a valid reference heap allocated by `kernel_build_file`.
+ */
+void file_kernel_free(FileKernel *kernel);
+
+/**
+ * Create a process by looking up its name
+ *
+ * This will consume `kernel` and free it later on.
+ *
+ * # Safety
+ *
+ * `name` must be a valid null terminated string
+ *
+ * `kernel` must be a valid reference to `FileKernel`. After the function the reference to it
+ * becomes invalid.
+ */
+FileProcess *file_kernel_into_process(FileKernel *kernel, const char *name);
+
+/**
+ * Create a process by looking up its PID
+ *
+ * This will consume `kernel` and free it later on.
+ *
+ * # Safety
+ *
+ * `kernel` must be a valid reference to `FileKernel`. After the function the reference to it
+ * becomes invalid.
+ */
+FileProcess *file_kernel_into_process_pid(FileKernel *kernel, PID pid);
+
+/**
+ * Read a list of values from the process memory
+ *
+ * The same as `process_read_list`, for processes created from a `FileKernel`.
+ *
+ * # Safety
+ *
+ * `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`, and
+ * every entry must point to a valid buffer of at least its `len` size.
+ */
+int32_t file_process_read_list(FileProcess *process, const VirtualReadEntry *data, uintptr_t len);
+
+/**
+ * Read a single value from the process memory into `out`
+ *
+ * # Safety
+ *
+ * `out` must be a valid pointer to a data buffer of at least `len` size.
+ */
+int32_t file_process_read_raw_into(FileProcess *process, Address addr, uint8_t *out, uintptr_t len);
+
+/**
+ * Read a single 32-bit value from the process memory
+ */
+uint32_t file_process_read_u32(FileProcess *process, Address addr);
+
+/**
+ * Read a single 64-bit value from the process memory
+ */
+uint64_t file_process_read_u64(FileProcess *process, Address addr);
+
+/**
+ * Frees the `process`
+ *
+ * # Safety
+ *
+ * `process` must be a valid heap allocated reference to a `FileProcess` object. After the
+ * function returns, the reference becomes invalid.
+ */
+void file_process_free(FileProcess *process);
+
 /**
  * Create a process with kernel and process info
  *
@@ -223,6 +503,57 @@ Win32Process *process_with_kernel(Kernel *kernel, const Win32ProcessInfo *proc_i
  */
 VirtualMemoryObj *process_virt_mem(Win32Process *process);
 
+/**
+ * Create an asynchronous reader for the process memory
+ *
+ * The reader performs its reads on a copy of the process with its own caches, `process` can
+ * still be used and freed independently of the reader. The reader has to be freed with
+ * `virt_async_free`.
+ */
+VirtualAsyncReader *process_virt_async(const Win32Process *process);
+
+/**
+ * Read a list of values from the process memory
+ *
+ * This behaves like `virt_read_entries` on the object returned by `process_virt_mem`, but calls
+ * into the memory of the process directly, without going through a virtual memory object. Prefer
+ * it for hot loops issuing many small reads. Parts that could not be read are left zeroed.
+ *
+ * # Safety
+ *
+ * `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`, and
+ * every entry must point to a valid buffer of at least its `len` size.
+ */
+int32_t process_read_list(Win32Process *process, const VirtualReadEntry *data, uintptr_t len);
+
+/**
+ * Read a single value from the process memory into `out`
+ *
+ * # Safety
+ *
+ * `out` must be a valid pointer to a data buffer of at least `len` size.
+ */
+int32_t process_read_raw_into(Win32Process *process, Address addr, uint8_t *out, uintptr_t len);
+
+/**
+ * Read a single 32-bit value from the process memory
+ */
+uint32_t process_read_u32(Win32Process *process, Address addr);
+
+/**
+ * Read a single 64-bit value from the process memory
+ */
+uint64_t process_read_u64(Win32Process *process, Address addr);
+
+/**
+ * Write a single value from `input` into the process memory
+ *
+ * # Safety
+ *
+ * `input` must be a valid pointer to a data buffer of at least `len` size.
+ */
+int32_t process_write_raw(Win32Process *process, Address addr, const uint8_t *input, uintptr_t len);
+
 Win32Process *process_clone(const Win32Process *process);
 
 /**
@@ -279,6 +610,48 @@ Win32ModuleInfo *process_main_module_info(Win32Process *process);
  */
 Win32ModuleInfo *process_module_info(Win32Process *process, const char *name);
 
+Address process_entry_address(const Win32ProcessEntry *entry);
+
+/**
+ * Retrieve the fields of the entry that have been read so far
+ */
+Win32ProcessFields process_entry_fields(const Win32ProcessEntry *entry);
+
+PID process_entry_pid(const Win32ProcessEntry *entry);
+
+/**
+ * Retreive name of the process
+ *
+ * This will copy at most `max_len` characters (including the null terminator) into `out` of the
+ * name. If the name has not been read an empty string is returned.
+ *
+ * # Safety
+ *
+ * `out` must be a buffer with at least `max_len` size
+ */
+uintptr_t process_entry_name(const Win32ProcessEntry *entry, char *out, uintptr_t max_len);
+
+Address process_entry_dtb(const Win32ProcessEntry *entry);
+
+Address process_entry_wow64(const Win32ProcessEntry *entry);
+
+Address process_entry_peb(const Win32ProcessEntry *entry);
+
+Address process_entry_section_base(const Win32ProcessEntry *entry);
+
+int32_t process_entry_exit_status(const Win32ProcessEntry *entry);
+
+Address process_entry_ethread(const Win32ProcessEntry *entry);
+
+/**
+ * Free a process entry reference
+ *
+ * # Safety
+ *
+ * `entry` must be a valid heap allocated reference to a Win32ProcessEntry structure
+ */
+void process_entry_free(Win32ProcessEntry *entry);
+
 OsProcessInfoObj *process_info_trait(Win32ProcessInfo *info);
 
 Address process_info_dtb(const Win32ProcessInfo *info);
@@ -34,6 +34,32 @@ struct CWin32Process
 
     WRAP_FN_TYPE(CWin32ModuleInfo, process, module_info);
     WRAP_FN_TYPE(CVirtualMemory, process, virt_mem);
+#ifdef MEMFLOW_COROUTINES
+    WRAP_FN_TYPE(CAsyncVirtualMemory, process, virt_async);
+#endif
+    WRAP_FN(process, read_list);
+    WRAP_FN(process, read_raw_into);
+    WRAP_FN(process, read_u32);
+    WRAP_FN(process, read_u64);
+    WRAP_FN(process, write_raw);
+};
+
+struct CWin32ProcessEntry
+    : BindDestr<Win32ProcessEntry, process_entry_free>
+{
+    CWin32ProcessEntry(Win32ProcessEntry *entry)
+        : BindDestr(entry) {}
+
+    WRAP_FN(process_entry, address);
+    WRAP_FN(process_entry, fields);
+    WRAP_FN(process_entry, pid);
+    WRAP_FN(process_entry, name);
+    WRAP_FN(process_entry, dtb);
+    WRAP_FN(process_entry, wow64);
+    WRAP_FN(process_entry, peb);
+    WRAP_FN(process_entry, section_base);
+    WRAP_FN(process_entry, exit_status);
+    WRAP_FN(process_entry, ethread);
 };
 
 struct CWin32ProcessInfo
@@ -89,8 +115,11 @@ struct CKernel
     WRAP_FN(kernel, start_block);
     WRAP_FN(kernel, winver);
     WRAP_FN(kernel, winver_unmasked);
+    WRAP_FN(kernel, memory_usage);
+    WRAP_FN(kernel, shrink_memory);
     WRAP_FN(kernel, eprocess_list);
     WRAP_FN(kernel, process_info_list);
+    WRAP_FN(kernel, process_entry_list);
     WRAP_FN_TYPE(CWin32ProcessInfo, kernel, kernel_process_info);
     WRAP_FN_TYPE(CWin32ProcessInfo, kernel, process_info_from_eprocess);
     WRAP_FN_TYPE(CWin32ProcessInfo, kernel, process_info);
@@ -141,6 +170,27 @@ struct CKernel
     std::vector<CWin32ProcessInfo> process_info_vec() {
         return this->process_info_vec(AUTO_VEC_SIZE);
     }
+
+    // Manual process_entry_list impl
+    std::vector<CWin32ProcessEntry> process_entry_vec(Win32ProcessFields fields, size_t max_size) {
+        Win32ProcessEntry **buf = (Win32ProcessEntry **)malloc(sizeof(Win32ProcessEntry *) * max_size);
+        std::vector<CWin32ProcessEntry> ret;
+
+        if (buf) {
+            size_t size = kernel_process_entry_list(this->inner, fields, buf, max_size);
+
+            for (size_t i = 0; i < size; i++)
+                ret.push_back(CWin32ProcessEntry(buf[i]));
+
+            free(buf);
+        }
+
+        return ret;
+    }
+
+    std::vector<CWin32ProcessEntry> process_entry_vec(Win32ProcessFields fields) {
+        return this->process_entry_vec(fields, AUTO_VEC_SIZE);
+    }
 #endif
 };
 
@@ -1,11 +1,14 @@
 use memflow_ffi::mem::phys_mem::CloneablePhysicalMemoryObj;
+use memflow_ffi::mem::{write_memory_usage, MemoryUsageEntry};
 use memflow_ffi::util::*;
 use memflow_win32::kernel::Win32Version;
-use memflow_win32::win32::{kernel, Win32ProcessInfo, Win32VirtualTranslate};
+use memflow_win32::win32::{
+    kernel, Win32ProcessEntry, Win32ProcessFields, Win32ProcessInfo, Win32VirtualTranslate,
+};
 
 use memflow::mem::{
     cache::{CachedMemoryAccess, CachedVirtualTranslate, TimedCacheValidator},
-    CloneablePhysicalMemory, DirectTranslate, VirtualDMA,
+    CloneablePhysicalMemory, DirectTranslate, MemoryUsage, VirtualDMA,
 };
 
 use memflow::iter::FnExtend;
@@ -145,6 +148,31 @@ pub extern "C" fn kernel_winver_unmasked(kernel: &Kernel) -> Win32Version {
     kernel.kernel_info.kernel_winver
 }
 
+/// Retrieve the memory held by the kernel object, its caches and its memory object
+///
+/// Up to `max_len` components are written into `out`. The total number of components is
+/// returned, if it is larger than `max_len` the call can be repeated with a larger buffer.
+///
+/// # Safety
+///
+/// `out` must be a valid array of `MemoryUsageEntry` with the length of at least `max_len`
+#[no_mangle]
+pub unsafe extern "C" fn kernel_memory_usage(
+    kernel: &Kernel,
+    out: *mut MemoryUsageEntry,
+    max_len: usize,
+) -> usize {
+    let mut usage = MemoryUsage::new();
+    kernel.memory_usage(&mut usage);
+    write_memory_usage(&usage, out, max_len)
+}
+
+/// Release memory of the kernel object and its caches that is not needed right now
+#[no_mangle]
+pub extern "C" fn kernel_shrink_memory(kernel: &mut Kernel) {
+    kernel.shrink_memory()
+}
+
 /// Retrieve a list of peorcess addresses
 ///
 /// # Safety
@@ -158,7 +186,7 @@ pub unsafe extern "C" fn kernel_eprocess_list(
 ) -> usize {
     let mut ret = 0;
 
-    let buffer = std::slice::from_raw_parts_mut(buffer, max_size);
+    let buffer = from_c_array_mut(buffer, max_size);
 
     let mut extend_fn = FnExtend::new(|addr| {
         if ret < max_size {
@@ -191,7 +219,7 @@ pub unsafe extern "C" fn kernel_process_info_list(
 ) -> usize {
     let mut ret = 0;
 
-    let buffer = std::slice::from_raw_parts_mut(buffer, max_size);
+    let buffer = from_c_array_mut(buffer, max_size);
 
     let mut extend_fn = FnExtend::new(|info| {
         if ret < max_size {
@@ -208,6 +236,63 @@ pub unsafe extern "C" fn kernel_process_info_list(
         .unwrap_or_default()
 }
 
+/// Retrieve a list of processes with only the selected fields read
+///
+/// This will fill `buffer` with a list of win32 process entries. These entries will need to be
+/// individually freed with `process_entry_free`
+///
+/// # Safety
+///
+/// `buffer` must be a valid that can contain at least `max_size` references to `Win32ProcessEntry`.
+#[no_mangle]
+pub unsafe extern "C" fn kernel_process_entry_list(
+    kernel: &'static mut Kernel,
+    fields: Win32ProcessFields,
+    buffer: *mut &'static mut Win32ProcessEntry,
+    max_size: usize,
+) -> usize {
+    let mut ret = 0;
+
+    let buffer = from_c_array_mut(buffer, max_size);
+
+    let mut extend_fn = FnExtend::new(|entry| {
+        if ret < max_size {
+            buffer[ret] = Box::leak(Box::new(entry));
+            ret += 1;
+        }
+    });
+
+    kernel
+        .process_entry_list_extend(fields, &mut extend_fn)
+        .map_err(inspect_err)
+        .ok()
+        .map(|_| ret)
+        .unwrap_or_default()
+}
+
+/// Read the selected fields of multiple process entries at once
+///
+/// Only the fields that are missing in any of the entries are read, in a single batch.
+///
+/// # Safety
+///
+/// `entries` must be a valid buffer of `len` references to `Win32ProcessEntry`.
+#[no_mangle]
+pub unsafe extern "C" fn kernel_process_entries_load(
+    kernel: &'static mut Kernel,
+    entries: *mut &'static mut Win32ProcessEntry,
+    len: usize,
+    fields: Win32ProcessFields,
+) -> i32 {
+    if len == 0 {
+        return 0;
+    }
+
+    kernel
+        .process_entries_load(from_c_array_mut(entries, len), fields)
+        .int_result_logged()
+}
+
 // Process info
 
 #[no_mangle]
@@ -1,4 +1,6 @@
 pub mod kernel;
 pub mod module;
+pub mod native;
 pub mod process;
+pub mod process_entry;
 pub mod process_info;
@@ -0,0 +1,368 @@
+/*!
+Entry points specialized for the connectors that are built into memflow.
+
+Kernels built through `kernel_build` reach their connector through a boxed trait object, since
+plugin connectors can only be loaded dynamically. The connectors shipped with memflow itself are
+known at compile time, so the kernels and processes built here are monomorphized over them, and
+reads through `*_process_read_*` are dispatched statically all the way down to the connector.
+
+Every kernel and process type comes with its own set of functions, objects of one type can not be
+passed to the functions of another.
+*/
+
+use super::kernel::FFIVirtualTranslate;
+
+use memflow::connector::{FileIOMemory, MMAPInfo, ReadMappedFilePhysicalMemory};
+use memflow::error::{Error, PartialResultExt, Result};
+use memflow::mem::{
+    cache::{CachedMemoryAccess, TimedCacheValidator},
+    MemoryMap, PhysicalMemory, VirtualDMA, VirtualMemory,
+};
+use memflow::process::PID;
+use memflow::types::Address;
+use memflow_ffi::mem::virt_mem::{with_read_entries, VirtualReadEntry};
+use memflow_ffi::util::*;
+use memflow_win32::win32::{self, kernel, Win32VirtualTranslate};
+
+use std::ffi::CStr;
+use std::fs::File;
+use std::os::raw::c_char;
+
+type NativeMemory<T> = CachedMemoryAccess<'static, T, TimedCacheValidator>;
+type NativeKernel<T> = kernel::Kernel<NativeMemory<T>, FFIVirtualTranslate>;
+type NativeProcess<T> =
+    win32::Win32Process<VirtualDMA<NativeMemory<T>, FFIVirtualTranslate, Win32VirtualTranslate>>;
+
+pub(crate) type MmapMemory = NativeMemory<ReadMappedFilePhysicalMemory<'static>>;
+pub(crate) type MmapVirtualMemory =
+    VirtualDMA<MmapMemory, FFIVirtualTranslate, Win32VirtualTranslate>;
+
+pub type MmapKernel = kernel::Kernel<MmapMemory, FFIVirtualTranslate>;
+pub type MmapProcess = win32::Win32Process<MmapVirtualMemory>;
+
+pub(crate) type FileMemory = NativeMemory<FileIOMemory<File>>;
+pub(crate) type FileVirtualMemory =
+    VirtualDMA<FileMemory, FFIVirtualTranslate, Win32VirtualTranslate>;
+
+pub type FileKernel = kernel::Kernel<FileMemory, FFIVirtualTranslate>;
+pub type FileProcess = win32::Win32Process<FileVirtualMemory>;
+
+/// Maps the whole file as physical memory, starting at address 0.
+fn raw_dump_map(file: &File) -> Result<MemoryMap<(Address, usize)>> {
+    let len = file
+        .metadata()
+        .map_err(|_| Error::Connector("unable to retrieve the file size"))?
+        .len();
+
+    let mut map = MemoryMap::new();
+    map.push_remap(Address::NULL, len as usize, Address::NULL);
+    Ok(map)
+}
+
+unsafe fn open_raw_dump(path: *const c_char) -> Result<(File, MemoryMap<(Address, usize)>)> {
+    let path = CStr::from_ptr(path).to_string_lossy();
+    let file = File::open(&*path).map_err(|_| Error::Connector("unable to open the file"))?;
+    let map = raw_dump_map(&file)?;
+    Ok((file, map))
+}
+
+fn build_kernel<T: PhysicalMemory + 'static>(connector: T) -> Option<&'static mut NativeKernel<T>> {
+    kernel::Kernel::builder(connector)
+        .build_default_caches()
+        .build()
+        .map_err(inspect_err)
+        .ok()
+        .map(to_heap)
+}
+
+unsafe fn into_process<T: PhysicalMemory + 'static>(
+    kernel: &'static mut NativeKernel<T>,
+    name: *const c_char,
+) -> Option<&'static mut NativeProcess<T>> {
+    let kernel = Box::from_raw(kernel);
+    let name = CStr::from_ptr(name).to_string_lossy();
+    kernel
+        .into_process(&name)
+        .map_err(inspect_err)
+        .ok()
+        .map(to_heap)
+}
+
+unsafe fn into_process_pid<T: PhysicalMemory + 'static>(
+    kernel: &'static mut NativeKernel<T>,
+    pid: PID,
+) -> Option<&'static mut NativeProcess<T>> {
+    let kernel = Box::from_raw(kernel);
+    kernel
+        .into_process_pid(pid)
+        .map_err(inspect_err)
+        .ok()
+        .map(to_heap)
+}
+
+unsafe fn read_list<V: VirtualMemory>(
+    process: &mut win32::Win32Process<V>,
+    data: *const VirtualReadEntry,
+    len: usize,
+) -> i32 {
+    with_read_entries(data, len, |list| {
+        process
+            .virt_mem
+            .virt_read_raw_list(list)
+            .data_part()
+            .int_result()
+    })
+}
+
+unsafe fn read_raw_into<V: VirtualMemory>(
+    process: &mut win32::Win32Process<V>,
+    addr: Address,
+    out: *mut u8,
+    len: usize,
+) -> i32 {
+    process
+        .virt_mem
+        .virt_read_raw_into(addr, from_c_array_mut(out, len))
+        .data_part()
+        .int_result()
+}
+
+// mmap
+
+/// Build a kernel object on top of a raw memory dump that is mapped into memory
+///
+/// The file at `path` is mapped read-only and treated as physical memory starting at address 0.
+/// The kernel uses the default caching parameters and has to be freed with `mmap_kernel_free`
+/// or converted into a process.
+///
+/// # Safety
+///
+/// `path` must be a valid null terminated string. The file must not be truncated while the
+/// kernel or any process created from it is alive.
+#[no_mangle]
+pub unsafe extern "C" fn kernel_build_mmap(path: *const c_char) -> Option<&'static mut MmapKernel> {
+    let (file, map) = open_raw_dump(path).map_err(inspect_err).ok()?;
+    let connector = MMAPInfo::try_with_filemap(file, map)
+        .map_err(inspect_err)
+        .ok()?
+        .into_connector();
+    build_kernel(connector)
+}
+
+/// Free a kernel object created by `kernel_build_mmap`
+///
+/// # Safety
+///
+/// `kernel` must be a valid reference heap allocated by `kernel_build_mmap`.
+#[no_mangle]
+pub unsafe extern "C" fn mmap_kernel_free(kernel: &'static mut MmapKernel) {
+    let _ = Box::from_raw(kernel);
+}
+
+/// Create a process by looking up its name
+///
+/// This will consume `kernel` and free it later on.
+///
+/// # Safety
+///
+/// `name` must be a valid null terminated string
+///
+/// `kernel` must be a valid reference to `MmapKernel`. After the function the reference to it
+/// becomes invalid.
+#[no_mangle]
+pub unsafe extern "C" fn mmap_kernel_into_process(
+    kernel: &'static mut MmapKernel,
+    name: *const c_char,
+) -> Option<&'static mut MmapProcess> {
+    into_process(kernel, name)
+}
+
+/// Create a process by looking up its PID
+///
+/// This will consume `kernel` and free it later on.
+///
+/// # Safety
+///
+/// `kernel` must be a valid reference to `MmapKernel`. After the function the reference to it
+/// becomes invalid.
+#[no_mangle]
+pub unsafe extern "C" fn mmap_kernel_into_process_pid(
+    kernel: &'static mut MmapKernel,
+    pid: PID,
+) -> Option<&'static mut MmapProcess> {
+    into_process_pid(kernel, pid)
+}
+
+/// Read a list of values from the process memory
+///
+/// The same as `process_read_list`, for processes created from an `MmapKernel`.
+///
+/// # Safety
+///
+/// `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`, and
+/// every entry must point to a valid buffer of at least its `len` size.
+#[no_mangle]
+pub unsafe extern "C" fn mmap_process_read_list(
+    process: &mut MmapProcess,
+    data: *const VirtualReadEntry,
+    len: usize,
+) -> i32 {
+    read_list(process, data, len)
+}
+
+/// Read a single value from the process memory into `out`
+///
+/// # Safety
+///
+/// `out` must be a valid pointer to a data buffer of at least `len` size.
+#[no_mangle]
+pub unsafe extern "C" fn mmap_process_read_raw_into(
+    process: &mut MmapProcess,
+    addr: Address,
+    out: *mut u8,
+    len: usize,
+) -> i32 {
+    read_raw_into(process, addr, out, len)
+}
+
+/// Read a single 32-bit value from the process memory
+#[no_mangle]
+pub extern "C" fn mmap_process_read_u32(process: &mut MmapProcess, addr: Address) -> u32 {
+    process.virt_mem.virt_read::<u32>(addr).unwrap_or_default()
+}
+
+/// Read a single 64-bit value from the process memory
+#[no_mangle]
+pub extern "C" fn mmap_process_read_u64(process: &mut MmapProcess, addr: Address) -> u64 {
+    process.virt_mem.virt_read::<u64>(addr).unwrap_or_default()
+}
+
+/// Frees the `process`
+///
+/// # Safety
+///
+/// `process` must be a valid heap allocated reference to a `MmapProcess` object. After the
+/// function returns, the reference becomes invalid.
+#[no_mangle]
+pub unsafe extern "C" fn mmap_process_free(process: &'static mut MmapProcess) {
+    let _ = Box::from_raw(process);
+}
+
+// file
+
+/// Build a kernel object on top of a raw memory dump that is read with file io
+///
+/// The file at `path` is opened read-only and treated as physical memory starting at address 0.
+/// Prefer `kernel_build_mmap` unless the file can not be mapped. The kernel uses the default
+/// caching parameters and has to be freed with `file_kernel_free` or converted into a process.
+///
+/// # Safety
+///
+/// `path` must be a valid null terminated string.
+#[no_mangle]
+pub unsafe extern "C" fn kernel_build_file(path: *const c_char) -> Option<&'static mut FileKernel> {
+    let (file, map) = open_raw_dump(path).map_err(inspect_err).ok()?;
+    let connector = FileIOMemory::try_with_reader(file, map)
+        .map_err(inspect_err)
+        .ok()?;
+    build_kernel(connector)
+}
+
+/// Free a kernel object created by `kernel_build_file`
+///
+/// # Safety
+///
+/// `kernel` must be a valid reference heap allocated by `kernel_build_file`.
+#[no_mangle]
+pub unsafe extern "C" fn file_kernel_free(kernel: &'static mut FileKernel) {
+    let _ = Box::from_raw(kernel);
+}
+
+/// Create a process by looking up its name
+///
+/// This will consume `kernel` and free it later on.
+///
+/// # Safety
+///
+/// `name` must be a valid null terminated string
+///
+/// `kernel` must be a valid reference to `FileKernel`. After the function the reference to it
+/// becomes invalid.
+#[no_mangle]
+pub unsafe extern "C" fn file_kernel_into_process(
+    kernel: &'static mut FileKernel,
+    name: *const c_char,
+) -> Option<&'static mut FileProcess> {
+    into_process(kernel, name)
+}
+
+/// Create a process by looking up its PID
+///
+/// This will consume `kernel` and free it later on.
+///
+/// # Safety
+///
+/// `kernel` must be a valid reference to `FileKernel`. After the function the reference to it
+/// becomes invalid.
+#[no_mangle]
+pub unsafe extern "C" fn file_kernel_into_process_pid(
+    kernel: &'static mut FileKernel,
+    pid: PID,
+) -> Option<&'static mut FileProcess> {
+    into_process_pid(kernel, pid)
+}
+
+/// Read a list of values from the process memory
+///
+/// The same as `process_read_list`, for processes created from a `FileKernel`.
+///
+/// # Safety
+///
+/// `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`, and
+/// every entry must point to a valid buffer of at least its `len` size.
+#[no_mangle]
+pub unsafe extern "C" fn file_process_read_list(
+    process: &mut FileProcess,
+    data: *const VirtualReadEntry,
+    len: usize,
+) -> i32 {
+    read_list(process, data, len)
+}
+
+/// Read a single value from the process memory into `out`
+///
+/// # Safety
+///
+/// `out` must be a valid pointer to a data buffer of at least `len` size.
+#[no_mangle]
+pub unsafe extern "C" fn file_process_read_raw_into(
+    process: &mut FileProcess,
+    addr: Address,
+    out: *mut u8,
+    len: usize,
+) -> i32 {
+    read_raw_into(process, addr, out, len)
+}
+
+/// Read a single 32-bit value from the process memory
+#[no_mangle]
+pub extern "C" fn file_process_read_u32(process: &mut FileProcess, addr: Address) -> u32 {
+    process.virt_mem.virt_read::<u32>(addr).unwrap_or_default()
+}
+
+/// Read a single 64-bit value from the process memory
+#[no_mangle]
+pub extern "C" fn file_process_read_u64(process: &mut FileProcess, addr: Address) -> u64 {
+    process.virt_mem.virt_read::<u64>(addr).unwrap_or_default()
+}
+
+/// Frees the `process`
+///
+/// # Safety
+///
+/// `process` must be a valid heap allocated reference to a `FileProcess` object. After the
+/// function returns, the reference becomes invalid.
+#[no_mangle]
+pub unsafe extern "C" fn file_process_free(process: &'static mut FileProcess) {
+    let _ = Box::from_raw(process);
+}
@@ -1,7 +1,11 @@
 use super::kernel::{FFIVirtualMemory, Kernel};
 
+use memflow::error::PartialResultExt;
 use memflow::iter::FnExtend;
-use memflow_ffi::mem::virt_mem::VirtualMemoryObj;
+use memflow::mem::VirtualMemory;
+use memflow::types::Address;
+use memflow_ffi::mem::virt_async::VirtualAsyncReader;
+use memflow_ffi::mem::virt_mem::{with_read_entries, VirtualMemoryObj, VirtualReadEntry};
 use memflow_ffi::util::*;
 use memflow_win32::win32::{self, Win32ModuleInfo, Win32ProcessInfo};
 
@@ -37,6 +41,91 @@ pub extern "C" fn process_virt_mem(
     to_heap(&mut process.virt_mem)
 }
 
+/// Create an asynchronous reader for the process memory
+///
+/// The reader performs its reads on a copy of the process with its own caches, `process` can
+/// still be used and freed independently of the reader. The reader has to be freed with
+/// `virt_async_free`.
+#[no_mangle]
+pub extern "C" fn process_virt_async(process: &Win32Process) -> &'static mut VirtualAsyncReader {
+    to_heap(VirtualAsyncReader::new(process.virt_mem.clone()))
+}
+
+/// Read a list of values from the process memory
+///
+/// This behaves like `virt_read_entries` on the object returned by `process_virt_mem`, but calls
+/// into the memory of the process directly, without going through a virtual memory object. Prefer
+/// it for hot loops issuing many small reads. Parts that could not be read are left zeroed.
+///
+/// # Safety
+///
+/// `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`, and
+/// every entry must point to a valid buffer of at least its `len` size.
+#[no_mangle]
+pub unsafe extern "C" fn process_read_list(
+    process: &mut Win32Process,
+    data: *const VirtualReadEntry,
+    len: usize,
+) -> i32 {
+    with_read_entries(data, len, |list| {
+        process
+            .virt_mem
+            .virt_read_raw_list(list)
+            .data_part()
+            .int_result()
+    })
+}
+
+/// Read a single value from the process memory into `out`
+///
+/// # Safety
+///
+/// `out` must be a valid pointer to a data buffer of at least `len` size.
+#[no_mangle]
+pub unsafe extern "C" fn process_read_raw_into(
+    process: &mut Win32Process,
+    addr: Address,
+    out: *mut u8,
+    len: usize,
+) -> i32 {
+    process
+        .virt_mem
+        .virt_read_raw_into(addr, from_c_array_mut(out, len))
+        .data_part()
+        .int_result()
+}
+
+/// Read a single 32-bit value from the process memory
+#[no_mangle]
+pub extern "C" fn process_read_u32(process: &mut Win32Process, addr: Address) -> u32 {
+    process.virt_mem.virt_read::<u32>(addr).unwrap_or_default()
+}
+
+/// Read a single 64-bit value from the process memory
+#[no_mangle]
+pub extern "C" fn process_read_u64(process: &mut Win32Process, addr: Address) -> u64 {
+    process.virt_mem.virt_read::<u64>(addr).unwrap_or_default()
+}
+
+/// Write a single value from `input` into the process memory
+///
+/// # Safety
+///
+/// `input` must be a valid pointer to a data buffer of at least `len` size.
+#[no_mangle]
+pub unsafe extern "C" fn process_write_raw(
+    process: &mut Win32Process,
+    addr: Address,
+    input: *const u8,
+    len: usize,
+) -> i32 {
+    process
+        .virt_mem
+        .virt_write_raw(addr, from_c_array(input, len))
+        .data_part()
+        .int_result()
+}
+
 #[no_mangle]
 pub extern "C" fn process_clone(process: &Win32Process) -> &'static mut Win32Process {
     to_heap((*process).clone())
@@ -70,7 +159,7 @@ pub unsafe extern "C" fn process_module_list(
 ) -> usize {
     let mut ret = 0;
 
-    let buffer = std::slice::from_raw_parts_mut(out, max_len);
+    let buffer = from_c_array_mut(out, max_len);
 
     let mut extend_fn = FnExtend::new(|info| {
         if ret < max_len {
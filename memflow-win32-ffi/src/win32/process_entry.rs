@@ -0,0 +1,79 @@
+use memflow::process::PID;
+use memflow::types::Address;
+use memflow_ffi::util::write_cstr;
+use memflow_win32::win32::{Win32ProcessEntry, Win32ProcessFields};
+
+use std::os::raw::c_char;
+
+#[no_mangle]
+pub extern "C" fn process_entry_address(entry: &Win32ProcessEntry) -> Address {
+    entry.address
+}
+
+/// Retrieve the fields of the entry that have been read so far
+#[no_mangle]
+pub extern "C" fn process_entry_fields(entry: &Win32ProcessEntry) -> Win32ProcessFields {
+    entry.fields()
+}
+
+#[no_mangle]
+pub extern "C" fn process_entry_pid(entry: &Win32ProcessEntry) -> PID {
+    entry.pid().unwrap_or_default()
+}
+
+/// Retreive name of the process
+///
+/// This will copy at most `max_len` characters (including the null terminator) into `out` of the
+/// name. If the name has not been read an empty string is returned.
+///
+/// # Safety
+///
+/// `out` must be a buffer with at least `max_len` size
+#[no_mangle]
+pub unsafe extern "C" fn process_entry_name(
+    entry: &Win32ProcessEntry,
+    out: *mut c_char,
+    max_len: usize,
+) -> usize {
+    write_cstr(entry.name().unwrap_or_default(), out, max_len)
+}
+
+#[no_mangle]
+pub extern "C" fn process_entry_dtb(entry: &Win32ProcessEntry) -> Address {
+    entry.dtb().unwrap_or_default()
+}
+
+#[no_mangle]
+pub extern "C" fn process_entry_wow64(entry: &Win32ProcessEntry) -> Address {
+    entry.wow64().unwrap_or_default()
+}
+
+#[no_mangle]
+pub extern "C" fn process_entry_peb(entry: &Win32ProcessEntry) -> Address {
+    entry.peb().unwrap_or_default()
+}
+
+#[no_mangle]
+pub extern "C" fn process_entry_section_base(entry: &Win32ProcessEntry) -> Address {
+    entry.section_base().unwrap_or_default()
+}
+
+#[no_mangle]
+pub extern "C" fn process_entry_exit_status(entry: &Win32ProcessEntry) -> i32 {
+    entry.exit_status().unwrap_or_default()
+}
+
+#[no_mangle]
+pub extern "C" fn process_entry_ethread(entry: &Win32ProcessEntry) -> Address {
+    entry.ethread().unwrap_or_default()
+}
+
+/// Free a process entry reference
+///
+/// # Safety
+///
+/// `entry` must be a valid heap allocated reference to a Win32ProcessEntry structure
+#[no_mangle]
+pub unsafe extern "C" fn process_entry_free(entry: &'static mut Win32ProcessEntry) {
+    let _ = Box::from_raw(entry);
+}
@@ -0,0 +1,77 @@
+/*!
+Serves a single connector to other local processes.
+
+The daemon initializes the kernel once, which leaves the page cache warm with the kernel
+structures, and then serves the cached physical memory on a unix socket. Clients connect with
+`DaemonConnector::connect` (or `daemon_connect` in the ffi) and use it like any other connector.
+*/
+use clap::*;
+use log::{info, Level};
+
+use memflow::connector::*;
+
+use memflow_win32::win32::Kernel;
+
+pub fn main() {
+    let matches = App::new("daemon example")
+        .version(crate_version!())
+        .author(crate_authors!())
+        .arg(Arg::with_name("verbose").short("v").multiple(true))
+        .arg(
+            Arg::with_name("connector")
+                .long("connector")
+                .short("c")
+                .takes_value(true)
+                .required(true),
+        )
+        .arg(
+            Arg::with_name("args")
+                .long("args")
+                .short("a")
+                .takes_value(true)
+                .default_value(""),
+        )
+        .arg(
+            Arg::with_name("socket")
+                .long("socket")
+                .short("s")
+                .takes_value(true)
+                .default_value("/tmp/memflow.sock"),
+        )
+        .get_matches();
+
+    // set log level
+    let level = match matches.occurrences_of("verbose") {
+        0 => Level::Error,
+        1 => Level::Warn,
+        2 => Level::Info,
+        3 => Level::Debug,
+        4 => Level::Trace,
+        _ => Level::Trace,
+    };
+    simple_logger::SimpleLogger::new()
+        .with_level(level.to_level_filter())
+        .init()
+        .unwrap();
+
+    // create inventory + connector
+    let inventory = unsafe { ConnectorInventory::scan() };
+    let connector = unsafe {
+        inventory.create_connector(
+            matches.value_of("connector").unwrap(),
+            &ConnectorArgs::parse(matches.value_of("args").unwrap()).unwrap(),
+        )
+    }
+    .unwrap();
+
+    let kernel = Kernel::builder(connector)
+        .build_default_caches()
+        .build()
+        .unwrap();
+    info!("{:?}", kernel.kernel_info);
+
+    DaemonServer::bind(matches.value_of("socket").unwrap(), kernel.phys_mem)
+        .unwrap()
+        .run()
+        .unwrap();
+}
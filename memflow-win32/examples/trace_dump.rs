@@ -0,0 +1,118 @@
+use std::fs::File;
+use std::io::{Read, Write};
+
+use clap::*;
+use log::{info, Level};
+
+use memflow::connector::*;
+use memflow::trace::{self, TraceRecord};
+
+use memflow_win32::win32::{trace_events, Kernel};
+
+fn print_records(records: &[TraceRecord]) {
+    let start = records.first().map(|r| r.timestamp).unwrap_or_default();
+
+    for record in records.iter() {
+        let name = trace_events::name(record.event)
+            .map(String::from)
+            .unwrap_or_else(|| format!("event_{:x}", record.event));
+
+        println!(
+            "{:>12} {:>3} {:<20} {:x} {:x} {:x}",
+            record.timestamp - start,
+            record.thread,
+            name,
+            record.args[0],
+            record.args[1],
+            record.args[2]
+        );
+    }
+}
+
+pub fn main() {
+    let matches = App::new("trace dump example")
+        .version(crate_version!())
+        .author(crate_authors!())
+        .arg(Arg::with_name("verbose").short("v").multiple(true))
+        .arg(
+            Arg::with_name("connector")
+                .long("connector")
+                .short("c")
+                .takes_value(true)
+                .required_unless("decode"),
+        )
+        .arg(
+            Arg::with_name("args")
+                .long("args")
+                .short("a")
+                .takes_value(true)
+                .default_value(""),
+        )
+        .arg(
+            Arg::with_name("output")
+                .long("output")
+                .short("o")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("decode")
+                .long("decode")
+                .short("d")
+                .takes_value(true)
+                .conflicts_with("connector"),
+        )
+        .get_matches();
+
+    // set log level
+    let level = match matches.occurrences_of("verbose") {
+        0 => Level::Error,
+        1 => Level::Warn,
+        2 => Level::Info,
+        3 => Level::Debug,
+        4 => Level::Trace,
+        _ => Level::Trace,
+    };
+    simple_logger::SimpleLogger::new()
+        .with_level(level.to_level_filter())
+        .init()
+        .unwrap();
+
+    // decode a previously written dump
+    if let Some(input) = matches.value_of("decode") {
+        let mut buf = Vec::new();
+        File::open(input).unwrap().read_to_end(&mut buf).unwrap();
+        print_records(&trace::decode(&buf).unwrap());
+        return;
+    }
+
+    // create inventory + connector
+    let inventory = unsafe { ConnectorInventory::scan() };
+    let connector = unsafe {
+        inventory.create_connector(
+            matches.value_of("connector").unwrap(),
+            &ConnectorArgs::parse(matches.value_of("args").unwrap()).unwrap(),
+        )
+    }
+    .unwrap();
+
+    let mut kernel = Kernel::builder(connector)
+        .build_default_caches()
+        .build()
+        .unwrap();
+
+    // trace a full process list walk
+    trace::set_enabled(true);
+    let process_list = kernel.process_info_list().unwrap();
+    trace::set_enabled(false);
+
+    info!("found {} processes", process_list.len());
+
+    let records = trace::snapshot();
+    match matches.value_of("output") {
+        Some(output) => {
+            let mut file = File::create(output).unwrap();
+            file.write_all(&trace::encode(&records)).unwrap();
+        }
+        None => print_records(&records),
+    }
+}
@@ -6,7 +6,7 @@ use std::prelude::v1::*;
 
 use crate::error::{Error, Result};
 
-use log::warn;
+use log::{trace, warn};
 
 use memflow::architecture;
 use memflow::architecture::ArchitectureObj;
@@ -22,13 +22,39 @@ pub struct StartBlock {
     pub dtb: Address,
 }
 
+/// Size of the chunks physical memory is scanned in by `find_fallback`.
+const FALLBACK_CHUNK_SIZE: usize = size::mb(16);
+
+/// Scans physical memory for a page table when the low stub is missing.
+///
+/// Memory is read in large chunks, starting at the low 16mb, until the first candidate
+/// is found or the end of physical memory is reached. Chunks that cannot be read are skipped.
 pub fn find_fallback<T: PhysicalMemory>(mem: &mut T, arch: ArchitectureObj) -> Result<StartBlock> {
     if arch == architecture::x86::x64::ARCH {
-        // read low 16mb stub
-        let mut low16m = vec![0; size::mb(16)];
-        mem.phys_read_raw_into(PhysicalAddress::NULL, &mut low16m)?;
+        let mem_size = std::cmp::max(mem.metadata().size, FALLBACK_CHUNK_SIZE);
+        let mut chunk = vec![0; FALLBACK_CHUNK_SIZE];
+
+        for base in (0..mem_size).step_by(FALLBACK_CHUNK_SIZE) {
+            // the last chunk is shorter if memory is not a multiple of the chunk size
+            let chunk = &mut chunk[..std::cmp::min(FALLBACK_CHUNK_SIZE, mem_size - base)];
+            let base = Address::from(base);
+            if let Err(e) = mem.phys_read_raw_into(base.into(), chunk) {
+                // the low 16mb have always been required
+                if base.is_null() {
+                    return Err(e.into());
+                }
+                trace!("unable to read {:x}: {}", base, e);
+                continue;
+            }
+
+            if let Some(sb) = x64::find_at(base, chunk) {
+                return Ok(sb);
+            }
+        }
 
-        x64::find(&low16m)
+        Err(Error::Initialization(
+            "unable to find x64 dtb in physical memory",
+        ))
     } else {
         Err(Error::Initialization(
             "start_block: fallback not implemented for given arch",
@@ -73,3 +99,64 @@ pub fn find<T: PhysicalMemory>(mem: &mut T, arch: Option<ArchitectureObj>) -> Re
             .map_err(|_| Error::Initialization("unable to find dtb"))
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use memflow::error::Error as MemError;
+    use memflow::mem::dummy::DummyMemory;
+    use memflow::mem::{PhysicalMemoryMetadata, PhysicalReadData, PhysicalWriteData};
+
+    /// Fails reads that reach past the end of physical memory, like most hardware connectors do.
+    struct BoundedMemory(DummyMemory);
+
+    impl PhysicalMemory for BoundedMemory {
+        fn phys_read_raw_list(
+            &mut self,
+            data: &mut [PhysicalReadData],
+        ) -> memflow::error::Result<()> {
+            let size = self.0.metadata().size;
+            if data
+                .iter()
+                .any(|PhysicalReadData(addr, buf)| addr.as_usize() + buf.len() > size)
+            {
+                return Err(MemError::Bounds);
+            }
+            self.0.phys_read_raw_list(data)
+        }
+
+        fn phys_write_raw_list(
+            &mut self,
+            data: &[PhysicalWriteData],
+        ) -> memflow::error::Result<()> {
+            self.0.phys_write_raw_list(data)
+        }
+
+        fn metadata(&self) -> PhysicalMemoryMetadata {
+            self.0.metadata()
+        }
+    }
+
+    #[test]
+    fn test_fallback_partial_chunk() {
+        // the pml4 lies in the last 8mb of memory, which is only half a chunk
+        let dtb = size::mb(20) as u64;
+        let mut entries = vec![0u64; 512];
+        entries[0] = 0x1234_5000 | 0x7;
+        entries[256..264]
+            .iter_mut()
+            .for_each(|e| *e = 0x2000_0000 | 0x63);
+        entries[0x1ed] = (1u64 << 63) | dtb | 0x63;
+        let page = entries
+            .iter()
+            .flat_map(|e| e.to_le_bytes().to_vec())
+            .collect::<Vec<_>>();
+
+        let mut mem = BoundedMemory(DummyMemory::new(size::mb(24)));
+        mem.phys_write_raw(Address::from(dtb).into(), &page)
+            .unwrap();
+
+        let sb = find_fallback(&mut mem, architecture::x86::x64::ARCH).unwrap();
+        assert_eq!(sb.dtb, Address::from(dtb));
+    }
+}
@@ -30,6 +30,72 @@ pub fn find_lowstub(stub: &[u8]) -> Result<StartBlock> {
         .ok_or_else(|| Error::Initialization("unable to find x64 dtb in lowstub < 1M"))?)
 }
 
+/// Number of kernel entries a pml4 needs to have at least.
+const MIN_KERNEL_ENTRIES: usize = 6;
+
+/// Flags of a present, writeable, accessed and dirty kernel page table entry.
+const KERNEL_ENTRY: u64 = 0x63;
+
+/// Scans the kernel half of a page table.
+///
+/// Returns whether it contains an entry pointing back to `addr` and the number of kernel entries.
+#[cfg(all(target_arch = "x86_64", target_feature = "sse2"))]
+fn scan_kernel_half(addr: Address, entries: &[u8]) -> (bool, usize) {
+    use core::arch::x86_64::*;
+
+    debug_assert_eq!(entries.len() % 16, 0);
+
+    // the nx bit is ignored for the self reference
+    let self_ref = addr.as_u64() ^ KERNEL_ENTRY;
+
+    let mut found = false;
+    let mut count = 0;
+
+    // Every 16 byte load holds two entries. SSE2 has no 64-bit equality compare, so both 32-bit
+    // halves of an entry are compared separately. movemask then yields one bit per byte, and an
+    // entry only matches if all 8 of its bits are set: bits 0-7 for the first entry and bits
+    // 8-15 for the second.
+    unsafe {
+        let self_mask = _mm_set1_epi64x(!(1u64 << 63) as i64);
+        let self_needle = _mm_set1_epi64x(self_ref as i64);
+        let flags_mask = _mm_set1_epi64x(0xff);
+        let flags_needle = _mm_set1_epi64x(KERNEL_ENTRY as i64);
+
+        for chunk in entries.chunks_exact(16) {
+            let v = _mm_loadu_si128(chunk.as_ptr() as *const __m128i);
+
+            let self_eq = _mm_cmpeq_epi32(_mm_and_si128(v, self_mask), self_needle);
+            let flags_eq = _mm_cmpeq_epi32(_mm_and_si128(v, flags_mask), flags_needle);
+
+            let self_bits = _mm_movemask_epi8(self_eq) as u32;
+            let flags_bits = _mm_movemask_epi8(flags_eq) as u32;
+
+            found |= (self_bits & 0xff) == 0xff || (self_bits >> 8) == 0xff;
+            count += ((flags_bits & 0xff) == 0xff) as usize + ((flags_bits >> 8) == 0xff) as usize;
+        }
+    }
+
+    (found, count)
+}
+
+/// Scans the kernel half of a page table.
+///
+/// Returns whether it contains an entry pointing back to `addr` and the number of kernel entries.
+#[cfg(not(all(target_arch = "x86_64", target_feature = "sse2")))]
+fn scan_kernel_half(addr: Address, entries: &[u8]) -> (bool, usize) {
+    let self_ref = addr.as_u64() ^ KERNEL_ENTRY;
+
+    entries
+        .chunks_exact(8)
+        .map(|c| u64::from_le_bytes(c.try_into().unwrap()))
+        .fold((false, 0), |(found, count), a| {
+            (
+                found || (a & !(1u64 << 63)) == self_ref,
+                count + ((a & 0xff) == KERNEL_ENTRY) as usize,
+            )
+        })
+}
+
 fn find_pt(addr: Address, mem: &[u8]) -> Option<Address> {
     // TODO: global define / config setting
     let max_mem = size::gb(512) as u64;
@@ -42,31 +108,72 @@ fn find_pt(addr: Address, mem: &[u8]) -> Option<Address> {
 
     // Second half must have a self ref entry
     // This is usually enough to filter wrong data out
-    mem[0x800..]
-        .chunks(8)
-        .map(|c| u64::from_le_bytes(c.try_into().unwrap()))
-        .find(|a| (a ^ 0x0000_0000_0000_0063) & !(1u64 << 63) == addr.as_u64())?;
-
+    //
     // A page table does need to have some entries, right? Particularly, kernel-side page table
     // entries must be marked as such
-    mem[0x800..]
-        .chunks(8)
-        .map(|c| u64::from_le_bytes(c.try_into().unwrap()))
-        .filter(|a| (a & 0xff) == 0x63)
-        .nth(5)?;
+    let (self_ref, kernel_entries) = scan_kernel_half(addr, &mem[0x800..0x1000]);
+    if !self_ref || kernel_entries < MIN_KERNEL_ENTRIES {
+        return None;
+    }
 
     Some(addr)
 }
 
-pub fn find(mem: &[u8]) -> Result<StartBlock> {
+/// Searches `mem`, which starts at the physical address `base`, for the first valid pml4.
+pub fn find_at(base: Address, mem: &[u8]) -> Option<StartBlock> {
     mem.chunks_exact(x64::ARCH.page_size())
         .enumerate()
-        .filter_map(|(i, c)| find_pt((i * x64::ARCH.page_size()).into(), c))
+        .filter_map(|(i, c)| find_pt(base + i * x64::ARCH.page_size(), c))
         .map(|addr| StartBlock {
             arch: x64::ARCH,
             kernel_hint: 0.into(),
             dtb: addr,
         })
         .next()
+}
+
+pub fn find(mem: &[u8]) -> Result<StartBlock> {
+    find_at(Address::NULL, mem)
         .ok_or_else(|| Error::Initialization("unable to find x64 dtb in lowstub < 16M"))
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn page_table(addr: u64, kernel_entries: usize, self_ref: bool) -> Vec<u8> {
+        let mut entries = vec![0u64; 512];
+        entries[0] = 0x1234_5000 | 0x7;
+        for e in entries[256..].iter_mut().take(kernel_entries) {
+            *e = 0x2000_0000 | KERNEL_ENTRY;
+        }
+        if self_ref {
+            entries[0x1ed] = (1u64 << 63) | addr | KERNEL_ENTRY;
+        }
+        entries
+            .iter()
+            .flat_map(|e| e.to_le_bytes().to_vec())
+            .collect()
+    }
+
+    #[test]
+    fn test_find_pt() {
+        let addr = Address::from(0x1a_b000);
+        assert_eq!(find_pt(addr, &page_table(0x1a_b000, 6, true)), Some(addr));
+        // the self reference counts as a kernel entry
+        assert_eq!(find_pt(addr, &page_table(0x1a_b000, 5, true)), Some(addr));
+        assert_eq!(find_pt(addr, &page_table(0x1a_b000, 4, true)), None);
+        assert_eq!(find_pt(addr, &page_table(0x1a_b000, 16, false)), None);
+        assert_eq!(find_pt(addr, &page_table(0x1a_c000, 16, true)), None);
+    }
+
+    #[test]
+    fn test_find_at() {
+        let mut mem = vec![0u8; size::mb(1)];
+        mem[0x3000..0x4000].copy_from_slice(&page_table(0x100_3000, 8, true));
+
+        let sb = find_at(Address::from(0x100_0000), &mem).unwrap();
+        assert_eq!(sb.dtb, Address::from(0x100_3000));
+        assert!(find_at(Address::NULL, &mem).is_none());
+    }
+}
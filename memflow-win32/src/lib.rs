@@ -6,6 +6,9 @@ It is used to interface with windows targets.
 #![cfg_attr(not(feature = "std"), no_std)]
 extern crate no_std_compat as std;
 
+#[macro_use]
+extern crate bitflags;
+
 pub mod error;
 
 pub mod kernel;
@@ -11,7 +11,10 @@ pub mod offset_table;
 pub use offset_table::{Win32OffsetFile, Win32OffsetTable, Win32OffsetsArchitecture};
 
 #[cfg(feature = "symstore")]
-pub use {pdb_struct::PdbStruct, symstore::*};
+pub use {
+    pdb_struct::{find_symbol_rva, PdbStruct, PdbTypeIndex, PdbTypes},
+    symstore::*,
+};
 
 use std::prelude::v1::*;
 
@@ -112,17 +115,18 @@ impl Win32Offsets {
 
     #[cfg(feature = "symstore")]
     pub fn from_pdb_slice(pdb_slice: &[u8]) -> Result<Self> {
-        let list = PdbStruct::with(pdb_slice, "_LIST_ENTRY")
-            .map_err(|_| Error::PDB("_LIST_ENTRY not found"))?;
-        let kproc = PdbStruct::with(pdb_slice, "_KPROCESS")
-            .map_err(|_| Error::PDB("_KPROCESS not found"))?;
-        let eproc = PdbStruct::with(pdb_slice, "_EPROCESS")
-            .map_err(|_| Error::PDB("_EPROCESS not found"))?;
-        let ethread =
-            PdbStruct::with(pdb_slice, "_ETHREAD").map_err(|_| Error::PDB("_ETHREAD not found"))?;
-        let kthread =
-            PdbStruct::with(pdb_slice, "_KTHREAD").map_err(|_| Error::PDB("_KTHREAD not found"))?;
-        let teb = PdbStruct::with(pdb_slice, "_TEB").map_err(|_| Error::PDB("_TEB not found"))?;
+        let types = PdbTypes::new(pdb_slice).map_err(|_| Error::PDB("unable to open pdb"))?;
+        let index = types
+            .index()
+            .map_err(|_| Error::PDB("unable to index pdb types"))?;
+        let find_struct = |name| index.find_struct(name).ok().flatten();
+
+        let list = find_struct("_LIST_ENTRY").ok_or(Error::PDB("_LIST_ENTRY not found"))?;
+        let kproc = find_struct("_KPROCESS").ok_or(Error::PDB("_KPROCESS not found"))?;
+        let eproc = find_struct("_EPROCESS").ok_or(Error::PDB("_EPROCESS not found"))?;
+        let ethread = find_struct("_ETHREAD").ok_or(Error::PDB("_ETHREAD not found"))?;
+        let kthread = find_struct("_KTHREAD").ok_or(Error::PDB("_KTHREAD not found"))?;
+        let teb = find_struct("_TEB").ok_or(Error::PDB("_TEB not found"))?;
 
         let list_blink = list
             .find_field("Blink")
@@ -185,9 +189,7 @@ impl Win32Offsets {
             .find_field("ProcessEnvironmentBlock")
             .ok_or_else(|| Error::PDB("_TEB::ProcessEnvironmentBlock not found"))?
             .offset as _;
-        let teb_peb_x86 = if let Ok(teb32) =
-            PdbStruct::with(pdb_slice, "_TEB32").map_err(|_| Error::PDB("_TEB32 not found"))
-        {
+        let teb_peb_x86 = if let Some(teb32) = find_struct("_TEB32") {
             teb32
                 .find_field("ProcessEnvironmentBlock")
                 .ok_or_else(|| Error::PDB("_TEB32::ProcessEnvironmentBlock not found"))?
@@ -196,6 +198,38 @@ impl Win32Offsets {
             0
         };
 
+        // thread contexts, these are optional and only used for sampling
+        let kthread_initial_stack = kthread
+            .find_field("InitialStack")
+            .map(|f| f.offset as _)
+            .unwrap_or_default();
+        let (ktrap_frame_ip, ktrap_frame_size) = match find_struct("_KTRAP_FRAME") {
+            Some(trap_frame) => (
+                trap_frame
+                    .find_field("Rip")
+                    .or_else(|| trap_frame.find_field("Eip"))
+                    .map(|f| f.offset as _)
+                    .unwrap_or_default(),
+                trap_frame.size() as _,
+            ),
+            None => (0, 0),
+        };
+
+        // cid table, these are optional and only used for enumerating the cid table
+        let psp_cid_table_rva = find_symbol_rva(pdb_slice, "PspCidTable")
+            .unwrap_or_else(|err| {
+                log::warn!("unable to look up PspCidTable: {}", err);
+                None
+            })
+            .unwrap_or_default();
+        let handle_table_code = find_struct("_HANDLE_TABLE")
+            .and_then(|handle_table| handle_table.find_field("TableCode").map(|f| f.offset as _))
+            .unwrap_or(u32::MAX);
+        let ethread_cid = ethread
+            .find_field("Cid")
+            .map(|f| f.offset as _)
+            .unwrap_or_default();
+
         Ok(Self {
             0: Win32OffsetTable {
                 list_blink,
@@ -215,6 +249,14 @@ impl Win32Offsets {
                 ethread_list_entry,
                 teb_peb,
                 teb_peb_x86,
+
+                kthread_initial_stack,
+                ktrap_frame_ip,
+                ktrap_frame_size,
+
+                psp_cid_table_rva,
+                handle_table_code,
+                ethread_cid,
             },
         })
     }
@@ -290,6 +332,43 @@ impl Win32Offsets {
         self.0.teb_peb_x86 as usize
     }
 
+    /// _KTHREAD::InitialStack offset
+    /// Exists since version 5.2
+    pub fn kthread_initial_stack(&self) -> usize {
+        self.0.kthread_initial_stack as usize
+    }
+    /// _KTRAP_FRAME::Rip (or _KTRAP_FRAME::Eip on x86) offset
+    /// Exists since version 5.2
+    pub fn ktrap_frame_ip(&self) -> usize {
+        self.0.ktrap_frame_ip as usize
+    }
+    /// Size of _KTRAP_FRAME
+    /// Exists since version 5.2
+    pub fn ktrap_frame_size(&self) -> usize {
+        self.0.ktrap_frame_size as usize
+    }
+
+    /// PspCidTable relative virtual address in ntoskrnl.exe
+    /// Exists since version 5.0
+    pub fn psp_cid_table_rva(&self) -> usize {
+        self.0.psp_cid_table_rva as usize
+    }
+    /// _HANDLE_TABLE::TableCode offset
+    /// Exists since version 5.0
+    ///
+    /// Returns `None` if the offset is unknown, as 0 is a valid offset up until version 6.1.
+    pub fn handle_table_code(&self) -> Option<usize> {
+        match self.0.handle_table_code {
+            u32::MAX => None,
+            offset => Some(offset as usize),
+        }
+    }
+    /// _ETHREAD::Cid offset
+    /// Exists since version 3.10
+    pub fn ethread_cid(&self) -> usize {
+        self.0.ethread_cid as usize
+    }
+
     pub fn builder() -> Win32OffsetBuilder {
         Win32OffsetBuilder::default()
     }
@@ -157,6 +157,11 @@ impl<'de> ::serde::de::Deserialize<'de> for BinaryString {
     }
 }
 
+#[cfg(feature = "serde")]
+fn missing_offset() -> u32 {
+    u32::MAX
+}
+
 #[repr(C, align(4))]
 #[derive(Debug, Clone, Pod)]
 #[cfg_attr(feature = "serde", derive(::serde::Serialize, ::serde::Deserialize))]
@@ -189,4 +194,27 @@ pub struct Win32OffsetTable {
     pub teb_peb: u32,
     /// Since version x.x
     pub teb_peb_x86: u32,
+
+    /// Since version 5.2, only required for thread sampling
+    #[cfg_attr(feature = "serde", serde(default))]
+    pub kthread_initial_stack: u32,
+    /// Since version 5.2, only required for thread sampling
+    #[cfg_attr(feature = "serde", serde(default))]
+    pub ktrap_frame_ip: u32,
+    /// Since version 5.2, only required for thread sampling
+    #[cfg_attr(feature = "serde", serde(default))]
+    pub ktrap_frame_size: u32,
+
+    /// Since version 5.0, only required for cid table enumeration
+    #[cfg_attr(feature = "serde", serde(default))]
+    pub psp_cid_table_rva: u32,
+    /// Since version 5.0, only required for cid table enumeration
+    ///
+    /// TableCode is located at offset 0 up until version 6.1,
+    /// a missing offset is therefore denoted by `u32::MAX` instead of 0.
+    #[cfg_attr(feature = "serde", serde(default = "missing_offset"))]
+    pub handle_table_code: u32,
+    /// Since version 3.10, only required for cid table enumeration
+    #[cfg_attr(feature = "serde", serde(default))]
+    pub ethread_cid: u32,
 }
@@ -6,7 +6,19 @@ use data::TypeSet;
 use std::collections::HashMap;
 use std::{fmt, io, result};
 
-use pdb::{FallibleIterator, Result, Source, SourceSlice, SourceView, TypeData, PDB};
+use pdb::{
+    FallibleIterator, Result, Source, SourceSlice, SourceView, SymbolData, TypeData, TypeFinder,
+    TypeIndex, TypeInformation, PDB,
+};
+
+// leaf kinds of class like records, see `TypeData::Class`
+const LF_CLASS: u16 = 0x1504;
+const LF_STRUCTURE: u16 = 0x1505;
+const LF_INTERFACE: u16 = 0x1519;
+const LF_CLASS_ST: u16 = 0x1004;
+const LF_STRUCTURE_ST: u16 = 0x1005;
+const LF_CLASS_16T: u16 = 0x0004;
+const LF_STRUCTURE_16T: u16 = 0x0005;
 
 #[derive(Debug, Clone, PartialEq, Eq)]
 pub struct PdbField {
@@ -17,74 +29,194 @@ pub struct PdbField {
 #[derive(Debug, Clone, PartialEq, Eq)]
 pub struct PdbStruct {
     field_map: HashMap<String, PdbField>,
+    size: usize,
 }
 
 impl PdbStruct {
+    /// Parses a single struct from a pdb file.
+    ///
+    /// This walks the type stream up to the struct, use a `PdbTypeIndex` when looking up
+    /// multiple structs of the same file.
+    /// If the struct does not exist an empty struct is returned.
     pub fn with(pdb_slice: &[u8], class_name: &str) -> Result<Self> {
+        let types = PdbTypes::new(pdb_slice)?;
+        Ok(types.find_struct(class_name)?.unwrap_or_else(|| Self {
+            field_map: HashMap::new(),
+            size: 0,
+        }))
+    }
+
+    fn from_class(class: &data::Class) -> Self {
+        let field_map = class
+            .fields
+            .iter()
+            .map(|f| {
+                (
+                    f.name.to_string().into_owned(),
+                    PdbField {
+                        type_name: f.type_name.clone(),
+                        offset: f.offset as usize,
+                    },
+                )
+            })
+            .collect();
+
+        Self {
+            field_map,
+            size: class.size,
+        }
+    }
+
+    pub fn find_field(&self, name: &str) -> Option<&PdbField> {
+        self.field_map.get(name)
+    }
+
+    /// Returns the size of the struct in bytes.
+    pub fn size(&self) -> usize {
+        self.size
+    }
+}
+
+/// The type stream of a pdb file.
+pub struct PdbTypes<'s> {
+    type_information: TypeInformation<'s>,
+}
+
+impl<'s> PdbTypes<'s> {
+    pub fn new(pdb_slice: &'s [u8]) -> Result<Self> {
         let pdb_buffer = PdbSourceBuffer::new(pdb_slice);
         let mut pdb = PDB::open(pdb_buffer)?;
-
         let type_information = pdb.type_information()?;
-        let mut type_finder = type_information.finder();
+        Ok(Self { type_information })
+    }
 
-        let mut needed_types = TypeSet::new();
-        let mut data = data::Data::new();
+    /// Walks the type stream until the struct `class_name` is found and decodes its fields.
+    ///
+    /// Forward references are skipped. Returns `None` if the struct does not exist.
+    pub fn find_struct(&self, class_name: &str) -> Result<Option<PdbStruct>> {
+        let mut type_finder = self.type_information.finder();
 
-        let mut type_iter = type_information.iter();
+        // the field list of a struct always precedes it in the stream
+        let mut type_iter = self.type_information.iter();
         while let Some(typ) = type_iter.next()? {
-            // keep building the index
             type_finder.update(&type_iter);
 
+            if !is_class_kind(typ.raw_kind()) {
+                continue;
+            }
+
             if let Ok(TypeData::Class(class)) = typ.parse() {
-                if class.name.as_bytes() == class_name.as_bytes()
-                    && !class.properties.forward_reference()
+                if !class.properties.forward_reference()
+                    && class.name.as_bytes() == class_name.as_bytes()
                 {
-                    data.add(&type_finder, typ.index(), &mut needed_types)?;
-                    break;
+                    return decode_struct(&type_finder, typ.index());
                 }
             }
         }
 
-        // add all the needed types iteratively until we're done
-        loop {
-            // get the last element in needed_types without holding an immutable borrow
-            let last = match needed_types.iter().next_back() {
-                Some(n) => Some(*n),
-                None => None,
-            };
-
-            if let Some(type_index) = last {
-                // remove it
-                needed_types.remove(&type_index);
-
-                // add the type
-                data.add(&type_finder, type_index, &mut needed_types)?;
-            } else {
-                break;
+        Ok(None)
+    }
+
+    /// Walks the type stream once and indexes all structs by their name.
+    pub fn index(&self) -> Result<PdbTypeIndex<'_>> {
+        let mut type_finder = self.type_information.finder();
+        let mut classes = HashMap::new();
+
+        let mut type_iter = self.type_information.iter();
+        while let Some(typ) = type_iter.next()? {
+            // keep building the index
+            type_finder.update(&type_iter);
+
+            // only parse class records, field lists make up most of the stream
+            if !is_class_kind(typ.raw_kind()) {
+                continue;
+            }
+
+            if let Ok(TypeData::Class(class)) = typ.parse() {
+                if !class.properties.forward_reference() {
+                    classes
+                        .entry(class.name.to_string().into_owned())
+                        .or_insert_with(|| typ.index());
+                }
             }
         }
 
-        let mut field_map = HashMap::new();
-        for class in &data.classes {
-            class.fields.iter().for_each(|f| {
-                field_map.insert(
-                    f.name.to_string().into_owned(),
-                    PdbField {
-                        type_name: f.type_name.clone(),
-                        offset: f.offset as usize,
-                    },
-                );
-            });
+        Ok(PdbTypeIndex {
+            type_finder,
+            classes,
+        })
+    }
+}
+
+/// Looks up the relative virtual address of the public symbol `name`.
+///
+/// This walks the global symbol stream, unexported kernel variables like `PspCidTable` can only
+/// be found this way. Returns `None` if the symbol does not exist.
+pub fn find_symbol_rva(pdb_slice: &[u8], name: &str) -> Result<Option<u32>> {
+    let pdb_buffer = PdbSourceBuffer::new(pdb_slice);
+    let mut pdb = PDB::open(pdb_buffer)?;
+    let symbol_table = pdb.global_symbols()?;
+    let address_map = pdb.address_map()?;
+
+    let mut symbols = symbol_table.iter();
+    while let Some(symbol) = symbols.next()? {
+        if let Ok(SymbolData::Public(data)) = symbol.parse() {
+            if data.name.as_bytes() == name.as_bytes() {
+                return Ok(data.offset.to_rva(&address_map).map(|rva| rva.0));
+            }
         }
+    }
+
+    Ok(None)
+}
+
+fn is_class_kind(kind: u16) -> bool {
+    matches!(
+        kind,
+        LF_CLASS
+            | LF_STRUCTURE
+            | LF_INTERFACE
+            | LF_CLASS_ST
+            | LF_STRUCTURE_ST
+            | LF_CLASS_16T
+            | LF_STRUCTURE_16T
+    )
+}
+
+/// Maps struct names to their type records.
+///
+/// The fields of a struct are only decoded when it is looked up.
+pub struct PdbTypeIndex<'t> {
+    type_finder: TypeFinder<'t>,
+    classes: HashMap<String, TypeIndex>,
+}
 
-        Ok(Self { field_map })
+impl<'t> PdbTypeIndex<'t> {
+    /// Decodes the fields of the struct `class_name`.
+    ///
+    /// Only the fields of the struct itself are returned, nested structs can be looked up
+    /// separately. Returns `None` if the struct does not exist.
+    pub fn find_struct(&self, class_name: &str) -> Result<Option<PdbStruct>> {
+        match self.classes.get(class_name) {
+            Some(&type_index) => decode_struct(&self.type_finder, type_index),
+            None => Ok(None),
+        }
     }
 
-    pub fn find_field(&self, name: &str) -> Option<&PdbField> {
-        self.field_map.get(name)
+    pub fn contains_struct(&self, class_name: &str) -> bool {
+        self.classes.contains_key(class_name)
     }
 }
 
+fn decode_struct(type_finder: &TypeFinder<'_>, type_index: TypeIndex) -> Result<Option<PdbStruct>> {
+    // types referenced by the fields are not decoded
+    let mut needed_types = TypeSet::new();
+    let mut data = data::Data::new();
+    data.add(type_finder, type_index, &mut needed_types)?;
+
+    Ok(data.classes.first().map(PdbStruct::from_class))
+}
+
 pub struct PdbSourceBuffer<'a> {
     bytes: &'a [u8],
 }
@@ -148,3 +280,145 @@ impl Drop for PdbSourceBufferView {
         // no-op
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const PAGE_SIZE: usize = 0x1000;
+    const LF_FIELDLIST: u16 = 0x1203;
+    const LF_MEMBER: u16 = 0x150d;
+    const FWDREF: u16 = 0x80;
+    // primitive types
+    const T_UINT4: u32 = 0x75;
+    const T_UINT8: u32 = 0x77;
+
+    // pads a record with LF_PAD bytes so the next one starts at a 4 byte boundary
+    fn pad(buf: &mut Vec<u8>, start: usize) {
+        let rem = (4 - (buf.len() - start) % 4) % 4;
+        for i in (1..=rem).rev() {
+            buf.push(0xf0 | i as u8);
+        }
+    }
+
+    fn record(kind: u16, data: &[u8]) -> Vec<u8> {
+        let mut rec = vec![0, 0];
+        rec.extend_from_slice(&kind.to_le_bytes());
+        rec.extend_from_slice(data);
+        pad(&mut rec, 0);
+        let len = (rec.len() - 2) as u16;
+        rec[..2].copy_from_slice(&len.to_le_bytes());
+        rec
+    }
+
+    fn field_list(members: &[(&str, u32, u16)]) -> Vec<u8> {
+        let mut data = vec![];
+        for &(name, typ, offset) in members {
+            let start = data.len();
+            data.extend_from_slice(&LF_MEMBER.to_le_bytes());
+            data.extend_from_slice(&3u16.to_le_bytes()); // public
+            data.extend_from_slice(&typ.to_le_bytes());
+            data.extend_from_slice(&offset.to_le_bytes());
+            data.extend_from_slice(name.as_bytes());
+            data.push(0);
+            pad(&mut data, start);
+        }
+        record(LF_FIELDLIST, &data)
+    }
+
+    fn structure(name: &str, count: u16, properties: u16, fields: u32, size: u16) -> Vec<u8> {
+        let mut data = vec![];
+        data.extend_from_slice(&count.to_le_bytes());
+        data.extend_from_slice(&properties.to_le_bytes());
+        data.extend_from_slice(&fields.to_le_bytes());
+        data.extend_from_slice(&[0; 8]); // derived_from, vtable_shape
+        data.extend_from_slice(&size.to_le_bytes());
+        data.extend_from_slice(name.as_bytes());
+        data.push(0);
+        record(LF_STRUCTURE, &data)
+    }
+
+    /// Builds a msf 7.0 file with an empty stream 0 and 1 and `records` as the type stream.
+    fn build_pdb(records: &[Vec<u8>]) -> Vec<u8> {
+        let count = records.len() as u32;
+        let records = records.concat();
+
+        // version, header size, type index range and size of the records
+        let mut tpi = vec![];
+        for value in [20_040_203, 56, 0x1000, 0x1000 + count, records.len() as u32].iter() {
+            tpi.extend_from_slice(&value.to_le_bytes());
+        }
+        tpi.extend_from_slice(&[0xff; 4]); // no hash streams
+        tpi.extend_from_slice(&4u32.to_le_bytes());
+        tpi.extend_from_slice(&0x3ffffu32.to_le_bytes());
+        tpi.extend_from_slice(&[0; 24]);
+        tpi.extend_from_slice(&records);
+        assert!(tpi.len() <= PAGE_SIZE);
+
+        // header, free page maps, stream directory page list, stream directory, type stream
+        let mut pdb = vec![0; PAGE_SIZE * 6];
+        let mut write = |offset: usize, values: &[u32]| {
+            for (i, value) in values.iter().enumerate() {
+                pdb[offset + i * 4..offset + i * 4 + 4].copy_from_slice(&value.to_le_bytes());
+            }
+        };
+        let directory = [3, 0, 0, tpi.len() as u32, 5];
+        write(
+            32,
+            &[PAGE_SIZE as u32, 1, 6, directory.len() as u32 * 4, 0, 3],
+        );
+        write(PAGE_SIZE * 3, &[4]);
+        write(PAGE_SIZE * 4, &directory);
+        pdb[..32].copy_from_slice(b"Microsoft C/C++ MSF 7.00\r\n\x1a\x44\x53\x00\x00\x00");
+        pdb[PAGE_SIZE * 5..PAGE_SIZE * 5 + tpi.len()].copy_from_slice(&tpi);
+        pdb
+    }
+
+    fn test_pdb() -> Vec<u8> {
+        build_pdb(&[
+            // 0x1000: forward reference, as emitted for pointers to the struct
+            structure("_TEST", 0, FWDREF, 0, 0),
+            // 0x1001
+            field_list(&[("Flags", T_UINT4, 0), ("Link", T_UINT8, 8)]),
+            // 0x1002
+            structure("_TEST", 2, 0, 0x1001, 0x10),
+            // 0x1003: only ever forward referenced
+            structure("_OPAQUE", 0, FWDREF, 0, 0),
+        ])
+    }
+
+    #[test]
+    fn test_index_find_struct() {
+        let pdb = test_pdb();
+        let types = PdbTypes::new(&pdb).unwrap();
+        let index = types.index().unwrap();
+
+        assert!(index.contains_struct("_TEST"));
+        assert!(!index.contains_struct("_OPAQUE"));
+        assert_eq!(index.find_struct("_OPAQUE").unwrap(), None);
+        assert_eq!(index.find_struct("_MISSING").unwrap(), None);
+
+        // the forward reference resolves to the full definition
+        let test = index.find_struct("_TEST").unwrap().unwrap();
+        assert_eq!(test.size(), 0x10);
+        assert_eq!(test.find_field("Flags").unwrap().offset, 0);
+        assert_eq!(test.find_field("Link").unwrap().offset, 8);
+        assert_eq!(test.find_field("Link").unwrap().type_name, "uint64_t");
+    }
+
+    #[test]
+    fn test_find_single_struct() {
+        let pdb = test_pdb();
+        let types = PdbTypes::new(&pdb).unwrap();
+
+        assert_eq!(
+            types.find_struct("_TEST").unwrap(),
+            types.index().unwrap().find_struct("_TEST").unwrap()
+        );
+        assert_eq!(types.find_struct("_OPAQUE").unwrap(), None);
+
+        let test = PdbStruct::with(&pdb, "_TEST").unwrap();
+        assert_eq!(test.find_field("Flags").unwrap().offset, 0);
+        assert_eq!(PdbStruct::with(&pdb, "_MISSING").unwrap().size(), 0);
+    }
+}
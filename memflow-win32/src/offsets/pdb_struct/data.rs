@@ -103,6 +103,7 @@ pub fn type_name<'p>(
 pub struct Class<'p> {
     pub kind: pdb::ClassKind,
     pub name: pdb::RawString<'p>,
+    pub size: usize,
     pub base_classes: Vec<BaseClass>,
     pub fields: Vec<Field<'p>>,
     pub instance_methods: Vec<Method<'p>>,
@@ -403,6 +404,7 @@ impl<'p> Data<'p> {
                 let mut class = Class {
                     kind: data.kind,
                     name: data.name,
+                    size: data.size as usize,
                     fields: Vec::new(),
                     base_classes: Vec::new(),
                     instance_methods: Vec::new(),
@@ -6,14 +6,21 @@ pub use kernel::Kernel;
 pub use kernel_builder::KernelBuilder;
 pub use kernel_info::KernelInfo;
 
+pub mod cid_table;
 pub mod keyboard;
 pub mod module;
 pub mod process;
+pub mod process_entry;
+pub mod sampler;
+pub mod trace_events;
 pub mod unicode_string;
 pub mod vat;
 
+pub use cid_table::*;
 pub use keyboard::*;
 pub use module::*;
 pub use process::*;
+pub use process_entry::*;
+pub use sampler::*;
 pub use unicode_string::*;
 pub use vat::*;
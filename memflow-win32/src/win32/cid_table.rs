@@ -0,0 +1,462 @@
+/*!
+Module for enumerating processes and threads through the client id table of the kernel.
+
+Process and thread ids are handles in the `PspCidTable` handle table. Every process and thread
+has an entry in this table which points to its `_EPROCESS` or `_ETHREAD` structure, the id is
+the handle value of the entry.
+
+Walking the `ActiveProcessLinks` list takes one dependent read per process. The handle table
+on the other hand is a tree of at most three levels of pages, so once the upper levels are known
+all entries can be read at once:
+
+1. The `PspCidTable` pointer and the `TableCode` of the handle table are read.
+2. The page tables of every level of the table are read in one batch per level.
+3. All pages containing entries are read in a single batch.
+4. The type and client id of all objects referenced by the table are read in a single batch.
+
+Enumerating all processes and threads thereby takes the same few batched reads, regardless of
+the number of processes and threads on the system.
+
+Enumeration through the cid table requires the `PspCidTable` symbol and the `_HANDLE_TABLE`
+and `_ETHREAD::Cid` offsets, which are resolved from the kernel pdb.
+
+# Examples:
+
+```
+use memflow::mem::{PhysicalMemory, VirtualTranslate};
+use memflow_win32::win32::{CidTable, Kernel};
+
+fn test<T: PhysicalMemory, V: VirtualTranslate>(kernel: &mut Kernel<T, V>) {
+    let mut cid_table = CidTable::try_with(kernel).unwrap();
+    cid_table.enumerate_with_kernel(kernel).unwrap();
+
+    for process in cid_table.processes() {
+        let threads = cid_table
+            .threads()
+            .iter()
+            .filter(|thread| thread.pid == process.pid)
+            .count();
+        println!("{} {:x}: {} threads", process.pid, process.eprocess, threads);
+    }
+}
+```
+*/
+use std::prelude::v1::*;
+
+use super::{Kernel, Win32VirtualTranslate};
+use crate::error::{Error, Result};
+
+use log::{debug, trace};
+
+use memflow::architecture::{x86, ArchitectureObj};
+use memflow::error::PartialResultExt;
+use memflow::mem::{PhysicalMemory, VirtualDMA, VirtualMemory, VirtualReadData, VirtualTranslate};
+use memflow::process::PID;
+use memflow::types::{size, Address};
+
+// handle tables are made up of pages of this size on all architectures
+const TABLE_PAGE_SIZE: usize = size::kb(4);
+
+// _DISPATCHER_HEADER::Type of processes and threads, see `KOBJECTS`
+const PROCESS_OBJECT: u8 = 3;
+const THREAD_OBJECT: u8 = 6;
+
+/// A process found in the client id table.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct CidProcess {
+    pub pid: PID,
+    pub eprocess: Address,
+}
+
+/// A thread found in the client id table.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct CidThread {
+    pub tid: u32,
+    /// Id of the process the thread belongs to.
+    pub pid: PID,
+    pub ethread: Address,
+}
+
+/// Enumerates all processes and threads through the `PspCidTable` handle table.
+#[derive(Clone, Debug)]
+pub struct CidTable {
+    arch: ArchitectureObj,
+    // address of the PspCidTable variable
+    table_ptr: Address,
+    table_code_offset: usize,
+    cid_offset: usize,
+    // entries store the object pointer shifted into the upper bits since windows 8.1 on x64
+    compressed: bool,
+
+    processes: Vec<CidProcess>,
+    threads: Vec<CidThread>,
+}
+
+impl CidTable {
+    pub fn try_with<T: PhysicalMemory, V: VirtualTranslate>(
+        kernel: &mut Kernel<T, V>,
+    ) -> Result<Self> {
+        let arch = kernel.kernel_info.start_block.arch;
+        if arch != x86::x64::ARCH && arch != x86::x32::ARCH && arch != x86::x32_pae::ARCH {
+            return Err(Error::InvalidArchitecture);
+        }
+
+        let offsets = &kernel.offsets;
+        let table_code_offset = match offsets.handle_table_code() {
+            Some(offset) if offsets.psp_cid_table_rva() != 0 && offsets.ethread_cid() != 0 => {
+                offset
+            }
+            _ => {
+                return Err(Error::Other(
+                    "cid table enumeration requires the PspCidTable symbol and the _HANDLE_TABLE offsets",
+                ))
+            }
+        };
+
+        let table_ptr = kernel.kernel_info.kernel_base + offsets.psp_cid_table_rva();
+        debug!("found PspCidTable at {:x}", table_ptr);
+
+        Ok(Self::new(
+            arch,
+            table_ptr,
+            table_code_offset,
+            offsets.ethread_cid(),
+            arch == x86::x64::ARCH && kernel.kernel_info.kernel_winver >= (6, 3).into(),
+        ))
+    }
+
+    fn new(
+        arch: ArchitectureObj,
+        table_ptr: Address,
+        table_code_offset: usize,
+        cid_offset: usize,
+        compressed: bool,
+    ) -> Self {
+        Self {
+            arch,
+            table_ptr,
+            table_code_offset,
+            cid_offset,
+            compressed,
+
+            processes: vec![],
+            threads: vec![],
+        }
+    }
+
+    /// Returns the processes found by the last enumeration, ordered by their pid.
+    pub fn processes(&self) -> &[CidProcess] {
+        &self.processes
+    }
+
+    /// Returns the threads found by the last enumeration, ordered by their tid.
+    pub fn threads(&self) -> &[CidThread] {
+        &self.threads
+    }
+
+    /// Enumerates all processes and threads with the kernel context.
+    pub fn enumerate_with_kernel<T: PhysicalMemory, V: VirtualTranslate>(
+        &mut self,
+        kernel: &mut Kernel<T, V>,
+    ) -> Result<()> {
+        let mut reader = VirtualDMA::with_vat(
+            &mut kernel.phys_mem,
+            kernel.kernel_info.start_block.arch,
+            Win32VirtualTranslate::new(kernel.kernel_info.start_block.arch, kernel.sysproc_dtb),
+            &mut kernel.vat,
+        );
+        self.enumerate(&mut reader)
+    }
+
+    /// Enumerates all processes and threads with the given kernel memory reader.
+    ///
+    /// Entries of pages that can not be read are skipped.
+    pub fn enumerate<T: VirtualMemory>(&mut self, virt_mem: &mut T) -> Result<()> {
+        self.processes.clear();
+        self.threads.clear();
+
+        let handle_table = virt_mem.virt_read_addr_arch(self.arch, self.table_ptr)?;
+        if handle_table.is_null() {
+            return Err(Error::Other("PspCidTable is not initialized"));
+        }
+        let table_code =
+            virt_mem.virt_read_addr_arch(self.arch, handle_table + self.table_code_offset)?;
+        trace!(
+            "handle_table={:x} table_code={:x}",
+            handle_table,
+            table_code
+        );
+
+        // the lower bits of the table code contain the number of page table levels
+        let levels = (table_code.as_u64() & 0b11) as usize;
+        let mut pages = vec![(0, Address::from(table_code.as_u64() & !0b11))];
+        for _ in 0..levels {
+            pages = self.read_page_tables(virt_mem, &pages)?;
+        }
+        trace!("levels={} pages={}", levels, pages.len());
+
+        let objects = self.read_entries(virt_mem, &pages)?;
+        self.read_objects(virt_mem, &objects)?;
+
+        debug!(
+            "found {} processes and {} threads",
+            self.processes.len(),
+            self.threads.len()
+        );
+        Ok(())
+    }
+
+    /// Reads the page tables `tables` and returns the pages they point to.
+    ///
+    /// Pages are identified by their index in handle order.
+    fn read_page_tables<T: VirtualMemory>(
+        &self,
+        virt_mem: &mut T,
+        tables: &[(usize, Address)],
+    ) -> Result<Vec<(usize, Address)>> {
+        let mut buf = vec![0; tables.len() * TABLE_PAGE_SIZE];
+        {
+            let mut list = tables
+                .iter()
+                .zip(buf.chunks_exact_mut(TABLE_PAGE_SIZE))
+                .map(|(&(_, table), chunk)| VirtualReadData(table, chunk))
+                .collect::<Vec<_>>();
+            virt_mem.virt_read_raw_list(&mut list).data_part()?;
+        }
+
+        let size = self.arch.size_addr();
+        let ptrs_per_table = TABLE_PAGE_SIZE / size;
+        let pages = tables
+            .iter()
+            .zip(buf.chunks_exact(TABLE_PAGE_SIZE))
+            .flat_map(|(&(table_idx, _), chunk)| {
+                chunk
+                    .chunks_exact(size)
+                    .enumerate()
+                    .map(move |(idx, ptr)| (table_idx * ptrs_per_table + idx, read_le(ptr)))
+            })
+            .filter(|&(_, page)| page != 0)
+            .map(|(idx, page)| (idx, Address::from(page)))
+            .collect();
+        Ok(pages)
+    }
+
+    /// Reads all entries of `pages` and returns the ids and objects of all used entries.
+    fn read_entries<T: VirtualMemory>(
+        &self,
+        virt_mem: &mut T,
+        pages: &[(usize, Address)],
+    ) -> Result<Vec<(u32, Address)>> {
+        let mut buf = vec![0; pages.len() * TABLE_PAGE_SIZE];
+        {
+            let mut list = pages
+                .iter()
+                .zip(buf.chunks_exact_mut(TABLE_PAGE_SIZE))
+                .map(|(&(_, page), chunk)| VirtualReadData(page, chunk))
+                .collect::<Vec<_>>();
+            virt_mem.virt_read_raw_list(&mut list).data_part()?;
+        }
+
+        // a _HANDLE_TABLE_ENTRY consists of two pointer sized values
+        let entry_size = self.arch.size_addr() * 2;
+        let entries_per_page = TABLE_PAGE_SIZE / entry_size;
+        let objects = pages
+            .iter()
+            .zip(buf.chunks_exact(TABLE_PAGE_SIZE))
+            .flat_map(|(&(page_idx, _), chunk)| {
+                chunk
+                    .chunks_exact(entry_size)
+                    .enumerate()
+                    .map(move |(idx, entry)| (page_idx * entries_per_page + idx, entry))
+            })
+            .filter_map(|(idx, entry)| {
+                let value = read_le(&entry[..entry_size / 2]);
+                self.decode_entry(value)
+                    .map(|object| ((idx * 4) as u32, object))
+            })
+            .collect();
+        Ok(objects)
+    }
+
+    /// Decodes the object pointer of the first value of a `_HANDLE_TABLE_ENTRY`.
+    fn decode_entry(&self, value: u64) -> Option<Address> {
+        let object = if self.compressed {
+            // ObjectPointerBits are stored in bits 20 to 63 and the lower 4 bits are always zero
+            if value >> 20 == 0 {
+                return None;
+            }
+            ((value >> 16) & !0xf) | 0xffff_0000_0000_0000
+        } else {
+            // the lower bits contain the lock and attribute flags
+            value & !0b111
+        };
+        Address::from(object).non_null()
+    }
+
+    /// Reads the type of all `objects` and sorts them into processes and threads.
+    fn read_objects<T: VirtualMemory>(
+        &mut self,
+        virt_mem: &mut T,
+        objects: &[(u32, Address)],
+    ) -> Result<()> {
+        let size = self.arch.size_addr();
+
+        // the object type and the process id of threads are read at once for all objects
+        let mut types = vec![0u8; objects.len()];
+        let mut pids = vec![[0u8; 8]; objects.len()];
+        {
+            let mut list = Vec::with_capacity(objects.len() * 2);
+            for ((&(_, object), ty), pid) in
+                objects.iter().zip(types.iter_mut()).zip(pids.iter_mut())
+            {
+                list.push(VirtualReadData(object, std::slice::from_mut(ty)));
+                list.push(VirtualReadData(object + self.cid_offset, &mut pid[..size]));
+            }
+            virt_mem.virt_read_raw_list(&mut list).data_part()?;
+        }
+
+        for ((&(id, object), &ty), pid) in objects.iter().zip(types.iter()).zip(pids.iter()) {
+            match ty {
+                PROCESS_OBJECT => self.processes.push(CidProcess {
+                    pid: id,
+                    eprocess: object,
+                }),
+                THREAD_OBJECT => self.threads.push(CidThread {
+                    tid: id,
+                    pid: read_le(&pid[..size]) as PID,
+                    ethread: object,
+                }),
+                _ => trace!("skipping object {:x} of type {}", object, ty),
+            }
+        }
+
+        Ok(())
+    }
+}
+
+fn read_le(buf: &[u8]) -> u64 {
+    let mut bytes = [0; 8];
+    bytes[..buf.len()].copy_from_slice(buf);
+    u64::from_le_bytes(bytes)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use memflow::mem::dummy::DummyMemory;
+
+    #[test]
+    fn test_enumerate() {
+        let (mut mem, base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &[0; 0x8000]);
+
+        // PspCidTable at +0 -> _HANDLE_TABLE at +0x100 -> one level of page tables at +0x1000
+        let table_code_offset = 0x8;
+        let cid_offset = 0x20;
+        mem.virt_write(base, &(base + 0x100).as_u64()).unwrap();
+        mem.virt_write(base + 0x108, &((base + 0x1000).as_u64() | 1))
+            .unwrap();
+
+        // the second page table entry is empty, the third page of entries starts at handle 0x800
+        let pages = [base + 0x2000, Address::null(), base + 0x3000];
+        for (i, page) in pages.iter().enumerate() {
+            mem.virt_write(base + 0x1000 + i * 8, &page.as_u64())
+                .unwrap();
+        }
+
+        let objects = [
+            (pages[0] + 0x10, base + 0x4000, PROCESS_OBJECT, 0),
+            (pages[0] + 0x20, base + 0x4100, THREAD_OBJECT, 4),
+            (pages[2] + 0x30, base + 0x4200, THREAD_OBJECT, 4),
+            // the object of an entry that is neither a process nor a thread is skipped
+            (pages[2] + 0x40, base + 0x4300, 1, 0),
+        ];
+        for &(entry, object, ty, pid) in objects.iter() {
+            // set the lock bit like the kernel does for unlocked entries
+            mem.virt_write(entry, &(object.as_u64() | 1)).unwrap();
+            mem.virt_write(object, &ty).unwrap();
+            mem.virt_write(object + cid_offset, &(pid as u64)).unwrap();
+        }
+
+        let mut cid_table =
+            CidTable::new(x86::x64::ARCH, base, table_code_offset, cid_offset, false);
+        cid_table.enumerate(&mut mem).unwrap();
+
+        assert_eq!(
+            cid_table.processes(),
+            &[CidProcess {
+                pid: 4,
+                eprocess: base + 0x4000
+            }]
+        );
+        assert_eq!(
+            cid_table.threads(),
+            &[
+                CidThread {
+                    tid: 8,
+                    pid: 4,
+                    ethread: base + 0x4100
+                },
+                CidThread {
+                    tid: 0x80c,
+                    pid: 4,
+                    ethread: base + 0x4200
+                }
+            ]
+        );
+    }
+
+    #[test]
+    fn test_enumerate_win7() {
+        let (mut mem, base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &[0; 0x8000]);
+
+        // windows 7 keeps TableCode at offset 0 of _HANDLE_TABLE and uses a single level table here
+        let table_code_offset = 0x0;
+        let cid_offset = 0x3b8;
+        mem.virt_write(base, &(base + 0x100).as_u64()).unwrap();
+        mem.virt_write(base + 0x100, &(base + 0x1000).as_u64())
+            .unwrap();
+        // a stale pointer at the windows 8 offset must not be followed
+        mem.virt_write(base + 0x108, &((base + 0x2000).as_u64() | 1))
+            .unwrap();
+
+        let objects = [
+            (base + 0x1010, base + 0x4000, PROCESS_OBJECT, 0),
+            (base + 0x1020, base + 0x4800, THREAD_OBJECT, 4),
+        ];
+        for &(entry, object, ty, pid) in objects.iter() {
+            mem.virt_write(entry, &(object.as_u64() | 1)).unwrap();
+            mem.virt_write(object, &ty).unwrap();
+            mem.virt_write(object + cid_offset, &(pid as u64)).unwrap();
+        }
+
+        let mut cid_table =
+            CidTable::new(x86::x64::ARCH, base, table_code_offset, cid_offset, false);
+        cid_table.enumerate(&mut mem).unwrap();
+
+        assert_eq!(
+            cid_table.processes(),
+            &[CidProcess {
+                pid: 4,
+                eprocess: base + 0x4000
+            }]
+        );
+        assert_eq!(
+            cid_table.threads(),
+            &[CidThread {
+                tid: 8,
+                pid: 4,
+                ethread: base + 0x4800
+            }]
+        );
+    }
+
+    #[test]
+    fn test_decode_compressed() {
+        let cid_table = CidTable::new(x86::x64::ARCH, Address::null(), 0, 0, true);
+
+        let object = 0xffff_a001_2345_6780u64;
+        let value = ((object & 0xffff_ffff_ffff) << 16) | 1;
+        assert_eq!(cid_table.decode_entry(value), Some(object.into()));
+        assert_eq!(cid_table.decode_entry(1), None);
+    }
+}
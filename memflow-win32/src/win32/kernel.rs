@@ -1,19 +1,26 @@
 use std::prelude::v1::*;
 
 use super::{
-    process::EXIT_STATUS_STILL_ACTIVE, process::IMAGE_FILE_NAME_LENGTH, KernelBuilder, KernelInfo,
-    Win32ExitStatus, Win32ModuleListInfo, Win32Process, Win32ProcessInfo, Win32VirtualTranslate,
+    process::EXIT_STATUS_STILL_ACTIVE, process::IMAGE_FILE_NAME_LENGTH,
+    process_entry::read_process_fields, trace_events, KernelBuilder, KernelInfo, Win32ExitStatus,
+    Win32ModuleListInfo, Win32Process, Win32ProcessEntry, Win32ProcessFields, Win32ProcessInfo,
+    Win32VirtualTranslate,
 };
 
 use crate::error::{Error, Result};
 use crate::offsets::Win32Offsets;
 
 use log::{info, trace};
+use std::borrow::{Borrow, BorrowMut};
 use std::fmt;
 
-use memflow::architecture::x86;
-use memflow::mem::{DirectTranslate, PhysicalMemory, VirtualDMA, VirtualMemory, VirtualTranslate};
+use memflow::architecture::{x86, ScopedVirtualTranslate};
+use memflow::mem::{
+    DirectTranslate, ListHead, ListWalker, MemoryUsage, PhysicalMemory, VirtualDMA, VirtualMemory,
+    VirtualTranslate,
+};
 use memflow::process::{OperatingSystem, OsProcessInfo, OsProcessModuleInfo, PID};
+use memflow::trace_event;
 use memflow::types::Address;
 
 use pelite::{self, pe64::exports::Export, PeView};
@@ -28,6 +35,86 @@ pub struct Kernel<T, V> {
 
     pub kernel_info: KernelInfo,
     pub sysproc_dtb: Address,
+
+    process_dtbs: ProcessDtbs,
+}
+
+#[derive(Debug, Clone, Copy)]
+struct ProcessDtb {
+    dtb: Address,
+    eprocess: Address,
+    // translations of the dtb have been invalidated since the process started exiting
+    exited: bool,
+}
+
+/// Tracks which process owns which dtb, to find out when cached translations become stale.
+///
+/// Translations of a dtb are invalidated once when its process starts exiting or disappears,
+/// and once when the dtb is handed out to a new process.
+#[derive(Debug, Clone, Default)]
+struct ProcessDtbs(Vec<ProcessDtb>);
+
+impl ProcessDtbs {
+    /// Records that `eprocess` uses `dtb`.
+    ///
+    /// Returns true if cached translations of the dtb have to be invalidated.
+    fn update(&mut self, dtb: Address, eprocess: Address, active: bool) -> bool {
+        if dtb.is_null() {
+            return false;
+        }
+
+        match self.0.binary_search_by_key(&dtb, |entry| entry.dtb) {
+            Ok(idx) => {
+                let entry = &mut self.0[idx];
+                if entry.eprocess != eprocess {
+                    // the dtb has been handed out to a new process
+                    entry.eprocess = eprocess;
+                    entry.exited = !active;
+                    true
+                } else if !active && !entry.exited {
+                    entry.exited = true;
+                    true
+                } else {
+                    false
+                }
+            }
+            Err(idx) => {
+                self.0.insert(
+                    idx,
+                    ProcessDtb {
+                        dtb,
+                        eprocess,
+                        exited: !active,
+                    },
+                );
+                !active
+            }
+        }
+    }
+
+    /// Forgets all processes that are not in `eprocs` and calls `invalidate` with the dtbs
+    /// of those that have not been invalidated yet.
+    fn retain<F: FnMut(Address)>(&mut self, mut eprocs: Vec<Address>, mut invalidate: F) {
+        eprocs.sort_unstable();
+        self.0.retain(|entry| {
+            if eprocs.binary_search(&entry.eprocess).is_ok() {
+                true
+            } else {
+                if !entry.exited {
+                    invalidate(entry.dtb);
+                }
+                false
+            }
+        });
+    }
+
+    fn memory_usage(&self) -> usize {
+        self.0.capacity() * std::mem::size_of::<ProcessDtb>()
+    }
+
+    fn shrink_to_fit(&mut self) {
+        self.0.shrink_to_fit();
+    }
 }
 
 impl<T: PhysicalMemory, V: VirtualTranslate> OperatingSystem for Kernel<T, V> {}
@@ -71,6 +158,8 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
 
             kernel_info,
             sysproc_dtb,
+
+            process_dtbs: ProcessDtbs::default(),
         }
     }
 
@@ -79,6 +168,58 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
         self.phys_mem
     }
 
+    /// Drops all cached virtual address translations of the given process.
+    ///
+    /// Once a process exits its dtb can be handed out to a new process,
+    /// thus all translations cached for it have to be invalidated.
+    pub fn invalidate_process(&mut self, proc_info: &Win32ProcessInfo) {
+        self.invalidate_dtb(proc_info.dtb);
+    }
+
+    /// Reports the memory held by the kernel, its translation layer and its physical memory.
+    pub fn memory_usage(&self, usage: &mut MemoryUsage) {
+        usage.push("kernel_process_dtbs", self.process_dtbs.memory_usage());
+        self.vat.memory_usage(usage);
+        self.phys_mem.memory_usage(usage);
+    }
+
+    /// Releases memory of the kernel and the layers below that is not needed right now.
+    pub fn shrink_memory(&mut self) {
+        self.process_dtbs.shrink_to_fit();
+        self.vat.shrink_memory();
+        self.phys_mem.shrink_memory();
+    }
+
+    fn invalidate_dtb(&mut self, dtb: Address) {
+        trace!("invalidating translations of dtb={:x}", dtb);
+        let translator = Win32VirtualTranslate::new(self.kernel_info.start_block.arch, dtb);
+        self.vat
+            .invalidate_translation_table(translator.translation_table_id(Address::null()));
+    }
+
+    /// Records the dtb of a process and invalidates its translations if the process started
+    /// exiting or if the dtb previously belonged to a different process.
+    ///
+    /// This has to happen before anything is read in the address space of the process.
+    fn track_process_dtb(&mut self, dtb: Address, eprocess: Address, exit_status: Win32ExitStatus) {
+        if self
+            .process_dtbs
+            .update(dtb, eprocess, exit_status == EXIT_STATUS_STILL_ACTIVE)
+        {
+            self.invalidate_dtb(dtb);
+        }
+    }
+
+    /// Invalidates the translations of all tracked processes that are not part of `eprocs`,
+    /// the full list of processes of the last enumeration.
+    fn retire_process_dtbs(&mut self, eprocs: Vec<Address>) {
+        let mut exited = vec![];
+        self.process_dtbs.retain(eprocs, |dtb| exited.push(dtb));
+        for dtb in exited.into_iter() {
+            self.invalidate_dtb(dtb);
+        }
+    }
+
     pub fn eprocess_list(&mut self) -> Result<Vec<Address>> {
         let mut eprocs = Vec::new();
         self.eprocess_list_extend(&mut eprocs)?;
@@ -98,19 +239,24 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
         let list_start = self.kernel_info.eprocess_base + self.offsets.eproc_link();
         let mut list_entry = list_start;
 
+        let mut count = 0;
+
         for _ in 0..MAX_ITER_COUNT {
             let eprocess = list_entry - self.offsets.eproc_link();
-            trace!("eprocess={}", eprocess);
 
             // test flink + blink before adding the process
             let flink_entry =
                 reader.virt_read_addr_arch(self.kernel_info.start_block.arch, list_entry)?;
-            trace!("flink_entry={}", flink_entry);
             let blink_entry = reader.virt_read_addr_arch(
                 self.kernel_info.start_block.arch,
                 list_entry + self.offsets.list_blink(),
             )?;
-            trace!("blink_entry={}", blink_entry);
+            trace_event!(
+                trace_events::EPROCESS_ENTRY,
+                eprocess.as_u64(),
+                flink_entry.as_u64(),
+                blink_entry.as_u64()
+            );
 
             if flink_entry.is_null()
                 || blink_entry.is_null()
@@ -120,13 +266,15 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
                 break;
             }
 
-            trace!("found eprocess {:x}", eprocess);
             eprocs.extend(Some(eprocess).into_iter());
+            count += 1;
 
             // continue
             list_entry = flink_entry;
         }
 
+        trace_event!(trace_events::EPROCESS_LIST_END, count);
+
         Ok(())
     }
 
@@ -210,6 +358,12 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
             eprocess + self.offsets.kproc_dtb(),
         )?;
         trace!("dtb={:x}", dtb);
+        trace_event!(
+            trace_events::PROCESS_INFO,
+            eprocess.as_u64(),
+            pid,
+            dtb.as_u64()
+        );
 
         let wow64 = if self.offsets.eproc_wow64() == 0 {
             trace!("eproc_wow64=null; skipping wow64 detection");
@@ -303,6 +457,9 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
 
         std::mem::drop(reader);
 
+        // the dtb may have been reused since it was last seen
+        self.track_process_dtb(dtb, eprocess, exit_status);
+
         // construct reader with process dtb
         // TODO: can tlb be used here already?
         let mut proc_reader = VirtualDMA::with_vat(
@@ -365,11 +522,12 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
     ) -> Result<()> {
         let mut vec = Vec::new();
         self.eprocess_list_extend(&mut vec)?;
-        for eprocess in vec.into_iter() {
+        for &eprocess in vec.iter() {
             if let Ok(prc) = self.process_info_from_eprocess(eprocess) {
                 list.extend(Some(prc).into_iter());
             }
         }
+        self.retire_process_dtbs(vec);
         Ok(())
     }
 
@@ -381,6 +539,135 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
         Ok(list)
     }
 
+    pub fn process_entry_list_extend<E: Extend<Win32ProcessEntry>>(
+        &mut self,
+        fields: Win32ProcessFields,
+        list: &mut E,
+    ) -> Result<()> {
+        let eprocs = self.eprocess_list()?;
+        let mut entries = eprocs
+            .iter()
+            .copied()
+            .map(Win32ProcessEntry::new)
+            .collect::<Vec<_>>();
+
+        // the dtb and exit status are needed to keep the cached translations coherent
+        let tracked = Win32ProcessFields::DTB | Win32ProcessFields::EXIT_STATUS;
+        self.process_entries_load(&mut entries, fields | tracked)?;
+        for entry in entries.iter() {
+            self.track_process_dtb(
+                entry.dtb().unwrap_or_default(),
+                entry.address,
+                entry.exit_status().unwrap_or(EXIT_STATUS_STILL_ACTIVE),
+            );
+        }
+        self.retire_process_dtbs(eprocs);
+
+        list.extend(entries);
+        Ok(())
+    }
+
+    /// Retrieves a list of `Win32ProcessEntry` structs for all processes
+    /// that can be found on the target system, with only `fields` read.
+    ///
+    /// The dtb and the exit status of every process are always read as well.
+    ///
+    /// Unlike `process_info_list` this does not walk into the address space of every process,
+    /// the selected fields of all processes are read in a single batch. Use this when only a
+    /// few fields are needed, e.g. the pid and name of every process.
+    pub fn process_entry_list(
+        &mut self,
+        fields: Win32ProcessFields,
+    ) -> Result<Vec<Win32ProcessEntry>> {
+        let mut list = Vec::new();
+        self.process_entry_list_extend(fields, &mut list)?;
+        Ok(list)
+    }
+
+    /// Reads the `fields` that are missing in any of the `entries`.
+    ///
+    /// The missing fields of all entries are read in a single batch. `entries` can either hold
+    /// the entries themselves or references to entries that are scattered in memory.
+    pub fn process_entries_load<E: BorrowMut<Win32ProcessEntry>>(
+        &mut self,
+        entries: &mut [E],
+        fields: Win32ProcessFields,
+    ) -> Result<()> {
+        let missing = entries
+            .iter()
+            .fold(Win32ProcessFields::empty(), |missing, entry| {
+                missing | (fields - entry.borrow().fields())
+            });
+        if missing.is_empty() {
+            return Ok(());
+        }
+
+        let mut reader = VirtualDMA::with_vat(
+            &mut self.phys_mem,
+            self.kernel_info.start_block.arch,
+            Win32VirtualTranslate::new(self.kernel_info.start_block.arch, self.sysproc_dtb),
+            &mut self.vat,
+        );
+
+        read_process_fields(
+            &mut reader,
+            self.kernel_info.start_block.arch,
+            &self.offsets,
+            entries,
+            missing,
+        )
+    }
+
+    /// Retrieves the native and WoW64 module entries of all `processes` at once.
+    ///
+    /// All module lists are walked in lockstep with a single physical read per hop. Walking the
+    /// lists of all processes takes as many round trips as the longest list has entries.
+    ///
+    /// Returns the native list and, for WoW64 processes, the WoW64 list of every process in the
+    /// order of `processes`. Every list starts with its head, like in
+    /// `Win32Process::module_entry_list_native`. Unlike there, a node that can not be read ends
+    /// its list instead of failing.
+    pub fn module_entry_lists(
+        &mut self,
+        processes: &[Win32ProcessInfo],
+    ) -> Result<Vec<(Vec<Address>, Option<Vec<Address>>)>> {
+        let mut lists = vec![];
+        for info in processes.iter() {
+            lists.push(ListHead {
+                translator: info.translator(),
+                arch: info.sys_arch,
+                head: info.module_info_native.module_base(),
+            });
+            if let Some(module_info) = info.module_info_wow64 {
+                lists.push(ListHead {
+                    translator: info.translator(),
+                    arch: info.proc_arch,
+                    head: module_info.module_base(),
+                });
+            }
+        }
+
+        let mut entries = lists.iter().map(|list| vec![list.head]).collect::<Vec<_>>();
+        ListWalker::new()
+            .max_len(MAX_ITER_COUNT)
+            .alignment(8)
+            .walk_spaces(&mut self.phys_mem, &mut self.vat, &lists, |list, entry| {
+                entries[list].push(entry)
+            })?;
+
+        let mut entries = entries.into_iter();
+        Ok(processes
+            .iter()
+            .map(|info| {
+                let native = entries.next().unwrap_or_default();
+                let wow64 = info
+                    .module_info_wow64
+                    .map(|_| entries.next().unwrap_or_default());
+                (native, wow64)
+            })
+            .collect())
+    }
+
     /// Finds a process by it's name and returns the `Win32ProcessInfo` struct.
     /// If no process with the specified name can be found this function will return an Error.
     pub fn process_info(&mut self, name: &str) -> Result<Win32ProcessInfo> {
@@ -528,3 +815,153 @@ impl<T: PhysicalMemory, V: VirtualTranslate> fmt::Debug for Kernel<T, V> {
         write!(f, "{:?}", self.kernel_info)
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::kernel::{StartBlock, Win32Version};
+    use crate::offsets::Win32OffsetTable;
+    use memflow::architecture::x86::x64;
+    use memflow::mem::dummy::DummyMemory;
+    use memflow::types::size;
+
+    fn offsets() -> Win32Offsets {
+        Win32Offsets(Win32OffsetTable {
+            list_blink: 0x8,
+            eproc_link: 0x2f0,
+            kproc_dtb: 0x28,
+            eproc_pid: 0x2e8,
+            eproc_name: 0x450,
+            eproc_peb: 0x3f8,
+            eproc_section_base: 0x3c0,
+            eproc_exit_status: 0x654,
+            eproc_thread_list: 0x488,
+            eproc_wow64: 0x428,
+            kthread_teb: 0xf0,
+            ethread_list_entry: 0x6a8,
+            teb_peb: 0x60,
+            teb_peb_x86: 0x30,
+            kthread_initial_stack: 0x28,
+            ktrap_frame_ip: 0x168,
+            ktrap_frame_size: 0x190,
+            psp_cid_table_rva: 0,
+            handle_table_code: 0x8,
+            ethread_cid: 0x648,
+        })
+    }
+
+    fn process_info(dtb: Address, native: Address, wow64: Option<Address>) -> Win32ProcessInfo {
+        Win32ProcessInfo {
+            address: Address::NULL,
+
+            pid: 0,
+            name: String::new(),
+            dtb,
+            section_base: Address::NULL,
+            exit_status: EXIT_STATUS_STILL_ACTIVE,
+            ethread: Address::NULL,
+            wow64: Address::NULL,
+
+            teb: None,
+            teb_wow64: None,
+
+            peb_native: Address::NULL,
+            peb_wow64: None,
+
+            module_info_native: Win32ModuleListInfo::with_base(native, x64::ARCH).unwrap(),
+            module_info_wow64: wow64
+                .map(|base| Win32ModuleListInfo::with_base(base, x64::ARCH).unwrap()),
+
+            sys_arch: x64::ARCH,
+            proc_arch: x64::ARCH,
+        }
+    }
+
+    #[test]
+    fn test_module_entry_lists() {
+        let (mut mem, dtb, base) = DummyMemory::new_and_dtb(size::mb(4), size::mb(2), &[0; 0x1000]);
+
+        // first process: a circular native list, second process: a native list that only holds
+        // its head and a null terminated wow64 list
+        let links = [
+            (base, base + 0x100),
+            (base + 0x100, base + 0x200),
+            (base + 0x200, base),
+            (base + 0x300, base + 0x300),
+            (base + 0x400, base + 0x500),
+            (base + 0x500, Address::NULL),
+        ];
+        {
+            let mut virt_mem = VirtualDMA::new(&mut mem, x64::ARCH, x64::new_translator(dtb));
+            for &(entry, next) in links.iter() {
+                virt_mem.virt_write(entry, &next.as_u64()).unwrap();
+            }
+        }
+
+        let mut kernel = Kernel {
+            phys_mem: mem,
+            vat: DirectTranslate::new(),
+            offsets: offsets(),
+            kernel_info: KernelInfo {
+                start_block: StartBlock {
+                    arch: x64::ARCH,
+                    kernel_hint: Address::NULL,
+                    dtb,
+                },
+                kernel_base: Address::NULL,
+                kernel_size: 0,
+                kernel_guid: None,
+                kernel_winver: Win32Version::new(10, 0, 19041),
+                eprocess_base: Address::NULL,
+            },
+            sysproc_dtb: dtb,
+            process_dtbs: ProcessDtbs::default(),
+        };
+
+        let processes = [
+            process_info(dtb, base, None),
+            process_info(dtb, base + 0x300, Some(base + 0x400)),
+        ];
+        let lists = kernel.module_entry_lists(&processes).unwrap();
+
+        assert_eq!(
+            lists,
+            vec![
+                (vec![base, base + 0x100, base + 0x200], None),
+                (vec![base + 0x300], Some(vec![base + 0x400, base + 0x500])),
+            ]
+        );
+    }
+
+    #[test]
+    fn test_process_dtbs() {
+        let mut dtbs = ProcessDtbs::default();
+        let (dtb, eproc, other) = (
+            Address::from(0x1000),
+            Address::from(0xffff_8000),
+            Address::from(0xffff_9000),
+        );
+
+        assert!(!dtbs.update(dtb, eproc, true));
+        assert!(!dtbs.update(dtb, eproc, true));
+
+        // a lingering zombie is only invalidated once
+        assert!(dtbs.update(dtb, eproc, false));
+        assert!(!dtbs.update(dtb, eproc, false));
+
+        // the dtb is handed out to a new process
+        assert!(dtbs.update(dtb, other, true));
+        assert!(!dtbs.update(dtb, other, true));
+
+        let mut invalidated = vec![];
+        dtbs.retain(vec![other], |dtb| invalidated.push(dtb));
+        assert!(invalidated.is_empty());
+        dtbs.retain(vec![eproc], |dtb| invalidated.push(dtb));
+        assert_eq!(invalidated, vec![dtb]);
+
+        // exited processes are not invalidated again when they disappear
+        assert!(dtbs.update(dtb, eproc, false));
+        dtbs.retain(vec![], |dtb| invalidated.push(dtb));
+        assert_eq!(invalidated, vec![dtb]);
+    }
+}
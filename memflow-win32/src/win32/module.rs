@@ -10,8 +10,47 @@ pub struct Win32ModuleInfo {
 
     pub base: Address, // _LDR_DATA_TABLE_ENTRY::DllBase
     pub size: usize,   // _LDR_DATA_TABLE_ENTRY::SizeOfImage
-    pub path: String,  // _LDR_DATA_TABLE_ENTRY::FullDllName
-    pub name: String,  // _LDR_DATA_TABLE_ENTRY::BaseDllName
+
+    // _LDR_DATA_TABLE_ENTRY::FullDllName followed by _LDR_DATA_TABLE_ENTRY::BaseDllName,
+    // the latter is only appended if it is not already the tail of the full name
+    names: String,
+    path_len: usize,
+    name_start: usize,
+}
+
+impl Win32ModuleInfo {
+    pub fn new(
+        peb_entry: Address,
+        parent_eprocess: Address,
+        base: Address,
+        size: usize,
+        path: String,
+        name: &str,
+    ) -> Self {
+        let mut names = path;
+        let path_len = names.len();
+        let name_start = if names.ends_with(name) {
+            path_len - name.len()
+        } else {
+            names.push_str(name);
+            path_len
+        };
+
+        Self {
+            peb_entry,
+            parent_eprocess,
+            base,
+            size,
+            names,
+            path_len,
+            name_start,
+        }
+    }
+
+    /// Returns the full path of the module.
+    pub fn path(&self) -> &str {
+        &self.names[..self.path_len]
+    }
 }
 
 impl OsProcessModuleInfo for Win32ModuleInfo {
@@ -31,7 +70,41 @@ impl OsProcessModuleInfo for Win32ModuleInfo {
         self.size
     }
 
-    fn name(&self) -> String {
-        self.name.clone()
+    fn name(&self) -> &str {
+        &self.names[self.name_start..]
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_name_in_path() {
+        let module = Win32ModuleInfo::new(
+            Address::null(),
+            Address::null(),
+            Address::null(),
+            0,
+            "C:\\Windows\\System32\\ntdll.dll".to_string(),
+            "ntdll.dll",
+        );
+        assert_eq!(module.path(), "C:\\Windows\\System32\\ntdll.dll");
+        assert_eq!(module.name(), "ntdll.dll");
+        assert_eq!(module.names.len(), module.path().len());
+    }
+
+    #[test]
+    fn test_name_not_in_path() {
+        let module = Win32ModuleInfo::new(
+            Address::null(),
+            Address::null(),
+            Address::null(),
+            0,
+            "\\SystemRoot\\system32\\ntoskrnl.exe".to_string(),
+            "ntkrnlmp.exe",
+        );
+        assert_eq!(module.path(), "\\SystemRoot\\system32\\ntoskrnl.exe");
+        assert_eq!(module.name(), "ntkrnlmp.exe");
     }
 }
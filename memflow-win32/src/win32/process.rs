@@ -116,14 +116,14 @@ impl Win32ModuleListInfo {
         let name = mem.virt_read_unicode_string(arch, entry + self.offsets.ldr_data_base_name)?;
         trace!("name={}", name);
 
-        Ok(Win32ModuleInfo {
-            peb_entry: entry,
+        Ok(Win32ModuleInfo::new(
+            entry,
             parent_eprocess,
             base,
             size,
             path,
-            name,
-        })
+            &name,
+        ))
     }
 }
 
@@ -213,8 +213,8 @@ impl OsProcessInfo for Win32ProcessInfo {
         self.pid
     }
 
-    fn name(&self) -> String {
-        self.name.clone()
+    fn name(&self) -> &str {
+        &self.name
     }
 
     fn sys_arch(&self) -> ArchitectureObj {
@@ -0,0 +1,348 @@
+use std::prelude::v1::*;
+
+use super::{Kernel, Win32ExitStatus, IMAGE_FILE_NAME_LENGTH};
+use crate::error::Result;
+use crate::offsets::Win32Offsets;
+
+use log::trace;
+use std::borrow::{Borrow, BorrowMut};
+
+use memflow::architecture::ArchitectureObj;
+use memflow::mem::{PhysicalMemory, TraversalPlan, VirtualMemory, VirtualTranslate};
+use memflow::process::PID;
+use memflow::types::Address;
+
+bitflags! {
+    /// Selects the fields of a `Win32ProcessEntry` that are read from its `_EPROCESS`.
+    #[repr(transparent)]
+    pub struct Win32ProcessFields: u32 {
+        /// _EPROCESS::UniqueProcessId
+        const PID = 0b0000_0001;
+        /// _EPROCESS::ImageFileName
+        const NAME = 0b0000_0010;
+        /// _KPROCESS::DirectoryTableBase
+        const DTB = 0b0000_0100;
+        /// _EPROCESS::WoW64Process
+        const WOW64 = 0b0000_1000;
+        /// _EPROCESS::Peb
+        const PEB = 0b0001_0000;
+        /// _EPROCESS::SectionBaseAddress
+        const SECTION_BASE = 0b0010_0000;
+        /// _EPROCESS::ExitStatus
+        const EXIT_STATUS = 0b0100_0000;
+        /// The first _ETHREAD of _EPROCESS::ThreadListHead
+        const ETHREAD = 0b1000_0000;
+    }
+}
+
+/// A process found while enumerating the process list of the kernel.
+///
+/// In contrast to `Win32ProcessInfo` an entry only holds the fields that were requested.
+/// Missing fields can be read later on with `load` or, for many entries at once, with
+/// `Kernel::process_entries_load`. A `Win32ProcessInfo` with all information about the process
+/// can be retrieved with `Kernel::process_info_from_eprocess`.
+#[derive(Debug, Clone)]
+#[cfg_attr(feature = "serde", derive(::serde::Serialize))]
+pub struct Win32ProcessEntry {
+    pub address: Address,
+
+    #[cfg_attr(feature = "serde", serde(skip))]
+    fields: Win32ProcessFields,
+
+    pid: PID,
+    name: String,
+    dtb: Address,
+    wow64: Address,
+    peb: Address,
+    section_base: Address,
+    exit_status: Win32ExitStatus,
+    ethread: Address,
+}
+
+impl Win32ProcessEntry {
+    /// Creates an entry for the `_EPROCESS` at `address` without any fields read.
+    pub fn new(address: Address) -> Self {
+        Self {
+            address,
+            fields: Win32ProcessFields::empty(),
+            pid: 0,
+            name: String::new(),
+            dtb: Address::NULL,
+            wow64: Address::NULL,
+            peb: Address::NULL,
+            section_base: Address::NULL,
+            exit_status: 0,
+            ethread: Address::NULL,
+        }
+    }
+
+    /// Returns the fields that have been read so far.
+    pub fn fields(&self) -> Win32ProcessFields {
+        self.fields
+    }
+
+    /// Reads all of `fields` that have not been read yet.
+    pub fn load<T: PhysicalMemory, V: VirtualTranslate>(
+        &mut self,
+        kernel: &mut Kernel<T, V>,
+        fields: Win32ProcessFields,
+    ) -> Result<()> {
+        kernel.process_entries_load(std::slice::from_mut(self), fields)
+    }
+
+    fn get<U>(&self, field: Win32ProcessFields, value: U) -> Option<U> {
+        if self.fields.contains(field) {
+            Some(value)
+        } else {
+            None
+        }
+    }
+
+    pub fn pid(&self) -> Option<PID> {
+        self.get(Win32ProcessFields::PID, self.pid)
+    }
+
+    pub fn name(&self) -> Option<&str> {
+        self.get(Win32ProcessFields::NAME, self.name.as_str())
+    }
+
+    pub fn dtb(&self) -> Option<Address> {
+        self.get(Win32ProcessFields::DTB, self.dtb)
+    }
+
+    /// Returns the address of the wow64 information of the process, null for native processes.
+    pub fn wow64(&self) -> Option<Address> {
+        self.get(Win32ProcessFields::WOW64, self.wow64)
+    }
+
+    pub fn peb(&self) -> Option<Address> {
+        self.get(Win32ProcessFields::PEB, self.peb)
+    }
+
+    pub fn section_base(&self) -> Option<Address> {
+        self.get(Win32ProcessFields::SECTION_BASE, self.section_base)
+    }
+
+    pub fn exit_status(&self) -> Option<Win32ExitStatus> {
+        self.get(Win32ProcessFields::EXIT_STATUS, self.exit_status)
+    }
+
+    pub fn ethread(&self) -> Option<Address> {
+        self.get(Win32ProcessFields::ETHREAD, self.ethread)
+    }
+}
+
+/// Reads `fields` of all `entries` from kernel memory.
+///
+/// All fields of all entries are read in a single batch. Unreadable fields are read as zero.
+pub(crate) fn read_process_fields<M: VirtualMemory, E: BorrowMut<Win32ProcessEntry>>(
+    mem: &mut M,
+    arch: ArchitectureObj,
+    offsets: &Win32Offsets,
+    entries: &mut [E],
+    fields: Win32ProcessFields,
+) -> Result<()> {
+    trace!("reading {:?} of {} processes", fields, entries.len());
+
+    let mut plan = TraversalPlan::new(arch);
+    let root = plan.root();
+    let select = |plan: &mut TraversalPlan, field, offset, len| {
+        if fields.contains(field) {
+            Some(plan.read(root, offset, len))
+        } else {
+            None
+        }
+    };
+
+    let size = arch.size_addr();
+    let pid = select(&mut plan, Win32ProcessFields::PID, offsets.eproc_pid(), 4);
+    let name = select(
+        &mut plan,
+        Win32ProcessFields::NAME,
+        offsets.eproc_name(),
+        IMAGE_FILE_NAME_LENGTH,
+    );
+    let dtb = select(
+        &mut plan,
+        Win32ProcessFields::DTB,
+        offsets.kproc_dtb(),
+        size,
+    );
+    // the wow64 pointer is missing on systems without wow64 support
+    let wow64 = if offsets.eproc_wow64() != 0 {
+        select(
+            &mut plan,
+            Win32ProcessFields::WOW64,
+            offsets.eproc_wow64(),
+            size,
+        )
+    } else {
+        None
+    };
+    let peb = select(
+        &mut plan,
+        Win32ProcessFields::PEB,
+        offsets.eproc_peb(),
+        size,
+    );
+    let section_base = select(
+        &mut plan,
+        Win32ProcessFields::SECTION_BASE,
+        offsets.eproc_section_base(),
+        size,
+    );
+    let exit_status = select(
+        &mut plan,
+        Win32ProcessFields::EXIT_STATUS,
+        offsets.eproc_exit_status(),
+        4,
+    );
+    let thread_list = select(
+        &mut plan,
+        Win32ProcessFields::ETHREAD,
+        offsets.eproc_thread_list(),
+        size,
+    );
+
+    let roots = entries
+        .iter()
+        .map(|entry| entry.borrow().address)
+        .collect::<Vec<_>>();
+    let traversal = plan.execute(mem, &roots)?;
+
+    // pointers are read into a zero extended u64, as on x86 they are always little endian
+    let addr = |field, idx| Address::from(traversal.value::<u64>(field, idx));
+
+    for (idx, entry) in entries.iter_mut().enumerate() {
+        let entry = entry.borrow_mut();
+        if let Some(pid) = pid {
+            entry.pid = traversal.value(pid, idx);
+        }
+        if let Some(name) = name {
+            let buf = traversal.field(name, idx);
+            let len = buf
+                .iter()
+                .position(|&c| c == 0)
+                .unwrap_or_else(|| buf.len());
+            // the name is read again on every refresh, so keep the allocation of the entry
+            entry.name.clear();
+            entry.name.push_str(&String::from_utf8_lossy(&buf[..len]));
+        }
+        if let Some(dtb) = dtb {
+            entry.dtb = addr(dtb, idx);
+        }
+        if let Some(wow64) = wow64 {
+            entry.wow64 = addr(wow64, idx);
+        }
+        if let Some(peb) = peb {
+            entry.peb = addr(peb, idx);
+        }
+        if let Some(section_base) = section_base {
+            entry.section_base = addr(section_base, idx);
+        }
+        if let Some(exit_status) = exit_status {
+            entry.exit_status = traversal.value(exit_status, idx);
+        }
+        if let Some(thread_list) = thread_list {
+            entry.ethread = addr(thread_list, idx)
+                .non_null()
+                .map(|list| list - offsets.ethread_list_entry())
+                .unwrap_or_default();
+        }
+        entry.fields |= fields;
+    }
+
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::offsets::Win32OffsetTable;
+    use memflow::architecture::x86::x64;
+    use memflow::mem::dummy::DummyMemory;
+    use memflow::types::size;
+
+    fn offsets() -> Win32Offsets {
+        Win32Offsets(Win32OffsetTable {
+            list_blink: 0x8,
+            eproc_link: 0x2f0,
+            kproc_dtb: 0x28,
+            eproc_pid: 0x2e8,
+            eproc_name: 0x450,
+            eproc_peb: 0x3f8,
+            eproc_section_base: 0x3c0,
+            eproc_exit_status: 0x654,
+            eproc_thread_list: 0x488,
+            eproc_wow64: 0x428,
+            kthread_teb: 0xf0,
+            ethread_list_entry: 0x6a8,
+            teb_peb: 0x60,
+            teb_peb_x86: 0x30,
+            kthread_initial_stack: 0x28,
+            ktrap_frame_ip: 0x168,
+            ktrap_frame_size: 0x190,
+            psp_cid_table_rva: 0,
+            handle_table_code: 0x8,
+            ethread_cid: 0x648,
+        })
+    }
+
+    #[test]
+    fn test_read_fields() {
+        let offsets = offsets();
+        let (mut mem, base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &[0; 0x2000]);
+
+        let eprocs = [base, base + 0x1000];
+        for (i, &eproc) in eprocs.iter().enumerate() {
+            mem.virt_write(eproc + offsets.eproc_pid(), &(4 + i as u32 * 4))
+                .unwrap();
+            mem.virt_write(eproc + offsets.eproc_name(), &b"System\0"[..])
+                .unwrap();
+            mem.virt_write(eproc + offsets.kproc_dtb(), &0x1aa000u64)
+                .unwrap();
+            mem.virt_write(eproc + offsets.eproc_thread_list(), &0xffff_1000u64)
+                .unwrap();
+        }
+        // the long name is cut off at IMAGE_FILE_NAME_LENGTH
+        mem.virt_write(eprocs[1] + offsets.eproc_name(), &b"svchost.exe.long"[..])
+            .unwrap();
+
+        let mut entries = eprocs
+            .iter()
+            .map(|&eproc| Win32ProcessEntry::new(eproc))
+            .collect::<Vec<_>>();
+        let fields = Win32ProcessFields::PID | Win32ProcessFields::NAME;
+        read_process_fields(&mut mem, x64::ARCH, &offsets, &mut entries, fields).unwrap();
+
+        assert_eq!(entries[0].fields(), fields);
+        assert_eq!(entries[0].pid(), Some(4));
+        assert_eq!(entries[0].name(), Some("System"));
+        assert_eq!(entries[1].pid(), Some(8));
+        assert_eq!(entries[1].name(), Some("svchost.exe.lon"));
+        assert_eq!(entries[1].dtb(), None);
+
+        let fields = Win32ProcessFields::DTB | Win32ProcessFields::ETHREAD;
+        read_process_fields(&mut mem, x64::ARCH, &offsets, &mut entries[1..], fields).unwrap();
+        assert_eq!(entries[0].dtb(), None);
+        assert_eq!(entries[1].pid(), Some(8));
+        assert_eq!(entries[1].dtb(), Some(0x1aa000.into()));
+        assert_eq!(
+            entries[1].ethread(),
+            Some(Address::from(0xffff_1000u64) - offsets.ethread_list_entry())
+        );
+
+        // a shorter name replaces the previous one
+        mem.virt_write(eprocs[1] + offsets.eproc_name(), &b"smss.exe\0"[..])
+            .unwrap();
+        read_process_fields(
+            &mut mem,
+            x64::ARCH,
+            &offsets,
+            &mut entries[1..],
+            Win32ProcessFields::NAME,
+        )
+        .unwrap();
+        assert_eq!(entries[1].name(), Some("smss.exe"));
+    }
+}
@@ -0,0 +1,497 @@
+/*!
+Module for sampling the instruction pointers of threads running inside the target.
+
+Whenever a thread enters the kernel from user mode (system calls, interrupts, the scheduler tick)
+its user mode context is saved in a `_KTRAP_FRAME` right below the initial kernel stack of the
+thread. Reading the instruction pointer of that trap frame for all threads of a process at a
+fixed rate yields a statistical profile of where the process spends its time, without any agent
+running inside of the target.
+
+The location of the trap frame of every thread only changes when threads are created or exit,
+so it is resolved once in `ThreadSampler::refresh_with_kernel`. A single sample then consists of
+one batched read of the instruction pointers of all threads. The instruction pointers are
+attributed to the modules of their process and accumulated in a histogram.
+
+Thread sampling is currently only supported on 64-bit kernels and requires the
+`_KTHREAD::InitialStack` and `_KTRAP_FRAME` offsets, which are resolved from the kernel pdb.
+
+# Examples:
+
+```
+use std::time::Duration;
+
+use memflow::mem::{PhysicalMemory, VirtualTranslate};
+use memflow_win32::win32::{Kernel, ThreadSampler};
+
+fn test<T: PhysicalMemory, V: VirtualTranslate>(kernel: &mut Kernel<T, V>) {
+    let process_info = kernel.process_info("explorer.exe").unwrap();
+    let mut sampler = ThreadSampler::try_with(kernel, &[process_info]).unwrap();
+
+    // sample all threads every millisecond for one second
+    sampler
+        .run_with_kernel(kernel, Duration::from_millis(1), 1000)
+        .unwrap();
+
+    for sample in sampler.histogram() {
+        println!("{}+{:x}: {}", sample.module, sample.offset, sample.count);
+    }
+}
+```
+*/
+use std::prelude::v1::*;
+
+use super::{Kernel, Win32ModuleInfo, Win32Process, Win32ProcessInfo, Win32VirtualTranslate};
+use crate::error::{Error, Result};
+
+use std::collections::BTreeMap;
+use std::fmt;
+
+use log::{debug, trace};
+
+use memflow::architecture::x86;
+use memflow::error::PartialResultExt;
+use memflow::mem::{
+    ListWalker, PhysicalMemory, VirtualDMA, VirtualMemory, VirtualReadData, VirtualTranslate,
+};
+use memflow::process::{OsProcessModuleInfo, PID};
+use memflow::types::Address;
+
+#[cfg(feature = "std")]
+use std::time::{Duration, Instant};
+
+const MAX_ITER_COUNT: usize = 65536;
+
+#[derive(Debug, Clone)]
+struct SampledModule {
+    pid: PID,
+    name: String,
+    base: Address,
+    size: usize,
+}
+
+#[derive(Debug, Clone, Copy)]
+struct SampledThread {
+    // index of the process in `ThreadSampler::processes`
+    process: usize,
+    // address of the saved user mode instruction pointer
+    ip_addr: Address,
+}
+
+/// The number of samples that hit a location inside of a module.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct SampleCount<'a> {
+    pub pid: PID,
+    pub module: &'a str,
+    /// Offset of the location from the module base, rounded down to the sampler granularity.
+    pub offset: usize,
+    pub count: u64,
+}
+
+/// Keeps the allocation of the read list between samples.
+#[derive(Default)]
+struct ReadList(Vec<VirtualReadData<'static>>);
+
+impl Clone for ReadList {
+    fn clone(&self) -> Self {
+        Self::default()
+    }
+}
+
+impl fmt::Debug for ReadList {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.debug_struct("ReadList")
+            .field("capacity", &self.0.capacity())
+            .finish()
+    }
+}
+
+/// Samples the instruction pointers of all threads of a set of processes.
+#[derive(Clone, Debug)]
+pub struct ThreadSampler {
+    processes: Vec<Win32ProcessInfo>,
+    // distance from the initial kernel stack to the saved instruction pointer
+    ip_offset: usize,
+    granularity: usize,
+
+    threads: Vec<SampledThread>,
+    ips: Vec<[u8; 8]>,
+    read_list: ReadList,
+
+    // all modules that were ever seen, histogram entries refer to their index
+    modules: Vec<SampledModule>,
+    module_ids: BTreeMap<(PID, Address), usize>,
+    // (process, module base, module index) of the last refresh, sorted
+    module_lookup: Vec<(usize, Address, usize)>,
+
+    histogram: BTreeMap<(usize, usize), u64>,
+    samples: u64,
+    unresolved: u64,
+}
+
+impl ThreadSampler {
+    /// Creates a sampler for all threads of `processes` and resolves their threads and modules.
+    pub fn try_with<T: PhysicalMemory, V: VirtualTranslate>(
+        kernel: &mut Kernel<T, V>,
+        processes: &[Win32ProcessInfo],
+    ) -> Result<Self> {
+        if kernel.kernel_info.start_block.arch != x86::x64::ARCH {
+            return Err(Error::InvalidArchitecture);
+        }
+
+        let offsets = &kernel.offsets;
+        if offsets.kthread_initial_stack() == 0
+            || offsets.ktrap_frame_size() == 0
+            || offsets.ktrap_frame_ip() == 0
+        {
+            return Err(Error::Other(
+                "thread sampling requires the _KTHREAD::InitialStack and _KTRAP_FRAME offsets",
+            ));
+        }
+
+        let mut sampler = Self::new(
+            processes.to_vec(),
+            offsets.ktrap_frame_size() - offsets.ktrap_frame_ip(),
+        );
+        sampler.refresh_with_kernel(kernel)?;
+        Ok(sampler)
+    }
+
+    fn new(processes: Vec<Win32ProcessInfo>, ip_offset: usize) -> Self {
+        Self {
+            processes,
+            ip_offset,
+            granularity: 1,
+
+            threads: vec![],
+            ips: vec![],
+            read_list: ReadList::default(),
+
+            modules: vec![],
+            module_ids: BTreeMap::new(),
+            module_lookup: vec![],
+
+            histogram: BTreeMap::new(),
+            samples: 0,
+            unresolved: 0,
+        }
+    }
+
+    /// Changes the granularity of the histogram in bytes.
+    ///
+    /// Samples are accumulated in buckets of `granularity` bytes, e.g. a granularity of 0x10
+    /// roughly groups samples by basic block instead of by instruction.
+    pub fn granularity(mut self, granularity: usize) -> Self {
+        self.granularity = granularity.max(1);
+        self
+    }
+
+    /// Re-reads the thread lists and module lists of all sampled processes.
+    ///
+    /// This has to be called to pick up threads that were created and modules that were loaded
+    /// after the sampler was created. The accumulated histogram is kept.
+    pub fn refresh_with_kernel<T: PhysicalMemory, V: VirtualTranslate>(
+        &mut self,
+        kernel: &mut Kernel<T, V>,
+    ) -> Result<()> {
+        let arch = kernel.kernel_info.start_block.arch;
+        let offsets = kernel.offsets.clone();
+
+        // walk the thread lists of all processes in lockstep
+        let mut ethreads = vec![];
+        {
+            let mut reader = kernel_reader(kernel);
+
+            let heads = self
+                .processes
+                .iter()
+                .map(|info| info.address + offsets.eproc_thread_list())
+                .collect::<Vec<_>>();
+            ListWalker::new().max_len(MAX_ITER_COUNT).walk(
+                &mut reader,
+                arch,
+                &heads,
+                |idx, entry| ethreads.push((idx, entry - offsets.ethread_list_entry())),
+            )?;
+
+            // read the initial kernel stacks of all threads at once
+            let mut stacks = vec![[0u8; 8]; ethreads.len()];
+            let mut list = ethreads
+                .iter()
+                .zip(stacks.iter_mut())
+                .map(|(&(_, ethread), buf)| {
+                    VirtualReadData(ethread + offsets.kthread_initial_stack(), &mut buf[..])
+                })
+                .collect::<Vec<_>>();
+            reader.virt_read_raw_list(&mut list).data_part()?;
+
+            let ip_offset = self.ip_offset;
+            self.threads.clear();
+            self.threads
+                .extend(
+                    ethreads
+                        .iter()
+                        .zip(stacks.iter())
+                        .filter_map(|(&(process, _), stack)| {
+                            Address::from(u64::from_le_bytes(*stack))
+                                .non_null()
+                                .map(|stack| SampledThread {
+                                    process,
+                                    ip_addr: stack - ip_offset,
+                                })
+                        }),
+                );
+            self.ips.resize(self.threads.len(), [0; 8]);
+        }
+        trace!("sampling {} threads", self.threads.len());
+
+        // resolve the modules of all processes
+        let mut module_lookup = vec![];
+        for idx in 0..self.processes.len() {
+            let info = self.processes[idx].clone();
+            let pid = info.pid;
+
+            match Win32Process::with_kernel_ref(kernel, info).module_list() {
+                Ok(modules) => {
+                    for module in modules.iter() {
+                        module_lookup.push((idx, module.base, self.module_id(pid, module)));
+                    }
+                }
+                Err(err) => debug!("unable to read modules of pid {}: {:?}", pid, err),
+            }
+        }
+        module_lookup.sort_unstable();
+        self.module_lookup = module_lookup;
+
+        Ok(())
+    }
+
+    fn module_id(&mut self, pid: PID, module: &Win32ModuleInfo) -> usize {
+        let modules = &mut self.modules;
+        let id = *self
+            .module_ids
+            .entry((pid, module.base))
+            .or_insert_with(|| {
+                modules.push(SampledModule {
+                    pid,
+                    name: module.name().to_string(),
+                    base: module.base,
+                    size: module.size,
+                });
+                modules.len() - 1
+            });
+
+        // a different module was mapped at the same base
+        if self.modules[id].size != module.size || self.modules[id].name != module.name() {
+            self.modules.push(SampledModule {
+                pid,
+                name: module.name().to_string(),
+                base: module.base,
+                size: module.size,
+            });
+            self.module_ids
+                .insert((pid, module.base), self.modules.len() - 1);
+            return self.modules.len() - 1;
+        }
+
+        id
+    }
+
+    /// Takes a single sample of all threads.
+    ///
+    /// `kernel_mem` has to be able to read kernel memory, e.g. the virtual memory of any process.
+    /// All instruction pointers are read in a single batch. Returns the number of threads sampled.
+    pub fn sample<T: VirtualMemory>(&mut self, kernel_mem: &mut T) -> Result<usize> {
+        {
+            let mut list = VirtualReadData::recycle_list(std::mem::take(&mut self.read_list.0));
+            list.extend(
+                self.threads
+                    .iter()
+                    .zip(self.ips.iter_mut())
+                    .map(|(thread, buf)| VirtualReadData(thread.ip_addr, &mut buf[..])),
+            );
+            let ret = kernel_mem.virt_read_raw_list(&mut list).data_part();
+            self.read_list.0 = VirtualReadData::recycle_list(list);
+            ret?;
+        }
+
+        for (thread, ip) in self.threads.iter().zip(self.ips.iter()) {
+            let ip = Address::from(u64::from_le_bytes(*ip));
+
+            match resolve(&self.module_lookup, &self.modules, thread.process, ip) {
+                Some((module, offset)) => {
+                    *self
+                        .histogram
+                        .entry((module, offset / self.granularity))
+                        .or_default() += 1
+                }
+                None => self.unresolved += 1,
+            }
+        }
+        self.samples += self.threads.len() as u64;
+
+        Ok(self.threads.len())
+    }
+
+    /// Takes a single sample of all threads with the kernel context.
+    pub fn sample_with_kernel<T: PhysicalMemory, V: VirtualTranslate>(
+        &mut self,
+        kernel: &mut Kernel<T, V>,
+    ) -> Result<usize> {
+        self.sample(&mut kernel_reader(kernel))
+    }
+
+    /// Takes `count` samples, one every `interval`.
+    #[cfg(feature = "std")]
+    pub fn run_with_kernel<T: PhysicalMemory, V: VirtualTranslate>(
+        &mut self,
+        kernel: &mut Kernel<T, V>,
+        interval: Duration,
+        count: usize,
+    ) -> Result<()> {
+        for _ in 0..count {
+            let start = Instant::now();
+            self.sample_with_kernel(kernel)?;
+            if let Some(rest) = interval.checked_sub(start.elapsed()) {
+                std::thread::sleep(rest);
+            }
+        }
+        Ok(())
+    }
+
+    /// Returns all locations that were hit so far, ordered by module and offset.
+    pub fn histogram(&self) -> impl Iterator<Item = SampleCount<'_>> + '_ {
+        self.histogram
+            .iter()
+            .map(move |(&(module, bucket), &count)| SampleCount {
+                pid: self.modules[module].pid,
+                module: &self.modules[module].name,
+                offset: bucket * self.granularity,
+                count,
+            })
+    }
+
+    /// Returns the total number of thread samples taken, including the unresolved ones.
+    pub fn samples(&self) -> u64 {
+        self.samples
+    }
+
+    /// Returns the number of samples that did not hit any module, e.g. threads in jitted code.
+    pub fn unresolved(&self) -> u64 {
+        self.unresolved
+    }
+
+    /// Returns the number of threads that are sampled.
+    pub fn thread_count(&self) -> usize {
+        self.threads.len()
+    }
+
+    /// Clears the accumulated histogram.
+    pub fn clear(&mut self) {
+        self.histogram.clear();
+        self.samples = 0;
+        self.unresolved = 0;
+    }
+}
+
+fn kernel_reader<T: PhysicalMemory, V: VirtualTranslate>(
+    kernel: &mut Kernel<T, V>,
+) -> VirtualDMA<&mut T, &mut V, Win32VirtualTranslate> {
+    VirtualDMA::with_vat(
+        &mut kernel.phys_mem,
+        kernel.kernel_info.start_block.arch,
+        Win32VirtualTranslate::new(kernel.kernel_info.start_block.arch, kernel.sysproc_dtb),
+        &mut kernel.vat,
+    )
+}
+
+/// Finds the module of `process` containing `ip` and returns its index and the offset into it.
+fn resolve(
+    lookup: &[(usize, Address, usize)],
+    modules: &[SampledModule],
+    process: usize,
+    ip: Address,
+) -> Option<(usize, usize)> {
+    let idx = match lookup.binary_search_by(|&(p, base, _)| (p, base).cmp(&(process, ip))) {
+        Ok(idx) => idx,
+        Err(0) => return None,
+        Err(idx) => idx - 1,
+    };
+
+    let (p, base, module) = lookup[idx];
+    if p == process && ip - base < modules[module].size {
+        Some((module, ip - base))
+    } else {
+        None
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use memflow::mem::dummy::DummyMemory;
+    use memflow::types::size;
+
+    fn module(name: &str, base: u64, size: usize) -> Win32ModuleInfo {
+        Win32ModuleInfo::new(
+            Address::null(),
+            Address::null(),
+            base.into(),
+            size,
+            String::new(),
+            name,
+        )
+    }
+
+    #[test]
+    fn test_sample() {
+        let ips: [u64; 6] = [0x1010, 0x1010, 0x4020, 0x9000, 0x1fff, 0x1018];
+        let data = ips
+            .iter()
+            .flat_map(|ip| ip.to_le_bytes().to_vec())
+            .collect::<Vec<_>>();
+        let (mut mem, addr) = DummyMemory::new_virt(size::mb(4), size::mb(2), &data);
+
+        let mut sampler = ThreadSampler::new(vec![], 0);
+        for i in 0..ips.len() {
+            sampler.threads.push(SampledThread {
+                // the last thread belongs to a process without modules
+                process: if i < 5 { 0 } else { 1 },
+                ip_addr: addr + i * 8,
+            });
+        }
+        sampler.ips.resize(ips.len(), [0; 8]);
+
+        let a = sampler.module_id(4, &module("a.dll", 0x1000, 0x1000));
+        let b = sampler.module_id(4, &module("b.dll", 0x4000, 0x100));
+        sampler.module_lookup = vec![(0, 0x1000.into(), a), (0, 0x4000.into(), b)];
+
+        assert_eq!(sampler.sample(&mut mem).unwrap(), 6);
+        assert_eq!(sampler.samples(), 6);
+        assert_eq!(sampler.unresolved(), 2);
+
+        let hist = sampler
+            .histogram()
+            .map(|s| (s.module, s.offset, s.count))
+            .collect::<Vec<_>>();
+        assert_eq!(
+            hist,
+            vec![("a.dll", 0x10, 2), ("a.dll", 0xfff, 1), ("b.dll", 0x20, 1)]
+        );
+
+        // a module with the same base but a different size gets a new index
+        assert_eq!(sampler.module_id(4, &module("a.dll", 0x1000, 0x1000)), a);
+        assert_ne!(sampler.module_id(4, &module("c.dll", 0x1000, 0x2000)), a);
+
+        let mut sampler = sampler.granularity(0x100);
+        sampler.clear();
+        sampler.sample(&mut mem).unwrap();
+        let hist = sampler
+            .histogram()
+            .map(|s| (s.module, s.offset, s.count))
+            .collect::<Vec<_>>();
+        assert_eq!(
+            hist,
+            vec![("a.dll", 0, 2), ("a.dll", 0xf00, 1), ("b.dll", 0, 1)]
+        );
+    }
+}
@@ -0,0 +1,24 @@
+/*!
+Binary trace events emitted by the win32 layer.
+
+See `memflow::trace` for how to enable tracing and how to dump the recorded events.
+*/
+
+use memflow::trace::event::USER_BASE;
+
+/// An entry of the kernel process list was walked. Arguments: eprocess, flink, blink.
+pub const EPROCESS_ENTRY: u32 = USER_BASE + 0x100;
+/// The kernel process list walk finished. Arguments: number of processes found.
+pub const EPROCESS_LIST_END: u32 = USER_BASE + 0x101;
+/// Process information was read from an eprocess. Arguments: eprocess, pid, dtb.
+pub const PROCESS_INFO: u32 = USER_BASE + 0x102;
+
+/// Returns a readable name of a trace event, including the events emitted by memflow itself.
+pub fn name(event: u32) -> Option<&'static str> {
+    match event {
+        EPROCESS_ENTRY => Some("eprocess_entry"),
+        EPROCESS_LIST_END => Some("eprocess_list_end"),
+        PROCESS_INFO => Some("process_info"),
+        _ => memflow::trace::event::name(event),
+    }
+}
@@ -46,6 +46,16 @@ impl ScopedVirtualTranslate for Win32VirtualTranslate {
         translator.virt_to_phys_iter(mem, addrs, out, out_fail, arena)
     }
 
+    fn virt_to_phys_fixed<T: PhysicalMemory, const N: usize>(
+        &self,
+        mem: &mut T,
+        addrs: &[Address],
+        out: &mut [memflow::error::Result<PhysicalAddress>],
+    ) {
+        let translator = x86::new_translator(self.dtb, self.sys_arch).unwrap();
+        translator.virt_to_phys_fixed::<_, N>(mem, addrs, out)
+    }
+
     fn translation_table_id(&self, _address: Address) -> usize {
         self.dtb.as_u64().overflowing_shr(12).0 as usize
     }
@@ -1,12 +1,14 @@
 pub(crate) mod translate_data;
 
 use crate::error::{Error, Result};
-use crate::iter::{PageChunks, SplitAtIndex};
+use crate::iter::{FnExtend, PageChunks, SplitAtIndex};
 use crate::mem::{PhysicalMemory, PhysicalReadData};
+use crate::trace::event;
 use crate::types::{Address, PageType, PhysicalAddress};
 use std::convert::TryInto;
-use translate_data::{TranslateData, TranslateVec, TranslationChunk};
+use translate_data::{TranslateData, TranslationBatch};
 
+use arrayvec::ArrayVec;
 use bumpalo::{collections::Vec as BumpVec, Bump};
 use vector_trees::{BVecTreeMap as BTreeMap, Vector};
 
@@ -66,15 +68,11 @@ pub struct ArchMMUSpec {
 pub trait MMUTranslationBase {
     fn get_initial_pt(&self, address: Address) -> Address;
 
-    fn get_pt_by_index(&self, _: usize) -> Address;
-
-    fn pt_count(&self) -> usize;
-
     fn virt_addr_filter<B: SplitAtIndex, O: Extend<(Error, Address, B)>>(
         &self,
         spec: &ArchMMUSpec,
         addr: (Address, B),
-        data_to_translate: &mut TranslateVec<B>,
+        data_to_translate: &mut TranslationBatch<B>,
         out_fail: &mut O,
     );
 }
@@ -321,6 +319,11 @@ impl ArchMMUSpec {
 
     /// This function will do a virtual to physical memory translation for the `ArchMMUSpec` in
     /// `MMUTranslationBase` scope, over multiple elements.
+    ///
+    /// The translations are processed level by level. In every step, the whole batch is first
+    /// classified by the entry that was read in the previous step, the remaining translations
+    /// are split on the next page boundary, and the next entry addresses are computed in bulk.
+    /// Every distinct entry is then read exactly once, in a single batched read.
     pub(crate) fn virt_to_phys_iter<T, B, D, VI, VO, FO>(
         &self,
         mem: &mut T,
@@ -339,188 +342,328 @@ impl ArchMMUSpec {
     {
         vtop_trace!("virt_to_phys_iter_with_mmu");
 
-        let mut data_to_translate = BumpVec::new_in(arena);
-        let mut data_pt_read: BumpVec<PhysicalReadData> = BumpVec::new_in(arena);
-        let mut data_pt_buf = BumpVec::new_in(arena);
-        let mut data_to_translate_map = BTreeMap::new_in(BumpVec::new_in(arena));
+        let mut batch = TranslationBatch::new_in(arena);
+        let mut next_batch = TranslationBatch::new_in(arena);
 
-        //TODO: Calculate and reserve enough data in the data_to_translate vectors
-        //TODO: precalc vtop_step bit split sum / transform the splits to a lookup table
-        //TODO: Improve filtering speed (vec reserve)
-        //TODO: Optimize BTreeMap
+        // per element index into the list of unique entries
+        let mut entry_idx: BumpVec<u32> = BumpVec::new_in(arena);
+        // element indices sorted by entry address
+        let mut order: BumpVec<u32> = BumpVec::new_in(arena);
+        // unique entry addresses, their values and validity
+        let mut entry_addrs: BumpVec<Address> = BumpVec::new_in(arena);
+        let mut entry_vals: BumpVec<Address> = BumpVec::new_in(arena);
+        let mut entry_valid: BumpVec<bool> = BumpVec::new_in(arena);
+        let mut pt_buf: BumpVec<u8> = BumpVec::new_in(arena);
+        let mut addr_map = BTreeMap::new_in(BumpVec::new_in(arena));
 
-        data_to_translate
-            .extend((0..dtb.pt_count()).map(|idx| {
-                TranslationChunk::new(dtb.get_pt_by_index(idx), BumpVec::new_in(arena))
-            }));
-
-        addrs.for_each(|data| dtb.virt_addr_filter(self, data, &mut data_to_translate, out_fail));
-
-        data_to_translate
-            .iter_mut()
-            .for_each(|trd| trd.recalc_minmax());
+        addrs.for_each(|data| dtb.virt_addr_filter(self, data, &mut batch, out_fail));
 
         for pt_step in 0..self.split_count() {
-            vtop_trace!(
-                "pt_step = {}, data_to_translate.len() = {:x}",
-                pt_step,
-                data_to_translate.len()
-            );
+            vtop_trace!("pt_step = {}, batch.len() = {:x}", pt_step, batch.len());
 
             let next_page_size = self.page_size_step_unchecked(pt_step + 1);
 
             vtop_trace!("next_page_size = {:x}", next_page_size);
 
-            //Loop through the data in reverse order to allow the data buffer grow on the back when
-            //memory regions are split
-            for i in (0..data_to_translate.len()).rev() {
-                let tr_chunk = data_to_translate.swap_remove(i);
-                vtop_trace!(
-                    "checking pt_addr={:x}, elems={:x}",
-                    tr_chunk.pt_addr,
-                    tr_chunk.vec.len()
-                );
-
-                if !self.check_entry(tr_chunk.pt_addr, pt_step) {
+            // Classify the batch by the entries of the previous step. Translations that are
+            // still walking get split on the next page boundary into the next batch.
+            batch.drain_with(|addr, pt_addr, buf| {
+                if !self.check_entry(pt_addr, pt_step) {
                     //There has been an error in translation, push it to output with the associated buf
                     vtop_trace!("check_entry failed");
-                    out_fail.extend(
-                        tr_chunk
-                            .vec
-                            .into_iter()
-                            .map(|entry| (Error::VirtualTranslate, entry.addr, entry.buf)),
-                    );
-                } else if self.is_final_mapping(tr_chunk.pt_addr, pt_step) {
+                    out_fail.extend(Some((Error::VirtualTranslate, addr, buf)));
+                } else if self.is_final_mapping(pt_addr, pt_step) {
                     //We reached an actual page. The translation was successful
-                    vtop_trace!("found final mapping: {:x}", tr_chunk.pt_addr);
-                    let pt_addr = tr_chunk.pt_addr;
-                    out.extend(tr_chunk.vec.into_iter().map(|entry| {
-                        (self.get_phys_page(pt_addr, entry.addr, pt_step), entry.buf)
-                    }));
+                    vtop_trace!("found final mapping: {:x}", pt_addr);
+                    out.extend(Some((self.get_phys_page(pt_addr, addr, pt_step), buf)));
                 } else {
-                    //We still need to continue the page walk
-
-                    let min_addr = tr_chunk.min_addr();
-
-                    //As an optimization, divide and conquer the input memory regions.
-                    //VTOP speedup is insane. Visible in large sequential or chunked reads.
-                    for (_, (_, mut chunk)) in
-                        (arena, tr_chunk).page_chunks(min_addr, next_page_size)
-                    {
-                        let pt_addr = self.vtop_step(chunk.pt_addr, chunk.min_addr(), pt_step);
-                        chunk.pt_addr = pt_addr;
-                        data_to_translate.push(chunk);
+                    for (addr, buf) in buf.page_chunks(addr, next_page_size) {
+                        next_batch.push(addr, pt_addr, buf);
                     }
                 }
-            }
+            });
+
+            std::mem::swap(&mut batch, &mut next_batch);
 
-            if data_to_translate.is_empty() {
+            if batch.is_empty() {
                 break;
             }
 
-            if let Err(err) = self.read_pt_address_iter(
+            // Compute the entry addresses of this step for the whole batch at once
+            let pt_mask = self.pte_addr_mask(Address::INVALID, pt_step);
+            let (min_bits, max_bits) = self.virt_addr_bit_range(pt_step);
+            let index_mask = Address::bit_mask(0..(max_bits - min_bits - 1)).as_u64();
+            let pte_shift = self.pte_size.to_le().trailing_zeros();
+
+            for (pt_addr, addr) in batch.pt_addrs.iter_mut().zip(batch.addrs.iter()) {
+                *pt_addr = Address::from(
+                    (pt_addr.as_u64() & pt_mask)
+                        | (((addr.as_u64() >> min_bits) & index_mask) << pte_shift),
+                );
+            }
+
+            // Deduplicate the entries, so every one of them is only read once
+            order.clear();
+            order.extend(0..batch.len() as u32);
+            if !batch.pt_addrs.windows(2).all(|w| w[0] <= w[1]) {
+                let pt_addrs = &batch.pt_addrs;
+                order.sort_unstable_by_key(|&i| pt_addrs[i as usize]);
+            }
+
+            entry_addrs.clear();
+            entry_idx.clear();
+            entry_idx.resize(batch.len(), 0);
+
+            for &i in order.iter() {
+                let pt_addr = batch.pt_addrs[i as usize];
+                if entry_addrs.last() != Some(&pt_addr) {
+                    entry_addrs.push(pt_addr);
+                }
+                entry_idx[i as usize] = (entry_addrs.len() - 1) as u32;
+            }
+
+            trace_event!(event::VTOP_STEP, pt_step, batch.len(), entry_addrs.len());
+
+            if let Err(err) = self.read_pt_entries(
                 mem,
                 pt_step,
-                &mut data_to_translate_map,
-                &mut data_to_translate,
-                &mut data_pt_buf,
-                &mut data_pt_read,
-                out_fail,
+                arena,
+                &entry_addrs,
+                &mut pt_buf,
+                &mut entry_vals,
             ) {
-                vtop_trace!("read_pt_address_iter failure: {}", err);
-                out_fail.extend(
-                    data_to_translate
-                        .into_iter()
-                        .flat_map(|chunk| chunk.vec.into_iter())
-                        .map(|data| (err, data.addr, data.buf)),
-                );
+                vtop_trace!("read_pt_entries failure: {}", err);
+                trace_event!(event::VTOP_READ_FAIL, pt_step, batch.len());
+                batch.drain_with(|addr, _, buf| out_fail.extend(Some((err, addr, buf))));
                 return;
             }
+
+            self.filter_pt_entries(
+                pt_step,
+                &entry_addrs,
+                &entry_vals,
+                &mut entry_valid,
+                &mut addr_map,
+            );
+
+            // Gather the read entries back into the batch
+            let mut i = 0;
+            batch.drain_with(|addr, _, buf| {
+                let idx = entry_idx[i] as usize;
+                i += 1;
+
+                if entry_valid[idx] {
+                    next_batch.push(addr, entry_vals[idx], buf);
+                } else {
+                    out_fail.extend(Some((Error::VirtualTranslate, addr, buf)));
+                }
+            });
+
+            std::mem::swap(&mut batch, &mut next_batch);
         }
 
-        debug_assert!(data_to_translate.is_empty());
+        debug_assert!(batch.is_empty());
     }
 
-    //TODO: Clean this up to have less args
-    #[allow(clippy::too_many_arguments)]
-    fn read_pt_address_iter<'a, T, B, V, FO>(
+    /// Translates every address in `addrs` without allocating, writing the results to `out`.
+    ///
+    /// Up to `N` addresses are walked together, so every page walk step needs a single batched
+    /// read per `N` addresses. All state lives in fixed size arrays on the stack. Unlike
+    /// `virt_to_phys_iter` entries are neither deduplicated, nor checked for pointing to tables
+    /// that are already reached through other entries, which is fine since the walk of every
+    /// address ends after `split_count` steps either way.
+    pub(crate) fn virt_to_phys_fixed<T, D, const N: usize>(
         &self,
         mem: &mut T,
-        step: usize,
-        addr_map: &mut BTreeMap<V, Address, ()>,
-        addrs: &mut TranslateVec<'a, B>,
-        pt_buf: &mut BumpVec<u8>,
-        pt_read: &mut BumpVec<PhysicalReadData>,
-        err_out: &mut FO,
-    ) -> Result<()>
-    where
+        dtb: &D,
+        addrs: &[Address],
+        out: &mut [Result<PhysicalAddress>],
+    ) where
         T: PhysicalMemory + ?Sized,
-        FO: Extend<(Error, Address, B)>,
-        V: Vector<vector_trees::btree::BVecTreeNode<Address, ()>>,
-        B: SplitAtIndex,
+        D: MMUTranslationBase,
     {
+        debug_assert_eq!(addrs.len(), out.len());
+
+        for (addrs, out) in addrs.chunks(N.max(1)).zip(out.chunks_mut(N.max(1))) {
+            // the entry of the last step for every address, or none if the walk has ended
+            let mut pt_addrs = [None; N];
+
+            for ((&addr, pt_addr), res) in addrs.iter().zip(pt_addrs.iter_mut()).zip(out.iter_mut())
+            {
+                let mut valid = false;
+                self.virt_addr_filter(
+                    (addr, 1),
+                    &mut FnExtend::new(|_: TranslateData<usize>| valid = true),
+                    &mut FnExtend::void(),
+                );
+
+                if valid {
+                    *pt_addr = Some(dtb.get_initial_pt(addr));
+                } else {
+                    *res = Err(Error::VirtualTranslate);
+                }
+            }
+
+            for pt_step in 0..self.split_count() {
+                let mut pt_bufs = [[0_u8; 8]; N];
+                let mut pt_read = ArrayVec::<PhysicalReadData, N>::new();
+
+                for (((&addr, pt_addr), res), pt_buf) in addrs
+                    .iter()
+                    .zip(pt_addrs.iter_mut())
+                    .zip(out.iter_mut())
+                    .zip(pt_bufs.iter_mut())
+                {
+                    let entry = match *pt_addr {
+                        Some(entry) => entry,
+                        None => continue,
+                    };
+
+                    if !self.check_entry(entry, pt_step) {
+                        *res = Err(Error::VirtualTranslate);
+                        *pt_addr = None;
+                    } else if self.is_final_mapping(entry, pt_step) {
+                        *res = Ok(self.get_phys_page(entry, addr, pt_step));
+                        *pt_addr = None;
+                    } else {
+                        let entry_addr = self.vtop_step(entry, addr, pt_step);
+                        *pt_addr = Some(entry_addr);
+                        pt_read.push(PhysicalReadData(
+                            PhysicalAddress::with_page(
+                                entry_addr,
+                                PageType::PAGE_TABLE,
+                                self.pt_leaf_size(pt_step),
+                            ),
+                            pt_buf,
+                        ));
+                    }
+                }
+
+                if pt_read.is_empty() {
+                    break;
+                }
+
+                let read = mem.phys_read_raw_list(&mut pt_read);
+                drop(pt_read);
+
+                for ((pt_addr, res), pt_buf) in
+                    pt_addrs.iter_mut().zip(out.iter_mut()).zip(pt_bufs.iter())
+                {
+                    let entry_addr = match *pt_addr {
+                        Some(entry_addr) => entry_addr,
+                        None => continue,
+                    };
+
+                    let entry = Address::from(u64::from_le_bytes(*pt_buf));
+                    match read {
+                        // entries pointing back into their own table would walk in circles
+                        Ok(_)
+                            if self.pte_addr_mask(entry_addr, pt_step)
+                                != self.pte_addr_mask(entry, pt_step) =>
+                        {
+                            *pt_addr = Some(entry)
+                        }
+                        Ok(_) => {
+                            *res = Err(Error::VirtualTranslate);
+                            *pt_addr = None;
+                        }
+                        Err(err) => {
+                            *res = Err(err);
+                            *pt_addr = None;
+                        }
+                    }
+                }
+            }
+
+            debug_assert!(pt_addrs.iter().all(Option::is_none));
+        }
+    }
+
+    /// Read all page table entries in `entry_addrs` in a single batched read
+    fn read_pt_entries<T: PhysicalMemory + ?Sized>(
+        &self,
+        mem: &mut T,
+        step: usize,
+        arena: &Bump,
+        entry_addrs: &[Address],
+        pt_buf: &mut BumpVec<u8>,
+        entry_vals: &mut BumpVec<Address>,
+    ) -> Result<()> {
         //TODO: use self.pt_leaf_size(step) (need to handle LittleEndian::read_u64)
         let pte_size = 8;
         let page_size = self.pt_leaf_size(step);
 
-        //pt_buf.clear();
-        pt_buf.resize(pte_size * addrs.len(), 0);
-
-        debug_assert!(pt_read.is_empty());
-
-        //This is safe, because pt_read gets cleared at the end of the function
-        let pt_read: &mut BumpVec<PhysicalReadData> = unsafe { std::mem::transmute(pt_read) };
+        pt_buf.clear();
+        pt_buf.resize(pte_size * entry_addrs.len(), 0);
+
+        {
+            let mut pt_read = BumpVec::with_capacity_in(entry_addrs.len(), arena);
+
+            pt_read.extend(
+                pt_buf
+                    .chunks_exact_mut(pte_size)
+                    .zip(entry_addrs.iter())
+                    .map(|(chunk, &pt_addr)| {
+                        PhysicalReadData(
+                            PhysicalAddress::with_page(pt_addr, PageType::PAGE_TABLE, page_size),
+                            chunk,
+                        )
+                    }),
+            );
 
-        for (chunk, tr_chunk) in pt_buf.chunks_exact_mut(pte_size).zip(addrs.iter()) {
-            pt_read.push(PhysicalReadData(
-                PhysicalAddress::with_page(tr_chunk.pt_addr, PageType::PAGE_TABLE, page_size),
-                chunk,
-            ));
+            mem.phys_read_raw_list(&mut pt_read)?;
         }
 
-        mem.phys_read_raw_list(pt_read)?;
+        entry_vals.clear();
+        entry_vals.extend(
+            pt_buf
+                .chunks_exact(pte_size)
+                .map(|buf| Address::from(u64::from_le_bytes(buf[0..8].try_into().unwrap()))),
+        );
+
+        Ok(())
+    }
 
-        //Filter out duplicate reads
-        //Ideally, we would want to append all duplicates to the existing list, but they would mostly
-        //only occur, in strange kernel side situations when building the page map,
-        //and having such handling may end up highly inefficient (due to having to use map, and remapping it)
+    /// Filter out entries that would make the page walk go in circles
+    ///
+    /// Entries pointing back into their own table are rejected, and so are entries pointing to
+    /// a table that is already reached through another entry of the same step. Ideally, we would
+    /// want to walk duplicates as well, but they would mostly only occur in strange kernel side
+    /// situations when building the page map, and handling them may end up highly inefficient.
+    fn filter_pt_entries<V>(
+        &self,
+        step: usize,
+        entry_addrs: &[Address],
+        entry_vals: &[Address],
+        entry_valid: &mut BumpVec<bool>,
+        addr_map: &mut BTreeMap<V, Address, ()>,
+    ) where
+        V: Vector<vector_trees::btree::BVecTreeNode<Address, ()>>,
+    {
         addr_map.clear();
+        entry_valid.clear();
 
         //Okay, so this is extremely useful in one element reads.
         //We kind of have a local on-stack cache to check against
         //before a) checking in the set, and b) pushing to the set
         let mut prev_addr: Option<Address> = None;
 
-        for i in (0..addrs.len()).rev() {
-            let mut chunk = addrs.swap_remove(i);
-            let PhysicalReadData(_, buf) = pt_read.swap_remove(i);
-            let pt_addr = Address::from(u64::from_le_bytes(buf[0..8].try_into().unwrap()));
-
-            if self.pte_addr_mask(chunk.pt_addr, step) != self.pte_addr_mask(pt_addr, step)
-                && (prev_addr.is_none()
-                    || (prev_addr.unwrap() != pt_addr && !addr_map.contains_key(&pt_addr)))
-            {
-                chunk.pt_addr = pt_addr;
+        entry_valid.extend(entry_addrs.iter().zip(entry_vals.iter()).map(
+            |(&entry_addr, &pt_addr)| {
+                if self.pte_addr_mask(entry_addr, step) != self.pte_addr_mask(pt_addr, step)
+                    && (prev_addr.is_none()
+                        || (prev_addr.unwrap() != pt_addr && !addr_map.contains_key(&pt_addr)))
+                {
+                    if let Some(pa) = prev_addr {
+                        addr_map.insert(pa, ());
+                    }
 
-                if let Some(pa) = prev_addr {
-                    addr_map.insert(pa, ());
+                    prev_addr = Some(pt_addr);
+                    true
+                } else {
+                    false
                 }
-
-                prev_addr = Some(pt_addr);
-                addrs.push(chunk);
-                continue;
-            }
-
-            err_out.extend(
-                chunk
-                    .vec
-                    .into_iter()
-                    .map(|entry| (Error::VirtualTranslate, entry.addr, entry.buf)),
-            );
-        }
-
-        pt_read.clear();
-
-        Ok(())
+            },
+        ));
     }
 }
@@ -42,6 +42,20 @@ pub enum Endianess {
     BigEndian,
 }
 
+impl Endianess {
+    /// Returns the endianess of the host memflow is running on.
+    pub const fn native() -> Self {
+        #[cfg(target_endian = "little")]
+        {
+            Endianess::LittleEndian
+        }
+        #[cfg(target_endian = "big")]
+        {
+            Endianess::BigEndian
+        }
+    }
+}
+
 /// Translates virtual memory to physical using internal translation base (usually a process' dtb)
 ///
 /// This trait abstracts virtual address translation for a single virtual memory scope.
@@ -87,6 +101,24 @@ pub trait ScopedVirtualTranslate: Clone + Copy + Send {
         arena: &Bump,
     );
 
+    /// Translates every address in `addrs` into `out` without allocating.
+    ///
+    /// `N` is the number of addresses that are walked together in a single batch. The state of
+    /// the walk is kept on the stack, so the stack usage grows linearly with `N`. The default
+    /// implementation translates the addresses one by one through `virt_to_phys`, which does
+    /// allocate. Architectures that are used in allocation-free setups should override it.
+    fn virt_to_phys_fixed<T: PhysicalMemory, const N: usize>(
+        &self,
+        mem: &mut T,
+        addrs: &[Address],
+        out: &mut [Result<PhysicalAddress>],
+    ) {
+        addrs
+            .iter()
+            .zip(out.iter_mut())
+            .for_each(|(&addr, out)| *out = self.virt_to_phys(mem, addr));
+    }
+
     fn translation_table_id(&self, address: Address) -> usize;
 
     fn arch(&self) -> ArchitectureObj;
@@ -3,13 +3,16 @@ pub mod x32_pae;
 pub mod x64;
 
 use super::{
-    mmu_spec::{translate_data::TranslateVec, ArchMMUSpec, MMUTranslationBase},
+    mmu_spec::{
+        translate_data::{TranslateData, TranslationBatch},
+        ArchMMUSpec, MMUTranslationBase,
+    },
     Architecture, ArchitectureObj, Endianess, ScopedVirtualTranslate,
 };
 
 use super::Bump;
 use crate::error::{Error, Result};
-use crate::iter::SplitAtIndex;
+use crate::iter::{FnExtend, SplitAtIndex};
 use crate::mem::PhysicalMemory;
 use crate::types::{Address, PhysicalAddress};
 
@@ -79,6 +82,17 @@ impl ScopedVirtualTranslate for X86ScopedVirtualTranslate {
             .virt_to_phys_iter(mem, self.dtb, addrs, out, out_fail, arena)
     }
 
+    fn virt_to_phys_fixed<T: PhysicalMemory, const N: usize>(
+        &self,
+        mem: &mut T,
+        addrs: &[Address],
+        out: &mut [Result<PhysicalAddress>],
+    ) {
+        self.arch
+            .mmu
+            .virt_to_phys_fixed::<_, _, N>(mem, &self.dtb, addrs, out)
+    }
+
     fn translation_table_id(&self, _address: Address) -> usize {
         self.dtb.0.as_u64().overflowing_shr(12).0 as usize
     }
@@ -97,25 +111,23 @@ impl MMUTranslationBase for X86PageTableBase {
         self.0
     }
 
-    fn get_pt_by_index(&self, _: usize) -> Address {
-        self.0
-    }
-
-    fn pt_count(&self) -> usize {
-        1
-    }
-
     fn virt_addr_filter<B, O>(
         &self,
         spec: &ArchMMUSpec,
         addr: (Address, B),
-        data_to_translate: &mut TranslateVec<B>,
+        data_to_translate: &mut TranslationBatch<B>,
         out_fail: &mut O,
     ) where
         B: SplitAtIndex,
         O: Extend<(Error, Address, B)>,
     {
-        spec.virt_addr_filter(addr, &mut data_to_translate[0].vec, out_fail);
+        spec.virt_addr_filter(
+            addr,
+            &mut FnExtend::new(|data: TranslateData<B>| {
+                data_to_translate.push(data.addr, self.0, data.buf)
+            }),
+            out_fail,
+        );
     }
 }
 
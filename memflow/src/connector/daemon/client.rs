@@ -0,0 +1,226 @@
+/*!
+The client side of the daemon.
+*/
+
+use super::*;
+
+use crate::mem::{PhysicalMemory, PhysicalReadData, PhysicalWriteData};
+
+use std::fs::OpenOptions;
+use std::io::{Read, Write};
+use std::os::unix::net::UnixStream;
+use std::path::{Path, PathBuf};
+
+use memmap::{MmapMut, MmapOptions};
+
+/// Accesses the physical memory served by a `DaemonServer`.
+///
+/// Requests that do not fit into the shared segment are split up transparently.
+///
+/// Cloning the connector opens a new connection to the daemon with its own shared segment.
+/// The connection of a clone is only established on its first use. If the connection to the
+/// daemon breaks, the next request tries to reconnect.
+pub struct DaemonConnector {
+    path: PathBuf,
+    metadata: PhysicalMemoryMetadata,
+    conn: Option<Connection>,
+}
+
+impl DaemonConnector {
+    /// Connects to the daemon listening on the unix socket at `path`.
+    pub fn connect<P: AsRef<Path>>(path: P) -> Result<Self> {
+        let path = path.as_ref().to_path_buf();
+        let conn = Connection::open(&path)?;
+
+        Ok(Self {
+            path,
+            metadata: conn.header.metadata,
+            conn: Some(conn),
+        })
+    }
+
+    fn with_connection<F, R>(&mut self, func: F) -> Result<R>
+    where
+        F: FnOnce(&mut Connection) -> Result<R>,
+    {
+        if self.conn.is_none() {
+            self.conn = Some(Connection::open(&self.path)?);
+        }
+
+        let ret = func(self.conn.as_mut().unwrap());
+        if let Err(Error::IO(_)) = ret {
+            self.conn = None;
+        }
+        ret
+    }
+}
+
+impl Clone for DaemonConnector {
+    fn clone(&self) -> Self {
+        Self {
+            path: self.path.clone(),
+            metadata: self.metadata,
+            conn: None,
+        }
+    }
+}
+
+impl PhysicalMemory for DaemonConnector {
+    fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+        self.with_connection(|conn| conn.read_list(data))
+    }
+
+    fn phys_write_raw_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
+        self.with_connection(|conn| conn.write_list(data))
+    }
+
+    fn metadata(&self) -> PhysicalMemoryMetadata {
+        self.metadata
+    }
+}
+
+struct Connection {
+    stream: UnixStream,
+    map: MmapMut,
+    header: Header,
+}
+
+impl Connection {
+    fn open(path: &Path) -> Result<Self> {
+        let mut stream =
+            UnixStream::connect(path).map_err(|_| Error::IO("unable to connect to daemon"))?;
+
+        let mut len = [0_u8; 4];
+        stream
+            .read_exact(&mut len)
+            .map_err(|_| Error::IO("daemon handshake failed"))?;
+        let mut segment = vec![0_u8; u32::from_le_bytes(len) as usize];
+        stream
+            .read_exact(&mut segment)
+            .map_err(|_| Error::IO("daemon handshake failed"))?;
+        let segment = String::from_utf8(segment).map_err(|_| Error::Encoding)?;
+
+        let file = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .open(&segment)
+            .map_err(|_| Error::IO("unable to open daemon segment"))?;
+        let map = unsafe { MmapOptions::new().map_mut(&file) }
+            .map_err(|_| Error::IO("unable to map daemon segment"))?;
+        let header = Header::read(&map)?;
+
+        stream
+            .write_all(&[1])
+            .map_err(|_| Error::IO("daemon handshake failed"))?;
+
+        Ok(Self {
+            stream,
+            map,
+            header,
+        })
+    }
+
+    /// Sends a request of `count` entries and waits for its status.
+    fn submit(&mut self, op: u8, count: usize) -> Result<()> {
+        let mut status = [0_u8; 4];
+        self.stream
+            .write_all(&encode_request(op, count))
+            .and_then(|_| self.stream.read_exact(&mut status))
+            .map_err(|_| Error::IO("daemon connection lost"))?;
+
+        match i32::from_le_bytes(status) {
+            STATUS_OK => Ok(()),
+            STATUS_INVALID => Err(Error::Connector("invalid daemon request")),
+            _ => Err(Error::Connector("daemon request failed")),
+        }
+    }
+
+    fn read_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+        let data_size = self.header.data_size;
+        let mut pending = Vec::with_capacity(self.header.entry_capacity.min(data.len()));
+        let mut used = 0;
+
+        for PhysicalReadData(addr, buf) in data.iter_mut() {
+            let mut addr = *addr;
+            let mut buf = &mut buf[..];
+
+            while !buf.is_empty() {
+                if pending.len() == self.header.entry_capacity || used == data_size {
+                    self.flush_read(&mut pending)?;
+                    used = 0;
+                }
+
+                let len = buf.len().min(data_size - used);
+                let (head, tail) = std::mem::take(&mut buf).split_at_mut(len);
+                write_entry(&mut self.map, pending.len(), addr, len);
+                pending.push(head);
+
+                used += len;
+                addr = split_addr(addr, len);
+                buf = tail;
+            }
+        }
+
+        self.flush_read(&mut pending)
+    }
+
+    /// Reads all pending entries and copies their data out of the segment.
+    fn flush_read(&mut self, pending: &mut Vec<&mut [u8]>) -> Result<()> {
+        if pending.is_empty() {
+            return Ok(());
+        }
+
+        self.submit(OP_READ, pending.len())?;
+
+        let mut off = self.header.data_offset();
+        for buf in pending.drain(..) {
+            buf.copy_from_slice(&self.map[off..off + buf.len()]);
+            off += buf.len();
+        }
+
+        Ok(())
+    }
+
+    fn write_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
+        let data_offset = self.header.data_offset();
+        let data_size = self.header.data_size;
+        let mut count = 0;
+        let mut used = 0;
+
+        for PhysicalWriteData(addr, buf) in data.iter() {
+            let mut addr = *addr;
+            let mut buf = *buf;
+
+            while !buf.is_empty() {
+                if count == self.header.entry_capacity || used == data_size {
+                    self.submit(OP_WRITE, count)?;
+                    count = 0;
+                    used = 0;
+                }
+
+                let len = buf.len().min(data_size - used);
+                let (head, tail) = buf.split_at(len);
+                write_entry(&mut self.map, count, addr, len);
+                self.map[data_offset + used..data_offset + used + len].copy_from_slice(head);
+
+                count += 1;
+                used += len;
+                addr = split_addr(addr, len);
+                buf = tail;
+            }
+        }
+
+        if count > 0 {
+            self.submit(OP_WRITE, count)?;
+        }
+
+        Ok(())
+    }
+}
+
+/// Returns the address `len` bytes after `addr`.
+///
+/// The page information is dropped, since the remainder might not be in the same page.
+fn split_addr(addr: PhysicalAddress, len: usize) -> PhysicalAddress {
+    PhysicalAddress::from(addr.address() + len)
+}
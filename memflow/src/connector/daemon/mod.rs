@@ -0,0 +1,312 @@
+/*!
+Sharing a single connector between multiple local processes.
+
+A `DaemonServer` owns a `PhysicalMemory` object (usually a connector wrapped in a page cache)
+and serves it to other processes over a unix domain socket. Every client gets its own shared
+memory segment containing a request area and a data area, the socket is only used to exchange
+the segment and to signal requests and their completion. Read results are written by the daemon
+straight into the shared data area, so they never pass through the socket.
+
+On the client side `DaemonConnector` implements `PhysicalMemory`, so everything built on top of
+physical memory (virtual address translation, OS layers, the ffi) works unchanged, while all
+clients share the warm caches and the single connector of the daemon.
+
+```no_run
+use memflow::connector::daemon::{DaemonConnector, DaemonServer};
+use memflow::mem::dummy::DummyMemory;
+use memflow::types::size;
+
+// in the daemon
+std::thread::spawn(|| {
+    DaemonServer::bind("/tmp/memflow.sock", DummyMemory::new(size::mb(16)))
+        .unwrap()
+        .run()
+        .unwrap();
+});
+
+// in any client
+let mut mem = DaemonConnector::connect("/tmp/memflow.sock").unwrap();
+```
+
+# Layout of a segment
+
+```text
++--------------------+ 0
+| header             |
++--------------------+ HEADER_SIZE
+| entries            | entry_capacity * ENTRY_SIZE
++--------------------+
+| data               | data_size
++--------------------+
+```
+
+A request consists of up to `entry_capacity` entries (a physical address and a length) and the
+data of all entries packed back to back in the data area, in the order of the entries. The
+client writes the entries (and the data of writes), sends the operation and the number of
+entries over the socket and waits for the status of the request.
+*/
+
+pub mod client;
+pub use client::DaemonConnector;
+
+pub mod server;
+pub use server::DaemonServer;
+
+use crate::error::{Error, Result};
+use crate::mem::PhysicalMemoryMetadata;
+use crate::types::PhysicalAddress;
+
+use std::convert::TryInto;
+
+/// Magic value at the start of every shared segment.
+pub const DAEMON_MAGIC: [u8; 8] = *b"MFDAEMON";
+
+/// Version of the segment layout and of the socket protocol.
+pub const DAEMON_VERSION: u32 = 1;
+
+/// Default number of entries per request.
+pub const DEFAULT_ENTRY_CAPACITY: usize = 0x1000;
+
+/// Default size of the data area of every client.
+pub const DEFAULT_DATA_SIZE: usize = 0x100_0000;
+
+const HEADER_SIZE: usize = 64;
+const ENTRY_SIZE: usize = 16;
+const REQUEST_SIZE: usize = 8;
+
+const OP_READ: u8 = 1;
+const OP_WRITE: u8 = 2;
+
+const STATUS_OK: i32 = 0;
+const STATUS_FAILED: i32 = -1;
+const STATUS_INVALID: i32 = -2;
+
+/// Layout and metadata stored in the header of a segment.
+#[derive(Debug, Clone, Copy)]
+struct Header {
+    entry_capacity: usize,
+    data_size: usize,
+    metadata: PhysicalMemoryMetadata,
+}
+
+impl Header {
+    fn segment_size(&self) -> usize {
+        self.data_offset() + self.data_size
+    }
+
+    fn data_offset(&self) -> usize {
+        HEADER_SIZE + self.entry_capacity * ENTRY_SIZE
+    }
+
+    fn write(&self, buf: &mut [u8]) {
+        buf[0..8].copy_from_slice(&DAEMON_MAGIC);
+        buf[8..12].copy_from_slice(&DAEMON_VERSION.to_le_bytes());
+        buf[12..16].copy_from_slice(&(self.metadata.readonly as u32).to_le_bytes());
+        buf[16..24].copy_from_slice(&(self.entry_capacity as u64).to_le_bytes());
+        buf[24..32].copy_from_slice(&(self.data_size as u64).to_le_bytes());
+        buf[32..40].copy_from_slice(&(self.metadata.size as u64).to_le_bytes());
+    }
+
+    fn read(buf: &[u8]) -> Result<Self> {
+        if buf.len() < HEADER_SIZE || buf[0..8] != DAEMON_MAGIC {
+            return Err(Error::Connector("invalid daemon segment"));
+        }
+        if read_u32(&buf[8..]) != DAEMON_VERSION {
+            return Err(Error::Connector("daemon version mismatch"));
+        }
+
+        let header = Self {
+            entry_capacity: read_u64(&buf[16..]) as usize,
+            data_size: read_u64(&buf[24..]) as usize,
+            metadata: PhysicalMemoryMetadata {
+                size: read_u64(&buf[32..]) as usize,
+                readonly: read_u32(&buf[12..]) != 0,
+            },
+        };
+
+        if header.segment_size() > buf.len() {
+            return Err(Error::Connector("daemon segment is too small"));
+        }
+
+        Ok(header)
+    }
+}
+
+fn read_u32(buf: &[u8]) -> u32 {
+    u32::from_le_bytes(buf[..4].try_into().unwrap())
+}
+
+fn read_u64(buf: &[u8]) -> u64 {
+    u64::from_le_bytes(buf[..8].try_into().unwrap())
+}
+
+fn write_entry(buf: &mut [u8], idx: usize, addr: PhysicalAddress, len: usize) {
+    let off = HEADER_SIZE + idx * ENTRY_SIZE;
+    buf[off..off + 8].copy_from_slice(&addr.to_bits().to_le_bytes());
+    buf[off + 8..off + 16].copy_from_slice(&(len as u64).to_le_bytes());
+}
+
+fn read_entry(buf: &[u8], idx: usize) -> (PhysicalAddress, usize) {
+    let off = HEADER_SIZE + idx * ENTRY_SIZE;
+    (
+        PhysicalAddress::from_bits(read_u64(&buf[off..])),
+        read_u64(&buf[off + 8..]) as usize,
+    )
+}
+
+fn encode_request(op: u8, count: usize) -> [u8; REQUEST_SIZE] {
+    let mut req = [0; REQUEST_SIZE];
+    req[0] = op;
+    req[4..8].copy_from_slice(&(count as u32).to_le_bytes());
+    req
+}
+
+fn decode_request(req: &[u8; REQUEST_SIZE]) -> (u8, usize) {
+    (req[0], read_u32(&req[4..]) as usize)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::mem::dummy::DummyMemory;
+    use crate::mem::{PhysicalMemory, PhysicalReadData, PhysicalWriteData};
+    use crate::types::{size, Address, PageType};
+
+    use std::path::PathBuf;
+    use std::thread;
+
+    fn socket_path(name: &str) -> PathBuf {
+        std::env::temp_dir().join(format!("memflow-test-{}-{}.sock", name, std::process::id()))
+    }
+
+    fn spawn_server(name: &str, mem: DummyMemory, data_size: usize) -> PathBuf {
+        let path = socket_path(name);
+        let server = DaemonServer::bind(&path, mem)
+            .unwrap()
+            .entry_capacity(4)
+            .data_size(data_size);
+        thread::spawn(move || server.run());
+        path
+    }
+
+    #[test]
+    fn test_header() {
+        let header = Header {
+            entry_capacity: 16,
+            data_size: 0x1000,
+            metadata: PhysicalMemoryMetadata {
+                size: size::mb(2),
+                readonly: true,
+            },
+        };
+
+        let mut buf = vec![0; header.segment_size()];
+        header.write(&mut buf);
+        let read = Header::read(&buf).unwrap();
+        assert_eq!(read.entry_capacity, 16);
+        assert_eq!(read.data_size, 0x1000);
+        assert_eq!(read.metadata.size, size::mb(2));
+        assert!(read.metadata.readonly);
+        assert!(Header::read(&buf[..HEADER_SIZE]).is_err());
+
+        let addr = PhysicalAddress::with_page(Address::from(0x1234), PageType::PAGE_TABLE, 0x1000);
+        write_entry(&mut buf, 3, addr, 0x20);
+        assert_eq!(read_entry(&buf, 3), (addr, 0x20));
+
+        assert_eq!(
+            decode_request(&encode_request(OP_WRITE, 12)),
+            (OP_WRITE, 12)
+        );
+    }
+
+    #[test]
+    fn test_read_write() {
+        let mut mem = DummyMemory::new(size::mb(2));
+        let pattern = (0..0x3000).map(|i| i as u8).collect::<Vec<_>>();
+        mem.phys_write_raw(Address::from(0x1000).into(), &pattern)
+            .unwrap();
+
+        // a tiny data area forces requests to be split
+        let path = spawn_server("rw", mem, 0x800);
+        let mut client = DaemonConnector::connect(&path).unwrap();
+        assert_eq!(client.metadata().size, size::mb(2));
+
+        let mut buf = vec![0; 0x3000];
+        client
+            .phys_read_raw_into(Address::from(0x1000).into(), &mut buf)
+            .unwrap();
+        assert_eq!(buf, pattern);
+
+        client
+            .phys_write_raw(Address::from(0x10000).into(), &pattern[..0x1234])
+            .unwrap();
+
+        // clones use their own connection
+        let mut clone = client.clone();
+        let mut buf = vec![0; 0x1234];
+        clone
+            .phys_read_raw_into(Address::from(0x10000).into(), &mut buf)
+            .unwrap();
+        assert_eq!(buf[..], pattern[..0x1234]);
+    }
+
+    struct PanicOnce {
+        mem: DummyMemory,
+        panicked: bool,
+    }
+
+    impl PhysicalMemory for PanicOnce {
+        fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+            if !self.panicked {
+                self.panicked = true;
+                panic!("connector failure");
+            }
+            self.mem.phys_read_raw_list(data)
+        }
+
+        fn phys_write_raw_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
+            self.mem.phys_write_raw_list(data)
+        }
+
+        fn metadata(&self) -> PhysicalMemoryMetadata {
+            self.mem.metadata()
+        }
+    }
+
+    #[test]
+    fn test_connector_panic() {
+        let mem = PanicOnce {
+            mem: DummyMemory::new(size::mb(1)),
+            panicked: false,
+        };
+        let path = socket_path("panic");
+        let server = DaemonServer::bind(&path, mem).unwrap();
+        thread::spawn(move || server.run());
+
+        // the panicking request fails, the connection and the poisoned lock stay usable
+        let mut client = DaemonConnector::connect(&path).unwrap();
+        assert!(client.phys_read_raw(Address::from(0).into(), 8).is_err());
+        assert!(client.phys_read_raw(Address::from(0).into(), 8).is_ok());
+
+        let mut clone = client.clone();
+        assert!(clone.phys_read_raw(Address::from(0).into(), 8).is_ok());
+    }
+
+    #[test]
+    fn test_segment_is_unlinked() {
+        let dir = std::env::temp_dir().join(format!("memflow-test-shm-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+
+        let path = socket_path("unlink");
+        let server = DaemonServer::bind(&path, DummyMemory::new(size::mb(1)))
+            .unwrap()
+            .shm_dir(&dir);
+        thread::spawn(move || server.run());
+
+        let mut client = DaemonConnector::connect(&path).unwrap();
+        client.phys_read_raw(Address::from(0).into(), 8).unwrap();
+
+        assert_eq!(std::fs::read_dir(&dir).unwrap().count(), 0);
+        std::fs::remove_dir(&dir).unwrap();
+    }
+}
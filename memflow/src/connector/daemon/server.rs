@@ -0,0 +1,276 @@
+/*!
+The serving side of the daemon.
+*/
+
+use super::*;
+
+use crate::mem::{PhysicalMemory, PhysicalReadData, PhysicalWriteData};
+
+use std::fs::{self, OpenOptions};
+use std::io::{Read, Write};
+use std::os::unix::fs::OpenOptionsExt;
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::panic::{self, AssertUnwindSafe};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex, MutexGuard, PoisonError};
+use std::thread;
+
+use log::{debug, info, warn};
+use memmap::{MmapMut, MmapOptions};
+
+static SEGMENT_COUNTER: AtomicUsize = AtomicUsize::new(0);
+
+/// Serves a `PhysicalMemory` object to `DaemonConnector` clients.
+///
+/// Every client is handled on its own thread. Requests of all clients are executed on the same
+/// memory object, one request at a time, so caches wrapped around the connector are shared
+/// between all of them.
+pub struct DaemonServer<T> {
+    listener: UnixListener,
+    path: PathBuf,
+    shm_dir: PathBuf,
+    entry_capacity: usize,
+    data_size: usize,
+    mem: Arc<Mutex<T>>,
+}
+
+impl<T: PhysicalMemory + 'static> DaemonServer<T> {
+    /// Binds the daemon to the unix socket at `path`.
+    ///
+    /// A stale socket file at `path` is removed first.
+    pub fn bind<P: AsRef<Path>>(path: P, mem: T) -> Result<Self> {
+        let path = path.as_ref().to_path_buf();
+        if path.exists() {
+            fs::remove_file(&path).map_err(|_| Error::IO("unable to remove stale socket"))?;
+        }
+
+        let listener =
+            UnixListener::bind(&path).map_err(|_| Error::IO("unable to bind daemon socket"))?;
+
+        Ok(Self {
+            listener,
+            path,
+            shm_dir: default_shm_dir(),
+            entry_capacity: DEFAULT_ENTRY_CAPACITY,
+            data_size: DEFAULT_DATA_SIZE,
+            mem: Arc::new(Mutex::new(mem)),
+        })
+    }
+
+    /// Changes the directory the shared segments are created in.
+    ///
+    /// The default is `/dev/shm` if it exists and the temporary directory otherwise.
+    pub fn shm_dir<P: AsRef<Path>>(mut self, dir: P) -> Self {
+        self.shm_dir = dir.as_ref().to_path_buf();
+        self
+    }
+
+    /// Changes the maximum number of entries of a single request.
+    pub fn entry_capacity(mut self, entry_capacity: usize) -> Self {
+        self.entry_capacity = entry_capacity.max(1);
+        self
+    }
+
+    /// Changes the size of the data area of every client.
+    pub fn data_size(mut self, data_size: usize) -> Self {
+        self.data_size = data_size.max(1);
+        self
+    }
+
+    /// Returns the memory object that is being served.
+    ///
+    /// It can be used to inspect or shrink the caches while the daemon is running.
+    pub fn memory(&self) -> Arc<Mutex<T>> {
+        self.mem.clone()
+    }
+
+    /// Accepts and serves clients until the socket fails.
+    pub fn run(self) -> Result<()> {
+        info!("memflow daemon listening on {:?}", self.path);
+
+        for stream in self.listener.incoming() {
+            let stream = stream.map_err(|_| Error::IO("unable to accept daemon client"))?;
+
+            let header = Header {
+                entry_capacity: self.entry_capacity,
+                data_size: self.data_size,
+                metadata: lock_memory(&self.mem).metadata(),
+            };
+            let shm_dir = self.shm_dir.clone();
+            let mem = self.mem.clone();
+
+            thread::spawn(move || {
+                if let Err(err) = serve_client(stream, &shm_dir, header, &mem) {
+                    warn!("daemon client failed: {:?}", err);
+                }
+            });
+        }
+
+        Ok(())
+    }
+}
+
+impl<T> Drop for DaemonServer<T> {
+    fn drop(&mut self) {
+        let _ = fs::remove_file(&self.path);
+    }
+}
+
+fn default_shm_dir() -> PathBuf {
+    let shm = Path::new("/dev/shm");
+    if shm.is_dir() {
+        shm.to_path_buf()
+    } else {
+        std::env::temp_dir()
+    }
+}
+
+/// Creates the shared segment of a new client and maps it.
+///
+/// The segment is only accessible by the current user, and gets unlinked as soon as the client
+/// has mapped it.
+fn create_segment(dir: &Path, header: &Header) -> Result<(PathBuf, MmapMut)> {
+    let path = dir.join(format!(
+        "memflow-daemon-{}-{}",
+        std::process::id(),
+        SEGMENT_COUNTER.fetch_add(1, Ordering::Relaxed)
+    ));
+
+    let file = OpenOptions::new()
+        .read(true)
+        .write(true)
+        .create_new(true)
+        .mode(0o600)
+        .open(&path)
+        .map_err(|_| Error::IO("unable to create daemon segment"))?;
+
+    let map = file
+        .set_len(header.segment_size() as u64)
+        .ok()
+        .and_then(|_| unsafe { MmapOptions::new().map_mut(&file) }.ok());
+
+    match map {
+        Some(mut map) => {
+            header.write(&mut map);
+            Ok((path, map))
+        }
+        None => {
+            let _ = fs::remove_file(&path);
+            Err(Error::IO("unable to map daemon segment"))
+        }
+    }
+}
+
+fn serve_client<T: PhysicalMemory>(
+    mut stream: UnixStream,
+    shm_dir: &Path,
+    header: Header,
+    mem: &Mutex<T>,
+) -> Result<()> {
+    let (path, mut map) = create_segment(shm_dir, &header)?;
+
+    // hand out the segment and wait until the client has mapped it
+    let handshake = {
+        let path_bytes = path.to_string_lossy().into_owned().into_bytes();
+        let mut ack = [0_u8; 1];
+        stream
+            .write_all(&(path_bytes.len() as u32).to_le_bytes())
+            .and_then(|_| stream.write_all(&path_bytes))
+            .and_then(|_| stream.read_exact(&mut ack))
+    };
+    let _ = fs::remove_file(&path);
+    handshake.map_err(|_| Error::IO("daemon handshake failed"))?;
+
+    debug!("daemon client connected, segment {:?}", path);
+
+    let mut entries = Vec::with_capacity(header.entry_capacity);
+    let mut req = [0_u8; REQUEST_SIZE];
+    loop {
+        if stream.read_exact(&mut req).is_err() {
+            debug!("daemon client disconnected");
+            return Ok(());
+        }
+
+        let (op, count) = decode_request(&req);
+        let status = execute(&header, &mut map, &mut entries, op, count, mem);
+
+        stream
+            .write_all(&status.to_le_bytes())
+            .map_err(|_| Error::IO("unable to send daemon status"))?;
+    }
+}
+
+/// Locks the served memory object.
+///
+/// A request that panicked inside the connector poisons the lock. The panic is reported to that
+/// client only, the other clients keep using the memory object.
+fn lock_memory<T>(mem: &Mutex<T>) -> MutexGuard<'_, T> {
+    mem.lock().unwrap_or_else(PoisonError::into_inner)
+}
+
+fn execute<T: PhysicalMemory>(
+    header: &Header,
+    map: &mut [u8],
+    entries: &mut Vec<(PhysicalAddress, usize)>,
+    op: u8,
+    count: usize,
+    mem: &Mutex<T>,
+) -> i32 {
+    if count > header.entry_capacity {
+        return STATUS_INVALID;
+    }
+
+    entries.clear();
+    entries.extend((0..count).map(|i| read_entry(map, i)));
+
+    let total = entries
+        .iter()
+        .try_fold(0_usize, |total, &(_, len)| total.checked_add(len));
+    if total.map(|total| total > header.data_size).unwrap_or(true) {
+        return STATUS_INVALID;
+    }
+
+    if op != OP_READ && op != OP_WRITE {
+        return STATUS_INVALID;
+    }
+
+    let data = &mut map[header.data_offset()..];
+
+    let result = panic::catch_unwind(AssertUnwindSafe(|| match op {
+        OP_READ => {
+            let mut rest = data;
+            let mut list = entries
+                .iter()
+                .map(|&(addr, len)| {
+                    let (buf, tail) = std::mem::take(&mut rest).split_at_mut(len);
+                    rest = tail;
+                    PhysicalReadData(addr, buf)
+                })
+                .collect::<Vec<_>>();
+            lock_memory(mem).phys_read_raw_list(&mut list)
+        }
+        OP_WRITE => {
+            let mut rest = &data[..];
+            let list = entries
+                .iter()
+                .map(|&(addr, len)| {
+                    let (buf, tail) = rest.split_at(len);
+                    rest = tail;
+                    PhysicalWriteData(addr, buf)
+                })
+                .collect::<Vec<_>>();
+            lock_memory(mem).phys_write_raw_list(&list)
+        }
+        _ => unreachable!(),
+    }));
+
+    match result {
+        Ok(Ok(_)) => STATUS_OK,
+        Ok(Err(_)) => STATUS_FAILED,
+        Err(_) => {
+            warn!("connector panicked during a daemon request");
+            STATUS_FAILED
+        }
+    }
+}
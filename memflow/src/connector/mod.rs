@@ -7,6 +7,9 @@ as well as a interface for interfacing with buffers.
 
 This module also contains functions to interface with dynamically loaded connectors.
 The inventory system is feature gated behind the `inventory` feature.
+
+Connectors can be shared with other local processes through a daemon,
+which is feature gated behind the `daemon` feature.
 */
 
 pub mod args;
@@ -35,6 +38,11 @@ pub use filemap::{
     MMAPInfo, MMAPInfoMut, ReadMappedFilePhysicalMemory, WriteMappedFilePhysicalMemory,
 };
 
+#[cfg(all(feature = "daemon", unix))]
+pub mod daemon;
+#[cfg(all(feature = "daemon", unix))]
+pub use daemon::{DaemonConnector, DaemonServer};
+
 pub mod mmap;
 #[doc(hidden)]
 pub use mmap::MappedPhysicalMemory;
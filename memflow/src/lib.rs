@@ -33,6 +33,9 @@ extern crate smallvec;
 
 pub mod error;
 
+#[macro_use]
+pub mod trace;
+
 #[macro_use]
 pub mod types;
 
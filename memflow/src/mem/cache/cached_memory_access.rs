@@ -35,13 +35,12 @@ use super::{
 use crate::architecture::ArchitectureObj;
 use crate::error::Result;
 use crate::iter::PageChunks;
+use crate::mem::mem_usage::{MemoryUsage, TrackedArena};
 use crate::mem::phys_mem::{
     PhysicalMemory, PhysicalMemoryMetadata, PhysicalReadData, PhysicalWriteData,
 };
 use crate::types::{size, PageType};
 
-use bumpalo::Bump;
-
 /// The cache object that can use as a drop-in replacement for any Connector.
 ///
 /// Since this cache implements `PhysicalMemory` it can be used as a replacement
@@ -49,7 +48,7 @@ use bumpalo::Bump;
 pub struct CachedMemoryAccess<'a, T, Q> {
     mem: T,
     cache: PageCache<'a, Q>,
-    arena: Bump,
+    arena: TrackedArena,
 }
 
 impl<'a, T, Q> Clone for CachedMemoryAccess<'a, T, Q>
@@ -61,7 +60,7 @@ where
         Self {
             mem: self.mem.clone(),
             cache: self.cache.clone(),
-            arena: Bump::new(),
+            arena: TrackedArena::new(),
         }
     }
 }
@@ -77,7 +76,7 @@ impl<'a, T: PhysicalMemory, Q: CacheValidator> CachedMemoryAccess<'a, T, Q> {
         Self {
             mem,
             cache,
-            arena: Bump::new(),
+            arena: TrackedArena::new(),
         }
     }
 
@@ -159,6 +158,17 @@ impl<'a, T: PhysicalMemory, Q: CacheValidator> PhysicalMemory for CachedMemoryAc
     fn metadata(&self) -> PhysicalMemoryMetadata {
         self.mem.metadata()
     }
+
+    fn memory_usage(&self, usage: &mut MemoryUsage) {
+        usage.push("page_cache", self.cache.memory_usage());
+        usage.push_arena("page_cache_arena", &self.arena);
+        self.mem.memory_usage(usage)
+    }
+
+    fn shrink_memory(&mut self) {
+        self.arena.shrink();
+        self.mem.shrink_memory()
+    }
 }
 
 /// The builder interface for constructing a `CachedMemoryAccess` object.
@@ -4,11 +4,12 @@ use super::tlb_cache::TLBCache;
 use crate::architecture::{ArchitectureObj, ScopedVirtualTranslate};
 use crate::iter::{PageChunks, SplitAtIndex};
 use crate::mem::cache::{CacheValidator, DefaultCacheValidator};
+use crate::mem::mem_usage::{MemoryUsage, TrackedArena};
 use crate::mem::virt_translate::VirtualTranslate;
 use crate::mem::PhysicalMemory;
 use crate::types::{Address, PhysicalAddress};
 
-use bumpalo::{collections::Vec as BumpVec, Bump};
+use bumpalo::collections::Vec as BumpVec;
 
 /// CachedVirtualTranslate trasnaparently caches virtual addresss translations.
 ///
@@ -90,7 +91,7 @@ pub struct CachedVirtualTranslate<V, Q> {
     vat: V,
     tlb: TLBCache<Q>,
     arch: ArchitectureObj,
-    arena: Bump,
+    arena: TrackedArena,
     pub hitc: usize,
     pub misc: usize,
 }
@@ -101,7 +102,7 @@ impl<V: VirtualTranslate, Q: CacheValidator> CachedVirtualTranslate<V, Q> {
             vat,
             tlb,
             arch,
-            arena: Bump::new(),
+            arena: TrackedArena::new(),
             hitc: 0,
             misc: 0,
         }
@@ -122,7 +123,7 @@ impl<V: VirtualTranslate + Clone, Q: CacheValidator + Clone> Clone
             vat: self.vat.clone(),
             tlb: self.tlb.clone(),
             arch: self.arch,
-            arena: Bump::new(),
+            arena: TrackedArena::new(),
             hitc: self.hitc,
             misc: self.misc,
         }
@@ -219,6 +220,28 @@ impl<V: VirtualTranslate, Q: CacheValidator> VirtualTranslate for CachedVirtualT
         self.hitc += hitc;
         self.misc += misc;
     }
+
+    fn invalidate_translation_table(&mut self, translation_table_id: usize) {
+        self.tlb.invalidate_translation_table(translation_table_id);
+        self.vat.invalidate_translation_table(translation_table_id);
+    }
+
+    fn invalidate_range(&mut self, translation_table_id: usize, start: Address, end: Address) {
+        self.tlb
+            .invalidate_range(translation_table_id, start, end, self.arch.page_size());
+        self.vat.invalidate_range(translation_table_id, start, end);
+    }
+
+    fn memory_usage(&self, usage: &mut MemoryUsage) {
+        usage.push("tlb", self.tlb.memory_usage());
+        usage.push_arena("tlb_arena", &self.arena);
+        self.vat.memory_usage(usage)
+    }
+
+    fn shrink_memory(&mut self) {
+        self.arena.shrink();
+        self.vat.shrink_memory()
+    }
 }
 
 pub struct CachedVirtualTranslateBuilder<V, Q> {
@@ -276,12 +299,12 @@ impl<V: VirtualTranslate, Q: CacheValidator> CachedVirtualTranslateBuilder<V, Q>
 
 #[cfg(test)]
 mod tests {
-    use crate::architecture::x86;
+    use crate::architecture::{x86, ScopedVirtualTranslate};
 
     use crate::error::PartialResultExt;
     use crate::mem::cache::cached_vat::CachedVirtualTranslate;
     use crate::mem::cache::timed_validator::TimedCacheValidator;
-    use crate::mem::{dummy::DummyMemory, DirectTranslate, PhysicalMemory};
+    use crate::mem::{dummy::DummyMemory, DirectTranslate, PhysicalMemory, VirtualTranslate};
     use crate::mem::{VirtualDMA, VirtualMemory};
     use crate::types::{size, Address};
     use coarsetime::Duration;
@@ -316,6 +339,35 @@ mod tests {
             .collect()
     }
 
+    #[test]
+    fn invalid_after_invalidation() {
+        // Invalidating the translation table has to drop the cached translations
+        // right away, regardless of the validator.
+        let buffer = standard_buffer(size::mb(2));
+        let (mut mem, dtb, virt_base) =
+            DummyMemory::new_and_dtb(buffer.len() + size::mb(2), buffer.len(), &buffer);
+        let translator = x86::x64::new_translator(dtb);
+
+        let mut vat = CachedVirtualTranslate::builder(DirectTranslate::new())
+            .arch(x86::x64::ARCH)
+            .validator(TimedCacheValidator::new(Duration::from_secs(100)))
+            .entries(2048)
+            .build()
+            .unwrap();
+
+        assert!(vat.virt_to_phys(&mut mem, &translator, virt_base).is_ok());
+
+        // Destroy the page tables
+        mem.phys_write_raw(dtb.into(), &vec![0; size::kb(4)])
+            .unwrap();
+
+        assert!(vat.virt_to_phys(&mut mem, &translator, virt_base).is_ok());
+
+        vat.invalidate_translation_table(translator.translation_table_id(virt_base));
+
+        assert!(vat.virt_to_phys(&mut mem, &translator, virt_base).is_err());
+    }
+
     #[test]
     fn valid_after_pt_destruction() {
         // The following test is against volatility of the page tables
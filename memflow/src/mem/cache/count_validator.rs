@@ -94,4 +94,8 @@ impl CacheValidator for CountCacheValidator {
     fn invalidate_slot(&mut self, slot_id: usize) {
         self.count[slot_id] = self.last_count - self.valid_count
     }
+
+    fn memory_usage(&self) -> usize {
+        self.count.capacity() * std::mem::size_of::<usize>()
+    }
 }
@@ -39,4 +39,9 @@ where
     fn is_slot_valid(&self, slot_id: usize) -> bool;
     fn validate_slot(&mut self, slot_id: usize);
     fn invalidate_slot(&mut self, slot_id: usize);
+
+    /// Returns the number of bytes used to track the slots.
+    fn memory_usage(&self) -> usize {
+        0
+    }
 }
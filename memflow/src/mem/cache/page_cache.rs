@@ -120,6 +120,15 @@ impl<'a, T: CacheValidator> PageCache<'a, T> {
         self.page_size
     }
 
+    /// Returns the number of bytes used by the cached pages and their bookkeeping.
+    pub fn memory_usage(&self) -> usize {
+        self.cache_layout.size()
+            + (self.address.len() + self.address_once_validated.len())
+                * std::mem::size_of::<Address>()
+            + self.page_refs.len() * std::mem::size_of::<Option<&mut [u8]>>()
+            + self.validator.memory_usage()
+    }
+
     pub fn is_cached_page_type(&self, page_type: PageType) -> bool {
         self.page_type_mask.contains(page_type)
     }
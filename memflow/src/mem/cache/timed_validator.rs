@@ -80,4 +80,8 @@ impl CacheValidator for TimedCacheValidator {
     fn invalidate_slot(&mut self, slot_id: usize) {
         self.time[slot_id] = self.last_time - self.valid_time
     }
+
+    fn memory_usage(&self) -> usize {
+        self.time.capacity() * std::mem::size_of::<Instant>()
+    }
 }
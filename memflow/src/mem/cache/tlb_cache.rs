@@ -3,7 +3,25 @@ use std::prelude::v1::*;
 use super::CacheValidator;
 use crate::architecture::{ArchitectureObj, ScopedVirtualTranslate};
 use crate::error::{Error, Result};
-use crate::types::{Address, PhysicalAddress};
+use crate::types::{Address, PageType, PhysicalAddress};
+
+use core::cell::Cell;
+use hashbrown::HashMap;
+
+/// Number of entries in a single TLB set.
+///
+/// Entries are 16 bytes in size, thus a whole set spans exactly one 64 byte cache line.
+pub const TLB_WAYS: usize = 4;
+
+/// Number of address space ids that can be stored in the low bits of a page aligned tag.
+///
+/// The last value is reserved, so that `INVALID_TAG` can never be matched by a real lookup.
+const ASID_COUNT: u64 = 0xfff;
+
+const INVALID_TAG: u64 = !0;
+
+/// Set in a frame if the entry holds a successful translation.
+const FRAME_PRESENT: u64 = 1 << 8;
 
 #[derive(Clone, Copy)]
 pub struct TLBEntry {
@@ -22,45 +40,277 @@ impl TLBEntry {
     }
 }
 
+/// A single set of the TLB.
+///
+/// Every entry consists of a tag (page aligned virtual address, with the address space id in the
+/// low bits) and a frame (page aligned physical address, with the page type and present bit in
+/// the low bits). Tags and frames are kept in separate arrays so the whole set can be compared
+/// against a tag at once.
 #[derive(Clone, Copy)]
-pub struct CachedEntry {
-    pt_index: usize,
-    virt_page: Address,
-    phys_page: PhysicalAddress,
+#[repr(C, align(64))]
+struct TLBSet {
+    tags: [u64; TLB_WAYS],
+    frames: [u64; TLB_WAYS],
 }
 
-impl CachedEntry {
-    const INVALID: CachedEntry = CachedEntry {
-        pt_index: !0,
-        virt_page: Address::INVALID,
-        phys_page: PhysicalAddress::INVALID,
+impl TLBSet {
+    const INVALID: TLBSet = TLBSet {
+        tags: [INVALID_TAG; TLB_WAYS],
+        frames: [0; TLB_WAYS],
     };
+
+    /// Returns a bitmask of all ways containing `tag`.
+    #[inline]
+    #[cfg(all(target_arch = "x86_64", target_feature = "sse2"))]
+    fn match_tag(&self, tag: u64) -> u32 {
+        use core::arch::x86_64::*;
+
+        // SSE2 lacks 64-bit compares, so compare the 32-bit halves and later require
+        // all 8 bytes of a way to be equal.
+        let mask = unsafe {
+            let needle = _mm_set1_epi64x(tag as i64);
+            let tags = self.tags.as_ptr() as *const __m128i;
+            let lo = _mm_cmpeq_epi32(_mm_load_si128(tags), needle);
+            let hi = _mm_cmpeq_epi32(_mm_load_si128(tags.add(1)), needle);
+            (_mm_movemask_epi8(lo) as u32) | ((_mm_movemask_epi8(hi) as u32) << 16)
+        };
+
+        (0..TLB_WAYS as u32).fold(0, |acc, way| {
+            acc | ((((mask >> (way * 8)) & 0xff) == 0xff) as u32) << way
+        })
+    }
+
+    /// Returns a bitmask of all ways containing `tag`.
+    #[inline]
+    #[cfg(not(all(target_arch = "x86_64", target_feature = "sse2")))]
+    fn match_tag(&self, tag: u64) -> u32 {
+        self.tags
+            .iter()
+            .enumerate()
+            .fold(0, |acc, (way, &t)| acc | ((t == tag) as u32) << way)
+    }
 }
 
+/// Set-associative translation lookaside buffer.
+///
+/// Translations of different address spaces are told apart by a small address space id (ASID)
+/// that gets assigned to every translation table id on first use. Once all ids are used up,
+/// the whole buffer is flushed and the assignment starts over.
 #[derive(Clone)]
 pub struct TLBCache<T> {
-    entries: Box<[CachedEntry]>,
+    sets: Box<[TLBSet]>,
+    plru: Box<[Cell<u8>]>,
+    asids: HashMap<usize, u64>,
+    next_asid: u64,
+    last_asid: Cell<(usize, u64)>,
     pub validator: T,
 }
 
 impl<T: CacheValidator> TLBCache<T> {
     pub fn new(size: usize, mut validator: T) -> Self {
-        validator.allocate_slots(size);
+        let set_count = core::cmp::max(1, size / TLB_WAYS).next_power_of_two();
+
+        validator.allocate_slots(set_count * TLB_WAYS);
 
         Self {
-            entries: vec![CachedEntry::INVALID; size].into_boxed_slice(),
+            sets: vec![TLBSet::INVALID; set_count].into_boxed_slice(),
+            plru: vec![Cell::new(0); set_count].into_boxed_slice(),
+            asids: HashMap::new(),
+            next_asid: 0,
+            last_asid: Cell::new((!0, 0)),
             validator,
         }
     }
 
+    /// Returns the total number of entries this TLB can hold.
+    #[inline]
+    pub fn capacity(&self) -> usize {
+        self.sets.len() * TLB_WAYS
+    }
+
+    /// Returns the number of bytes used by the entries and their bookkeeping.
+    ///
+    /// The size of the address space id map is estimated from its capacity.
+    pub fn memory_usage(&self) -> usize {
+        self.sets.len() * core::mem::size_of::<TLBSet>()
+            + self.plru.len() * core::mem::size_of::<Cell<u8>>()
+            + self.asids.capacity() * (core::mem::size_of::<(usize, u64)>() + 1)
+            + self.validator.memory_usage()
+    }
+
+    /// Removes all entries from the TLB and releases all address space ids.
+    pub fn flush(&mut self) {
+        self.sets.iter_mut().for_each(|set| *set = TLBSet::INVALID);
+        self.asids.clear();
+        self.next_asid = 0;
+        self.last_asid.set((!0, 0));
+    }
+
+    /// Invalidates all entries of a single translation table in constant time.
+    ///
+    /// The address space id of the table is retired and will not be handed out again until the
+    /// next flush, so the old entries can never be matched again and simply age out.
+    pub fn invalidate_translation_table(&mut self, pt_index: usize) {
+        if self.asids.remove(&pt_index).is_some() && self.last_asid.get().0 == pt_index {
+            self.last_asid.set((!0, 0));
+        }
+    }
+
+    /// Invalidates the entries of a translation table within `start..end`.
+    ///
+    /// If the range covers more pages than the TLB can hold, the whole translation table gets
+    /// invalidated instead.
+    pub fn invalidate_range(
+        &mut self,
+        pt_index: usize,
+        start: Address,
+        end: Address,
+        page_size: usize,
+    ) {
+        let asid = match self.lookup_asid(pt_index) {
+            Some(asid) => asid,
+            None => return,
+        };
+
+        let start = start.as_page_aligned(page_size);
+
+        if end <= start {
+            return;
+        }
+
+        if (end - start) / page_size > self.capacity() {
+            self.invalidate_translation_table(pt_index);
+            return;
+        }
+
+        for i in (start.as_u64()..end.as_u64()).step_by(page_size) {
+            let cur_page = Address::from(i);
+            let set_idx = self.get_set_index(cur_page, page_size, asid);
+            let hits = self.sets[set_idx].match_tag(Self::make_tag(cur_page, page_size, asid));
+            if hits != 0 {
+                let way = hits.trailing_zeros() as usize;
+                self.sets[set_idx].tags[way] = INVALID_TAG;
+                self.validator.invalidate_slot(set_idx * TLB_WAYS + way);
+            }
+        }
+    }
+
     #[inline]
-    fn get_cache_index(&self, page_addr: Address, page_size: usize) -> usize {
-        ((page_addr.as_u64() / (page_size as u64)) % (self.entries.len() as u64)) as usize
+    fn get_set_index(&self, page_addr: Address, page_size: usize, asid: u64) -> usize {
+        // Address spaces are scattered across the sets, so that pages mapped at the same
+        // virtual address in many processes do not all compete for a single set.
+        let page_index = page_addr.as_u64() / (page_size as u64);
+        (page_index.wrapping_add(asid.wrapping_mul(0x9e37_79b9)) as usize) & (self.sets.len() - 1)
+    }
+
+    #[inline]
+    fn lookup_asid(&self, pt_index: usize) -> Option<u64> {
+        let (last_index, last_asid) = self.last_asid.get();
+        if last_index == pt_index {
+            Some(last_asid)
+        } else {
+            let asid = *self.asids.get(&pt_index)?;
+            self.last_asid.set((pt_index, asid));
+            Some(asid)
+        }
+    }
+
+    fn allocate_asid(&mut self, pt_index: usize) -> u64 {
+        if let Some(asid) = self.lookup_asid(pt_index) {
+            return asid;
+        }
+
+        if self.next_asid >= ASID_COUNT {
+            self.flush();
+        }
+
+        let asid = self.next_asid;
+        self.next_asid += 1;
+        self.asids.insert(pt_index, asid);
+        self.last_asid.set((pt_index, asid));
+        asid
+    }
+
+    #[inline]
+    fn make_tag(page_addr: Address, page_size: usize, asid: u64) -> u64 {
+        debug_assert!(page_size as u64 > ASID_COUNT);
+        page_addr.as_u64() | asid
+    }
+
+    #[inline]
+    fn make_frame(phys_page: PhysicalAddress, page_size: usize) -> u64 {
+        if phys_page.is_valid() && phys_page.has_page() {
+            phys_page.address().as_page_aligned(page_size).as_u64()
+                | FRAME_PRESENT
+                | u64::from(phys_page.page_type().bits())
+        } else {
+            0
+        }
+    }
+
+    /// Marks `way` as the most recently used one inside the set.
+    ///
+    /// This is a tree pseudo-LRU: bit 0 selects the half to evict from, bits 1 and 2 select the
+    /// way inside the left and right half. Every node on the path gets pointed away from `way`.
+    #[inline]
+    fn touch(&self, set_idx: usize, way: usize) {
+        let bits = self.plru[set_idx].get();
+        let bits = if way < 2 {
+            (bits | 0b001) & !0b010 | ((way == 0) as u8) << 1
+        } else {
+            bits & !0b101 | ((way == 2) as u8) << 2
+        };
+        self.plru[set_idx].set(bits);
+    }
+
+    #[inline]
+    fn victim(&self, set_idx: usize) -> usize {
+        let bits = self.plru[set_idx].get();
+        if bits & 0b001 == 0 {
+            ((bits >> 1) & 1) as usize
+        } else {
+            2 + ((bits >> 2) & 1) as usize
+        }
+    }
+
+    #[inline]
+    fn find_way(&self, set_idx: usize, tag: u64) -> Option<usize> {
+        let mut hits = self.sets[set_idx].match_tag(tag);
+        while hits != 0 {
+            let way = hits.trailing_zeros() as usize;
+            if self.validator.is_slot_valid(set_idx * TLB_WAYS + way) {
+                return Some(way);
+            }
+            hits &= hits - 1;
+        }
+        None
+    }
+
+    fn insert(&mut self, set_idx: usize, tag: u64, frame: u64) {
+        let set = &self.sets[set_idx];
+        let hits = set.match_tag(tag);
+
+        let way = if hits != 0 {
+            hits.trailing_zeros() as usize
+        } else {
+            // fill up empty or expired slots before evicting anything
+            (0..TLB_WAYS)
+                .find(|&way| {
+                    set.tags[way] == INVALID_TAG
+                        || !self.validator.is_slot_valid(set_idx * TLB_WAYS + way)
+                })
+                .unwrap_or_else(|| self.victim(set_idx))
+        };
+
+        self.sets[set_idx].tags[way] = tag;
+        self.sets[set_idx].frames[way] = frame;
+        self.validator.validate_slot(set_idx * TLB_WAYS + way);
+        self.touch(set_idx, way);
     }
 
     #[inline]
     pub fn is_read_too_long(&self, arch: ArchitectureObj, size: usize) -> bool {
-        size / arch.page_size() > self.entries.len()
+        size / arch.page_size() > self.capacity()
     }
 
     #[inline]
@@ -71,31 +321,27 @@ impl<T: CacheValidator> TLBCache<T> {
         arch: ArchitectureObj,
     ) -> Option<Result<TLBEntry>> {
         let pt_index = translator.translation_table_id(addr);
+        let asid = self.lookup_asid(pt_index)?;
         let page_size = arch.page_size();
         let page_address = addr.as_page_aligned(page_size);
-        let idx = self.get_cache_index(page_address, page_size);
-        let entry = self.entries[idx];
-        if entry.pt_index == pt_index
-            && entry.virt_page == page_address
-            && self.validator.is_slot_valid(idx)
-        {
-            if entry.phys_page.is_valid() && entry.phys_page.has_page() {
-                Some(Ok(TLBEntry {
-                    pt_index,
-                    virt_addr: addr,
-                    // TODO: this should be aware of huge pages
-                    phys_addr: PhysicalAddress::with_page(
-                        entry.phys_page.address().as_page_aligned(page_size)
-                            + (addr - page_address),
-                        entry.phys_page.page_type(),
-                        page_size,
-                    ),
-                }))
-            } else {
-                Some(Err(Error::VirtualTranslate))
-            }
+        let set_idx = self.get_set_index(page_address, page_size, asid);
+        let way = self.find_way(set_idx, Self::make_tag(page_address, page_size, asid))?;
+        self.touch(set_idx, way);
+
+        let frame = self.sets[set_idx].frames[way];
+        if frame & FRAME_PRESENT != 0 {
+            Some(Ok(TLBEntry {
+                pt_index,
+                virt_addr: addr,
+                // TODO: this should be aware of huge pages
+                phys_addr: PhysicalAddress::with_page(
+                    Address::from(frame).as_page_aligned(page_size) + (addr - page_address),
+                    PageType::from_bits_truncate(frame as u8),
+                    page_size,
+                ),
+            }))
         } else {
-            None
+            Some(Err(Error::VirtualTranslate))
         }
     }
 
@@ -108,14 +354,15 @@ impl<T: CacheValidator> TLBCache<T> {
         arch: ArchitectureObj,
     ) {
         let pt_index = translator.translation_table_id(in_addr);
+        let asid = self.allocate_asid(pt_index);
         let page_size = arch.page_size();
-        let idx = self.get_cache_index(in_addr.as_page_aligned(page_size), page_size);
-        self.entries[idx] = CachedEntry {
-            pt_index,
-            virt_page: in_addr.as_page_aligned(page_size),
-            phys_page: out_page,
-        };
-        self.validator.validate_slot(idx);
+        let page_addr = in_addr.as_page_aligned(page_size);
+        let set_idx = self.get_set_index(page_addr, page_size, asid);
+        self.insert(
+            set_idx,
+            Self::make_tag(page_addr, page_size, asid),
+            Self::make_frame(out_page, page_size),
+        );
     }
 
     #[inline]
@@ -127,27 +374,182 @@ impl<T: CacheValidator> TLBCache<T> {
         arch: ArchitectureObj,
     ) {
         let pt_index = translator.translation_table_id(in_addr);
+        let asid = self.allocate_asid(pt_index);
         let page_size = arch.page_size();
         let page_addr = in_addr.as_page_aligned(page_size);
         let end_addr = (in_addr + invalid_len + 1).as_page_aligned(page_size);
 
         for i in (page_addr.as_u64()..end_addr.as_u64())
             .step_by(page_size)
-            .take(self.entries.len())
+            .take(self.capacity())
         {
             let cur_page = Address::from(i);
-            let idx = self.get_cache_index(cur_page, page_size);
-
-            let entry = &mut self.entries[idx];
-            if entry.pt_index == !0
-                || !entry.phys_page.is_valid()
-                || !self.validator.is_slot_valid(idx)
-            {
-                entry.pt_index = pt_index;
-                entry.virt_page = cur_page;
-                entry.phys_page = PhysicalAddress::INVALID;
-                self.validator.validate_slot(idx);
+            let set_idx = self.get_set_index(cur_page, page_size, asid);
+            let tag = Self::make_tag(cur_page, page_size, asid);
+
+            let is_present = self
+                .find_way(set_idx, tag)
+                .map(|way| self.sets[set_idx].frames[way] & FRAME_PRESENT != 0)
+                .unwrap_or(false);
+
+            if !is_present {
+                self.insert(set_idx, tag, 0);
             }
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::architecture::x86::x64;
+    use crate::mem::cache::CountCacheValidator;
+    use crate::types::size;
+
+    fn phys_page(addr: usize) -> PhysicalAddress {
+        PhysicalAddress::with_page(Address::from(addr), PageType::WRITEABLE, size::kb(4))
+    }
+
+    #[test]
+    fn shared_virt_page() {
+        // the same virtual page of multiple processes should not evict each other
+        let arch = x64::ARCH;
+        let mut tlb = TLBCache::new(64, CountCacheValidator::new(100));
+        let virt_addr = Address::from(0x7ff0_0000_0000u64);
+
+        let translators = (1..=8)
+            .map(|i| x64::new_translator(Address::from(size::mb(i))))
+            .collect::<Vec<_>>();
+
+        for (i, translator) in translators.iter().enumerate() {
+            tlb.cache_entry(translator, virt_addr, phys_page(size::mb(64 + i)), arch);
+        }
+
+        for (i, translator) in translators.iter().enumerate() {
+            let entry = tlb
+                .try_entry(translator, virt_addr + 0x10, arch)
+                .unwrap()
+                .unwrap();
+            assert_eq!(
+                entry.phys_addr.address(),
+                Address::from(size::mb(64 + i) + 0x10)
+            );
+            assert_eq!(entry.phys_addr.page_type(), PageType::WRITEABLE);
+        }
+    }
+
+    #[test]
+    fn recently_used_survives() {
+        let arch = x64::ARCH;
+        let mut tlb = TLBCache::new(64, CountCacheValidator::new(100));
+        let translator = x64::new_translator(Address::from(size::mb(1)));
+
+        // pages that are `set_count` pages apart map to the same set
+        let stride = size::kb(4) * (tlb.capacity() / TLB_WAYS);
+        let pages = (0..=TLB_WAYS)
+            .map(|i| Address::from(i * stride))
+            .collect::<Vec<_>>();
+
+        for (i, &page) in pages.iter().take(TLB_WAYS).enumerate() {
+            tlb.cache_entry(&translator, page, phys_page(size::mb(64 + i)), arch);
+        }
+
+        assert!(tlb.try_entry(&translator, pages[0], arch).is_some());
+
+        tlb.cache_entry(&translator, pages[TLB_WAYS], phys_page(size::mb(128)), arch);
+
+        assert!(tlb.try_entry(&translator, pages[0], arch).is_some());
+        assert!(tlb.try_entry(&translator, pages[TLB_WAYS], arch).is_some());
+        assert_eq!(
+            pages
+                .iter()
+                .filter(|&&page| tlb.try_entry(&translator, page, arch).is_some())
+                .count(),
+            TLB_WAYS
+        );
+    }
+
+    #[test]
+    fn invalidate_translation_table() {
+        let arch = x64::ARCH;
+        let mut tlb = TLBCache::new(64, CountCacheValidator::new(100));
+        let translator = x64::new_translator(Address::from(size::mb(1)));
+        let other_translator = x64::new_translator(Address::from(size::mb(2)));
+        let virt_addr = Address::from(size::mb(16));
+
+        tlb.cache_entry(&translator, virt_addr, phys_page(size::mb(64)), arch);
+        tlb.cache_entry(&other_translator, virt_addr, phys_page(size::mb(65)), arch);
+
+        tlb.invalidate_translation_table(translator.translation_table_id(virt_addr));
+
+        assert!(tlb.try_entry(&translator, virt_addr, arch).is_none());
+        assert!(tlb.try_entry(&other_translator, virt_addr, arch).is_some());
+
+        // the retired address space id must not leak old entries into the new address space
+        tlb.cache_entry(
+            &translator,
+            virt_addr + size::kb(4),
+            phys_page(size::mb(66)),
+            arch,
+        );
+        assert!(tlb.try_entry(&translator, virt_addr, arch).is_none());
+        assert!(tlb
+            .try_entry(&translator, virt_addr + size::kb(4), arch)
+            .is_some());
+    }
+
+    #[test]
+    fn invalidate_range() {
+        let arch = x64::ARCH;
+        let mut tlb = TLBCache::new(64, CountCacheValidator::new(100));
+        let translator = x64::new_translator(Address::from(size::mb(1)));
+        let pt_index = translator.translation_table_id(Address::null());
+        let virt_addr = Address::from(size::mb(16));
+
+        for i in 0..4 {
+            tlb.cache_entry(
+                &translator,
+                virt_addr + size::kb(4 * i),
+                phys_page(size::mb(64) + size::kb(4 * i)),
+                arch,
+            );
+        }
+
+        tlb.invalidate_range(
+            pt_index,
+            virt_addr + size::kb(4),
+            virt_addr + size::kb(12),
+            arch.page_size(),
+        );
+
+        assert!(tlb.try_entry(&translator, virt_addr, arch).is_some());
+        assert!(tlb
+            .try_entry(&translator, virt_addr + size::kb(4), arch)
+            .is_none());
+        assert!(tlb
+            .try_entry(&translator, virt_addr + size::kb(8), arch)
+            .is_none());
+        assert!(tlb
+            .try_entry(&translator, virt_addr + size::kb(12), arch)
+            .is_some());
+    }
+
+    #[test]
+    fn invalid_entries() {
+        let arch = x64::ARCH;
+        let mut tlb = TLBCache::new(64, CountCacheValidator::new(100));
+        let translator = x64::new_translator(Address::from(size::mb(1)));
+        let virt_addr = Address::from(size::mb(16));
+
+        tlb.cache_invalid_if_uncached(&translator, virt_addr, size::kb(8), arch);
+
+        assert!(tlb
+            .try_entry(&translator, virt_addr, arch)
+            .unwrap()
+            .is_err());
+        assert!(tlb
+            .try_entry(&translator, virt_addr + size::kb(4), arch)
+            .unwrap()
+            .is_err());
+    }
+}
@@ -84,6 +84,7 @@ impl PageInfo {
     }
 }
 
+#[derive(Clone)]
 pub struct DummyModule {
     base: Address,
     size: usize,
@@ -106,11 +107,12 @@ impl OsProcessModuleInfo for DummyModule {
         self.size
     }
 
-    fn name(&self) -> String {
-        String::from("dummy.so")
+    fn name(&self) -> &str {
+        "dummy.so"
     }
 }
 
+#[derive(Clone)]
 pub struct DummyProcess {
     address: Address,
     map_size: usize,
@@ -140,8 +142,8 @@ impl OsProcessInfo for DummyProcess {
         self.pid
     }
 
-    fn name(&self) -> String {
-        String::from("Dummy")
+    fn name(&self) -> &str {
+        "Dummy"
     }
 
     fn sys_arch(&self) -> ArchitectureObj {
@@ -0,0 +1,402 @@
+/*!
+Walking many linked lists in lockstep.
+
+Following a linked list costs one dependent read per node, as the address of the next node is
+only known once the current node has been read. Walking many lists one after another therefore
+takes as many round trips as all lists have nodes combined. `ListWalker` advances all lists at
+the same time instead: every hop reads the next pointer of the current node of every list that
+has not ended yet in a single batch. Walking all lists takes as many round trips as the longest
+list has nodes.
+
+The lists are expected to be circular lists like the windows `LIST_ENTRY`, where the next
+pointer is located at the start of every node. A list ends once it returns to its head, on a
+null or misaligned pointer, on a node pointing to itself or after `max_len` nodes.
+
+# Examples
+
+```
+use memflow::architecture::x86::x64;
+use memflow::mem::{ListWalker, VirtualMemory};
+use memflow::mem::dummy::DummyMemory;
+use memflow::types::size;
+
+let (mut mem, base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &[0; 0x100]);
+
+// two circular lists: base -> base + 0x10 -> base, and base + 0x80 -> base + 0x80
+mem.virt_write(base, &(base + 0x10).as_u64()).unwrap();
+mem.virt_write(base + 0x10, &base.as_u64()).unwrap();
+mem.virt_write(base + 0x80, &(base + 0x80).as_u64()).unwrap();
+
+let mut entries = vec![];
+ListWalker::new()
+    .walk(&mut mem, x64::ARCH, &[base, base + 0x80], |list, entry| entries.push((list, entry)))
+    .unwrap();
+
+assert_eq!(entries, vec![(0, base + 0x10)]);
+```
+*/
+
+use std::prelude::v1::*;
+
+use super::{PhysicalMemory, PhysicalReadData, VirtualMemory, VirtualReadData, VirtualTranslate};
+use crate::architecture::{ArchitectureObj, Endianess, ScopedVirtualTranslate};
+use crate::error::{Error, PartialResultExt, Result};
+use crate::types::{Address, PhysicalAddress};
+
+/// Default limit for the number of nodes of a single list.
+pub const DEFAULT_MAX_LIST_LEN: usize = 65536;
+
+/// The head of a list that is walked in its own address space.
+#[derive(Debug, Clone, Copy)]
+pub struct ListHead<D> {
+    /// Translator of the address space the list lives in.
+    pub translator: D,
+    /// Architecture of the list, this determines the size of the pointers.
+    pub arch: ArchitectureObj,
+    /// Address of the head of the list.
+    pub head: Address,
+}
+
+#[derive(Clone, Copy)]
+struct Cursor {
+    list: usize,
+    arch: ArchitectureObj,
+    head: Address,
+    entry: Address,
+    len: usize,
+}
+
+/// Walks many linked lists at once, with one batched read per hop.
+///
+/// The buffers of the walker are kept between walks.
+pub struct ListWalker {
+    max_len: usize,
+    alignment: u64,
+    cursors: Vec<Cursor>,
+    bufs: Vec<[u8; 8]>,
+    // read and translation lists, these are empty outside of a single hop
+    virt_reads: Vec<VirtualReadData<'static>>,
+    translated: Vec<(PhysicalAddress, &'static mut [u8])>,
+    failed: Vec<(Error, Address, &'static mut [u8])>,
+    phys_reads: Vec<PhysicalReadData<'static>>,
+}
+
+impl Default for ListWalker {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl ListWalker {
+    pub fn new() -> Self {
+        Self {
+            max_len: DEFAULT_MAX_LIST_LEN,
+            alignment: 1,
+            cursors: vec![],
+            bufs: vec![],
+            virt_reads: vec![],
+            translated: vec![],
+            failed: vec![],
+            phys_reads: vec![],
+        }
+    }
+
+    /// Changes the maximum number of nodes walked per list.
+    ///
+    /// This guards against cycles that do not pass through the head of a list.
+    pub fn max_len(mut self, max_len: usize) -> Self {
+        self.max_len = max_len;
+        self
+    }
+
+    /// Ends lists on pointers that are not aligned to `alignment` bytes.
+    pub fn alignment(mut self, alignment: usize) -> Self {
+        self.alignment = alignment.max(1) as u64;
+        self
+    }
+
+    /// Walks the lists starting at `heads`, which all live in the address space of `mem`.
+    ///
+    /// `out` is called with the index of the list and the address of every node, excluding
+    /// the heads. The nodes of a single list are passed in order.
+    pub fn walk<T: VirtualMemory, F: FnMut(usize, Address)>(
+        &mut self,
+        mem: &mut T,
+        arch: ArchitectureObj,
+        heads: &[Address],
+        out: F,
+    ) -> Result<()> {
+        let mut virt_reads = std::mem::take(&mut self.virt_reads);
+
+        let ret = self.walk_with(
+            heads.iter().map(|&head| (arch, head)),
+            |cursors, bufs| {
+                let mut list = VirtualReadData::recycle_list(std::mem::take(&mut virt_reads));
+                list.extend(
+                    cursors
+                        .iter()
+                        .zip(bufs.iter_mut())
+                        .map(|(c, buf)| VirtualReadData(c.entry, &mut buf[..c.arch.size_addr()])),
+                );
+                let ret = mem.virt_read_raw_list(&mut list).data_part();
+                virt_reads = VirtualReadData::recycle_list(list);
+                ret
+            },
+            out,
+        );
+
+        self.virt_reads = virt_reads;
+        ret
+    }
+
+    /// Walks lists that live in different address spaces, e.g. in multiple processes.
+    ///
+    /// On every hop the next pointers of all lists are translated in the address space of
+    /// their list and then read from `phys_mem` in a single batch. The translation is not
+    /// batched: `vat.virt_to_phys_iter` is called once per active list and hop, as translators
+    /// can not be compared to group lists of the same address space. `vat` should therefore
+    /// cache translations.
+    ///
+    /// Nodes that can not be translated end their list.
+    pub fn walk_spaces<T, V, D, F>(
+        &mut self,
+        phys_mem: &mut T,
+        vat: &mut V,
+        lists: &[ListHead<D>],
+        out: F,
+    ) -> Result<()>
+    where
+        T: PhysicalMemory,
+        V: VirtualTranslate,
+        D: ScopedVirtualTranslate,
+        F: FnMut(usize, Address),
+    {
+        let mut translated_list = std::mem::take(&mut self.translated);
+        let mut failed_list = std::mem::take(&mut self.failed);
+        let mut reads_list = std::mem::take(&mut self.phys_reads);
+
+        let ret = self.walk_with(
+            lists.iter().map(|list| (list.arch, list.head)),
+            |cursors, bufs| {
+                // the lists only borrow `bufs` for this hop
+                let mut translated = unsafe { recycle(std::mem::take(&mut translated_list)) };
+                let mut failed = unsafe { recycle(std::mem::take(&mut failed_list)) };
+                let mut reads = unsafe { recycle(std::mem::take(&mut reads_list)) };
+
+                for (c, buf) in cursors.iter().zip(bufs.iter_mut()) {
+                    vat.virt_to_phys_iter(
+                        &mut *phys_mem,
+                        &lists[c.list].translator,
+                        Some((c.entry, &mut buf[..c.arch.size_addr()])).into_iter(),
+                        &mut translated,
+                        &mut failed,
+                    );
+                }
+
+                reads.extend(
+                    translated
+                        .drain(..)
+                        .map(|(addr, buf)| PhysicalReadData(addr, buf)),
+                );
+                let ret = phys_mem.phys_read_raw_list(&mut reads);
+
+                translated_list = unsafe { recycle(translated) };
+                failed_list = unsafe { recycle(failed) };
+                reads_list = unsafe { recycle(reads) };
+                ret
+            },
+            out,
+        );
+
+        self.translated = translated_list;
+        self.failed = failed_list;
+        self.phys_reads = reads_list;
+        ret
+    }
+
+    fn walk_with<I, R, F>(&mut self, heads: I, mut read: R, mut out: F) -> Result<()>
+    where
+        I: Iterator<Item = (ArchitectureObj, Address)>,
+        R: FnMut(&[Cursor], &mut [[u8; 8]]) -> Result<()>,
+        F: FnMut(usize, Address),
+    {
+        self.cursors.clear();
+        self.cursors
+            .extend(heads.enumerate().map(|(list, (arch, head))| Cursor {
+                list,
+                arch,
+                head,
+                entry: head,
+                len: 0,
+            }));
+
+        while !self.cursors.is_empty() {
+            // unreadable pointers are left zeroed and end their list
+            self.bufs.clear();
+            self.bufs.resize(self.cursors.len(), [0; 8]);
+            read(&self.cursors, &mut self.bufs)?;
+
+            let mut active = 0;
+            for idx in 0..self.cursors.len() {
+                let mut cursor = self.cursors[idx];
+                let next = read_ptr(cursor.arch, &self.bufs[idx]);
+
+                if next.is_null()
+                    || next.as_u64() % self.alignment != 0
+                    || next == cursor.head
+                    || next == cursor.entry
+                    || cursor.len >= self.max_len
+                {
+                    continue;
+                }
+
+                out(cursor.list, next);
+
+                cursor.entry = next;
+                cursor.len += 1;
+                self.cursors[active] = cursor;
+                active += 1;
+            }
+            self.cursors.truncate(active);
+        }
+
+        Ok(())
+    }
+}
+
+/// Empties `list` and returns its allocation as a list of a different element type.
+///
+/// # Safety
+///
+/// `T` and `U` have to be the same type apart from their lifetimes.
+unsafe fn recycle<T, U>(list: Vec<T>) -> Vec<U> {
+    let mut list = std::mem::ManuallyDrop::new(list);
+    list.clear();
+    // the list is empty, so no reference of the old lifetimes survives
+    Vec::from_raw_parts(list.as_mut_ptr() as *mut U, 0, list.capacity())
+}
+
+pub(super) fn read_ptr(arch: ArchitectureObj, buf: &[u8; 8]) -> Address {
+    let mut bytes = [0; 8];
+    match (arch.endianess(), arch.size_addr()) {
+        (Endianess::LittleEndian, 4) => {
+            bytes[..4].copy_from_slice(&buf[..4]);
+            Address::from(u64::from_le_bytes(bytes))
+        }
+        (Endianess::BigEndian, 4) => {
+            bytes[4..].copy_from_slice(&buf[..4]);
+            Address::from(u64::from_be_bytes(bytes))
+        }
+        (Endianess::LittleEndian, _) => Address::from(u64::from_le_bytes(*buf)),
+        (Endianess::BigEndian, _) => Address::from(u64::from_be_bytes(*buf)),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::architecture::x86::{x32, x64};
+    use crate::mem::dummy::DummyMemory;
+    use crate::mem::DirectTranslate;
+    use crate::types::size;
+
+    #[test]
+    fn test_walk() {
+        let (mut mem, base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &[0; 0x1000]);
+
+        // a long list, a cycle that does not pass through the head and a broken list
+        let long = (0..20).map(|i| base + i * 0x20).collect::<Vec<_>>();
+        for (i, &node) in long.iter().enumerate() {
+            mem.virt_write(node, &long[(i + 1) % long.len()].as_u64())
+                .unwrap();
+        }
+        let cycle = [base + 0x400, base + 0x410, base + 0x420];
+        mem.virt_write(cycle[0], &cycle[1].as_u64()).unwrap();
+        mem.virt_write(cycle[1], &cycle[2].as_u64()).unwrap();
+        mem.virt_write(cycle[2], &cycle[1].as_u64()).unwrap();
+        mem.virt_write(base + 0x800, &(base + 0x811).as_u64())
+            .unwrap();
+
+        let mut entries = vec![];
+        ListWalker::new()
+            .max_len(8)
+            .alignment(8)
+            .walk(
+                &mut mem,
+                x64::ARCH,
+                &[long[0], cycle[0], base + 0x800],
+                |list, entry| entries.push((list, entry)),
+            )
+            .unwrap();
+
+        let list = |idx| {
+            entries
+                .iter()
+                .filter(|(l, _)| *l == idx)
+                .map(|&(_, e)| e)
+                .collect::<Vec<_>>()
+        };
+        assert_eq!(list(0), long[1..9].to_vec());
+        assert_eq!(list(1).len(), 8);
+        assert_eq!(list(1)[..3], [cycle[1], cycle[2], cycle[1]]);
+        assert!(list(2).is_empty());
+
+        let mut entries = vec![];
+        ListWalker::new()
+            .walk(&mut mem, x64::ARCH, &[long[0]], |_, entry| {
+                entries.push(entry)
+            })
+            .unwrap();
+        assert_eq!(entries, long[1..].to_vec());
+    }
+
+    #[test]
+    fn test_walk_spaces() {
+        let mut mem = DummyMemory::new(size::mb(8));
+        let base = Address::from(0x10_0000);
+
+        // two address spaces with different lists at the same addresses
+        let mut data32 = vec![];
+        for next in [8u32, 16, 0].iter() {
+            data32.extend_from_slice(&(base.as_u32() + next).to_le_bytes());
+            data32.extend_from_slice(&[0; 4]);
+        }
+        let mut data64 = vec![0; 0x28];
+        data64[..8].copy_from_slice(&(base + 0x20).as_u64().to_le_bytes());
+        data64[0x20..].copy_from_slice(&base.as_u64().to_le_bytes());
+
+        let dtb32 = mem.alloc_dtb_const_base(base, size::mb(2), &data32);
+        let dtb64 = mem.alloc_dtb_const_base(base, size::mb(2), &data64);
+
+        let list = |dtb, arch, head| ListHead {
+            translator: x64::new_translator(dtb),
+            arch,
+            head,
+        };
+        let lists = [
+            list(dtb32, x32::ARCH, base),
+            list(dtb32, x32::ARCH, base + 8),
+            list(dtb64, x64::ARCH, base),
+        ];
+
+        let mut entries = vec![];
+        ListWalker::new()
+            .walk_spaces(
+                &mut mem,
+                &mut DirectTranslate::new(),
+                &lists,
+                |list, entry| entries.push((list, entry)),
+            )
+            .unwrap();
+        assert_eq!(
+            entries,
+            vec![
+                (0, base + 8),
+                (1, base + 16),
+                (2, base + 0x20),
+                (0, base + 16),
+                (1, base),
+            ]
+        );
+    }
+}
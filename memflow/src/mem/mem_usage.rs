@@ -0,0 +1,316 @@
+/*!
+Accounting of the memory used by memflow itself.
+
+Caches and translation layers keep their own buffers around, and the scratch arenas used for
+batched reads grow to the largest batch they have ever seen. `MemoryUsage` collects the size of
+all of these per component, so a long running tool can see where its memory goes.
+
+Arenas are wrapped in a `TrackedArena` that records its high-water mark and releases memory
+again after a spike, according to its `ArenaShrinkPolicy`.
+*/
+
+use std::prelude::v1::*;
+
+use bumpalo::Bump;
+use core::ops::Deref;
+
+/// Memory used by a single component.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct MemoryComponent {
+    /// Name of the component, e.g. `page_cache`.
+    pub name: &'static str,
+    /// Number of bytes currently held by the component.
+    pub bytes: usize,
+    /// Largest number of bytes the component has held so far.
+    pub high_water_mark: usize,
+}
+
+/// Per-component memory usage report.
+///
+/// Every layer pushes its own components and then forwards the report to the layers it wraps,
+/// so the components are listed from the outermost to the innermost layer.
+///
+/// # Examples
+///
+/// ```
+/// use memflow::architecture::x86::x64;
+/// use memflow::mem::{CachedMemoryAccess, MemoryUsage, PhysicalMemory};
+/// use memflow::mem::dummy::DummyMemory;
+/// use memflow::types::size;
+///
+/// let mut mem = CachedMemoryAccess::builder(DummyMemory::new(size::mb(4)))
+///     .arch(x64::ARCH)
+///     .cache_size(size::kb(64))
+///     .build()
+///     .unwrap();
+///
+/// let mut usage = MemoryUsage::new();
+/// mem.memory_usage(&mut usage);
+///
+/// assert!(usage.total() >= size::kb(64));
+/// for component in usage.iter() {
+///     println!("{}: {} bytes", component.name, component.bytes);
+/// }
+/// ```
+#[derive(Debug, Clone, Default)]
+pub struct MemoryUsage {
+    components: Vec<MemoryComponent>,
+}
+
+impl MemoryUsage {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Adds a component with a fixed size.
+    pub fn push(&mut self, name: &'static str, bytes: usize) {
+        self.components.push(MemoryComponent {
+            name,
+            bytes,
+            high_water_mark: bytes,
+        });
+    }
+
+    /// Adds the current size and high-water mark of an arena.
+    pub fn push_arena(&mut self, name: &'static str, arena: &TrackedArena) {
+        self.components.push(MemoryComponent {
+            name,
+            bytes: arena.allocated_bytes(),
+            high_water_mark: arena.high_water_mark(),
+        });
+    }
+
+    /// Returns the number of bytes held by all components.
+    pub fn total(&self) -> usize {
+        self.components.iter().map(|c| c.bytes).sum()
+    }
+
+    pub fn iter(&self) -> impl Iterator<Item = &MemoryComponent> {
+        self.components.iter()
+    }
+
+    pub fn len(&self) -> usize {
+        self.components.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.components.is_empty()
+    }
+
+    pub fn clear(&mut self) {
+        self.components.clear();
+    }
+}
+
+/// Determines when a `TrackedArena` gives memory back after a spike.
+///
+/// The arena remembers the most memory used between two resets over the last `window` resets.
+/// If its capacity exceeds that peak by more than `factor` times, it is reallocated with just
+/// enough capacity for the peak. Arenas smaller than `min_capacity` are never shrunk.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct ArenaShrinkPolicy {
+    pub window: usize,
+    pub factor: usize,
+    pub min_capacity: usize,
+}
+
+impl ArenaShrinkPolicy {
+    /// A policy that never shrinks the arena automatically.
+    pub const fn never() -> Self {
+        Self {
+            window: 0,
+            factor: 0,
+            min_capacity: 0,
+        }
+    }
+}
+
+/// Shrinks arenas that are more than 4 times larger than needed over 256 resets.
+impl Default for ArenaShrinkPolicy {
+    fn default() -> Self {
+        Self {
+            window: 256,
+            factor: 4,
+            min_capacity: 0x10000,
+        }
+    }
+}
+
+/// A `Bump` arena which keeps track of its size and shrinks itself after spikes.
+///
+/// It dereferences to the underlying `Bump`, so it can be passed to everything taking an arena.
+/// Allocations are only accounted for on `reset`.
+#[derive(Debug, Default)]
+pub struct TrackedArena {
+    arena: Bump,
+    policy: ArenaShrinkPolicy,
+    resets: usize,
+    window_peak: usize,
+    high_water_mark: usize,
+}
+
+impl TrackedArena {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    pub fn with_capacity(capacity: usize) -> Self {
+        Self {
+            arena: Bump::with_capacity(capacity),
+            ..Self::default()
+        }
+    }
+
+    pub fn set_shrink_policy(&mut self, policy: ArenaShrinkPolicy) {
+        self.policy = policy;
+    }
+
+    pub fn shrink_policy(&self) -> ArenaShrinkPolicy {
+        self.policy
+    }
+
+    /// Returns the largest capacity the arena ever had.
+    pub fn high_water_mark(&self) -> usize {
+        self.high_water_mark.max(self.arena.allocated_bytes())
+    }
+
+    /// Frees all allocations of the arena, see `Bump::reset`.
+    ///
+    /// This also applies the shrink policy.
+    pub fn reset(&mut self) {
+        let used = self
+            .arena
+            .iter_allocated_chunks()
+            .map(|chunk| chunk.len())
+            .sum::<usize>();
+        self.window_peak = self.window_peak.max(used);
+        self.high_water_mark = self.high_water_mark.max(self.arena.allocated_bytes());
+
+        self.arena.reset();
+
+        if self.policy.window == 0 {
+            return;
+        }
+
+        self.resets += 1;
+        if self.resets >= self.policy.window {
+            let capacity = self.arena.allocated_bytes();
+            if capacity > self.policy.min_capacity
+                && capacity > self.window_peak.saturating_mul(self.policy.factor)
+            {
+                self.arena = Bump::with_capacity(self.window_peak.max(self.policy.min_capacity));
+            }
+            self.resets = 0;
+            self.window_peak = 0;
+        }
+    }
+
+    /// Frees all allocations and releases the memory of the arena.
+    pub fn shrink(&mut self) {
+        self.high_water_mark = self.high_water_mark();
+        self.arena = Bump::new();
+        self.resets = 0;
+        self.window_peak = 0;
+    }
+}
+
+/// Clones get a new, empty arena with the same shrink policy.
+impl Clone for TrackedArena {
+    fn clone(&self) -> Self {
+        Self {
+            policy: self.policy,
+            ..Self::default()
+        }
+    }
+}
+
+impl Deref for TrackedArena {
+    type Target = Bump;
+
+    fn deref(&self) -> &Bump {
+        &self.arena
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use bumpalo::collections::Vec as BumpVec;
+
+    fn fill(arena: &mut TrackedArena, bytes: usize) {
+        arena.reset();
+        let mut vec = BumpVec::<u8>::with_capacity_in(bytes, &**arena);
+        vec.resize(bytes, 0);
+    }
+
+    #[test]
+    fn test_high_water_mark() {
+        let mut arena = TrackedArena::new();
+        arena.set_shrink_policy(ArenaShrinkPolicy::never());
+
+        fill(&mut arena, 0x100000);
+        fill(&mut arena, 0x100);
+        arena.reset();
+
+        assert!(arena.high_water_mark() >= 0x100000);
+        assert!(arena.allocated_bytes() >= 0x100000);
+
+        arena.shrink();
+        assert!(arena.allocated_bytes() < 0x100000);
+        assert!(arena.high_water_mark() >= 0x100000);
+    }
+
+    #[test]
+    fn test_shrink_after_spike() {
+        let mut arena = TrackedArena::new();
+        arena.set_shrink_policy(ArenaShrinkPolicy {
+            window: 4,
+            factor: 4,
+            min_capacity: 0x1000,
+        });
+
+        fill(&mut arena, 0x100000);
+        // the window containing the spike keeps the memory
+        for _ in 0..4 {
+            fill(&mut arena, 0x100);
+        }
+        // a window of small batches releases it
+        for _ in 0..4 {
+            fill(&mut arena, 0x100);
+        }
+        arena.reset();
+
+        assert!(arena.allocated_bytes() < 0x100000);
+        assert!(arena.high_water_mark() >= 0x100000);
+    }
+
+    #[test]
+    fn test_no_shrink_when_used() {
+        let mut arena = TrackedArena::new();
+        arena.set_shrink_policy(ArenaShrinkPolicy {
+            window: 4,
+            factor: 4,
+            min_capacity: 0x1000,
+        });
+
+        for _ in 0..16 {
+            fill(&mut arena, 0x100000);
+        }
+
+        assert!(arena.allocated_bytes() >= 0x100000);
+    }
+
+    #[test]
+    fn test_usage_total() {
+        let mut arena = TrackedArena::new();
+        fill(&mut arena, 0x1000);
+
+        let mut usage = MemoryUsage::new();
+        usage.push("fixed", 0x2000);
+        usage.push_arena("arena", &arena);
+
+        assert_eq!(usage.len(), 2);
+        assert_eq!(usage.total(), 0x2000 + arena.allocated_bytes());
+        assert_eq!(usage.iter().next().unwrap().high_water_mark, 0x2000);
+    }
+}
@@ -10,9 +10,15 @@ TODO: more documentation
 */
 
 pub mod cache;
+pub mod list_walker;
 pub mod mem_map;
+pub mod mem_usage;
 pub mod phys_mem;
 pub mod phys_mem_batcher;
+#[cfg(feature = "snapshot")]
+pub mod snapshot;
+pub mod string_reader;
+pub mod traversal;
 pub mod virt_mem;
 pub mod virt_mem_batcher;
 pub mod virt_translate;
@@ -23,8 +29,12 @@ pub mod dummy;
 #[doc(hidden)]
 pub use cache::*; // TODO: specify pub declarations
 #[doc(hidden)]
+pub use list_walker::{ListHead, ListWalker};
+#[doc(hidden)]
 pub use mem_map::MemoryMap;
 #[doc(hidden)]
+pub use mem_usage::{ArenaShrinkPolicy, MemoryComponent, MemoryUsage, TrackedArena};
+#[doc(hidden)]
 pub use phys_mem::{
     CloneablePhysicalMemory, PhysicalMemory, PhysicalMemoryBox, PhysicalMemoryMetadata,
     PhysicalReadData, PhysicalReadIterator, PhysicalWriteData, PhysicalWriteIterator,
@@ -32,7 +42,11 @@ pub use phys_mem::{
 #[doc(hidden)]
 pub use phys_mem_batcher::PhysicalMemoryBatcher;
 #[doc(hidden)]
-pub use virt_mem::{VirtualDMA, VirtualMemory, VirtualReadData, VirtualWriteData};
+pub use string_reader::{StringBatch, StringReader};
+#[doc(hidden)]
+pub use traversal::{FieldId, NodeId, Traversal, TraversalPlan};
+#[doc(hidden)]
+pub use virt_mem::{FixedVirtualDMA, VirtualDMA, VirtualMemory, VirtualReadData, VirtualWriteData};
 #[doc(hidden)]
 pub use virt_mem_batcher::VirtualMemoryBatcher;
 #[doc(hidden)]
@@ -1,8 +1,9 @@
 use std::prelude::v1::*;
 
-use super::PhysicalMemoryBatcher;
+use super::{MemoryUsage, PhysicalMemoryBatcher};
+use crate::architecture::Endianess;
 use crate::error::Result;
-use crate::types::PhysicalAddress;
+use crate::types::{ByteSwap, PhysicalAddress};
 
 use std::mem::MaybeUninit;
 
@@ -116,6 +117,17 @@ where
     /// ```
     fn metadata(&self) -> PhysicalMemoryMetadata;
 
+    /// Reports the memory held by this object and the objects it wraps.
+    ///
+    /// Layers like caches push their own components and then forward the report to the memory
+    /// they wrap. Plain backends usually have nothing to report.
+    fn memory_usage(&self, _usage: &mut MemoryUsage) {}
+
+    /// Releases memory that is not needed right now, like the scratch arenas of batched reads.
+    ///
+    /// Cached contents are kept.
+    fn shrink_memory(&mut self) {}
+
     // read helpers
     fn phys_read_raw_into(&mut self, addr: PhysicalAddress, out: &mut [u8]) -> Result<()> {
         self.phys_read_raw_list(&mut [PhysicalReadData(addr, out)])
@@ -148,6 +160,39 @@ where
         Ok(obj)
     }
 
+    /// Reads `out` stored with the byte order `endianess` and converts it to the native byte order.
+    ///
+    /// Slices of `UniformSwap` types are converted in bulk.
+    fn phys_read_into_endian<T: Pod + ByteSwap + ?Sized>(
+        &mut self,
+        addr: PhysicalAddress,
+        out: &mut T,
+        endianess: Endianess,
+    ) -> Result<()>
+    where
+        Self: Sized,
+    {
+        self.phys_read_into(addr, out)?;
+        if endianess != Endianess::native() {
+            out.byte_swap();
+        }
+        Ok(())
+    }
+
+    #[allow(clippy::uninit_assumed_init)]
+    fn phys_read_endian<T: Pod + ByteSwap + Sized>(
+        &mut self,
+        addr: PhysicalAddress,
+        endianess: Endianess,
+    ) -> Result<T>
+    where
+        Self: Sized,
+    {
+        let mut obj: T = unsafe { MaybeUninit::uninit().assume_init() };
+        self.phys_read_into_endian(addr, &mut obj, endianess)?;
+        Ok(obj)
+    }
+
     // write helpers
     fn phys_write_raw(&mut self, addr: PhysicalAddress, data: &[u8]) -> Result<()> {
         self.phys_write_raw_list(&[PhysicalWriteData(addr, data)])
@@ -184,6 +229,16 @@ impl<T: PhysicalMemory + ?Sized, P: std::ops::DerefMut<Target = T> + Send> Physi
     fn metadata(&self) -> PhysicalMemoryMetadata {
         (**self).metadata()
     }
+
+    #[inline]
+    fn memory_usage(&self, usage: &mut MemoryUsage) {
+        (**self).memory_usage(usage)
+    }
+
+    #[inline]
+    fn shrink_memory(&mut self) {
+        (**self).shrink_memory()
+    }
 }
 
 /// Wrapper trait around physical memory which implements a boxed clone
@@ -0,0 +1,620 @@
+/*!
+Publishing snapshots of target memory to other processes.
+
+A `SnapshotPublisher` owns a named shared memory segment and a fixed set of registered regions.
+Each call to `publish` reads all regions from the target in a single list read. The data goes
+straight into the segment, and other processes open the segment with a `SnapshotReader` and
+copy out the latest consistent version of a region without any system call.
+
+# Layout of a segment
+
+The segment holds two slots, and every publication goes into the slot that is not the latest
+one. A reader never has to wait for a slow publication (one that is waiting on the target).
+It only retries when the publisher has lapped it twice while it was copying.
+
+```text
++--------------------+ 0
+| header             | magic, version, region count, generation, slot sequences, slot size
++--------------------+ HEADER_SIZE
+| regions            | region count * REGION_SIZE: name, address, size, offset in slot
++--------------------+
+| slot 0             | slot size
++--------------------+
+| slot 1             | slot size
++--------------------+
+```
+
+The generation is the number of the latest complete publication. It lives in slot
+`generation % 2`. Every slot has a sequence counter that is odd while the slot is being
+written. A publication that fails is not counted as a generation, it only leaves the slot with
+a new even sequence. A reader loads the generation and the sequence of its slot, and checks that
+the sequence is even and the generation did not change meanwhile. It then copies the region and
+checks that the sequence did not change either. All values are little endian, so consumers
+written in other languages can read the segment as well.
+
+Segments are only accessible by the user that created them, as they hold target memory.
+
+```no_run
+use memflow::mem::snapshot::{SnapshotPublisher, SnapshotReader};
+use memflow::mem::VirtualMemory;
+use memflow::types::Address;
+
+fn publish<T: VirtualMemory>(mem: &mut T, players: Address) {
+    let mut publisher = SnapshotPublisher::builder()
+        .region("players", players, 0x1000)
+        .create("memflow-players")
+        .unwrap();
+
+    loop {
+        publisher.publish(mem).ok();
+    }
+}
+
+fn consume() {
+    let reader = SnapshotReader::open("memflow-players").unwrap();
+    let players = reader.find_region("players").unwrap();
+
+    let mut buf = vec![0; 0x1000];
+    if let Some(generation) = reader.read_region(players, &mut buf) {
+        println!("generation {}: {:?}", generation, &buf[..16]);
+    }
+}
+```
+*/
+
+use std::prelude::v1::*;
+
+use crate::error::{Error, PartialError, PartialResult, Result};
+use crate::mem::{VirtualMemory, VirtualReadData};
+use crate::types::Address;
+
+use std::convert::TryInto;
+use std::fs::{self, File, OpenOptions};
+use std::io::Read;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{fence, AtomicU64, Ordering};
+
+use memmap::{Mmap, MmapMut, MmapOptions};
+
+/// Magic value at the start of every snapshot segment.
+pub const SNAPSHOT_MAGIC: [u8; 8] = *b"MFSNAPSH";
+
+/// Version of the segment layout.
+pub const SNAPSHOT_VERSION: u32 = 1;
+
+/// Maximum length of a region name in bytes.
+pub const SNAPSHOT_NAME_LEN: usize = 31;
+
+const HEADER_SIZE: usize = 64;
+const REGION_SIZE: usize = 64;
+
+const GENERATION_OFFSET: usize = 16;
+const SEQUENCE_OFFSET: usize = 24;
+const SLOT_SIZE_OFFSET: usize = 40;
+
+/// Number of attempts of `SnapshotReader::read_region` before it gives up.
+const READ_RETRIES: usize = 64;
+
+/// A region of a snapshot segment.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct SnapshotRegion {
+    pub name: String,
+    pub address: Address,
+    pub size: usize,
+    offset: usize,
+}
+
+/// Registers the regions of a `SnapshotPublisher`.
+#[derive(Debug, Clone, Default)]
+pub struct SnapshotBuilder {
+    regions: Vec<SnapshotRegion>,
+    slot_size: usize,
+}
+
+impl SnapshotBuilder {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Registers a region of `size` bytes at the virtual address `address`.
+    ///
+    /// Region names longer than `SNAPSHOT_NAME_LEN` bytes are rejected by `create`.
+    pub fn region(mut self, name: &str, address: Address, size: usize) -> Self {
+        self.regions.push(SnapshotRegion {
+            name: name.to_string(),
+            address,
+            size,
+            offset: self.slot_size,
+        });
+        // keep every region 8 byte aligned
+        self.slot_size += (size + 7) & !7;
+        self
+    }
+
+    /// Creates the shared segment `name` and returns its publisher.
+    ///
+    /// Names without a path separator are placed in `/dev/shm` if it exists and in the temporary
+    /// directory otherwise. An existing segment with the same name is replaced, any other file at
+    /// the path is left alone and fails the creation.
+    pub fn create(self, name: &str) -> Result<SnapshotPublisher> {
+        if self
+            .regions
+            .iter()
+            .any(|r| r.name.len() > SNAPSHOT_NAME_LEN)
+        {
+            return Err(Error::Other("snapshot region name is too long"));
+        }
+
+        let path = segment_path(name);
+        remove_segment(&path)?;
+
+        let mut options = OpenOptions::new();
+        options.read(true).write(true).create_new(true);
+        #[cfg(unix)]
+        {
+            use std::os::unix::fs::OpenOptionsExt;
+            options.mode(0o600);
+        }
+        let file = options
+            .open(&path)
+            .map_err(|_| Error::IO("unable to create snapshot segment"))?;
+
+        let size = slots_offset(self.regions.len()) + 2 * self.slot_size;
+        let map = file
+            .set_len(size as u64)
+            .ok()
+            .and_then(|_| unsafe { MmapOptions::new().map_mut(&file) }.ok());
+        let mut map = match map {
+            Some(map) => map,
+            None => {
+                let _ = fs::remove_file(&path);
+                return Err(Error::IO("unable to map snapshot segment"));
+            }
+        };
+
+        map[8..12].copy_from_slice(&SNAPSHOT_VERSION.to_le_bytes());
+        map[12..16].copy_from_slice(&(self.regions.len() as u32).to_le_bytes());
+        map[SLOT_SIZE_OFFSET..SLOT_SIZE_OFFSET + 8]
+            .copy_from_slice(&(self.slot_size as u64).to_le_bytes());
+
+        for (i, region) in self.regions.iter().enumerate() {
+            let entry = &mut map[HEADER_SIZE + i * REGION_SIZE..][..REGION_SIZE];
+            entry[..region.name.len()].copy_from_slice(region.name.as_bytes());
+            entry[32..40].copy_from_slice(&region.address.as_u64().to_le_bytes());
+            entry[40..48].copy_from_slice(&(region.size as u64).to_le_bytes());
+            entry[48..56].copy_from_slice(&(region.offset as u64).to_le_bytes());
+        }
+
+        // the magic is written last, readers reject the segment until it is fully set up
+        fence(Ordering::Release);
+        map[0..8].copy_from_slice(&SNAPSHOT_MAGIC);
+
+        Ok(SnapshotPublisher {
+            slots: Slots {
+                map,
+                slots_offset: slots_offset(self.regions.len()),
+                slot_size: self.slot_size,
+                generation: 0,
+            },
+            path,
+            regions: self.regions,
+        })
+    }
+}
+
+/// Publishes snapshots of registered regions into a shared segment.
+///
+/// The segment is removed when the publisher is dropped. Readers that already opened it keep
+/// their mapping.
+pub struct SnapshotPublisher {
+    slots: Slots,
+    path: PathBuf,
+    regions: Vec<SnapshotRegion>,
+}
+
+impl SnapshotPublisher {
+    pub fn builder() -> SnapshotBuilder {
+        SnapshotBuilder::new()
+    }
+
+    pub fn regions(&self) -> &[SnapshotRegion] {
+        &self.regions
+    }
+
+    /// Returns the path of the shared segment.
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
+    /// Returns the generation of the latest publication, 0 if nothing was published yet.
+    pub fn generation(&self) -> u64 {
+        self.slots.generation
+    }
+
+    /// Reads all regions from `mem` and publishes them.
+    ///
+    /// All regions are read with a single list read directly into the segment. Parts that could
+    /// not be read are published as well (zeroed), in which case the partial error is returned.
+    /// On any other error nothing is published and the generation stays the same.
+    pub fn publish<T: VirtualMemory + ?Sized>(&mut self, mem: &mut T) -> PartialResult<()> {
+        let regions = &self.regions;
+        let mut ret = Ok(());
+
+        self.slots.publish(|slot| {
+            let mut rest = slot;
+            let mut list = regions
+                .iter()
+                .map(|r| {
+                    let (buf, tail) = std::mem::take(&mut rest).split_at_mut((r.size + 7) & !7);
+                    rest = tail;
+                    VirtualReadData(r.address, &mut buf[..r.size])
+                })
+                .collect::<Vec<_>>();
+            ret = mem.virt_read_raw_list(&mut list);
+            match ret {
+                Ok(_) | Err(PartialError::PartialVirtualRead(_)) => true,
+                Err(_) => false,
+            }
+        });
+
+        ret
+    }
+
+    /// Publishes data produced by `func`.
+    ///
+    /// `func` receives a `SnapshotFrame` over the slot that is going to be published, which
+    /// still holds the data of the publication before the latest one.
+    pub fn update<F: FnOnce(&mut SnapshotFrame)>(&mut self, func: F) -> u64 {
+        let regions = &self.regions;
+        self.slots.publish(|slot| {
+            func(&mut SnapshotFrame { regions, slot });
+            true
+        });
+        self.slots.generation
+    }
+}
+
+impl Drop for SnapshotPublisher {
+    fn drop(&mut self) {
+        let _ = fs::remove_file(&self.path);
+    }
+}
+
+/// The writing side of the two slots of a segment.
+struct Slots {
+    map: MmapMut,
+    slots_offset: usize,
+    slot_size: usize,
+    generation: u64,
+}
+
+impl Slots {
+    /// Lets `func` fill the slot that is not the latest one and publishes it.
+    ///
+    /// If `func` returns false the slot is left with a new sequence, so readers discard any copy
+    /// they made of it meanwhile, but the generation is not advanced.
+    fn publish<F: FnOnce(&mut [u8]) -> bool>(&mut self, func: F) {
+        let generation = self.generation + 1;
+        let slot = (generation % 2) as usize;
+        let slot_start = self.slots_offset + slot * self.slot_size;
+
+        let seq = atomic_at(&self.map, SEQUENCE_OFFSET + slot * 8);
+        let start = seq.load(Ordering::Relaxed).wrapping_add(1);
+        seq.store(start, Ordering::Relaxed);
+        fence(Ordering::Release);
+
+        let complete = func(&mut self.map[slot_start..slot_start + self.slot_size]);
+
+        let seq = atomic_at(&self.map, SEQUENCE_OFFSET + slot * 8);
+        seq.store(start.wrapping_add(1), Ordering::Release);
+        if complete {
+            atomic_at(&self.map, GENERATION_OFFSET).store(generation, Ordering::Release);
+            self.generation = generation;
+        }
+    }
+}
+
+/// The slot of a publication in progress.
+pub struct SnapshotFrame<'a> {
+    regions: &'a [SnapshotRegion],
+    slot: &'a mut [u8],
+}
+
+impl<'a> SnapshotFrame<'a> {
+    /// Returns the buffer of the region at `idx` in the order of registration.
+    pub fn region_mut(&mut self, idx: usize) -> &mut [u8] {
+        let region = &self.regions[idx];
+        &mut self.slot[region.offset..region.offset + region.size]
+    }
+}
+
+/// Reads snapshots from a shared segment created by a `SnapshotPublisher`.
+pub struct SnapshotReader {
+    map: Mmap,
+    regions: Vec<SnapshotRegion>,
+    slots_offset: usize,
+    slot_size: usize,
+}
+
+impl SnapshotReader {
+    /// Opens the shared segment `name`, see `SnapshotBuilder::create`.
+    pub fn open(name: &str) -> Result<Self> {
+        let file = File::open(segment_path(name))
+            .map_err(|_| Error::IO("unable to open snapshot segment"))?;
+        let map = unsafe { MmapOptions::new().map(&file) }
+            .map_err(|_| Error::IO("unable to map snapshot segment"))?;
+
+        if map.len() < HEADER_SIZE || map[0..8] != SNAPSHOT_MAGIC {
+            return Err(Error::IO("invalid snapshot segment"));
+        }
+        fence(Ordering::Acquire);
+        if read_u32(&map[8..]) != SNAPSHOT_VERSION {
+            return Err(Error::IO("snapshot version mismatch"));
+        }
+
+        let count = read_u32(&map[12..]) as usize;
+        let slot_size = read_u64(&map[SLOT_SIZE_OFFSET..]) as usize;
+        let slots_offset = slots_offset(count);
+        if map.len() < slots_offset + 2 * slot_size {
+            return Err(Error::IO("snapshot segment is too small"));
+        }
+
+        let regions = (0..count)
+            .map(|i| {
+                let entry = &map[HEADER_SIZE + i * REGION_SIZE..][..REGION_SIZE];
+                let name_len = entry[..32].iter().position(|&c| c == 0).unwrap_or(32);
+                SnapshotRegion {
+                    name: String::from_utf8_lossy(&entry[..name_len]).into_owned(),
+                    address: Address::from(read_u64(&entry[32..])),
+                    size: read_u64(&entry[40..]) as usize,
+                    offset: read_u64(&entry[48..]) as usize,
+                }
+            })
+            .collect::<Vec<_>>();
+
+        if regions.iter().any(|r| r.offset + r.size > slot_size) {
+            return Err(Error::IO("invalid snapshot region"));
+        }
+
+        Ok(Self {
+            map,
+            regions,
+            slots_offset,
+            slot_size,
+        })
+    }
+
+    pub fn regions(&self) -> &[SnapshotRegion] {
+        &self.regions
+    }
+
+    /// Returns the index of the region called `name`.
+    pub fn find_region(&self, name: &str) -> Option<usize> {
+        self.regions.iter().position(|r| r.name == name)
+    }
+
+    /// Returns the generation of the latest publication, 0 if nothing was published yet.
+    ///
+    /// This is a single load from the segment and can be used to check for new data.
+    pub fn generation(&self) -> u64 {
+        atomic_at(&self.map, GENERATION_OFFSET).load(Ordering::Acquire)
+    }
+
+    /// Copies the latest consistent version of the region at `idx` into `out`.
+    ///
+    /// At most `out.len()` bytes are copied. Returns the generation of the copied data, or `None`
+    /// if nothing was published yet or the publisher kept overwriting the slot while copying.
+    pub fn read_region(&self, idx: usize, out: &mut [u8]) -> Option<u64> {
+        let region = self.regions.get(idx)?;
+        let len = out.len().min(region.size);
+
+        for _ in 0..READ_RETRIES {
+            let generation = self.generation();
+            if generation == 0 {
+                return None;
+            }
+
+            let slot = (generation % 2) as usize;
+            let seq = atomic_at(&self.map, SEQUENCE_OFFSET + slot * 8);
+            // A slot is only rewritten once the other slot has become the latest one. If the
+            // generation did not change, the sequence was loaded before any rewrite of the slot
+            // finished, and an ongoing one leaves it odd.
+            let start = seq.load(Ordering::Acquire);
+            if start % 2 != 0 || self.generation() != generation {
+                continue;
+            }
+
+            let src = self.slots_offset + slot * self.slot_size + region.offset;
+            // the publisher may write concurrently, the copy is discarded in that case
+            unsafe {
+                std::ptr::copy_nonoverlapping(self.map.as_ptr().add(src), out.as_mut_ptr(), len);
+            }
+
+            fence(Ordering::Acquire);
+            if seq.load(Ordering::Relaxed) == start {
+                return Some(generation);
+            }
+        }
+
+        None
+    }
+}
+
+fn segment_path(name: &str) -> PathBuf {
+    if name.contains('/') || name.contains('\\') {
+        return PathBuf::from(name);
+    }
+
+    let shm = Path::new("/dev/shm");
+    if shm.is_dir() {
+        shm.join(name)
+    } else {
+        std::env::temp_dir().join(name)
+    }
+}
+
+/// Removes the snapshot segment at `path`, if there is one.
+///
+/// Fails if `path` is any other file.
+fn remove_segment(path: &Path) -> Result<()> {
+    let mut file = match File::open(path) {
+        Ok(file) => file,
+        Err(_) => return Ok(()),
+    };
+
+    let mut magic = [0; 8];
+    if file.read_exact(&mut magic).is_err() || magic != SNAPSHOT_MAGIC {
+        return Err(Error::IO("snapshot segment path is used by another file"));
+    }
+
+    fs::remove_file(path).map_err(|_| Error::IO("unable to remove snapshot segment"))
+}
+
+fn slots_offset(region_count: usize) -> usize {
+    HEADER_SIZE + region_count * REGION_SIZE
+}
+
+fn atomic_at(map: &[u8], offset: usize) -> &AtomicU64 {
+    debug_assert!(offset + 8 <= map.len());
+    // the mapping is page aligned and all counters are at 8 byte aligned offsets
+    unsafe { &*(map.as_ptr().add(offset) as *const AtomicU64) }
+}
+
+fn read_u32(buf: &[u8]) -> u32 {
+    u32::from_le_bytes(buf[..4].try_into().unwrap())
+}
+
+fn read_u64(buf: &[u8]) -> u64 {
+    u64::from_le_bytes(buf[..8].try_into().unwrap())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::mem::dummy::DummyMemory;
+    use crate::types::size;
+
+    fn segment_name(name: &str) -> String {
+        format!("memflow-test-snapshot-{}-{}", name, std::process::id())
+    }
+
+    #[test]
+    fn test_publish() {
+        let data = (0..0x2000).map(|i| i as u8).collect::<Vec<_>>();
+        let (mut mem, addr) = DummyMemory::new_virt(size::mb(4), size::mb(2), &data);
+
+        let name = segment_name("publish");
+        let mut publisher = SnapshotPublisher::builder()
+            .region("first", addr, 0x13)
+            .region("second", addr + 0x1000, 0x1000)
+            .create(&name)
+            .unwrap();
+
+        let reader = SnapshotReader::open(&name).unwrap();
+        assert_eq!(reader.regions(), publisher.regions());
+        assert_eq!(reader.generation(), 0);
+
+        let mut buf = vec![0; 0x1000];
+        assert_eq!(reader.read_region(1, &mut buf), None);
+
+        publisher.publish(&mut mem).unwrap();
+        assert_eq!(reader.read_region(1, &mut buf), Some(1));
+        assert_eq!(buf[..], data[0x1000..]);
+
+        let first = reader.find_region("first").unwrap();
+        assert_eq!(reader.read_region(first, &mut buf), Some(1));
+        assert_eq!(buf[..0x13], data[..0x13]);
+    }
+
+    #[test]
+    fn test_update() {
+        let name = segment_name("update");
+        let mut publisher = SnapshotPublisher::builder()
+            .region("counter", Address::null(), 8)
+            .create(&name)
+            .unwrap();
+        let reader = SnapshotReader::open(&name).unwrap();
+
+        let mut buf = [0; 8];
+        for i in 1..5_u64 {
+            let generation = publisher.update(|frame| {
+                frame.region_mut(0).copy_from_slice(&i.to_le_bytes());
+            });
+            assert_eq!(generation, i);
+            assert_eq!(reader.read_region(0, &mut buf), Some(i));
+            assert_eq!(u64::from_le_bytes(buf), i);
+        }
+
+        drop(publisher);
+        assert!(SnapshotReader::open(&name).is_err());
+    }
+
+    #[test]
+    fn test_failed_publish() {
+        let name = segment_name("failed");
+        let mut publisher = SnapshotPublisher::builder()
+            .region("counter", Address::null(), 8)
+            .create(&name)
+            .unwrap();
+        let reader = SnapshotReader::open(&name).unwrap();
+
+        for i in 1..3_u64 {
+            publisher.update(|frame| {
+                frame.region_mut(0).copy_from_slice(&i.to_le_bytes());
+            });
+        }
+
+        // a failed publication garbles the slot of generation 1, but does not publish it
+        publisher.slots.publish(|slot| {
+            slot.iter_mut().for_each(|b| *b = 0xff);
+            false
+        });
+        assert_eq!(publisher.generation(), 2);
+
+        let mut buf = [0; 8];
+        assert_eq!(reader.read_region(0, &mut buf), Some(2));
+        assert_eq!(u64::from_le_bytes(buf), 2);
+
+        publisher.update(|frame| {
+            frame.region_mut(0).copy_from_slice(&3_u64.to_le_bytes());
+        });
+        assert_eq!(reader.read_region(0, &mut buf), Some(3));
+        assert_eq!(u64::from_le_bytes(buf), 3);
+    }
+
+    #[test]
+    fn test_create_keeps_other_files() {
+        let path = std::env::temp_dir().join(segment_name("other"));
+        fs::write(&path, b"not a snapshot segment").unwrap();
+
+        assert!(SnapshotPublisher::builder()
+            .region("counter", Address::null(), 8)
+            .create(path.to_str().unwrap())
+            .is_err());
+        assert_eq!(fs::read(&path).unwrap(), b"not a snapshot segment");
+
+        fs::remove_file(&path).unwrap();
+    }
+
+    #[cfg(unix)]
+    #[test]
+    fn test_segment_mode() {
+        use std::os::unix::fs::PermissionsExt;
+
+        let publisher = SnapshotPublisher::builder()
+            .region("counter", Address::null(), 8)
+            .create(&segment_name("mode"))
+            .unwrap();
+        let mode = fs::metadata(publisher.path()).unwrap().permissions().mode();
+        assert_eq!(mode & 0o777, 0o600);
+    }
+
+    #[test]
+    fn test_name_too_long() {
+        let name = "x".repeat(SNAPSHOT_NAME_LEN + 1);
+        assert!(SnapshotPublisher::builder()
+            .region(&name, Address::null(), 8)
+            .create(&segment_name("long"))
+            .is_err());
+    }
+}
@@ -0,0 +1,330 @@
+/*!
+Batched reading of many strings at once.
+
+Reading a string with `VirtualMemory::virt_read_cstr` costs one round trip to the connector and
+one allocation per string. When resolving the names of a large symbol or object table this adds
+up quickly. `StringReader` reads all strings of a table together:
+
+1. A first batch reads `chunk_size` bytes of every string in a single `virt_read_raw_list` call.
+2. Only the strings that are not terminated within the bytes read so far are read again, with a
+   four times larger chunk per pass, until they are terminated or `max_len` is reached.
+
+Typically all strings are resolved in one or two round trips. The decoded strings are stored
+back to back in a single arena that is reused between calls, and are returned as `&str` slices.
+
+# Examples
+
+```
+use memflow::mem::{StringReader, VirtualMemory};
+use memflow::mem::dummy::DummyMemory;
+use memflow::types::size;
+
+let (mut mem, addr) = DummyMemory::new_virt(size::mb(4), size::mb(2), b"first\0second\0");
+
+let mut reader = StringReader::new(0x100);
+let strings = reader.read_cstrs(&mut mem, &[addr, addr + 6]).unwrap();
+
+assert_eq!(strings.get(0), Some("first"));
+assert_eq!(strings.get(1), Some("second"));
+```
+*/
+
+use std::prelude::v1::*;
+
+use super::{VirtualMemory, VirtualReadData};
+use crate::architecture::Endianess;
+use crate::error::{PartialResultExt, Result};
+use crate::types::Address;
+
+use std::char::{decode_utf16, REPLACEMENT_CHARACTER};
+
+/// Number of bytes read per string in the first batch.
+pub const DEFAULT_CHUNK_SIZE: usize = 0x40;
+
+/// Reads many null terminated or counted strings in a few batched reads.
+///
+/// All buffers are kept between calls, so reading the strings of one table after another does
+/// not allocate once the buffers have grown large enough.
+pub struct StringReader {
+    chunk_size: usize,
+    max_len: usize,
+    scratch: Vec<u8>,
+    read_list: Vec<VirtualReadData<'static>>,
+    pending: Vec<usize>,
+    arena: String,
+    spans: Vec<(usize, usize)>,
+}
+
+impl StringReader {
+    /// Creates a new reader that reads at most `max_len` bytes per string.
+    pub fn new(max_len: usize) -> Self {
+        Self {
+            chunk_size: DEFAULT_CHUNK_SIZE,
+            max_len,
+            scratch: vec![],
+            read_list: vec![],
+            pending: vec![],
+            arena: String::new(),
+            spans: vec![],
+        }
+    }
+
+    /// Changes the number of bytes read per string in the first batch.
+    ///
+    /// The chunk size should cover the majority of the strings that are read. It is rounded up
+    /// to a multiple of two so UTF-16 characters are never split.
+    pub fn chunk_size(mut self, chunk_size: usize) -> Self {
+        self.chunk_size = (chunk_size.max(2) + 1) & !1;
+        self
+    }
+
+    /// Reads the null terminated strings at `addrs`.
+    ///
+    /// Invalid UTF-8 sequences are replaced with `U+FFFD`. Unreadable memory is treated as
+    /// zeroes, so a string in paged out memory is read as empty.
+    pub fn read_cstrs<T: VirtualMemory>(
+        &mut self,
+        mem: &mut T,
+        addrs: &[Address],
+    ) -> Result<StringBatch<'_>> {
+        self.read_terminated(mem, addrs, 1, |bytes, arena| {
+            arena.push_str(&String::from_utf8_lossy(bytes))
+        })?;
+        Ok(self.batch())
+    }
+
+    /// Reads the null terminated UTF-16 strings at `addrs` stored with the byte order `endianess`.
+    ///
+    /// Unpaired surrogates are replaced with `U+FFFD`.
+    pub fn read_utf16_strs<T: VirtualMemory>(
+        &mut self,
+        mem: &mut T,
+        addrs: &[Address],
+        endianess: Endianess,
+    ) -> Result<StringBatch<'_>> {
+        self.read_terminated(mem, addrs, 2, |bytes, arena| {
+            push_utf16(bytes, endianess, arena)
+        })?;
+        Ok(self.batch())
+    }
+
+    /// Reads UTF-16 strings with a known length in bytes, e.g. the buffers of a `UNICODE_STRING`.
+    ///
+    /// All strings are read in a single batch. Lengths are capped at `max_len`.
+    pub fn read_utf16_counted<T: VirtualMemory>(
+        &mut self,
+        mem: &mut T,
+        strings: &[(Address, usize)],
+        endianess: Endianess,
+    ) -> Result<StringBatch<'_>> {
+        let max_len = self.max_len & !1;
+        let len = |size: usize| size.min(max_len) & !1;
+
+        self.reset(strings.len());
+        self.scratch
+            .resize(strings.iter().map(|&(_, size)| len(size)).sum(), 0);
+
+        {
+            let mut rest = &mut self.scratch[..];
+            let mut list = VirtualReadData::recycle_list(std::mem::take(&mut self.read_list));
+            list.extend(strings.iter().map(|&(addr, size)| {
+                let (buf, tail) = std::mem::take(&mut rest).split_at_mut(len(size));
+                rest = tail;
+                VirtualReadData(addr, buf)
+            }));
+            let ret = mem.virt_read_raw_list(&mut list).data_part();
+            self.read_list = VirtualReadData::recycle_list(list);
+            ret?;
+        }
+
+        let mut off = 0;
+        for (i, &(_, size)) in strings.iter().enumerate() {
+            let bytes = &self.scratch[off..off + len(size)];
+            let start = self.arena.len();
+            push_utf16(bytes, endianess, &mut self.arena);
+            self.spans[i] = (start, self.arena.len());
+            off += bytes.len();
+        }
+
+        Ok(self.batch())
+    }
+
+    fn reset(&mut self, count: usize) {
+        self.arena.clear();
+        self.scratch.clear();
+        self.spans.clear();
+        self.spans.resize(count, (0, 0));
+    }
+
+    fn batch(&self) -> StringBatch<'_> {
+        StringBatch {
+            arena: &self.arena,
+            spans: &self.spans,
+        }
+    }
+
+    /// Reads strings terminated by a zeroed `unit` wide character.
+    fn read_terminated<T: VirtualMemory, F: Fn(&[u8], &mut String)>(
+        &mut self,
+        mem: &mut T,
+        addrs: &[Address],
+        unit: usize,
+        decode: F,
+    ) -> Result<()> {
+        self.reset(addrs.len());
+        self.pending.clear();
+        self.pending.extend(0..addrs.len());
+
+        let max_len = self.max_len - self.max_len % unit;
+        let mut len = self.chunk_size.min(max_len);
+
+        while !self.pending.is_empty() && len > 0 {
+            let Self {
+                scratch,
+                read_list,
+                pending,
+                arena,
+                spans,
+                ..
+            } = self;
+
+            scratch.clear();
+            scratch.resize(pending.len() * len, 0);
+
+            {
+                let mut list = VirtualReadData::recycle_list(std::mem::take(read_list));
+                list.extend(
+                    pending
+                        .iter()
+                        .zip(scratch.chunks_exact_mut(len))
+                        .map(|(&i, buf)| VirtualReadData(addrs[i], buf)),
+                );
+                let ret = mem.virt_read_raw_list(&mut list).data_part();
+                *read_list = VirtualReadData::recycle_list(list);
+                ret?;
+            }
+
+            // keep the strings that are not terminated yet for the next pass
+            let mut unfinished = 0;
+            for (n, buf) in scratch.chunks_exact(len).enumerate() {
+                let i = pending[n];
+                let end = buf
+                    .chunks_exact(unit)
+                    .position(|c| c.iter().all(|&b| b == 0))
+                    .map(|pos| pos * unit);
+
+                if end.is_none() && len < max_len {
+                    pending[unfinished] = i;
+                    unfinished += 1;
+                } else {
+                    let start = arena.len();
+                    decode(&buf[..end.unwrap_or(len)], arena);
+                    spans[i] = (start, arena.len());
+                }
+            }
+            pending.truncate(unfinished);
+
+            len = len.saturating_mul(4).min(max_len);
+        }
+
+        Ok(())
+    }
+}
+
+fn push_utf16(bytes: &[u8], endianess: Endianess, out: &mut String) {
+    let units = bytes.chunks_exact(2).map(|b| match endianess {
+        Endianess::LittleEndian => u16::from_le_bytes([b[0], b[1]]),
+        Endianess::BigEndian => u16::from_be_bytes([b[0], b[1]]),
+    });
+    out.extend(decode_utf16(units).map(|c| c.unwrap_or(REPLACEMENT_CHARACTER)));
+}
+
+/// The strings read by a single `StringReader` call, in the order they were requested.
+#[derive(Debug, Clone, Copy)]
+pub struct StringBatch<'a> {
+    arena: &'a str,
+    spans: &'a [(usize, usize)],
+}
+
+impl<'a> StringBatch<'a> {
+    /// Returns the string at `idx`.
+    pub fn get(&self, idx: usize) -> Option<&'a str> {
+        let arena = self.arena;
+        self.spans.get(idx).map(|&(start, end)| &arena[start..end])
+    }
+
+    pub fn iter(&self) -> impl Iterator<Item = &'a str> + 'a {
+        let arena = self.arena;
+        self.spans
+            .iter()
+            .map(move |&(start, end)| &arena[start..end])
+    }
+
+    pub fn len(&self) -> usize {
+        self.spans.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.spans.is_empty()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::mem::dummy::DummyMemory;
+    use crate::types::size;
+
+    #[test]
+    fn test_cstrs() {
+        let long = "x".repeat(0x300);
+        let mut data = b"first\0second\0".to_vec();
+        data.extend_from_slice(long.as_bytes());
+        data.push(0);
+        let (mut mem, addr) = DummyMemory::new_virt(size::mb(4), size::mb(2), &data);
+
+        let mut reader = StringReader::new(0x1000).chunk_size(0x10);
+        let addrs = [addr, addr + 13, addr + 6, addr + 5];
+        let strings = reader.read_cstrs(&mut mem, &addrs).unwrap();
+
+        assert_eq!(strings.len(), 4);
+        assert_eq!(strings.get(0), Some("first"));
+        assert_eq!(strings.get(1), Some(&long[..]));
+        assert_eq!(strings.get(2), Some("second"));
+        assert_eq!(strings.get(3), Some(""));
+        assert_eq!(strings.get(4), None);
+
+        // strings are cut off at max_len
+        let mut reader = StringReader::new(0x20).chunk_size(0x10);
+        let strings = reader.read_cstrs(&mut mem, &[addr + 13]).unwrap();
+        assert_eq!(strings.iter().collect::<Vec<_>>(), vec![&long[..0x20]]);
+    }
+
+    #[test]
+    fn test_utf16() {
+        let names = ["ntoskrnl.exe", "\u{1f980}.dll"];
+        let mut data = vec![];
+        let mut offsets = vec![];
+        for name in names.iter() {
+            offsets.push(data.len());
+            name.encode_utf16()
+                .for_each(|c| data.extend_from_slice(&c.to_le_bytes()));
+            data.extend_from_slice(&[0, 0]);
+        }
+        let (mut mem, addr) = DummyMemory::new_virt(size::mb(4), size::mb(2), &data);
+
+        let addrs = offsets.iter().map(|&o| addr + o).collect::<Vec<_>>();
+        let mut reader = StringReader::new(0x100).chunk_size(4);
+        let strings = reader
+            .read_utf16_strs(&mut mem, &addrs, Endianess::LittleEndian)
+            .unwrap();
+        assert_eq!(strings.iter().collect::<Vec<_>>(), names);
+
+        let counted = [(addrs[0], 16), (addrs[1], 6)];
+        let strings = reader
+            .read_utf16_counted(&mut mem, &counted, Endianess::LittleEndian)
+            .unwrap();
+        assert_eq!(strings.get(0), Some("ntoskrnl"));
+        assert_eq!(strings.get(1), Some("\u{1f980}."));
+    }
+}
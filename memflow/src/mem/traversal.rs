@@ -0,0 +1,540 @@
+/*!
+Declarative traversals of object graphs.
+
+Reading an object graph by hand (a list of objects, a pointer in every object, a few fields and
+a string behind that pointer) issues one read after the other, each waiting for the address
+produced by the previous one. A `TraversalPlan` describes such a traversal up front instead:
+
+- `read` captures a field of an object,
+- `follow` reads a pointer of an object and continues at the object it points to,
+- `list` walks a `LIST_ENTRY` style list and continues at every element.
+
+The plan is executed breadth-first. Every round reads all fields and pointers whose addresses
+are known at that point with a single `virt_read_raw_list`, the pointers read in one round
+produce the objects read in the next one. A traversal therefore takes as many round trips as
+its longest chain of dependent reads, regardless of how many objects it visits.
+
+Plans are immutable once built and can be executed any number of times, e.g. once per frame.
+`TraversalPlan::execute_into` reuses the buffers of a previous `Traversal`.
+
+# Examples
+
+```
+use memflow::architecture::x86::x64;
+use memflow::mem::{TraversalPlan, VirtualMemory};
+use memflow::mem::dummy::DummyMemory;
+use memflow::types::size;
+
+let (mut mem, base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &[0; 0x100]);
+mem.virt_write(base, &(base + 0x40).as_u64()).unwrap();
+mem.virt_write(base + 0x48, &0x1234u32).unwrap();
+
+// root -> *(root + 0) -> u32 at offset 8
+let mut plan = TraversalPlan::new(x64::ARCH);
+let target = plan.follow(plan.root(), 0);
+let value = plan.read(target, 8, 4);
+
+let traversal = plan.execute(&mut mem, &[base]).unwrap();
+assert_eq!(traversal.len(target), 1);
+assert_eq!(traversal.value::<u32>(value, 0), 0x1234);
+```
+*/
+
+use std::prelude::v1::*;
+
+use super::list_walker::{read_ptr, DEFAULT_MAX_LIST_LEN};
+use super::{VirtualMemory, VirtualReadData};
+use crate::architecture::ArchitectureObj;
+use crate::error::{PartialResultExt, Result};
+use crate::types::Address;
+
+use dataview::Pod;
+use std::mem::MaybeUninit;
+use std::ops::Range;
+
+/// An object type in a `TraversalPlan`.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct NodeId(usize);
+
+/// A field captured by a `TraversalPlan`.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FieldId {
+    node: NodeId,
+    record_offset: usize,
+    len: usize,
+}
+
+#[derive(Debug, Clone, Default)]
+struct PlanNode {
+    parent: Option<usize>,
+    record_len: usize,
+    // (offset, record offset, length)
+    fields: Vec<(usize, usize, usize)>,
+    // (offset of the pointer, target node)
+    follows: Vec<(usize, usize)>,
+    // (offset of the list head, offset of the link in the elements, element node)
+    lists: Vec<(usize, usize, usize)>,
+}
+
+/// A reusable description of the objects and fields to read.
+#[derive(Debug, Clone)]
+pub struct TraversalPlan {
+    arch: ArchitectureObj,
+    max_list_len: usize,
+    nodes: Vec<PlanNode>,
+}
+
+impl TraversalPlan {
+    /// Creates an empty plan, `arch` determines the size of the pointers that are followed.
+    pub fn new(arch: ArchitectureObj) -> Self {
+        Self {
+            arch,
+            max_list_len: DEFAULT_MAX_LIST_LEN,
+            nodes: vec![PlanNode::default()],
+        }
+    }
+
+    /// Changes the maximum number of elements read per list.
+    pub fn max_list_len(mut self, max_list_len: usize) -> Self {
+        self.max_list_len = max_list_len;
+        self
+    }
+
+    /// Returns the node of the root objects passed to `execute`.
+    pub fn root(&self) -> NodeId {
+        NodeId(0)
+    }
+
+    /// Captures `len` bytes at `offset` of every object of `node`.
+    pub fn read(&mut self, node: NodeId, offset: usize, len: usize) -> FieldId {
+        let plan_node = &mut self.nodes[node.0];
+        let record_offset = plan_node.record_len;
+        plan_node.fields.push((offset, record_offset, len));
+        plan_node.record_len += len;
+
+        FieldId {
+            node,
+            record_offset,
+            len,
+        }
+    }
+
+    /// Follows the pointer at `offset` of every object of `node`.
+    ///
+    /// Returns the node of the objects pointed to. Null pointers are skipped.
+    pub fn follow(&mut self, node: NodeId, offset: usize) -> NodeId {
+        let target = self.push_node(node);
+        self.nodes[node.0].follows.push((offset, target.0));
+        target
+    }
+
+    /// Walks the list whose head is located at `head_offset` of every object of `node`.
+    ///
+    /// The elements of the list are linked through the `LIST_ENTRY` at `link_offset` of every
+    /// element. Returns the node of the elements.
+    pub fn list(&mut self, node: NodeId, head_offset: usize, link_offset: usize) -> NodeId {
+        let element = self.push_node(node);
+        self.nodes[node.0]
+            .lists
+            .push((head_offset, link_offset, element.0));
+        element
+    }
+
+    fn push_node(&mut self, parent: NodeId) -> NodeId {
+        self.nodes.push(PlanNode {
+            parent: Some(parent.0),
+            ..PlanNode::default()
+        });
+        NodeId(self.nodes.len() - 1)
+    }
+
+    /// Executes the plan starting at the objects at `roots`.
+    pub fn execute<T: VirtualMemory>(&self, mem: &mut T, roots: &[Address]) -> Result<Traversal> {
+        let mut out = Traversal::new();
+        self.execute_into(mem, roots, &mut out)?;
+        Ok(out)
+    }
+
+    /// Executes the plan starting at the objects at `roots` and stores the results in `out`.
+    ///
+    /// All previous results of `out` are discarded, its buffers are reused.
+    pub fn execute_into<T: VirtualMemory>(
+        &self,
+        mem: &mut T,
+        roots: &[Address],
+        out: &mut Traversal,
+    ) -> Result<()> {
+        out.reset(self.nodes.len());
+
+        // the scratch buffers are moved out so objects can be spawned into `out`
+        let mut requests = std::mem::take(&mut out.requests);
+        let mut next_requests = std::mem::take(&mut out.next_requests);
+        let mut ptrs = std::mem::take(&mut out.ptrs);
+        requests.clear();
+
+        for (idx, &root) in roots.iter().enumerate() {
+            self.spawn(out, &mut requests, 0, idx, root);
+        }
+
+        let ptr_size = self.arch.size_addr();
+
+        while !requests.is_empty() {
+            out.rounds += 1;
+
+            // the fields of a round are reserved back to back at the end of the arena
+            let arena_start = requests
+                .iter()
+                .filter_map(|req: &Request| match req.target {
+                    Target::Field(start) => Some(start),
+                    _ => None,
+                })
+                .next()
+                .unwrap_or_else(|| out.arena.len());
+
+            ptrs.clear();
+            ptrs.resize(requests.len(), [0; 8]);
+
+            {
+                let mut arena = &mut out.arena[arena_start..];
+                let mut list = requests
+                    .iter()
+                    .zip(ptrs.iter_mut())
+                    .map(|(req, ptr)| match req.target {
+                        Target::Field(_) => {
+                            let (buf, rest) = std::mem::take(&mut arena).split_at_mut(req.len);
+                            arena = rest;
+                            VirtualReadData(req.addr, buf)
+                        }
+                        _ => VirtualReadData(req.addr, &mut ptr[..ptr_size]),
+                    })
+                    .collect::<Vec<_>>();
+                mem.virt_read_raw_list(&mut list).data_part()?;
+            }
+
+            for (req, ptr) in requests.iter().zip(ptrs.iter()) {
+                match req.target {
+                    Target::Field(_) => {}
+                    Target::Follow { node, parent } => {
+                        let addr = read_ptr(self.arch, ptr);
+                        if !addr.is_null() {
+                            self.spawn(out, &mut next_requests, node, parent, addr);
+                        }
+                    }
+                    Target::ListHop {
+                        node,
+                        parent,
+                        head,
+                        link_offset,
+                        len,
+                    } => {
+                        let next = read_ptr(self.arch, ptr);
+                        if next.is_null()
+                            || next == head
+                            || next == req.addr
+                            || len >= self.max_list_len
+                        {
+                            continue;
+                        }
+
+                        self.spawn(out, &mut next_requests, node, parent, next - link_offset);
+                        next_requests.push(Request {
+                            addr: next,
+                            len: ptr_size,
+                            target: Target::ListHop {
+                                node,
+                                parent,
+                                head,
+                                link_offset,
+                                len: len + 1,
+                            },
+                        });
+                    }
+                }
+            }
+
+            std::mem::swap(&mut requests, &mut next_requests);
+            next_requests.clear();
+        }
+
+        out.requests = requests;
+        out.next_requests = next_requests;
+        out.ptrs = ptrs;
+
+        out.sort(&self.nodes);
+        Ok(())
+    }
+
+    /// Creates an object of `node` at `addr` and queues all reads of it.
+    fn spawn(
+        &self,
+        out: &mut Traversal,
+        requests: &mut Vec<Request>,
+        node: usize,
+        parent: usize,
+        addr: Address,
+    ) {
+        let plan_node = &self.nodes[node];
+        let data_start = out.arena.len();
+        out.arena.resize(data_start + plan_node.record_len, 0);
+        let idx = out.objects[node].len();
+        out.objects[node].push(Object {
+            idx,
+            parent,
+            addr,
+            data_start,
+        });
+
+        requests.extend(
+            plan_node
+                .fields
+                .iter()
+                .map(|&(offset, record_offset, len)| Request {
+                    addr: addr + offset,
+                    len,
+                    target: Target::Field(data_start + record_offset),
+                }),
+        );
+        requests.extend(plan_node.follows.iter().map(|&(offset, target)| Request {
+            addr: addr + offset,
+            len: self.arch.size_addr(),
+            target: Target::Follow {
+                node: target,
+                parent: idx,
+            },
+        }));
+        requests.extend(
+            plan_node
+                .lists
+                .iter()
+                .map(|&(head_offset, link_offset, element)| Request {
+                    addr: addr + head_offset,
+                    len: self.arch.size_addr(),
+                    target: Target::ListHop {
+                        node: element,
+                        parent: idx,
+                        head: addr + head_offset,
+                        link_offset,
+                        len: 0,
+                    },
+                }),
+        );
+    }
+}
+
+#[derive(Debug, Clone, Copy)]
+struct Request {
+    addr: Address,
+    len: usize,
+    target: Target,
+}
+
+#[derive(Debug, Clone, Copy)]
+enum Target {
+    // start of the field in the arena
+    Field(usize),
+    Follow {
+        node: usize,
+        parent: usize,
+    },
+    ListHop {
+        node: usize,
+        parent: usize,
+        head: Address,
+        link_offset: usize,
+        len: usize,
+    },
+}
+
+#[derive(Debug, Clone, Copy)]
+struct Object {
+    // index before sorting
+    idx: usize,
+    parent: usize,
+    addr: Address,
+    data_start: usize,
+}
+
+/// The objects and fields read by executing a `TraversalPlan`.
+///
+/// The objects of every node are ordered by their parent object, the elements of a list in
+/// list order. The parent of a root object is its index in the roots passed to `execute`.
+#[derive(Debug, Clone, Default)]
+pub struct Traversal {
+    objects: Vec<Vec<Object>>,
+    arena: Vec<u8>,
+    remap: Vec<Vec<usize>>,
+    rounds: usize,
+    requests: Vec<Request>,
+    next_requests: Vec<Request>,
+    ptrs: Vec<[u8; 8]>,
+}
+
+impl Traversal {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    fn reset(&mut self, nodes: usize) {
+        self.objects.resize(nodes, vec![]);
+        self.objects.truncate(nodes);
+        self.objects.iter_mut().for_each(Vec::clear);
+        self.arena.clear();
+        self.rounds = 0;
+    }
+
+    /// Orders the objects of every node by their parent.
+    fn sort(&mut self, nodes: &[PlanNode]) {
+        self.remap.resize(nodes.len(), vec![]);
+
+        for (idx, node) in nodes.iter().enumerate() {
+            let objects = &mut self.objects[idx];
+
+            // parents come before their children in the plan, so they are sorted already
+            if let Some(parent) = node.parent {
+                let parent_remap = &self.remap[parent];
+                objects
+                    .iter_mut()
+                    .for_each(|obj| obj.parent = parent_remap[obj.parent]);
+            }
+
+            // stable, keeps the list order of elements with the same parent
+            objects.sort_by_key(|obj| obj.parent);
+
+            let remap = &mut self.remap[idx];
+            remap.clear();
+            remap.resize(objects.len(), 0);
+            for (new, obj) in objects.iter().enumerate() {
+                remap[obj.idx] = new;
+            }
+        }
+    }
+
+    /// Returns the number of round trips the traversal took.
+    pub fn rounds(&self) -> usize {
+        self.rounds
+    }
+
+    /// Returns the number of objects of `node` that were read.
+    pub fn len(&self, node: NodeId) -> usize {
+        self.objects[node.0].len()
+    }
+
+    /// Returns true if no objects of `node` were read.
+    pub fn is_empty(&self, node: NodeId) -> bool {
+        self.objects[node.0].is_empty()
+    }
+
+    /// Returns the address of the object `idx` of `node`.
+    pub fn address(&self, node: NodeId, idx: usize) -> Address {
+        self.objects[node.0][idx].addr
+    }
+
+    /// Returns the index of the parent object of the object `idx` of `node`.
+    pub fn parent(&self, node: NodeId, idx: usize) -> usize {
+        self.objects[node.0][idx].parent
+    }
+
+    /// Returns the indices of the objects of `node` that belong to the object `parent`.
+    pub fn children(&self, node: NodeId, parent: usize) -> Range<usize> {
+        let objects = &self.objects[node.0];
+        let start = objects
+            .binary_search_by(|obj| (obj.parent, 1).cmp(&(parent, 0)))
+            .unwrap_err();
+        let end = objects
+            .binary_search_by(|obj| (obj.parent, 0).cmp(&(parent, 1)))
+            .unwrap_err();
+        start..end
+    }
+
+    /// Returns the bytes of `field` of the object `idx`.
+    ///
+    /// Parts that could not be read are zeroed.
+    pub fn field(&self, field: FieldId, idx: usize) -> &[u8] {
+        let start = self.objects[field.node.0][idx].data_start + field.record_offset;
+        &self.arena[start..start + field.len]
+    }
+
+    /// Returns `field` of the object `idx` as a `T`.
+    ///
+    /// If the field is smaller than `T` the remaining bytes are zeroed.
+    pub fn value<T: Pod + Sized>(&self, field: FieldId, idx: usize) -> T {
+        let mut obj: T = unsafe { MaybeUninit::uninit().assume_init() };
+        let bytes = obj.as_bytes_mut();
+        let data = self.field(field, idx);
+        let len = bytes.len().min(data.len());
+        bytes[..len].copy_from_slice(&data[..len]);
+        bytes[len..].iter_mut().for_each(|b| *b = 0);
+        obj
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::architecture::x86::x64;
+    use crate::mem::dummy::DummyMemory;
+    use crate::types::size;
+
+    #[test]
+    fn test_traversal() {
+        let (mut mem, base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &[0; 0x1000]);
+
+        // two owners at 0x0 and 0x100, each with a list head at +0x10 and a name pointer at +0x20
+        // list elements link at +0x8 and have an id at +0x0
+        let elements = [[0x200usize, 0x240, 0x280], [0x300, 0, 0]];
+        for (&owner, elems) in [0x0usize, 0x100].iter().zip(elements.iter()) {
+            let elems = elems
+                .iter()
+                .filter(|&&e| e != 0)
+                .map(|&e| base + e)
+                .collect::<Vec<_>>();
+            let head = base + owner + 0x10;
+
+            let mut prev = head;
+            for &elem in elems.iter() {
+                mem.virt_write(prev, &(elem + 8).as_u64()).unwrap();
+                mem.virt_write(elem, &(elem.as_u64() as u32)).unwrap();
+                prev = elem + 8;
+            }
+            mem.virt_write(prev, &head.as_u64()).unwrap();
+
+            mem.virt_write(base + owner + 0x20, &(base + owner + 0x80).as_u64())
+                .unwrap();
+            mem.virt_write(base + owner + 0x80, b"owner\0\0\0").unwrap();
+        }
+
+        let mut plan = TraversalPlan::new(x64::ARCH);
+        let root = plan.root();
+        let elem = plan.list(root, 0x10, 0x8);
+        let id = plan.read(elem, 0, 4);
+        let name = plan.follow(root, 0x20);
+        let name_buf = plan.read(name, 0, 8);
+
+        let mut traversal = Traversal::new();
+        for _ in 0..2 {
+            plan.execute_into(
+                &mut mem,
+                &[base, base + 0x100, Address::null()],
+                &mut traversal,
+            )
+            .unwrap();
+
+            // the longest list takes 4 round trips, the last one finding the head again
+            assert_eq!(traversal.rounds(), 4);
+
+            assert_eq!(traversal.len(elem), 4);
+            assert_eq!(traversal.children(elem, 0), 0..3);
+            assert_eq!(traversal.children(elem, 1), 3..4);
+            assert_eq!(traversal.children(elem, 2), 4..4);
+            for (i, &off) in [0x200usize, 0x240, 0x280, 0x300].iter().enumerate() {
+                assert_eq!(traversal.address(elem, i), base + off);
+                assert_eq!(traversal.value::<u32>(id, i), (base + off).as_u64() as u32);
+            }
+
+            // the third root has no name pointer and its list is unreadable
+            assert_eq!(traversal.len(name), 2);
+            assert_eq!(traversal.parent(name, 1), 1);
+            assert_eq!(traversal.field(name_buf, 1), b"owner\0\0\0");
+        }
+    }
+}
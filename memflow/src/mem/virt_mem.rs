@@ -1,12 +1,15 @@
 use std::prelude::v1::*;
 
+pub mod fixed_dma;
+pub use fixed_dma::FixedVirtualDMA;
+
 pub mod virtual_dma;
 pub use virtual_dma::VirtualDMA;
 
-use super::VirtualMemoryBatcher;
-use crate::architecture::ArchitectureObj;
+use super::{MemoryUsage, VirtualMemoryBatcher};
+use crate::architecture::{ArchitectureObj, Endianess};
 use crate::error::{Error, PartialError, PartialResult, PartialResultExt, Result};
-use crate::types::{Address, Page, PhysicalAddress, Pointer32, Pointer64};
+use crate::types::{Address, ByteSwap, Page, PhysicalAddress, Pointer32, Pointer64};
 
 use std::mem::MaybeUninit;
 
@@ -63,6 +66,12 @@ where
         end: Address,
     ) -> Vec<(Address, usize)>;
 
+    /// Reports the memory held by this object and the objects it wraps.
+    fn memory_usage(&self, _usage: &mut MemoryUsage) {}
+
+    /// Releases memory that is not needed right now. Cached contents are kept.
+    fn shrink_memory(&mut self) {}
+
     // read helpers
     fn virt_read_raw_into(&mut self, addr: Address, out: &mut [u8]) -> PartialResult<()> {
         self.virt_read_raw_list(&mut [VirtualReadData(addr, out)])
@@ -93,6 +102,40 @@ where
         self.virt_read_into(addr, &mut obj).map_data(|_| obj)
     }
 
+    /// Reads `out` stored with the byte order `endianess` and converts it to the native byte order.
+    ///
+    /// Partially read data is converted as well. Slices of `UniformSwap` types are converted
+    /// in bulk.
+    fn virt_read_into_endian<T: Pod + ByteSwap + ?Sized>(
+        &mut self,
+        addr: Address,
+        out: &mut T,
+        endianess: Endianess,
+    ) -> PartialResult<()>
+    where
+        Self: Sized,
+    {
+        let ret = self.virt_read_into(addr, out);
+        if endianess != Endianess::native() {
+            out.byte_swap();
+        }
+        ret
+    }
+
+    #[allow(clippy::uninit_assumed_init)]
+    fn virt_read_endian<T: Pod + ByteSwap + Sized>(
+        &mut self,
+        addr: Address,
+        endianess: Endianess,
+    ) -> PartialResult<T>
+    where
+        Self: Sized,
+    {
+        let mut obj: T = unsafe { MaybeUninit::uninit().assume_init() };
+        self.virt_read_into_endian(addr, &mut obj, endianess)
+            .map_data(|_| obj)
+    }
+
     // write helpers
     fn virt_write_raw(&mut self, addr: Address, data: &[u8]) -> PartialResult<()> {
         self.virt_write_raw_list(&[VirtualWriteData(addr, data)])
@@ -182,7 +225,9 @@ where
     }
 
     // TODO: read into slice?
-    // TODO: if len is shorter than string -> dynamically double length up to an upper bound
+    /// Reads a single null terminated string of at most `len` bytes.
+    ///
+    /// Use a `StringReader` to read many strings at once.
     fn virt_read_cstr(&mut self, addr: Address, len: usize) -> PartialResult<String> {
         let mut buf = vec![0; len];
         self.virt_read_raw_into(addr, &mut buf).data_part()?;
@@ -235,6 +280,16 @@ impl<T: VirtualMemory + ?Sized, P: std::ops::DerefMut<Target = T> + Send> Virtua
     ) -> Vec<(Address, usize)> {
         (**self).virt_page_map_range(gap_size, start, end)
     }
+
+    #[inline]
+    fn memory_usage(&self, usage: &mut MemoryUsage) {
+        (**self).memory_usage(usage)
+    }
+
+    #[inline]
+    fn shrink_memory(&mut self) {
+        (**self).shrink_memory()
+    }
 }
 
 // iterator helpers
@@ -249,6 +304,19 @@ impl<'a> From<VirtualReadData<'a>> for (Address, &'a mut [u8]) {
     }
 }
 
+impl<'a> VirtualReadData<'a> {
+    /// Empties `list` and returns its allocation as a list borrowing for a different lifetime.
+    ///
+    /// This lets a caller keep the allocation of a read list between reads, while the entries
+    /// only ever borrow their buffers for the duration of a single read.
+    pub fn recycle_list<'b>(list: Vec<Self>) -> Vec<VirtualReadData<'b>> {
+        let mut list = std::mem::ManuallyDrop::new(list);
+        list.clear();
+        // the list is empty, so no reference of lifetime 'a survives
+        unsafe { Vec::from_raw_parts(list.as_mut_ptr() as *mut _, 0, list.capacity()) }
+    }
+}
+
 #[repr(C)]
 #[derive(Clone, Copy)]
 pub struct VirtualWriteData<'a>(pub Address, pub &'a [u8]);
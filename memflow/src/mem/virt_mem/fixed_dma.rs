@@ -0,0 +1,308 @@
+use std::prelude::v1::*;
+
+use super::{VirtualDMA, VirtualReadData, VirtualWriteData};
+use crate::architecture::{ArchitectureObj, ScopedVirtualTranslate};
+use crate::error::{Error, PartialError, PartialResult, Result};
+use crate::iter::PageChunks;
+use crate::mem::{
+    mem_usage::MemoryUsage, PhysicalMemory, PhysicalReadData, PhysicalWriteData, VirtualMemory,
+};
+use crate::types::{Address, Page, PhysicalAddress};
+
+use arrayvec::ArrayVec;
+
+/// A reasonable number of pages to translate and access in a single batch.
+pub const DEFAULT_FIXED_BATCH: usize = 64;
+
+/// The `FixedVirtualDMA` struct accesses virtual memory without allocating.
+///
+/// It is the allocation-free counterpart of `VirtualDMA`. Reads and writes are split into pages
+/// and processed in batches of up to `N` pages. Each batch is translated with
+/// `ScopedVirtualTranslate::virt_to_phys_fixed` and accessed with a single physical read or
+/// write. All intermediate state lives in fixed size arrays on the stack, which makes the memory
+/// usage of the read path deterministic, e.g. for firmware side agents without an allocator or
+/// for realtime tools.
+///
+/// Only the read and write path is allocation-free. `virt_translation_map_range` and
+/// `virt_page_map_range` return vectors and fall back to `VirtualDMA`.
+///
+/// `VirtualDMA`, `DirectTranslate` and the page caches keep their bump arenas. Their batch and
+/// cache sizes are chosen at runtime (e.g. from connector arguments), and the arenas are reset
+/// rather than freed between calls, so they stop allocating once warmed up. Wrapping a cached
+/// connector in `FixedVirtualDMA` still goes through `PageCache::cached_read`, so use it directly
+/// on the connector where the memory usage has to be bounded at compile time.
+///
+/// The batch size `N` has to be at least 1, an empty batch is rejected at compile time:
+///
+/// ```compile_fail
+/// use memflow::architecture::x86::x64;
+/// use memflow::mem::FixedVirtualDMA;
+/// # use memflow::mem::dummy::DummyMemory;
+/// # use memflow::types::size;
+///
+/// # let (mut mem, dtb, _) = DummyMemory::new_and_dtb(size::mb(4), size::mb(2), &[]);
+/// let virt_mem = FixedVirtualDMA::<_, _, 0>::new(&mut mem, x64::ARCH, x64::new_translator(dtb));
+/// ```
+///
+/// # Examples
+///
+/// ```
+/// use memflow::architecture::x86::x64;
+/// use memflow::mem::{FixedVirtualDMA, VirtualMemory};
+/// # use memflow::mem::dummy::DummyMemory;
+/// # use memflow::types::size;
+///
+/// # let (mut mem, dtb, virt_base) = DummyMemory::new_and_dtb(size::mb(4), size::mb(2), &[255, 0, 255, 0, 255, 0, 255, 0]);
+/// let mut virt_mem = FixedVirtualDMA::<_, _, 16>::new(&mut mem, x64::ARCH, x64::new_translator(dtb));
+///
+/// let mut addr = 0u64;
+/// virt_mem.virt_read_into(virt_base, &mut addr).unwrap();
+/// assert_eq!(addr, 0x00ff_00ff_00ff_00ff);
+/// ```
+#[derive(Clone)]
+pub struct FixedVirtualDMA<T, D, const N: usize> {
+    phys_mem: T,
+    proc_arch: ArchitectureObj,
+    translator: D,
+}
+
+impl<T: PhysicalMemory, D: ScopedVirtualTranslate, const N: usize> FixedVirtualDMA<T, D, N> {
+    /// Fails to evaluate if `N` is 0, a batch could never make progress otherwise.
+    const NONZERO_BATCH: usize = 0 - (N == 0) as usize;
+
+    /// Constructs a `FixedVirtualDMA` object from user supplied architectures and DTB.
+    pub fn new(phys_mem: T, proc_arch: ArchitectureObj, translator: D) -> Self {
+        let _ = Self::NONZERO_BATCH;
+
+        Self {
+            phys_mem,
+            proc_arch,
+            translator,
+        }
+    }
+
+    /// Returns the architecture of the system. The system architecture is used for virtual to physical translations.
+    pub fn sys_arch(&self) -> ArchitectureObj {
+        self.translator.arch()
+    }
+
+    /// Returns the architecture of the process for this context. The process architecture is mainly used to determine pointer sizes.
+    pub fn proc_arch(&self) -> ArchitectureObj {
+        self.proc_arch
+    }
+
+    /// Returns the Directory Table Base of this process.
+    pub fn translator(&self) -> &impl ScopedVirtualTranslate {
+        &self.translator
+    }
+
+    /// Consume the self object and returns the containing memory connection
+    pub fn destroy(self) -> T {
+        self.phys_mem
+    }
+
+    /// Translates all pages of `batch`, keeping the translated ones in `translated`.
+    ///
+    /// Returns true if any of the pages could not be translated. Those are passed to `fail`.
+    fn translate_batch<B, F: FnMut(B)>(
+        &mut self,
+        batch: &mut ArrayVec<(Address, B), N>,
+        translated: &mut ArrayVec<(PhysicalAddress, B), N>,
+        mut fail: F,
+    ) -> bool {
+        let mut addrs = [Address::NULL; N];
+        let mut phys = [Err(Error::VirtualTranslate); N];
+
+        addrs
+            .iter_mut()
+            .zip(batch.iter())
+            .for_each(|(addr, (page, _))| *addr = *page);
+
+        let len = batch.len();
+        self.translator.virt_to_phys_fixed::<_, N>(
+            &mut self.phys_mem,
+            &addrs[..len],
+            &mut phys[..len],
+        );
+
+        let mut partial = false;
+        for ((_, buf), phys) in batch.drain(..).zip(phys.iter()) {
+            match phys {
+                Ok(paddr) => translated.push((*paddr, buf)),
+                Err(_) => {
+                    partial = true;
+                    fail(buf)
+                }
+            }
+        }
+        partial
+    }
+
+    fn flush_read(&mut self, batch: &mut ArrayVec<(Address, &mut [u8]), N>) -> Result<bool> {
+        let mut translated = ArrayVec::<_, N>::new();
+        let partial = self.translate_batch(batch, &mut translated, |buf| {
+            buf.iter_mut().for_each(|b| *b = 0)
+        });
+
+        let mut reads = translated
+            .into_iter()
+            .map(|(paddr, buf)| PhysicalReadData(paddr, buf))
+            .collect::<ArrayVec<_, N>>();
+        self.phys_mem.phys_read_raw_list(&mut reads)?;
+
+        Ok(partial)
+    }
+
+    fn flush_write(&mut self, batch: &mut ArrayVec<(Address, &[u8]), N>) -> Result<bool> {
+        let mut translated = ArrayVec::<_, N>::new();
+        let partial = self.translate_batch(batch, &mut translated, |_| {});
+
+        let writes = translated
+            .into_iter()
+            .map(|(paddr, buf)| PhysicalWriteData(paddr, buf))
+            .collect::<ArrayVec<_, N>>();
+        self.phys_mem.phys_write_raw_list(&writes)?;
+
+        Ok(partial)
+    }
+}
+
+impl<T: PhysicalMemory, D: ScopedVirtualTranslate, const N: usize> VirtualMemory
+    for FixedVirtualDMA<T, D, N>
+{
+    fn virt_read_raw_list(&mut self, data: &mut [VirtualReadData]) -> PartialResult<()> {
+        let page_size = self.translator.arch().page_size();
+        let mut batch = ArrayVec::<_, N>::new();
+        let mut partial = false;
+
+        for VirtualReadData(addr, buf) in data.iter_mut() {
+            for (addr, buf) in (&mut buf[..]).page_chunks(*addr, page_size) {
+                if batch.is_full() {
+                    partial |= self.flush_read(&mut batch)?;
+                }
+                batch.push((addr, buf));
+            }
+        }
+
+        partial |= self.flush_read(&mut batch)?;
+
+        if !partial {
+            Ok(())
+        } else {
+            Err(PartialError::PartialVirtualRead(()))
+        }
+    }
+
+    fn virt_write_raw_list(&mut self, data: &[VirtualWriteData]) -> PartialResult<()> {
+        let page_size = self.translator.arch().page_size();
+        let mut batch = ArrayVec::<_, N>::new();
+        let mut partial = false;
+
+        for VirtualWriteData(addr, buf) in data.iter() {
+            for (addr, buf) in (&buf[..]).page_chunks(*addr, page_size) {
+                if batch.is_full() {
+                    partial |= self.flush_write(&mut batch)?;
+                }
+                batch.push((addr, buf));
+            }
+        }
+
+        partial |= self.flush_write(&mut batch)?;
+
+        if !partial {
+            Ok(())
+        } else {
+            Err(PartialError::PartialVirtualWrite)
+        }
+    }
+
+    fn virt_page_info(&mut self, addr: Address) -> Result<Page> {
+        let mut phys = [Err(Error::VirtualTranslate)];
+        self.translator
+            .virt_to_phys_fixed::<_, 1>(&mut self.phys_mem, &[addr], &mut phys);
+        phys[0].map(|paddr| paddr.containing_page())
+    }
+
+    fn virt_translation_map_range(
+        &mut self,
+        start: Address,
+        end: Address,
+    ) -> Vec<(Address, usize, PhysicalAddress)> {
+        VirtualDMA::new(&mut self.phys_mem, self.proc_arch, self.translator)
+            .virt_translation_map_range(start, end)
+    }
+
+    fn virt_page_map_range(
+        &mut self,
+        gap_length: usize,
+        start: Address,
+        end: Address,
+    ) -> Vec<(Address, usize)> {
+        VirtualDMA::new(&mut self.phys_mem, self.proc_arch, self.translator)
+            .virt_page_map_range(gap_length, start, end)
+    }
+
+    fn memory_usage(&self, usage: &mut MemoryUsage) {
+        self.phys_mem.memory_usage(usage)
+    }
+
+    fn shrink_memory(&mut self) {
+        self.phys_mem.shrink_memory()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::architecture::x86::x64;
+    use crate::mem::dummy::DummyMemory;
+    use crate::types::size;
+
+    #[test]
+    fn test_read_write() {
+        let data = (0..0x5000).map(|i| (i % 251) as u8).collect::<Vec<_>>();
+        let (mut mem, dtb, virt_base) = DummyMemory::new_and_dtb(size::mb(8), size::mb(2), &data);
+
+        // a batch size of 3 forces multiple batches per read
+        let mut virt_mem =
+            FixedVirtualDMA::<_, _, 3>::new(&mut mem, x64::ARCH, x64::new_translator(dtb));
+
+        let mut buf = vec![0; 0x4123];
+        virt_mem
+            .virt_read_raw_into(virt_base + 0x321, &mut buf)
+            .unwrap();
+        assert_eq!(buf[..], data[0x321..0x4444]);
+
+        let pattern = vec![0xcc; 0x1800];
+        virt_mem
+            .virt_write_raw(virt_base + 0x800, &pattern)
+            .unwrap();
+
+        // compare against the allocating implementation
+        let mut reference = VirtualDMA::new(&mut mem, x64::ARCH, x64::new_translator(dtb));
+        let mut buf = vec![0; 0x2000];
+        reference
+            .virt_read_raw_into(virt_base + 0x800, &mut buf)
+            .unwrap();
+        assert_eq!(buf[..0x1800], pattern[..]);
+        assert_eq!(buf[0x1800..], data[0x2000..0x2800]);
+    }
+
+    #[test]
+    fn test_partial() {
+        let (mut mem, dtb, virt_base) =
+            DummyMemory::new_and_dtb(size::mb(8), size::mb(2), &[0xff; 0x1000]);
+        let mut virt_mem =
+            FixedVirtualDMA::<_, _, 4>::new(&mut mem, x64::ARCH, x64::new_translator(dtb));
+
+        // nothing is mapped right below the base
+        let mut buf = vec![0xaa; 0x2000];
+        let res = virt_mem.virt_read_raw_into(virt_base - 0x1000, &mut buf);
+        assert!(matches!(res, Err(PartialError::PartialVirtualRead(_))));
+        assert!(buf[..0x1000].iter().all(|&b| b == 0));
+        assert!(buf[0x1000..].iter().all(|&b| b == 0xff));
+
+        assert!(virt_mem.virt_page_info(virt_base).is_ok());
+        assert!(virt_mem.virt_page_info(virt_base - 0x1000).is_err());
+    }
+}
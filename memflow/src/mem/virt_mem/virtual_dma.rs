@@ -5,12 +5,13 @@ use crate::architecture::{ArchitectureObj, ScopedVirtualTranslate};
 use crate::error::{Error, PartialError, PartialResult, Result};
 use crate::iter::FnExtend;
 use crate::mem::{
+    mem_usage::{MemoryUsage, TrackedArena},
     virt_translate::{DirectTranslate, VirtualTranslate},
     PhysicalMemory, PhysicalReadData, PhysicalWriteData, VirtualMemory,
 };
 use crate::types::{Address, Page, PhysicalAddress};
 
-use bumpalo::{collections::Vec as BumpVec, Bump};
+use bumpalo::collections::Vec as BumpVec;
 use itertools::Itertools;
 
 /// The `VirtualDMA` struct provides a default implementation to access virtual memory
@@ -22,7 +23,7 @@ pub struct VirtualDMA<T, V, D> {
     vat: V,
     proc_arch: ArchitectureObj,
     translator: D,
-    arena: Bump,
+    arena: TrackedArena,
 }
 
 impl<T: PhysicalMemory, D: ScopedVirtualTranslate> VirtualDMA<T, DirectTranslate, D> {
@@ -64,7 +65,7 @@ impl<T: PhysicalMemory, D: ScopedVirtualTranslate> VirtualDMA<T, DirectTranslate
             vat: DirectTranslate::new(),
             proc_arch,
             translator,
-            arena: Bump::new(),
+            arena: TrackedArena::new(),
         }
     }
 }
@@ -105,7 +106,7 @@ impl<T: PhysicalMemory, V: VirtualTranslate, D: ScopedVirtualTranslate> VirtualD
             vat,
             proc_arch,
             translator,
-            arena: Bump::new(),
+            arena: TrackedArena::new(),
         }
     }
 
@@ -151,7 +152,7 @@ where
             vat: self.vat.clone(),
             proc_arch: self.proc_arch,
             translator: self.translator.clone(),
-            arena: Bump::new(),
+            arena: TrackedArena::new(),
         }
     }
 }
@@ -276,4 +277,16 @@ impl<T: PhysicalMemory, V: VirtualTranslate, D: ScopedVirtualTranslate> VirtualM
             })
             .collect()
     }
+
+    fn memory_usage(&self, usage: &mut MemoryUsage) {
+        usage.push_arena("virt_arena", &self.arena);
+        self.vat.memory_usage(usage);
+        self.phys_mem.memory_usage(usage)
+    }
+
+    fn shrink_memory(&mut self) {
+        self.arena.shrink();
+        self.vat.shrink_memory();
+        self.phys_mem.shrink_memory()
+    }
 }
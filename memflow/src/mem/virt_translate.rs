@@ -9,7 +9,7 @@ mod tests;
 
 use crate::error::{Error, Result};
 
-use crate::mem::PhysicalMemory;
+use crate::mem::{MemoryUsage, PhysicalMemory};
 use crate::types::{Address, PhysicalAddress};
 
 use crate::architecture::ScopedVirtualTranslate;
@@ -88,6 +88,24 @@ where
         VO: Extend<(PhysicalAddress, B)>,
         FO: Extend<(Error, Address, B)>;
 
+    /// Invalidates all cached translations of a translation table.
+    ///
+    /// The id is the one returned by `ScopedVirtualTranslate::translation_table_id`. This should
+    /// be called when an address space is destroyed, since its translation table may be reused
+    /// by a different address space afterwards. Implementations without a cache ignore this.
+    fn invalidate_translation_table(&mut self, _translation_table_id: usize) {}
+
+    /// Invalidates cached translations of the virtual range `start..end` of a translation table.
+    ///
+    /// Implementations without a cache ignore this.
+    fn invalidate_range(&mut self, _translation_table_id: usize, _start: Address, _end: Address) {}
+
+    /// Reports the memory held by this object and the objects it wraps.
+    fn memory_usage(&self, _usage: &mut MemoryUsage) {}
+
+    /// Releases memory that is not needed right now. Cached translations are kept.
+    fn shrink_memory(&mut self) {}
+
     // helpers
     fn virt_to_phys<T: PhysicalMemory + ?Sized, D: ScopedVirtualTranslate>(
         &mut self,
@@ -136,4 +154,24 @@ where
     {
         (**self).virt_to_phys_iter(phys_mem, translator, addrs, out, out_fail)
     }
+
+    #[inline]
+    fn invalidate_translation_table(&mut self, translation_table_id: usize) {
+        (**self).invalidate_translation_table(translation_table_id)
+    }
+
+    #[inline]
+    fn invalidate_range(&mut self, translation_table_id: usize, start: Address, end: Address) {
+        (**self).invalidate_range(translation_table_id, start, end)
+    }
+
+    #[inline]
+    fn memory_usage(&self, usage: &mut MemoryUsage) {
+        (**self).memory_usage(usage)
+    }
+
+    #[inline]
+    fn shrink_memory(&mut self) {
+        (**self).shrink_memory()
+    }
 }
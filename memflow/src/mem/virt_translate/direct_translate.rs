@@ -2,22 +2,22 @@ use super::VirtualTranslate;
 use crate::architecture::ScopedVirtualTranslate;
 use crate::error::Error;
 use crate::iter::SplitAtIndex;
+use crate::mem::mem_usage::{MemoryUsage, TrackedArena};
 use crate::mem::PhysicalMemory;
 use crate::types::{Address, PhysicalAddress};
-use bumpalo::Bump;
 
 /*
 The `DirectTranslate` struct provides a default implementation for `VirtualTranslate` for physical memory.
 */
 #[derive(Debug, Default)]
 pub struct DirectTranslate {
-    arena: Bump,
+    arena: TrackedArena,
 }
 
 impl DirectTranslate {
     pub fn new() -> Self {
         Self {
-            arena: Bump::with_capacity(0x4000),
+            arena: TrackedArena::with_capacity(0x4000),
         }
     }
 }
@@ -47,4 +47,12 @@ impl VirtualTranslate for DirectTranslate {
         self.arena.reset();
         translator.virt_to_phys_iter(phys_mem, addrs, out, out_fail, &self.arena)
     }
+
+    fn memory_usage(&self, usage: &mut MemoryUsage) {
+        usage.push_arena("translate_arena", &self.arena);
+    }
+
+    fn shrink_memory(&mut self) {
+        self.arena.shrink();
+    }
 }
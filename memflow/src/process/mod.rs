@@ -30,7 +30,7 @@ pub trait OsProcessInfo {
     /// # Remarks
     ///
     /// On Windows this will be clamped to 16 characters.
-    fn name(&self) -> String;
+    fn name(&self) -> &str;
 
     /// Returns the architecture of the target system.
     fn sys_arch(&self) -> ArchitectureObj;
@@ -75,7 +75,7 @@ pub trait OsProcessModuleInfo {
     fn size(&self) -> usize;
 
     /// Returns the full name of the module.
-    fn name(&self) -> String;
+    fn name(&self) -> &str;
 }
 
 // TODO: Exports / Sections / etc
@@ -0,0 +1,444 @@
+/*!
+Low overhead binary event tracing.
+
+This module provides a per-thread ring buffer of fixed-size binary records, meant to be left
+compiled into hot paths. Tracing is toggled at runtime with [`set_enabled`](fn.set_enabled.html)
+and costs a single relaxed atomic load per event while it is disabled.
+
+Every thread writes into its own ring without taking any locks. Rings are never freed, once a
+thread exits its ring gets reused by the next thread, so the events of short lived threads can
+still be dumped afterwards. A [`snapshot`](fn.snapshot.html) of all rings can be taken at any
+point in time, and serialized with [`encode`](fn.encode.html) to be decoded later with
+[`decode`](fn.decode.html).
+
+Events are recorded with the [`trace_event!`](../macro.trace_event.html) macro:
+
+```
+use memflow::trace::{self, event};
+use memflow::trace_event;
+
+trace::set_enabled(true);
+trace_event!(event::VTOP_STEP, 0, 1, 1);
+trace::set_enabled(false);
+```
+
+Event ids `0x0000..0x1000` are reserved for memflow itself (see the [`event`](event/index.html)
+module), OS layers and connectors should use ids above that range.
+
+Tracing is only available with the `std` feature. Without it all events get discarded.
+*/
+
+use std::prelude::v1::*;
+
+use crate::error::{Error, Result};
+
+use std::convert::TryInto;
+
+/// Event ids emitted by memflow itself.
+pub mod event {
+    /// A virtual to physical translation step. Arguments: page table step, batch size, number of
+    /// distinct page table entries read.
+    pub const VTOP_STEP: u32 = 0x100;
+    /// Reading page table entries failed. Arguments: page table step, number of failed
+    /// translations.
+    pub const VTOP_READ_FAIL: u32 = 0x101;
+
+    /// First event id that is not reserved by memflow.
+    pub const USER_BASE: u32 = 0x1000;
+
+    /// Returns a readable name of an event emitted by memflow.
+    pub fn name(event: u32) -> Option<&'static str> {
+        match event {
+            VTOP_STEP => Some("vtop_step"),
+            VTOP_READ_FAIL => Some("vtop_read_fail"),
+            _ => None,
+        }
+    }
+}
+
+/// Number of records kept in every thread's ring.
+pub const TRACE_RING_SIZE: usize = 0x1000;
+
+/// Magic value at the start of every encoded trace.
+pub const TRACE_MAGIC: [u8; 8] = *b"MFTRACE\0";
+
+/// Size of a single encoded `TraceRecord` in bytes.
+pub const TRACE_RECORD_SIZE: usize = 40;
+
+const TRACE_VERSION: u32 = 1;
+const TRACE_HEADER_SIZE: usize = 16;
+
+/// A single traced event.
+#[derive(Copy, Clone, Debug, Default, PartialEq, Eq)]
+pub struct TraceRecord {
+    /// Id of the event.
+    pub event: u32,
+    /// Index of the ring (and thus of the thread) the event was recorded in.
+    pub thread: u32,
+    /// Time of the event in nanoseconds since tracing was first used.
+    pub timestamp: u64,
+    /// Event specific arguments.
+    pub args: [u64; 3],
+}
+
+impl TraceRecord {
+    fn write_bytes(&self, out: &mut [u8]) {
+        out[0..4].copy_from_slice(&self.event.to_le_bytes());
+        out[4..8].copy_from_slice(&self.thread.to_le_bytes());
+        out[8..16].copy_from_slice(&self.timestamp.to_le_bytes());
+        for (chunk, arg) in out[16..].chunks_exact_mut(8).zip(self.args.iter()) {
+            chunk.copy_from_slice(&arg.to_le_bytes());
+        }
+    }
+
+    fn from_bytes(buf: &[u8]) -> Self {
+        let u64_at = |off: usize| u64::from_le_bytes(buf[off..off + 8].try_into().unwrap());
+        Self {
+            event: u32::from_le_bytes(buf[0..4].try_into().unwrap()),
+            thread: u32::from_le_bytes(buf[4..8].try_into().unwrap()),
+            timestamp: u64_at(8),
+            args: [u64_at(16), u64_at(24), u64_at(32)],
+        }
+    }
+}
+
+/// Serializes trace records into the binary dump format.
+///
+/// The dump consists of a 16 byte header (`TRACE_MAGIC`, a version and the record size)
+/// followed by the little endian encoded records.
+pub fn encode(records: &[TraceRecord]) -> Vec<u8> {
+    let mut out = vec![0; TRACE_HEADER_SIZE + records.len() * TRACE_RECORD_SIZE];
+
+    out[0..8].copy_from_slice(&TRACE_MAGIC);
+    out[8..12].copy_from_slice(&TRACE_VERSION.to_le_bytes());
+    out[12..16].copy_from_slice(&(TRACE_RECORD_SIZE as u32).to_le_bytes());
+
+    for (chunk, record) in out[TRACE_HEADER_SIZE..]
+        .chunks_exact_mut(TRACE_RECORD_SIZE)
+        .zip(records.iter())
+    {
+        record.write_bytes(chunk);
+    }
+
+    out
+}
+
+/// Deserializes trace records previously serialized with `encode`.
+pub fn decode(buf: &[u8]) -> Result<Vec<TraceRecord>> {
+    if buf.len() < TRACE_HEADER_SIZE || buf[0..8] != TRACE_MAGIC {
+        return Err(Error::Other("invalid trace header"));
+    }
+
+    let version = u32::from_le_bytes(buf[8..12].try_into().unwrap());
+    let record_size = u32::from_le_bytes(buf[12..16].try_into().unwrap()) as usize;
+
+    if version != TRACE_VERSION || record_size != TRACE_RECORD_SIZE {
+        return Err(Error::Other("unsupported trace version"));
+    }
+
+    let body = &buf[TRACE_HEADER_SIZE..];
+    if body.len() % TRACE_RECORD_SIZE != 0 {
+        return Err(Error::Bounds);
+    }
+
+    Ok(body
+        .chunks_exact(TRACE_RECORD_SIZE)
+        .map(TraceRecord::from_bytes)
+        .collect())
+}
+
+/// Records a binary trace event if tracing is enabled.
+///
+/// Takes an event id and up to 3 arguments that are converted to `u64` with `as`.
+#[macro_export]
+macro_rules! trace_event {
+    ($event:expr) => {
+        $crate::trace_event!($event, 0, 0, 0)
+    };
+    ($event:expr, $a:expr) => {
+        $crate::trace_event!($event, $a, 0, 0)
+    };
+    ($event:expr, $a:expr, $b:expr) => {
+        $crate::trace_event!($event, $a, $b, 0)
+    };
+    ($event:expr, $a:expr, $b:expr, $c:expr) => {
+        if $crate::trace::is_enabled() {
+            $crate::trace::record($event, [$a as u64, $b as u64, $c as u64]);
+        }
+    };
+}
+
+#[cfg(feature = "std")]
+pub use ring::{is_enabled, record, set_enabled, snapshot};
+
+#[cfg(not(feature = "std"))]
+/// Enables or disables tracing. Without the `std` feature this has no effect.
+pub fn set_enabled(_enabled: bool) {}
+
+#[cfg(not(feature = "std"))]
+/// Checks whether tracing is enabled. Always false without the `std` feature.
+#[inline(always)]
+pub fn is_enabled() -> bool {
+    false
+}
+
+#[cfg(not(feature = "std"))]
+/// Records an event. Without the `std` feature all events get discarded.
+#[inline(always)]
+pub fn record(_event: u32, _args: [u64; 3]) {}
+
+#[cfg(feature = "std")]
+mod ring {
+    use super::{TraceRecord, TRACE_RING_SIZE};
+
+    use std::prelude::v1::*;
+
+    use std::ptr;
+    use std::sync::atomic::{
+        self, AtomicBool, AtomicPtr, AtomicU32, AtomicU64, AtomicUsize, Ordering,
+    };
+    use std::sync::Once;
+    use std::time::Instant;
+
+    static ENABLED: AtomicBool = AtomicBool::new(false);
+    static RING_LIST: AtomicPtr<TraceRing> = AtomicPtr::new(ptr::null_mut());
+    static RING_COUNT: AtomicU32 = AtomicU32::new(0);
+
+    static EPOCH_INIT: Once = Once::new();
+    static mut EPOCH: Option<Instant> = None;
+
+    thread_local! {
+        static LOCAL_RING: RingHandle = RingHandle::acquire();
+    }
+
+    /// Records are stored as plain atomic words, so that the rings can be read from other threads
+    /// while they are being written to. Torn records get filtered out by re-checking the head
+    /// after the read.
+    struct TraceRing {
+        next: *mut TraceRing,
+        owned: AtomicBool,
+        thread: u32,
+        head: AtomicUsize,
+        slots: Box<[[AtomicU64; 5]]>,
+    }
+
+    // The rings are leaked and `next` never changes after a ring got published.
+    unsafe impl Sync for TraceRing {}
+    unsafe impl Send for TraceRing {}
+
+    impl TraceRing {
+        fn push(&self, event: u32, timestamp: u64, args: [u64; 3]) {
+            // only the owning thread ever writes into the ring
+            let head = self.head.load(Ordering::Relaxed);
+            let slot = &self.slots[head % TRACE_RING_SIZE];
+
+            // keeps the slot stores from becoming visible before the head of the previous push,
+            // a reader that sees any of them is then guaranteed to also see that head
+            atomic::fence(Ordering::Release);
+
+            slot[0].store(
+                event as u64 | ((self.thread as u64) << 32),
+                Ordering::Relaxed,
+            );
+            slot[1].store(timestamp, Ordering::Relaxed);
+            slot[2].store(args[0], Ordering::Relaxed);
+            slot[3].store(args[1], Ordering::Relaxed);
+            slot[4].store(args[2], Ordering::Relaxed);
+
+            self.head.store(head + 1, Ordering::Release);
+        }
+
+        fn read_into(&self, out: &mut Vec<TraceRecord>) {
+            let head = self.head.load(Ordering::Acquire);
+            let start = out.len();
+
+            out.extend((head.saturating_sub(TRACE_RING_SIZE)..head).map(|idx| {
+                let slot = &self.slots[idx % TRACE_RING_SIZE];
+                let id = slot[0].load(Ordering::Relaxed);
+                TraceRecord {
+                    event: id as u32,
+                    thread: (id >> 32) as u32,
+                    timestamp: slot[1].load(Ordering::Relaxed),
+                    args: [
+                        slot[2].load(Ordering::Relaxed),
+                        slot[3].load(Ordering::Relaxed),
+                        slot[4].load(Ordering::Relaxed),
+                    ],
+                }
+            }));
+
+            // drop all records that may have been overwritten while reading, including the slot
+            // that may currently be in the middle of a write. The fence keeps the relaxed slot
+            // loads above from being reordered after the second load of the head.
+            atomic::fence(Ordering::Acquire);
+            let new_head = self.head.load(Ordering::Acquire);
+            let first_valid = (new_head + 1).saturating_sub(TRACE_RING_SIZE);
+            let overwritten = first_valid
+                .saturating_sub(head.saturating_sub(TRACE_RING_SIZE))
+                .min(out.len() - start);
+            out.drain(start..start + overwritten);
+        }
+    }
+
+    fn rings() -> impl Iterator<Item = &'static TraceRing> {
+        let mut cur = RING_LIST.load(Ordering::Acquire);
+        std::iter::from_fn(move || {
+            if cur.is_null() {
+                None
+            } else {
+                let ring = unsafe { &*cur };
+                cur = ring.next;
+                Some(ring)
+            }
+        })
+    }
+
+    struct RingHandle(&'static TraceRing);
+
+    impl RingHandle {
+        fn acquire() -> Self {
+            // reuse the ring of an exited thread if there is one
+            if let Some(ring) = rings().find(|ring| {
+                ring.owned
+                    .compare_exchange(false, true, Ordering::Acquire, Ordering::Relaxed)
+                    .is_ok()
+            }) {
+                return Self(ring);
+            }
+
+            let ring = Box::leak(Box::new(TraceRing {
+                next: ptr::null_mut(),
+                owned: AtomicBool::new(true),
+                thread: RING_COUNT.fetch_add(1, Ordering::Relaxed),
+                head: AtomicUsize::new(0),
+                slots: (0..TRACE_RING_SIZE).map(|_| Default::default()).collect(),
+            }));
+
+            let mut next = RING_LIST.load(Ordering::Relaxed);
+            loop {
+                ring.next = next;
+                match RING_LIST.compare_exchange_weak(
+                    next,
+                    ring,
+                    Ordering::Release,
+                    Ordering::Relaxed,
+                ) {
+                    Ok(_) => break,
+                    Err(cur) => next = cur,
+                }
+            }
+
+            Self(ring)
+        }
+    }
+
+    impl Drop for RingHandle {
+        fn drop(&mut self) {
+            self.0.owned.store(false, Ordering::Release);
+        }
+    }
+
+    fn timestamp() -> u64 {
+        EPOCH_INIT.call_once(|| unsafe { EPOCH = Some(Instant::now()) });
+        // EPOCH is only written once, inside of call_once
+        let epoch = unsafe { EPOCH.unwrap() };
+        epoch.elapsed().as_nanos() as u64
+    }
+
+    /// Enables or disables tracing for all threads.
+    pub fn set_enabled(enabled: bool) {
+        if enabled {
+            // initialize the epoch before the first event
+            timestamp();
+        }
+        ENABLED.store(enabled, Ordering::Relaxed);
+    }
+
+    /// Checks whether tracing is enabled.
+    #[inline(always)]
+    pub fn is_enabled() -> bool {
+        ENABLED.load(Ordering::Relaxed)
+    }
+
+    /// Records an event into the ring of the current thread.
+    ///
+    /// Prefer the `trace_event!` macro, which skips the call entirely when tracing is disabled.
+    #[inline(never)]
+    pub fn record(event: u32, args: [u64; 3]) {
+        let timestamp = timestamp();
+        // the ring is not available anymore while the thread is being torn down
+        let _ = LOCAL_RING.try_with(|handle| handle.0.push(event, timestamp, args));
+    }
+
+    /// Collects the records of all threads, sorted by their timestamp.
+    pub fn snapshot() -> Vec<TraceRecord> {
+        let mut out = Vec::new();
+        rings().for_each(|ring| ring.read_into(&mut out));
+        out.sort_by_key(|record| record.timestamp);
+        out
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn encode_decode() {
+        let records = vec![
+            TraceRecord {
+                event: event::VTOP_STEP,
+                thread: 1,
+                timestamp: 1234,
+                args: [1, 2, 3],
+            },
+            TraceRecord {
+                event: event::USER_BASE + 5,
+                thread: 2,
+                timestamp: !0,
+                args: [!0, 0, 7],
+            },
+        ];
+
+        let buf = encode(&records);
+        assert_eq!(buf.len(), TRACE_HEADER_SIZE + 2 * TRACE_RECORD_SIZE);
+        assert_eq!(decode(&buf).unwrap(), records);
+        assert!(decode(&buf[1..]).is_err());
+        assert!(decode(&buf[..buf.len() - 1]).is_err());
+    }
+
+    #[cfg(feature = "std")]
+    #[test]
+    fn record_threads() {
+        const EVENT: u32 = event::USER_BASE + 0x42;
+
+        set_enabled(true);
+        trace_event!(EVENT, 1);
+
+        // check from within the thread, so that its ring can not get reused in between
+        std::thread::spawn(|| {
+            for i in 0..(TRACE_RING_SIZE + 10) {
+                trace_event!(EVENT, 2, i);
+            }
+
+            let records = snapshot();
+            let main = records
+                .iter()
+                .filter(|r| r.event == EVENT && r.args[0] == 1)
+                .count();
+            let other = records
+                .iter()
+                .filter(|r| r.event == EVENT && r.args[0] == 2)
+                .collect::<Vec<_>>();
+
+            assert_eq!(main, 1);
+            // the ring wrapped around, only the most recent records are kept
+            assert_eq!(other.len(), TRACE_RING_SIZE - 1);
+            assert_eq!(other.last().unwrap().args[1], (TRACE_RING_SIZE + 9) as u64);
+        })
+        .join()
+        .unwrap();
+
+        set_enabled(false);
+    }
+}
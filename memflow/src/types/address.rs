@@ -15,7 +15,7 @@ use std::ops;
 #[derive(Copy, Clone, PartialEq, Eq, PartialOrd, Ord)]
 #[cfg_attr(feature = "serde", derive(::serde::Serialize, ::serde::Deserialize))]
 #[repr(transparent)]
-pub struct Address(u64);
+pub struct Address(pub(crate) u64);
 
 /// Constructs an `Address` from a `i32` value.
 impl From<i32> for Address {
@@ -2,6 +2,8 @@
 Trait for byte-swappable basic types.
 
 The trait is used in conjunction with the `#[derive(ByteSwap)]` derive macro.
+Types that consist of primitives of a single width can use `#[derive(UniformSwap)]` instead
+to have slices of them swapped in bulk.
 */
 
 use core::marker::PhantomData;
@@ -34,43 +36,127 @@ use core::marker::PhantomData;
 /// ```
 pub trait ByteSwap {
     fn byte_swap(&mut self);
+
+    /// Swaps every element of `slice`.
+    ///
+    /// Implementations of `UniformSwap` types forward this to `byte_swap_uniform`.
+    fn byte_swap_slice(slice: &mut [Self])
+    where
+        Self: Sized,
+    {
+        slice.iter_mut().for_each(|e| e.byte_swap());
+    }
+}
+
+/// A type that consists solely of primitives of the same width.
+///
+/// Slices of such types can be swapped as a flat run of words with `byte_swap_uniform`.
+/// `#[derive(UniformSwap)]` implements this together with `ByteSwap` and computes the width
+/// from the fields, all of which have to be `UniformSwap` themselves.
+///
+/// # Safety
+///
+/// A non zero `SWAP_WIDTH` promises that the type has no padding, that swapping it equals
+/// reversing every `SWAP_WIDTH` byte word of its memory and that every value produced this
+/// way is a valid value of the type.
+pub unsafe trait UniformSwap: ByteSwap {
+    /// Width in bytes of the primitives this type consists of, 0 if they differ in width.
+    const SWAP_WIDTH: usize;
+}
+
+/// Swaps every element of `slice` by reversing the `SWAP_WIDTH` byte words of its memory.
+///
+/// Falls back to swapping element by element if `T` has no uniform width.
+pub fn byte_swap_uniform<T: UniformSwap + Sized>(slice: &mut [T]) {
+    let width = T::SWAP_WIDTH;
+    if width == 0 || core::mem::size_of::<T>() % width != 0 {
+        slice.iter_mut().for_each(|e| e.byte_swap());
+        return;
+    }
+
+    // UniformSwap guarantees there is no padding and that every swapped word is valid
+    let bytes = unsafe {
+        core::slice::from_raw_parts_mut(
+            slice.as_mut_ptr() as *mut u8,
+            core::mem::size_of_val(slice),
+        )
+    };
+    byte_swap_words(bytes, width);
 }
 
+macro_rules! impl_uniform_swap {
+    ($($ty:ty),*) => {
+        $(
+            unsafe impl UniformSwap for $ty {
+                const SWAP_WIDTH: usize = core::mem::size_of::<$ty>();
+            }
+        )*
+    };
+}
+
+impl_uniform_swap!(i8, i16, i32, i64, i128, isize);
+impl_uniform_swap!(u8, u16, u32, u64, u128, usize);
+impl_uniform_swap!(f32, f64);
+
 // signed types
 impl ByteSwap for i8 {
     fn byte_swap(&mut self) {
         // no-op
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 impl ByteSwap for i16 {
     fn byte_swap(&mut self) {
         *self = Self::from_le_bytes(self.to_be_bytes());
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 impl ByteSwap for i32 {
     fn byte_swap(&mut self) {
         *self = Self::from_le_bytes(self.to_be_bytes());
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 impl ByteSwap for i64 {
     fn byte_swap(&mut self) {
         *self = Self::from_le_bytes(self.to_be_bytes());
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 impl ByteSwap for i128 {
     fn byte_swap(&mut self) {
         *self = Self::from_le_bytes(self.to_be_bytes());
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 impl ByteSwap for isize {
     fn byte_swap(&mut self) {
         *self = Self::from_le_bytes(self.to_be_bytes());
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 // unsigned types
@@ -78,36 +164,60 @@ impl ByteSwap for u8 {
     fn byte_swap(&mut self) {
         // no-op
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 impl ByteSwap for u16 {
     fn byte_swap(&mut self) {
         *self = Self::from_le_bytes(self.to_be_bytes());
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 impl ByteSwap for u32 {
     fn byte_swap(&mut self) {
         *self = Self::from_le_bytes(self.to_be_bytes());
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 impl ByteSwap for u64 {
     fn byte_swap(&mut self) {
         *self = Self::from_le_bytes(self.to_be_bytes());
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 impl ByteSwap for u128 {
     fn byte_swap(&mut self) {
         *self = Self::from_le_bytes(self.to_be_bytes());
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 impl ByteSwap for usize {
     fn byte_swap(&mut self) {
         *self = Self::from_le_bytes(self.to_be_bytes());
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 // floating point types
@@ -115,12 +225,20 @@ impl ByteSwap for f32 {
     fn byte_swap(&mut self) {
         *self = Self::from_le_bytes(self.to_be_bytes());
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 impl ByteSwap for f64 {
     fn byte_swap(&mut self) {
         *self = Self::from_le_bytes(self.to_be_bytes());
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 // pointer types
@@ -128,12 +246,20 @@ impl<T: 'static> ByteSwap for *const T {
     fn byte_swap(&mut self) {
         *self = usize::from_le_bytes((*self as usize).to_be_bytes()) as *const T;
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 impl<T: 'static> ByteSwap for *mut T {
     fn byte_swap(&mut self) {
         *self = usize::from_le_bytes((*self as usize).to_be_bytes()) as *mut T;
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
 }
 
 // phantomdata type
@@ -146,7 +272,125 @@ impl<T: 'static> ByteSwap for PhantomData<T> {
 // slice types
 impl<T: ByteSwap> ByteSwap for [T] {
     fn byte_swap(&mut self) {
-        self.iter_mut().for_each(|e| e.byte_swap());
+        T::byte_swap_slice(self);
+    }
+}
+
+unsafe impl<T: 'static> UniformSwap for *const T {
+    const SWAP_WIDTH: usize = core::mem::size_of::<usize>();
+}
+
+unsafe impl<T: 'static> UniformSwap for *mut T {
+    const SWAP_WIDTH: usize = core::mem::size_of::<usize>();
+}
+
+unsafe impl<T: 'static> UniformSwap for PhantomData<T> {
+    const SWAP_WIDTH: usize = 0;
+}
+
+unsafe impl<T: UniformSwap> UniformSwap for [T] {
+    const SWAP_WIDTH: usize = T::SWAP_WIDTH;
+}
+
+/// Returns the `SWAP_WIDTH` of a struct from the `SWAP_WIDTH` and size of all of its fields.
+///
+/// The struct only gets a width if all of its non zero sized fields share the same width and
+/// the fields cover the whole struct, i.e. there is no padding. This is used by
+/// `#[derive(UniformSwap)]`.
+#[doc(hidden)]
+pub const fn uniform_swap_width(size: usize, fields: &[(usize, usize)]) -> usize {
+    let mut width = 0;
+    let mut total = 0;
+    let mut i = 0;
+    while i < fields.len() {
+        let (field_width, field_size) = fields[i];
+        if field_size != 0 {
+            if field_width == 0 || (width != 0 && field_width != width) {
+                return 0;
+            }
+            width = field_width;
+            total += field_size;
+        }
+        i += 1;
+    }
+
+    if total == size {
+        width
+    } else {
+        0
+    }
+}
+
+/// Swaps the byte order of every `width` byte word in `buf`.
+///
+/// Words of 2, 4, 8 and 16 bytes are swapped 16 bytes at a time with SSE2 where available.
+/// Trailing bytes that do not form a whole word are left untouched.
+pub fn byte_swap_words(buf: &mut [u8], width: usize) {
+    if width < 2 {
+        return;
+    }
+
+    let len = buf.len() - buf.len() % width;
+    let done = match width {
+        2 | 4 | 8 | 16 => simd::byte_swap_words(&mut buf[..len], width),
+        _ => 0,
+    };
+
+    buf[done..len]
+        .chunks_exact_mut(width)
+        .for_each(|word| word.reverse());
+}
+
+#[cfg(all(target_arch = "x86_64", target_feature = "sse2"))]
+mod simd {
+    use core::arch::x86_64::*;
+
+    /// Swaps all whole 16 byte blocks of `buf` and returns the number of bytes swapped.
+    pub fn byte_swap_words(buf: &mut [u8], width: usize) -> usize {
+        unsafe {
+            match width {
+                2 => swap_blocks(buf, |v| swap16(v)),
+                4 => swap_blocks(buf, |v| swap32(v)),
+                8 => swap_blocks(buf, |v| swap64(v)),
+                _ => swap_blocks(buf, |v| _mm_shuffle_epi32(swap64(v), 0b01_00_11_10)),
+            }
+        }
+    }
+
+    #[inline(always)]
+    unsafe fn swap_blocks<F: Fn(__m128i) -> __m128i>(buf: &mut [u8], swap: F) -> usize {
+        let blocks = buf.len() / 16;
+        let ptr = buf.as_mut_ptr() as *mut __m128i;
+        for i in 0..blocks {
+            _mm_storeu_si128(ptr.add(i), swap(_mm_loadu_si128(ptr.add(i))));
+        }
+        blocks * 16
+    }
+
+    #[inline(always)]
+    unsafe fn swap16(v: __m128i) -> __m128i {
+        _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8))
+    }
+
+    /// Swaps the bytes of every 16 bit word and then the 16 bit words of every dword.
+    #[inline(always)]
+    unsafe fn swap32(v: __m128i) -> __m128i {
+        let v = swap16(v);
+        _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0b10_11_00_01), 0b10_11_00_01)
+    }
+
+    /// Swaps the bytes of every 16 bit word and then reverses the 16 bit words of every qword.
+    #[inline(always)]
+    unsafe fn swap64(v: __m128i) -> __m128i {
+        let v = swap16(v);
+        _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0b00_01_10_11), 0b00_01_10_11)
+    }
+}
+
+#[cfg(not(all(target_arch = "x86_64", target_feature = "sse2")))]
+mod simd {
+    pub fn byte_swap_words(_buf: &mut [u8], _width: usize) -> usize {
+        0
     }
 }
 
@@ -244,6 +488,61 @@ mod tests {
         assert_eq!(num, 1234);
     }
 
+    fn check_bulk<T: ByteSwap + Copy + PartialEq + core::fmt::Debug>(
+        vals: &mut [T],
+        swap: fn(T) -> T,
+    ) {
+        let expected = vals.iter().map(|&v| swap(v)).collect::<Vec<_>>();
+        vals.byte_swap();
+        assert_eq!(vals, &expected[..]);
+    }
+
+    #[test]
+    fn swap_slice_bulk() {
+        // odd lengths to cover the scalar tail after the 16 byte blocks
+        check_bulk(
+            &mut (0..37u16).map(|i| i * 0x0103).collect::<Vec<_>>(),
+            u16::swap_bytes,
+        );
+        check_bulk(
+            &mut (0..37u32).map(|i| i * 0x0102_0304).collect::<Vec<_>>(),
+            u32::swap_bytes,
+        );
+        check_bulk(
+            &mut (0..37u64)
+                .map(|i| i * 0x0102_0304_0506_0708)
+                .collect::<Vec<_>>(),
+            u64::swap_bytes,
+        );
+        check_bulk(
+            &mut (0..37u128)
+                .map(|i| i * 0x0102_0304_0506_0708_090a_0b0c_0d0e_0f10)
+                .collect::<Vec<_>>(),
+            u128::swap_bytes,
+        );
+        check_bulk(&mut [1.5f32, -2.25, 1e10], |v| {
+            f32::from_bits(v.to_bits().swap_bytes())
+        });
+    }
+
+    #[test]
+    fn swap_words_odd_width() {
+        let mut buf = [1, 2, 3, 4, 5, 6, 7];
+        byte_swap_words(&mut buf, 3);
+        assert_eq!(buf, [3, 2, 1, 6, 5, 4, 7]);
+    }
+
+    #[test]
+    fn uniform_width() {
+        assert_eq!(uniform_swap_width(8, &[(4, 4), (4, 4)]), 4);
+        assert_eq!(uniform_swap_width(16, &[(4, 4), (8, 8)]), 0);
+        // padding
+        assert_eq!(uniform_swap_width(16, &[(4, 4), (4, 4)]), 0);
+        // zero sized fields do not matter
+        assert_eq!(uniform_swap_width(8, &[(8, 8), (0, 0)]), 8);
+        assert_eq!(<[u32]>::SWAP_WIDTH, 4);
+    }
+
     #[test]
     fn swap_slice_i16() {
         let mut slice = [1234i16, 50, 64, 128, 200];
@@ -30,4 +30,4 @@ pub use pointer64::Pointer64;
 
 pub mod byte_swap;
 #[doc(hidden)]
-pub use byte_swap::ByteSwap;
+pub use byte_swap::{ByteSwap, UniformSwap};
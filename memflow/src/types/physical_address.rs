@@ -15,23 +15,30 @@ use std::fmt;
 ///
 /// Most architectures have support multiple page sizes (see [huge pages](todo.html))
 /// which will be represented by the containing `page` of the `PhysicalAddress` struct.
+///
+/// # Remarks
+///
+/// Physical addresses never exceed 52 bits (see `ArchMMUSpec::address_space_bits`), so the page
+/// information is packed into the low 12 bits below the address, keeping the whole structure
+/// at 8 bytes. This matters because a `PhysicalAddress` is stored in every batched read,
+/// every TLB entry and every translation output. The ordering of the packed value matches
+/// ordering by address, then page type, then page size.
+///
+/// Addresses that do not fit into 52 bits are converted to an invalid physical address.
 #[derive(Copy, Clone, PartialEq, Eq, PartialOrd, Ord)]
 #[cfg_attr(feature = "serde", derive(::serde::Serialize, ::serde::Deserialize))]
-#[repr(C)]
-pub struct PhysicalAddress {
-    address: Address,
-    page_type: PageType,
-    page_size_log2: u8,
-}
+#[repr(transparent)]
+pub struct PhysicalAddress(u64);
+
+const ADDRESS_SHIFT: u32 = 12;
+const ADDRESS_MAX: u64 = (1 << (64 - ADDRESS_SHIFT)) - 1;
+const PAGE_TYPE_SHIFT: u32 = 6;
+const FIELD_MASK: u64 = (1 << PAGE_TYPE_SHIFT) - 1;
 
 /// Converts a `Address` into a `PhysicalAddress` with no page information attached.
 impl From<Address> for PhysicalAddress {
     fn from(address: Address) -> Self {
-        Self {
-            address,
-            page_type: PageType::UNKNOWN,
-            page_size_log2: 0,
-        }
+        Self::pack(address, PageType::UNKNOWN, 0)
     }
 }
 
@@ -66,24 +73,40 @@ impl From<usize> for PhysicalAddress {
 /// Converts a `PhysicalAddress` into a `Address`.
 impl From<PhysicalAddress> for Address {
     fn from(address: PhysicalAddress) -> Self {
-        Self::from(address.address.as_u64())
+        address.address()
     }
 }
 
 impl PhysicalAddress {
     /// A physical address with a value of zero.
-    pub const NULL: PhysicalAddress = PhysicalAddress {
-        address: Address::null(),
-        page_type: PageType::UNKNOWN,
-        page_size_log2: 0,
-    };
+    pub const NULL: PhysicalAddress =
+        PhysicalAddress((PageType::UNKNOWN.bits() as u64) << PAGE_TYPE_SHIFT);
 
     /// A physical address with an invalid value.
-    pub const INVALID: PhysicalAddress = PhysicalAddress {
-        address: Address::INVALID,
-        page_type: PageType::UNKNOWN,
-        page_size_log2: 0,
-    };
+    pub const INVALID: PhysicalAddress = PhysicalAddress(
+        (ADDRESS_MAX << ADDRESS_SHIFT) | ((PageType::UNKNOWN.bits() as u64) << PAGE_TYPE_SHIFT),
+    );
+
+    #[inline]
+    fn pack(address: Address, page_type: PageType, page_size_log2: u8) -> Self {
+        let address = address.as_u64();
+        let address = if address > ADDRESS_MAX {
+            ADDRESS_MAX
+        } else {
+            address
+        };
+
+        Self(
+            (address << ADDRESS_SHIFT)
+                | ((page_type.bits() as u64 & FIELD_MASK) << PAGE_TYPE_SHIFT)
+                | (page_size_log2 as u64 & FIELD_MASK),
+        )
+    }
+
+    #[inline]
+    const fn page_size_log2(&self) -> u8 {
+        (self.0 & FIELD_MASK) as u8
+    }
 
     /// Returns a physical address with a value of zero.
     #[inline]
@@ -98,23 +121,22 @@ impl PhysicalAddress {
     /// Note: The page size must be a power of 2.
     #[inline]
     pub fn with_page(address: Address, page_type: PageType, page_size: usize) -> Self {
-        Self {
+        Self::pack(
             address,
             page_type,
             // TODO: this should be replaced by rust's internal functions as this is not endian aware
             // once it is stabilizied in rust
             // see issue: https://github.com/rust-lang/rust/issues/70887
-            page_size_log2: (std::mem::size_of::<u64>() * 8
-                - (page_size as u64).to_le().leading_zeros() as usize)
+            (std::mem::size_of::<u64>() * 8 - (page_size as u64).to_le().leading_zeros() as usize)
                 as u8
                 - 2,
-        }
+        )
     }
 
     /// Checks wether the physical address is zero or not.
     #[inline]
     pub const fn is_null(&self) -> bool {
-        self.address.is_null()
+        (self.0 >> ADDRESS_SHIFT) == 0
     }
 
     /// Returns a physical address that is invalid.
@@ -126,31 +148,31 @@ impl PhysicalAddress {
     /// Checks wether the physical is valid or not.
     #[inline]
     pub const fn is_valid(&self) -> bool {
-        self.address.is_valid()
+        (self.0 >> ADDRESS_SHIFT) != ADDRESS_MAX
     }
 
     /// Checks wether the physical address also contains page informations or not.
     #[inline]
     pub const fn has_page(&self) -> bool {
-        self.page_size_log2 != 0
+        self.page_size_log2() != 0
     }
 
     /// Returns the address of this physical address.
     #[inline]
     pub const fn address(&self) -> Address {
-        self.address
+        Address(self.as_u64())
     }
 
     /// Returns the type of page this physical address is contained in.
     #[inline]
     pub const fn page_type(&self) -> PageType {
-        self.page_type
+        PageType::from_bits_truncate(((self.0 >> PAGE_TYPE_SHIFT) & FIELD_MASK) as u8)
     }
 
     /// Returns the size of the page this physical address is contained in.
     #[inline]
     pub fn page_size(&self) -> usize {
-        (2 << self.page_size_log2) as usize
+        (2 << self.page_size_log2()) as usize
     }
 
     /// Returns the base address of the containing page.
@@ -158,7 +180,7 @@ impl PhysicalAddress {
         if !self.has_page() {
             Address::INVALID
         } else {
-            self.address.as_page_aligned(self.page_size())
+            self.address().as_page_aligned(self.page_size())
         }
     }
 
@@ -166,7 +188,7 @@ impl PhysicalAddress {
     #[inline]
     pub fn containing_page(&self) -> Page {
         Page {
-            page_type: self.page_type,
+            page_type: self.page_type(),
             page_base: self.page_base(),
             page_size: self.page_size(),
         }
@@ -175,19 +197,38 @@ impl PhysicalAddress {
     /// Returns the containing address converted to a u32.
     #[inline]
     pub const fn as_u32(&self) -> u32 {
-        self.address.as_u32()
+        self.as_u64() as u32
     }
 
     /// Returns the internal u64 value of the address.
     #[inline]
     pub const fn as_u64(&self) -> u64 {
-        self.address.as_u64()
+        let address = self.0 >> ADDRESS_SHIFT;
+        if address == ADDRESS_MAX {
+            Address::INVALID.as_u64()
+        } else {
+            address
+        }
     }
 
     /// Returns the containing address converted to a usize.
     #[inline]
     pub const fn as_usize(&self) -> usize {
-        self.address.as_usize()
+        self.as_u64() as usize
+    }
+
+    /// Returns the packed representation including the page information.
+    ///
+    /// This is meant for passing physical addresses to other processes, see `from_bits`.
+    #[inline]
+    pub const fn to_bits(&self) -> u64 {
+        self.0
+    }
+
+    /// Constructs a physical address from a value returned by `to_bits`.
+    #[inline]
+    pub const fn from_bits(bits: u64) -> Self {
+        Self(bits)
     }
 }
 
@@ -200,24 +241,24 @@ impl Default for PhysicalAddress {
 
 impl fmt::Debug for PhysicalAddress {
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
-        write!(f, "{:x}", self.address)
+        write!(f, "{:x}", self.address())
     }
 }
 impl fmt::UpperHex for PhysicalAddress {
     #[inline(always)]
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
-        write!(f, "{:X}", self.address)
+        write!(f, "{:X}", self.address())
     }
 }
 impl fmt::LowerHex for PhysicalAddress {
     #[inline(always)]
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
-        write!(f, "{:x}", self.address)
+        write!(f, "{:x}", self.address())
     }
 }
 impl fmt::Display for PhysicalAddress {
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
-        write!(f, "{:x}", self.address)
+        write!(f, "{:x}", self.address())
     }
 }
 
@@ -242,6 +283,38 @@ mod tests {
         assert_ne!(pa_0.page_size(), 0);
     }
 
+    #[test]
+    fn test_packed() {
+        assert_eq!(std::mem::size_of::<PhysicalAddress>(), 8);
+
+        let pa = PhysicalAddress::with_page(
+            Address::from(0x000f_1234_5678_9abc_u64),
+            PageType::PAGE_TABLE | PageType::NOEXEC,
+            0x1000,
+        );
+        assert_eq!(pa.address(), Address::from(0x000f_1234_5678_9abc_u64));
+        assert_eq!(pa.page_type(), PageType::PAGE_TABLE | PageType::NOEXEC);
+        assert_eq!(pa.page_size(), 0x1000);
+        assert_eq!(PhysicalAddress::from_bits(pa.to_bits()), pa);
+    }
+
+    #[test]
+    fn test_invalid() {
+        assert!(!PhysicalAddress::INVALID.is_valid());
+        assert_eq!(PhysicalAddress::INVALID.address(), Address::INVALID);
+        assert!(!PhysicalAddress::from(Address::INVALID).is_valid());
+        assert!(!PhysicalAddress::from(1u64 << 52).is_valid());
+        assert!(PhysicalAddress::NULL.is_null());
+        assert_eq!(PhysicalAddress::NULL.page_type(), PageType::UNKNOWN);
+    }
+
+    #[test]
+    fn test_ordering() {
+        let lo = PhysicalAddress::with_page(Address::from(0x1fff), PageType::NOEXEC, 0x1000);
+        let hi = PhysicalAddress::with_page(Address::from(0x2000), PageType::NONE, 0x1000);
+        assert!(lo < hi);
+    }
+
     #[test]
     #[allow(clippy::unreadable_literal)]
     fn test_page_size_huge() {
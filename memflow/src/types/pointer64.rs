@@ -4,7 +4,7 @@
 
 use crate::error::PartialResult;
 use crate::mem::VirtualMemory;
-use crate::types::{Address, ByteSwap};
+use crate::types::{byte_swap::byte_swap_uniform, Address, ByteSwap, UniformSwap};
 
 use std::marker::PhantomData;
 use std::mem::size_of;
@@ -266,4 +266,12 @@ impl<T: ?Sized + 'static> ByteSwap for Pointer64<T> {
     fn byte_swap(&mut self) {
         self.address.byte_swap();
     }
+
+    fn byte_swap_slice(slice: &mut [Self]) {
+        byte_swap_uniform(slice);
+    }
+}
+
+unsafe impl<T: ?Sized + 'static> UniformSwap for Pointer64<T> {
+    const SWAP_WIDTH: usize = 8;
 }
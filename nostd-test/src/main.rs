@@ -1,6 +1,7 @@
 #![no_std]
 #![no_main]
 #![feature(abi_efiapi)]
+#![feature(asm)]
 use core::*;
 use uefi::prelude::*;
 
@@ -13,6 +14,12 @@ use crate::alloc::vec::Vec;
 
 use log::*;
 
+use memflow::architecture::x86::x64;
+use memflow::connector::MappedPhysicalMemory;
+use memflow::error::PartialResultExt;
+use memflow::mem::{FixedVirtualDMA, MemoryMap, VirtualMemory};
+use memflow::types::{size, Address};
+
 use uefi::{
     data_types::{CStr16, Char16},
     proto::Protocol,
@@ -27,5 +34,24 @@ fn efi_main(handle: Handle, st: SystemTable<Boot>) -> Status {
 
     let bt = st.boot_services();
 
+    // the firmware identity maps physical memory, read our own entry point through its page tables
+    let cr3: u64;
+    unsafe { asm!("mov {}, cr3", out(reg) cr3) };
+    match fixed_read(Address::from(cr3 & !0xfff), Address::from(efi_main as u64)) {
+        Ok(val) => info!("efi_main starts with {:x}", val),
+        Err(err) => error!("unable to read efi_main: {}", err),
+    }
+
     Status::SUCCESS
 }
+
+/// Reads through the page tables at `dtb` without allocating in the read path.
+fn fixed_read(dtb: Address, addr: Address) -> memflow::error::Result<u64> {
+    let mut map = MemoryMap::new();
+    map.push_remap(Address::NULL, size::gb(4), Address::NULL);
+    let phys_mem = unsafe { MappedPhysicalMemory::from_addrmap(map) };
+
+    let mut virt_mem =
+        FixedVirtualDMA::<_, _, 16>::new(phys_mem, x64::ARCH, x64::new_translator(dtb));
+    virt_mem.virt_read(addr).data_part()
+}